@@ -0,0 +1,129 @@
+// The web UI over the wire: what the old handler sent on every hit (the
+// whole page uncompressed, strlen() each time, no validator) against the
+// assets partition handler on a first visit and on a revisit that gets a
+// 304. Reports bytes on the wire and handler CPU per request, and checks
+// the gzip body is the page.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "assets.h"
+#include "hal_mock.h"
+#include "httpd_mock.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define RUNS            20000
+#define PART_SIZE       0xE0000
+
+static char *page;                    // main/www/index.html, NUL-terminated
+static size_t page_len;
+
+static uint8_t *read_file(const char *path, size_t *len, size_t min_size)
+{
+    FILE *f = fopen(path, "rb");
+
+    CHECK(f != NULL);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    size_t size = *len + 1 > min_size ? *len + 1 : min_size;
+    uint8_t *buf = malloc(size);
+    memset(buf, 0xFF, size);          // Erased flash past the image
+    CHECK(fread(buf, 1, *len, f) == *len);
+    buf[*len] = min_size ? 0xFF : '\0';
+    fclose(f);
+    return buf;
+}
+
+// main.c's root_get_handler before the assets partition
+static esp_err_t legacy_root_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_send(req, page, strlen(page));
+}
+
+static void get(host_http_t *h, const char *inm)
+{
+    host_http_init(h, HTTP_GET, "/");
+    if (inm) {
+        host_http_set_hdr(h, "If-None-Match", inm);
+    }
+    CHECK(host_http_run(h) == ESP_OK);
+}
+
+static void check_gzip_body(const host_http_t *h)
+{
+    char *out = malloc(page_len + 1);
+    z_stream z = { .next_in = h->resp, .avail_in = h->resp_len,
+                   .next_out = (Bytef *)out, .avail_out = page_len + 1 };
+
+    CHECK(inflateInit2(&z, 16 + MAX_WBITS) == Z_OK);
+    CHECK(inflate(&z, Z_FINISH) == Z_STREAM_END);
+    CHECK(z.total_out == page_len && memcmp(out, page, page_len) == 0);
+    inflateEnd(&z);
+    free(out);
+}
+
+int main(void)
+{
+    size_t image_len;
+    host_http_t h;
+    char etag[32];
+
+    page = (char *)read_file(HOST_SOURCE_DIR "/main/www/index.html", &page_len, 0);
+    hal_mock_assets_set(read_file(HOST_ASSETS_BIN, &image_len, PART_SIZE), PART_SIZE);
+    CHECK(assets_init() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+
+    // Before: the raw page, every time
+    host_http_init(&h, HTTP_GET, "/");
+    CHECK(legacy_root_handler(&h.req) == ESP_OK);
+    size_t legacy_wire = host_http_wire_bytes(&h);
+    host_http_free(&h);
+    double legacy_ns = BENCH_NS(i, RUNS, {
+        host_http_init(&h, HTTP_GET, "/");
+        legacy_root_handler(&h.req);
+        host_http_free(&h);
+    });
+
+    // First visit: gzip, with a validator to come back with
+    get(&h, NULL);
+    CHECK_EQ(host_http_status(&h), 200);
+    CHECK(strcmp(host_http_resp_hdr(&h, "Content-Encoding"), "gzip") == 0);
+    CHECK(strcmp(host_http_resp_hdr(&h, "Cache-Control"), "no-cache") == 0);
+    snprintf(etag, sizeof(etag), "%s", host_http_resp_hdr(&h, "ETag"));
+    CHECK(etag[0] == '"' && strlen(etag) == 10);
+    check_gzip_body(&h);
+    size_t first_wire = host_http_wire_bytes(&h);
+    host_http_free(&h);
+    double first_ns = BENCH_NS(i, RUNS, {
+        get(&h, NULL);
+        host_http_free(&h);
+    });
+
+    // Revisit: 304, no body
+    get(&h, etag);
+    CHECK_EQ(host_http_status(&h), 304);
+    CHECK_EQ(h.resp_len, 0);
+    size_t revisit_wire = host_http_wire_bytes(&h);
+    host_http_free(&h);
+    double revisit_ns = BENCH_NS(i, RUNS, {
+        get(&h, etag);
+        host_http_free(&h);
+    });
+
+    // A stale validator gets the page again
+    get(&h, "\"00000000\"");
+    CHECK_EQ(host_http_status(&h), 200);
+    host_http_free(&h);
+
+    printf("                         wire bytes   handler CPU\n");
+    printf("before (raw page):       %10zu   %8.0f ns\n", legacy_wire, legacy_ns);
+    printf("first visit (gzip):      %10zu   %8.0f ns\n", first_wire, first_ns);
+    printf("revisit (304):           %10zu   %8.0f ns\n", revisit_wire, revisit_ns);
+    CHECK(first_wire < legacy_wire / 2);
+    CHECK(revisit_wire < 256);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// All four channels of the four-nozzle rig changing speed, one channel at a
+// time against one batch: called directly, and through pump_ctrl as the
+// HTTP API does. Reports CPU per update of the whole rig, latch calls,
+// control task commands, and the skew between the first and the last
+// channel taking its new duty.
+
+#include "hal_mock.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+
+#define RUNS            20000
+#define CTRL_RUNS       2000
+#define ALL             ((1 << PUMP_NUM_CHANNELS) - 1)
+
+_Static_assert(PUMP_NUM_CHANNELS == 4, "built for the four-nozzle rig");
+
+typedef struct {
+    double ns;                        // CPU per update of every channel
+    double latches;                   // hal_pwm_set_duty_batch() calls per update
+    double commands;                  // Control task commands per update
+    double skew_ns;                   // Mean first-to-last channel latch
+} result_t;
+
+static uint32_t applied(void)
+{
+    pump_ctrl_latency_t lat;
+
+    pump_ctrl_get_latency(&lat);
+    return lat.count;
+}
+
+static void speeds_for(long i, uint8_t *speeds)
+{
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        speeds[ch] = 1 + (i + 40 * ch) % 255;
+    }
+}
+
+static int64_t skew_ns(void)
+{
+    int64_t first = INT64_MAX, last = 0;
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        int64_t t = hal_mock_pwm_channels[2 * ch].latched_ns;  // IA leg
+        first = t < first ? t : first;
+        last = t > last ? t : last;
+    }
+    return last - first;
+}
+
+static void check_speeds(long i)
+{
+    uint8_t speeds[PUMP_NUM_CHANNELS];
+
+    speeds_for(i, speeds);
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        CHECK_EQ(pump_get_channel(ch), speeds[ch]);
+    }
+}
+
+static result_t direct(bool batch)
+{
+    uint8_t speeds[PUMP_NUM_CHANNELS];
+    uint32_t latches = hal_mock_pwm_batches;
+    int64_t skew = 0;
+    result_t r = {0};
+
+    r.ns = BENCH_NS(i, RUNS, {
+        speeds_for(i, speeds);
+        if (batch) {
+            pump_set_batch(ALL, speeds);
+        } else {
+            for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+                pump_set_channel(ch, speeds[ch]);
+            }
+        }
+        skew += skew_ns();
+    });
+    check_speeds(RUNS - 1);
+    r.latches = (double)(hal_mock_pwm_batches - latches) / RUNS;
+    r.skew_ns = (double)skew / RUNS;
+    return r;
+}
+
+static result_t through_ctrl(bool batch)
+{
+    uint8_t speeds[PUMP_NUM_CHANNELS];
+    uint32_t latches = hal_mock_pwm_batches;
+    uint32_t before = applied();
+    int64_t skew = 0;
+    result_t r = {0};
+
+    r.ns = BENCH_NS(i, CTRL_RUNS, {
+        speeds_for(i, speeds);
+        if (batch) {
+            CHECK(pump_ctrl_set_batch(ALL, speeds) == ESP_OK);
+        } else {
+            for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+                CHECK(pump_ctrl_set_channel(ch, speeds[ch]) == ESP_OK);
+            }
+        }
+        host_settle();
+        skew += skew_ns();
+    });
+    check_speeds(CTRL_RUNS - 1);
+    r.latches = (double)(hal_mock_pwm_batches - latches) / CTRL_RUNS;
+    r.commands = (double)(applied() - before) / CTRL_RUNS;
+    r.skew_ns = (double)skew / CTRL_RUNS;
+    return r;
+}
+
+static void report(const char *name, result_t r)
+{
+    printf("%-24s %8.0f ns  %7.1f  %8.1f  %9.0f ns\n", name, r.ns, r.latches, r.commands,
+           r.skew_ns);
+}
+
+int main(void)
+{
+    pump_init();
+    result_t one = direct(false);
+    result_t all = direct(true);
+
+    CHECK(pump_ctrl_start() == ESP_OK);
+    result_t ctrl_one = through_ctrl(false);
+    result_t ctrl_all = through_ctrl(true);
+
+    printf("%d channels             CPU/update  latches  commands       skew\n", PUMP_NUM_CHANNELS);
+    report("pump_set_channel x4", one);
+    report("pump_set_batch", all);
+    report("pump_ctrl_set_channel x4", ctrl_one);
+    report("pump_ctrl_set_batch", ctrl_all);
+
+    CHECK(all.latches == 1 && one.latches == PUMP_NUM_CHANNELS);
+    CHECK(ctrl_all.commands == 1 && ctrl_one.commands == PUMP_NUM_CHANNELS);
+    CHECK(all.skew_ns < one.skew_ns && ctrl_all.skew_ns < ctrl_one.skew_ns);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Closed-loop flow control against a simulated pump and nozzle, on the
+// manual clock: the PWM output drives a first-order plant whose flow is
+// turned into flow-sensor pulses every millisecond. GET /spray?flow= sets
+// the target, then the supply sags and the nozzle clogs part-way through.
+// Reports settling time and overshoot for each disturbance and the CPU
+// cost of one controller step.
+
+#include <math.h>
+#include "esp_timer.h"
+#include "flow_ctrl.h"
+#include "hal.h"
+#include "hal_mock.h"
+#include "httpd_mock.h"
+#include "pid.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define PLANT_STEP_US       1000
+#define PLANT_TAU_MS        150.0     // Motor and plumbing lag
+#define PLANT_DEAD_DUTY     0.20      // Below this the pump doesn't push through the nozzle
+#define PLANT_MAX_MLPM      2500.0    // Full duty, full supply, clean nozzle
+#define TARGET_MLPM         1000
+#define BAND_PCT            5         // Settled: within this much of target from then on
+#define SETTLE_MS_MAX       4000
+#define OVERSHOOT_PCT_MAX   15
+#define PID_RUNS            1000000
+
+typedef struct {
+    double supply;                    // Battery, 1.0 is full
+    double nozzle;                    // Flow the nozzle lets through, 1.0 is clean
+    double flow_mlpm;
+    double pulse_frac;                // Pulses owed to the counter
+} plant_t;
+
+static plant_t plant = { .supply = 1.0, .nozzle = 1.0 };
+
+static void plant_step(void *arg)
+{
+    uint8_t timer = hal_mock_pwm_channels[0].timer;
+    double duty = (double)hal_pwm_get_duty(0) / ((1u << hal_mock_pwm_timers[timer].resolution_bits) - 1);
+    double drive = (duty - PLANT_DEAD_DUTY) / (1.0 - PLANT_DEAD_DUTY);
+    double target = drive > 0 ? drive * plant.supply * plant.nozzle * PLANT_MAX_MLPM : 0;
+
+    plant.flow_mlpm += (target - plant.flow_mlpm) * (PLANT_STEP_US / 1000.0 / PLANT_TAU_MS);
+    plant.pulse_frac += plant.flow_mlpm / 60000.0 / 1000.0 * CONFIG_PLANTDOC_FLOW_PULSES_PER_L *
+                        (PLANT_STEP_US / 1000.0);
+    int32_t n = (int32_t)plant.pulse_frac;
+    plant.pulse_frac -= n;
+    hal_mock_pulses(n);
+}
+
+typedef struct {
+    int settle_ms;                    // -1: never settled
+    double overshoot_pct;             // Past the target in the direction of travel
+    double flow_end;
+} response_t;
+
+// Run for ms, sampling the true flow every millisecond
+static response_t run(int ms, double from)
+{
+    response_t r = { .settle_ms = -1 };
+    double band = TARGET_MLPM * BAND_PCT / 100.0;
+    double peak = 0;
+    int dir = from < TARGET_MLPM ? 1 : -1;
+
+    for (int t = 1; t <= ms; t++) {
+        host_advance_us(1000);
+        double err = plant.flow_mlpm - TARGET_MLPM;
+        if (err * dir > peak) {
+            peak = err * dir;
+        }
+        if (fabs(err) > band) {
+            r.settle_ms = -1;
+        } else if (r.settle_ms < 0) {
+            r.settle_ms = t;
+        }
+    }
+    r.overshoot_pct = peak * 100.0 / TARGET_MLPM;
+    r.flow_end = plant.flow_mlpm;
+    return r;
+}
+
+static void report(const char *name, response_t r)
+{
+    printf("%-22s settle %5d ms  overshoot %5.1f %%  flow %6.0f mL/min\n", name, r.settle_ms,
+           r.overshoot_pct, r.flow_end);
+    CHECK(r.settle_ms >= 0 && r.settle_ms <= SETTLE_MS_MAX);
+    CHECK(r.overshoot_pct <= OVERSHOOT_PCT_MAX);
+}
+
+int main(void)
+{
+    esp_timer_handle_t plant_timer;
+    const esp_timer_create_args_t args = { .callback = plant_step, .name = "plant" };
+    flow_ctrl_status_t st;
+
+    host_clock_manual();
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(flow_ctrl_start() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+    CHECK(esp_timer_create(&args, &plant_timer) == ESP_OK);
+    CHECK(esp_timer_start_periodic(plant_timer, PLANT_STEP_US) == ESP_OK);
+
+    host_http_t h;
+    host_http_init(&h, HTTP_GET, "/spray?flow=1000");
+    CHECK(host_http_run(&h) == ESP_OK);
+    host_http_free(&h);
+    report("start, 0 -> 1000", run(6000, 0));
+    flow_ctrl_get_status(&st);
+    CHECK(st.active && st.target_mlpm == TARGET_MLPM);
+
+    // The sensor's own view of it: one pulse in the 500 ms window is 267 mL/min at 450 pulses/L
+    CHECK(abs((int)st.flow_mlpm - TARGET_MLPM) <= 60000 * 1000 / (CONFIG_PLANTDOC_FLOW_PULSES_PER_L * 500));
+
+    // Open loop, any of these would move the flow by the same factor
+    double before = plant.flow_mlpm;
+    plant.supply = 0.8;
+    report("battery sags 20 %", run(6000, before * 0.8));
+
+    before = plant.flow_mlpm;
+    plant.nozzle = 0.7;
+    report("nozzle clogs 30 %", run(6000, before * 0.7));
+
+    before = plant.flow_mlpm;
+    plant.nozzle = 1.0;
+    report("nozzle clears", run(6000, before / 0.7));
+
+    // A manual command takes the pump back and the loop goes idle
+    CHECK(pump_ctrl_set_speed(0) == ESP_OK);
+    host_advance_us(100000);
+    flow_ctrl_get_status(&st);
+    CHECK(!st.active);
+
+    pid_ctrl_t pid = { .kp = PID_GAIN(0.02), .ki = PID_GAIN(0.004), .out_min = 0, .out_max = 255 };
+    pid_reset(&pid, 0, 0);
+    volatile int32_t sink;
+    double pid_ns = BENCH_NS(i, PID_RUNS, sink = pid_update(&pid, TARGET_MLPM, 900 + i % 200));
+    (void)sink;
+    printf("pid_update: %.1f ns per step, the loop runs every 50 ms\n", pid_ns);
+    return 0;
+}
@@ -0,0 +1,214 @@
+// The history ring filled the way a running pump fills it: duty changes
+// now and then, soil and current once a second, flow every 100 ms, on the
+// manual clock until the ring has wrapped. Queries must give back exactly
+// what was recorded, raw and in buckets, and /history must refuse
+// parameters that don't fit instead of wrapping them. Reports append cost,
+// bytes per sample, and the query cost over the whole ring, one series,
+// and a short recent window that skips most blocks unread.
+
+#include <string.h>
+#include "history.h"
+#include "httpd_mock.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define TICK_MS         100
+#define TICKS           200000        // 5.5 hours, the ring wraps several times
+#define SHADOW          (TICKS * 2)
+#define RUNS            2000
+#define APPENDS         1000000
+#define MAX_BUCKETS     16384
+
+typedef struct {
+    uint32_t t_ms;
+    uint8_t series;
+    int32_t value;
+} sample_t;
+
+static sample_t shadow[SHADOW];       // Everything appended, in order
+static int n_shadow;
+static uint32_t seed = 0xABCDEF;
+
+static uint32_t rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void append(history_series_t s, int32_t v)
+{
+    history_append(s, v);
+    CHECK(n_shadow < SHADOW);
+    shadow[n_shadow++] = (sample_t){ history_now_ms(), s, v };
+}
+
+static void fill(void)
+{
+    int32_t flow = 800, soil = 500, current = 300;
+    uint8_t duty = 0;
+
+    for (int i = 0; i < TICKS; i++) {
+        host_advance_us(TICK_MS * 1000);
+        flow += (int32_t)(rnd() % 41) - 20;
+        append(HIST_FLOW, flow);
+        if (i % 10 == 0) {
+            soil += (int32_t)(rnd() % 7) - 3;
+            current += (int32_t)(rnd() % 21) - 10;
+            append(HIST_SOIL, soil);
+            append(HIST_CURRENT, current);
+        }
+        if (rnd() % 50 == 0) {
+            duty = rnd() % 2 ? 0 : rnd();
+            append(HIST_DUTY + rnd() % PUMP_MAX_CHANNELS, duty);
+        }
+    }
+}
+
+typedef struct {
+    history_bucket_t b[MAX_BUCKETS];
+    int n;
+} collected_t;
+
+static bool collect(const history_bucket_t *b, void *ctx)
+{
+    collected_t *c = ctx;
+
+    CHECK(c->n < MAX_BUCKETS);
+    c->b[c->n++] = *b;
+    return true;
+}
+
+static bool discard(const history_bucket_t *b, void *ctx)
+{
+    return true;
+}
+
+// Raw samples of a series back as appended, for the newest ones the ring
+// still holds
+static void check_raw(history_series_t s, uint32_t from_ms)
+{
+    static collected_t c;
+    uint32_t to_ms = history_now_ms();
+
+    c.n = 0;
+    history_query(from_ms, to_ms, 0, 1u << s, collect, &c);
+    int k = 0;
+    for (int i = 0; i < n_shadow; i++) {
+        if (shadow[i].series == s && shadow[i].t_ms >= from_ms) {
+            CHECK(k < c.n);
+            CHECK_EQ(c.b[k].t_ms, shadow[i].t_ms);
+            CHECK(c.b[k].count == 1 && c.b[k].min == shadow[i].value &&
+                  c.b[k].max == shadow[i].value && c.b[k].mean == shadow[i].value);
+            k++;
+        }
+    }
+    CHECK_EQ(k, c.n);
+    CHECK(k > 0);
+}
+
+// Buckets of step_ms against the same reduction done on the shadow
+static void check_buckets(history_series_t s, uint32_t from_ms, uint32_t step_ms)
+{
+    static collected_t c;
+    uint32_t to_ms = history_now_ms();
+
+    c.n = 0;
+    history_query(from_ms, to_ms, step_ms, 1u << s, collect, &c);
+    for (int k = 0; k < c.n; k++) {
+        uint32_t t0 = c.b[k].t_ms;
+        int64_t sum = 0;
+        int count = 0;
+        int32_t mn = INT32_MAX, mx = INT32_MIN;
+        for (int i = 0; i < n_shadow; i++) {
+            const sample_t *x = &shadow[i];
+            if (x->series == s && x->t_ms >= t0 && x->t_ms < t0 + step_ms && x->t_ms <= to_ms) {
+                sum += x->value;
+                count++;
+                mn = x->value < mn ? x->value : mn;
+                mx = x->value > mx ? x->value : mx;
+            }
+        }
+        CHECK_EQ(c.b[k].count, count);
+        CHECK(c.b[k].min == mn && c.b[k].max == mx && c.b[k].mean == (int32_t)(sum / count));
+    }
+    CHECK(c.n > 0);
+}
+
+static int get_status(const char *uri)
+{
+    host_http_t h;
+
+    host_http_init(&h, HTTP_GET, uri);
+    esp_err_t err = host_http_run(&h);
+    int status = host_http_status(&h);
+    CHECK((err == ESP_OK) == (status == 200));
+    if (status == 200) {
+        CHECK(h.finished && strncmp((char *)h.resp, "t_ms,series,", 12) == 0);
+    }
+    host_http_free(&h);
+    return status;
+}
+
+static void check_params(void)
+{
+    CHECK_EQ(get_status("/history"), 200);
+    CHECK_EQ(get_status("/history?from=-60000&step=1000&series=64"), 200);
+    CHECK_EQ(get_status("/history?from=-2147483648"), 200);     // From boot
+    CHECK_EQ(get_status("/history?from=0&to=2147483647"), 200);
+    CHECK_EQ(get_status("/history?step=0&from=-1000"), 200);
+    CHECK_EQ(get_status("/history?to=-2147483648"), 400);       // Ends before boot
+    CHECK_EQ(get_status("/history?from=2147483648"), 400);      // Not an int
+    CHECK_EQ(get_status("/history?from=-9999999999999"), 400);
+    CHECK_EQ(get_status("/history?step=-2"), 400);
+    CHECK_EQ(get_status("/history?series=65536"), 400);
+    CHECK_EQ(get_status("/history?series=-1"), 400);
+    CHECK_EQ(get_status("/history?to=abc"), 400);
+    CHECK_EQ(get_status("/history?from=-1000&to=-2000"), 400);  // Empty range
+}
+
+int main(void)
+{
+    uint32_t samples, bytes;
+
+    host_clock_manual();
+    CHECK(start_webserver() != NULL);
+    fill();
+    history_stats(&samples, &bytes);
+    CHECK(samples < (uint32_t)n_shadow);  // Wrapped
+
+    uint32_t now = history_now_ms();
+    collected_t *all = malloc(sizeof(*all));
+    all->n = 0;
+    history_query(0, now, 0, 1u << HIST_FLOW, collect, all);
+    uint32_t oldest = all->b[0].t_ms;
+    free(all);
+    check_raw(HIST_FLOW, oldest);
+    check_raw(HIST_SOIL, oldest);
+    check_buckets(HIST_FLOW, oldest, 60000);
+    check_buckets(HIST_CURRENT, oldest, 7000);
+    check_buckets(HIST_FLOW, now - 10000, 1000);
+    check_params();
+
+    uint32_t full_n = history_query(0, now, (now - oldest) / 120 + 1, 0xffff, discard, NULL);
+    uint32_t one_n = history_query(0, now, 0, 1u << HIST_SOIL, discard, NULL);
+    uint32_t recent_n = history_query(now - 10000, now, 1000, 0xffff, discard, NULL);
+    double full_ns = BENCH_NS(i, RUNS,
+                              history_query(0, now, (now - oldest) / 120 + 1, 0xffff, discard, NULL));
+    double one_ns = BENCH_NS(i, RUNS, history_query(0, now, 0, 1u << HIST_SOIL, discard, NULL));
+    double recent_ns = BENCH_NS(i, RUNS * 10,
+                                history_query(now - 10000, now, 1000, 0xffff, discard, NULL));
+    double http_ns = BENCH_NS(i, RUNS, get_status("/history"));
+    double append_ns = BENCH_NS(i, APPENDS, history_append(HIST_FLOW, i & 0xfff));
+
+    printf("ring: %u samples in %u bytes (%.2f bytes/sample), %.1f minutes\n", samples, bytes,
+           (double)bytes / samples, (now - oldest) / 60000.0);
+    printf("append %.1f ns\n", append_ns);
+    printf("query all series, 120 buckets: %6.1f us (%u samples)\n", full_ns / 1000, full_n);
+    printf("query one series, raw:         %6.1f us (%u samples)\n", one_ns / 1000, one_n);
+    printf("query last 10 s:               %6.1f us (%u samples)\n", recent_ns / 1000, recent_n);
+    printf("GET /history (last 10 min):    %6.1f us\n", http_ns / 1000);
+    CHECK(recent_ns * 10 < full_ns);  // Old blocks skipped unread
+    return 0;
+}
@@ -0,0 +1,295 @@
+// tom.png and sugarcane.png through the streaming decoder the way the
+// network delivers them: in random pieces, from single bytes up to several
+// TCP segments. Every split must give exactly the image a whole-file decode
+// with zlib gives, box-downscaled the same way, and a cut or corrupted file
+// must fail. Reports throughput per piece size and peak RAM: the decoder
+// state, the stack the decode reaches and heap allocations made while
+// decoding. The host's zlib stand-in for the ROM inflater allocates inside
+// zlib, which isn't counted, and its state is smaller than the ROM's
+// tinfl_decompressor (about 11 KB more on the device).
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <zlib.h>
+#include "img_decode.h"
+#include "test_util.h"
+
+#define SPLITS          20            // Random splits per photo and piece size
+#define DAMAGED         10
+#define RUNS            10
+#define STACK_SIZE      (64 * 1024)
+#define STACK_FILL      0xA5
+
+typedef struct {
+    const char *name;
+    uint8_t *png;
+    size_t len;
+    uint8_t want[IMG_OUT_SIZE * IMG_OUT_SIZE * 3];
+    int width, height;
+} photo_t;
+
+static img_decoder_t dec;
+static uint32_t seed = 0x1234567;
+
+// Heap calls made by the app's objects while decoding (-Wl,--wrap)
+static _Thread_local bool counting;
+static atomic_int allocs;
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocs += counting;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    allocs += counting;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    allocs += counting;
+    return __real_realloc(p, size);
+}
+
+static uint32_t rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+
+    CHECK(f != NULL);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len);
+    CHECK(fread(buf, 1, *len, f) == *len);
+    fclose(f);
+    return buf;
+}
+
+static uint8_t paeth(int a, int b, int c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// The whole file at once: IDATs joined, inflated by zlib, every row
+// unfiltered into a full image, then box-averaged to the model size
+static void reference(photo_t *p)
+{
+    size_t idat_len = 0, pos = 8;
+    uint8_t *idat = malloc(p->len);
+    int bpp = 0;
+
+    while (pos + 12 <= p->len) {
+        uint32_t n = be32(p->png + pos);
+        const uint8_t *type = p->png + pos + 4, *data = type + 4;
+        if (memcmp(type, "IHDR", 4) == 0) {
+            static const int channels[7] = { 1, 0, 3, 0, 2, 0, 4 };
+            p->width = be32(data);
+            p->height = be32(data + 4);
+            CHECK(data[8] == 8 && data[12] == 0);
+            bpp = channels[data[9]];
+            CHECK(bpp >= 3);
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            memcpy(idat + idat_len, data, n);
+            idat_len += n;
+        }
+        pos += 12 + n;
+    }
+    size_t stride = (size_t)p->width * bpp;
+    uLongf raw_len = (stride + 1) * p->height;
+    uint8_t *raw = malloc(raw_len), *img = calloc(stride, p->height + 1);
+    CHECK(uncompress(raw, &raw_len, idat, idat_len) == Z_OK);
+    CHECK(raw_len == (stride + 1) * p->height);
+
+    for (int y = 0; y < p->height; y++) {
+        const uint8_t *in = raw + y * (stride + 1) + 1;
+        uint8_t *row = img + (y + 1) * stride, *up = row - stride;
+        for (size_t i = 0; i < stride; i++) {
+            int a = i >= (size_t)bpp ? row[i - bpp] : 0, c = i >= (size_t)bpp ? up[i - bpp] : 0;
+            switch (in[-1]) {
+            case 0: row[i] = in[i]; break;
+            case 1: row[i] = in[i] + a; break;
+            case 2: row[i] = in[i] + up[i]; break;
+            case 3: row[i] = in[i] + ((a + up[i]) >> 1); break;
+            case 4: row[i] = in[i] + paeth(a, up[i], c); break;
+            default: CHECK(false);
+            }
+        }
+    }
+
+    uint32_t sum[IMG_OUT_SIZE * IMG_OUT_SIZE][3] = {{0}}, n[IMG_OUT_SIZE * IMG_OUT_SIZE] = {0};
+    for (int y = 0; y < p->height; y++) {
+        for (int x = 0; x < p->width; x++) {
+            const uint8_t *px = img + (y + 1) * stride + x * bpp;
+            int o = (y * IMG_OUT_SIZE / p->height) * IMG_OUT_SIZE + x * IMG_OUT_SIZE / p->width;
+            for (int c = 0; c < 3; c++) {
+                sum[o][c] += px[c];
+            }
+            n[o]++;
+        }
+    }
+    for (int o = 0; o < IMG_OUT_SIZE * IMG_OUT_SIZE; o++) {
+        for (int c = 0; c < 3; c++) {
+            p->want[o * 3 + c] = (sum[o][c] + n[o] / 2) / n[o];
+        }
+    }
+    free(idat);
+    free(raw);
+    free(img);
+}
+
+// Pieces of 1..max bytes, max 0: the whole file in one feed
+static esp_err_t decode(const uint8_t *png, size_t len, size_t max, const img_result_t **out)
+{
+    esp_err_t err = ESP_OK;
+
+    img_decode_begin(&dec);
+    for (size_t pos = 0; pos < len && err == ESP_OK;) {
+        size_t n = max ? 1 + rnd() % max : len;
+        n = n < len - pos ? n : len - pos;
+        err = img_decode_feed(&dec, png + pos, n);
+        pos += n;
+    }
+    return err == ESP_OK ? img_decode_end(&dec, out) : err;
+}
+
+static void check_splits(const photo_t *p, size_t max)
+{
+    const img_result_t *img;
+
+    for (int i = 0; i < SPLITS; i++) {
+        CHECK(decode(p->png, p->len, max, &img) == ESP_OK);
+        CHECK(img->width == p->width && img->height == p->height);
+        CHECK_EQ(img->bytes_in, p->len);
+        CHECK(memcmp(img->rgb, p->want, sizeof(p->want)) == 0);
+    }
+}
+
+// Cut anywhere before IEND, or one byte flipped: an error, never a result
+static void check_damage(const photo_t *p)
+{
+    uint8_t *bad = malloc(p->len);
+    const img_result_t *img;
+
+    for (int i = 0; i < DAMAGED; i++) {
+        CHECK(decode(p->png, rnd() % (p->len - 12), 1460, &img) != ESP_OK);
+        memcpy(bad, p->png, p->len);
+        bad[8 + rnd() % (p->len - 20)] ^= 1 << (rnd() % 8);
+        CHECK(decode(bad, p->len, 1460, &img) != ESP_OK);
+    }
+    free(bad);
+}
+
+typedef struct {
+    const photo_t *p;
+    size_t max;
+} job_t;
+
+static void *decode_job(void *arg)
+{
+    const job_t *job = arg;
+    const img_result_t *img;
+
+    if (job->p) {
+        counting = true;
+        CHECK(decode(job->p->png, job->p->len, job->max, &img) == ESP_OK);
+        counting = false;
+    }
+    return NULL;
+}
+
+// Deepest a thread's stack gets on a painted stack of its own; with p NULL
+// the thread does nothing, which is glibc's share
+static size_t stack_used(const photo_t *p, size_t max)
+{
+    static uint8_t stack[STACK_SIZE] __attribute__((aligned(16)));
+    job_t job = { p, max };
+    pthread_attr_t attr;
+    pthread_t t;
+
+    memset(stack, STACK_FILL, sizeof(stack));
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, sizeof(stack));
+    CHECK(pthread_create(&t, &attr, decode_job, &job) == 0);
+    pthread_join(t, NULL);
+    pthread_attr_destroy(&attr);
+
+    size_t untouched = 0;
+    while (untouched < sizeof(stack) && stack[untouched] == STACK_FILL) {
+        untouched++;
+    }
+    return sizeof(stack) - untouched;
+}
+
+int main(void)
+{
+    static photo_t photos[] = {
+        { HOST_SOURCE_DIR "/main/www/tom.png" },
+        { HOST_SOURCE_DIR "/main/www/sugarcane.png" },
+    };
+    static const size_t pieces[] = { 0, 16, 64, 512, 1460, 4096, 16384 };
+    const int n_pieces = sizeof(pieces) / sizeof(pieces[0]);
+
+    for (int i = 0; i < 2; i++) {
+        photo_t *p = &photos[i];
+        p->png = read_file(p->name, &p->len);
+        reference(p);
+        for (int k = 0; k < n_pieces; k++) {
+            check_splits(p, pieces[k]);
+        }
+        check_damage(p);
+    }
+
+    printf("piece bytes   MB/s   Mpx/s   (both photos, host CPU)\n");
+    for (int k = 0; k < n_pieces; k++) {
+        size_t bytes = 0, px = 0;
+        int64_t t0 = host_thread_ns();
+        for (int r = 0; r < RUNS; r++) {
+            for (int i = 0; i < 2; i++) {
+                const img_result_t *img;
+                CHECK(decode(photos[i].png, photos[i].len, pieces[k], &img) == ESP_OK);
+                bytes += photos[i].len;
+                px += (size_t)img->width * img->height;
+            }
+        }
+        double s = (host_thread_ns() - t0) / 1e9;
+        char label[16];
+        snprintf(label, sizeof(label), pieces[k] ? "1..%zu" : "whole", pieces[k]);
+        printf("%-11s %6.1f  %6.1f\n", label, bytes / s / 1e6, px / s / 1e6);
+    }
+
+    size_t stack = 0, idle = stack_used(NULL, 0);
+    for (int i = 0; i < 2; i++) {
+        for (int k = 0; k < n_pieces; k++) {
+            size_t used = stack_used(&photos[i], pieces[k]) - idle;
+            stack = used > stack ? used : stack;
+        }
+    }
+    printf("peak RAM: decoder state %zu bytes (window %d, line %d), stack %zu bytes, "
+           "%d heap allocations\n", sizeof(img_decoder_t), TINFL_LZ_DICT_SIZE,
+           IMG_MAX_WIDTH * 4, stack, allocs);
+    CHECK_EQ(allocs, 0);
+    for (int i = 0; i < 2; i++) {
+        free(photos[i].png);
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+// Pump hot paths on the host: a speed change straight into pump.c, an idle
+// poll, a command posted through pump_ctrl until the control task has
+// latched it, and the /spray handler. Figures are host CPU time, for spotting regressions between
+// commits rather than predicting the ESP32.
+
+#include "hal_mock.h"
+#include "httpd_mock.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define RUNS        200000
+#define ROUND_TRIPS 2000
+
+int main(void)
+{
+    pump_init();
+
+    double set_ns = BENCH_NS(i, RUNS, pump_set_speed(i & 0xff));
+    double poll_ns = BENCH_NS(i, RUNS, pump_poll());
+    printf("pump_set_speed:        %7.0f ns\n", set_ns);
+    printf("pump_poll (idle):      %7.0f ns\n", poll_ns);
+    pump_stop_with(PUMP_STOP_COAST);
+
+    CHECK(pump_ctrl_start() == ESP_OK);
+    int64_t t0 = host_wall_ns();
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        uint8_t speed = 1 + i % 255;
+        CHECK(pump_ctrl_set_speed(speed) == ESP_OK);
+        while (pump_get_speed() != speed) {
+        }
+    }
+    double trip_ns = (double)(host_wall_ns() - t0) / ROUND_TRIPS;
+
+    pump_ctrl_latency_t lat;
+    pump_ctrl_get_latency(&lat);
+    printf("pump_ctrl round trip:  %7.0f ns wall\n", trip_ns);
+    printf("command latency:       p50 %u us, p99 %u us, max %u us over %u\n",
+           lat.p50_us, lat.p99_us, lat.max_us, lat.count);
+    CHECK(lat.count >= ROUND_TRIPS);
+
+    // Handler CPU per request: query parsing, the post and the response
+    CHECK(start_webserver() != NULL);
+    host_http_t h;
+    double spray_ns = BENCH_NS(i, ROUND_TRIPS, {
+        host_http_init(&h, HTTP_GET, i & 1 ? "/spray?pwm=100" : "/spray?pwm=0&ch=0");
+        CHECK(host_http_run(&h) == ESP_OK);
+        host_http_free(&h);
+        host_settle();
+    });
+    printf("GET /spray handler:    %7.0f ns (with the control task's share)\n", spray_ns);
+    return 0;
+}
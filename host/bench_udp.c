@@ -0,0 +1,319 @@
+// UDP binary control against GET /spray over loopback sockets. The UDP
+// listener is udp_ctrl.c as built for the device; /spray runs its real
+// handler behind a minimal HTTP front that only frames requests and
+// responses, so its figures leave out esp_http_server's own parsing.
+// First the protocol: acks, duplicates, stale and corrupt frames, bad
+// channels, a restarted sequence. Then each transport changes channel 0's
+// duty until the control task has applied it, one command at a time.
+// Reports latency percentiles, commands per second and bytes on the wire.
+// tools/udp_ctrl.py measures the same over the air.
+
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_rom_crc.h"
+#include "httpd_mock.h"
+#include "lwip/sockets.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "udp_ctrl.h"
+#include "web_server.h"
+#include "ws_control.h"
+
+#define RUNS            2000
+#define APPLY_LIMIT_NS  1000000000LL
+#define IP_UDP_HDR      28
+#define IP_TCP_HDR      52            // With the timestamp option Linux sends
+#define TCP_SETUP       (3 + 4)       // Segments to open and close a connection
+
+static int udp;                       // Connected to the listener
+static uint32_t seq;
+
+// ---- UDP client ----
+
+static void frame(udp_ctrl_frame_t *f, uint8_t op, uint8_t ch, uint8_t duty, uint32_t s)
+{
+    f->magic = UDP_CTRL_MAGIC;
+    f->op = op;
+    f->arg = ch;
+    f->duty = duty;
+    f->seq = s;
+    f->crc = esp_rom_crc32_le(0, (const uint8_t *)f, offsetof(udp_ctrl_frame_t, crc));
+}
+
+// Send raw bytes, return the ack's status, or -1 if none came
+static int exchange(const void *buf, size_t len, udp_ctrl_frame_t *ack)
+{
+    uint8_t in[64];
+
+    CHECK(send(udp, buf, len, 0) == (ssize_t)len);
+    ssize_t n = recv(udp, in, sizeof(in), 0);
+    if (n < 0) {
+        return -1;
+    }
+    CHECK_EQ(n, UDP_CTRL_FRAME_LEN);
+    memcpy(ack, in, sizeof(*ack));
+    CHECK(ack->magic == UDP_CTRL_MAGIC);
+    CHECK(ack->crc == esp_rom_crc32_le(0, in, offsetof(udp_ctrl_frame_t, crc)));
+    return ack->arg;
+}
+
+static int command(uint8_t op, uint8_t ch, uint8_t duty, uint32_t s, udp_ctrl_frame_t *ack)
+{
+    udp_ctrl_frame_t f;
+
+    frame(&f, op, ch, duty, s);
+    int status = exchange(&f, sizeof(f), ack);
+    CHECK(status < 0 || (ack->op == (op | 0x80) && ack->seq == s));
+    return status;
+}
+
+static void wait_applied(uint8_t duty)
+{
+    int64_t give_up = host_wall_ns() + APPLY_LIMIT_NS;
+
+    while (pump_get_command(0) != duty) {
+        CHECK(host_wall_ns() < give_up);
+        sched_yield();                // The control task may share this CPU
+    }
+}
+
+static void test_protocol(void)
+{
+    udp_ctrl_frame_t f, ack;
+
+    CHECK_EQ(command(WS_OP_SPEED, 0, 90, 0, &ack), UDP_STATUS_OK);
+    wait_applied(90);
+    CHECK_EQ(command(WS_OP_SPEED, 0, 91, 5, &ack), UDP_STATUS_OK);
+    wait_applied(91);
+    CHECK_EQ(command(WS_OP_QUERY, 0, 0, 6, &ack), UDP_STATUS_OK);
+    CHECK_EQ(ack.duty, 91);
+
+    // The newest frame again: acked, not applied twice; an older one refused
+    CHECK_EQ(command(WS_OP_SPEED, 0, 91, 6, &ack), UDP_STATUS_DUP);
+    CHECK_EQ(command(WS_OP_SPEED, 0, 10, 4, &ack), UDP_STATUS_STALE);
+    CHECK_EQ(command(WS_OP_QUERY, 0, 0, 7, &ack), UDP_STATUS_OK);
+    CHECK_EQ(ack.duty, 91);
+
+    CHECK_EQ(command(WS_OP_SPEED, PUMP_NUM_CHANNELS, 10, 8, &ack), UDP_STATUS_BAD);
+    CHECK_EQ(command('Z', 0, 10, 9, &ack), UDP_STATUS_BAD);
+
+    // Corrupt, short or long: dropped without an ack
+    frame(&f, WS_OP_SPEED, 0, 10, 10);
+    f.duty ^= 1;
+    CHECK_EQ(exchange(&f, sizeof(f), &ack), -1);
+    frame(&f, WS_OP_SPEED, 0, 10, 10);
+    CHECK_EQ(exchange(&f, sizeof(f) - 1, &ack), -1);
+    uint8_t big[UDP_CTRL_FRAME_LEN + 1] = { 0 };
+    memcpy(big, &f, sizeof(f));
+    CHECK_EQ(exchange(big, sizeof(big), &ack), -1);
+    CHECK_EQ(command(WS_OP_QUERY, 0, 0, 11, &ack), UDP_STATUS_OK);
+    CHECK_EQ(ack.duty, 91);
+
+    // seq 0 starts over, as a restarted script would
+    CHECK_EQ(command(WS_OP_SPEED, 0, 20, 0, &ack), UDP_STATUS_OK);
+    wait_applied(20);
+    CHECK_EQ(command(WS_OP_SPEED, 0, 21, 1, &ack), UDP_STATUS_OK);
+    wait_applied(21);
+    seq = 2;
+}
+
+// ---- HTTP front for the mock server ----
+
+static int http_listen;
+
+// Serve requests on one connection until the client closes it
+static void serve(int fd)
+{
+    char req[512], uri[256], resp[256];
+    size_t len = 0;
+
+    for (;;) {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n <= 0) {
+            return;
+        }
+        len += n;
+        req[len] = '\0';
+        char *end = strstr(req, "\r\n\r\n");
+        if (end == NULL) {
+            CHECK(len < sizeof(req) - 1);
+            continue;
+        }
+        CHECK(sscanf(req, "GET %255s HTTP/1.1", uri) == 1);
+        host_http_t h;
+        host_http_init(&h, HTTP_GET, uri);
+        CHECK(host_http_run(&h) == ESP_OK);
+        int out = snprintf(resp, sizeof(resp),
+                           "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n%s",
+                           h.status[0] ? h.status : "200 OK", h.type, h.resp_len,
+                           (char *)h.resp);
+        host_http_free(&h);
+        CHECK(send(fd, resp, out, 0) == out);
+        // Pipelining isn't used; whatever followed the request is the next one
+        len -= end + 4 - req;
+        memmove(req, end + 4, len);
+    }
+}
+
+static void *http_front(void *arg)
+{
+    for (;;) {
+        int fd = accept(http_listen, NULL, NULL);
+        if (fd < 0) {
+            return NULL;
+        }
+        serve(fd);
+        close(fd);
+    }
+}
+
+static uint16_t http_start(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    pthread_t thread;
+
+    http_listen = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(http_listen >= 0);
+    CHECK(bind(http_listen, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(listen(http_listen, 4) == 0);
+    CHECK(getsockname(http_listen, (struct sockaddr *)&addr, &addr_len) == 0);
+    CHECK(pthread_create(&thread, NULL, http_front, NULL) == 0);
+    return addr.sin_port;
+}
+
+static int http_connect(uint16_t port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = port,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    CHECK(fd >= 0);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+// One GET /spray on fd, as a browser's fetch() would send it; bytes both ways
+static size_t http_spray(int fd, uint8_t duty)
+{
+    char req[160], resp[256];
+    int len = snprintf(req, sizeof(req),
+                       "GET /spray?pwm=%u&ch=0 HTTP/1.1\r\nHost: 192.168.4.1\r\n"
+                       "Connection: keep-alive\r\nAccept: */*\r\n\r\n", duty);
+    size_t got = 0;
+
+    CHECK(send(fd, req, len, 0) == len);
+    // The response is small and ends with its two byte body
+    while (got < 6 || memcmp(resp + got - 6, "\r\n\r\nOK", 6) != 0) {
+        ssize_t n = recv(fd, resp + got, sizeof(resp) - 1 - got, 0);
+        CHECK(n > 0);
+        got += n;
+        resp[got] = '\0';
+        CHECK(strncmp(resp, "HTTP/1.1 200 OK\r\n", got < 17 ? got : 17) == 0);
+    }
+    return len + got;
+}
+
+// ---- Benchmark ----
+
+typedef struct {
+    int64_t ns[RUNS];
+    int64_t total_ns;
+    size_t bytes;                     // On the wire per command, headers included
+} run_t;
+
+static int cmp_ns(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, run_t *r)
+{
+    qsort(r->ns, RUNS, sizeof(r->ns[0]), cmp_ns);
+    printf("%-22s %7.1f %7.1f %7.1f  %8.0f  %6zu\n", name, r->ns[RUNS / 2] / 1e3,
+           r->ns[RUNS * 99 / 100] / 1e3, r->ns[RUNS - 1] / 1e3, RUNS / (r->total_ns / 1e9),
+           r->bytes);
+}
+
+static run_t runs[3];
+
+int main(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_PLANTDOC_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    struct timeval tv = { .tv_usec = 50000 };
+    udp_ctrl_frame_t ack;
+
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+    CHECK(udp_ctrl_start() == ESP_OK);
+    udp = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(udp >= 0);
+    CHECK(connect(udp, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    CHECK(setsockopt(udp, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+    test_protocol();
+
+    // Each command waits for its ack, then for the control task to apply it
+    run_t *r = &runs[0];
+    int64_t t0 = host_wall_ns();
+    for (int i = 0; i < RUNS; i++) {
+        uint8_t duty = 64 + i % 128;
+        int64_t t = host_wall_ns();
+        CHECK_EQ(command(WS_OP_SPEED, 0, duty, seq++, &ack), UDP_STATUS_OK);
+        wait_applied(duty);
+        r->ns[i] = host_wall_ns() - t;
+    }
+    r->total_ns = host_wall_ns() - t0;
+    r->bytes = 2 * (UDP_CTRL_FRAME_LEN + IP_UDP_HDR);
+
+    uint16_t port = http_start();
+    r = &runs[1];
+    t0 = host_wall_ns();
+    for (int i = 0; i < RUNS; i++) {
+        uint8_t duty = 64 + i % 128;
+        int64_t t = host_wall_ns();
+        int fd = http_connect(port);
+        size_t bytes = http_spray(fd, duty);
+        close(fd);
+        wait_applied(duty);
+        r->ns[i] = host_wall_ns() - t;
+        r->bytes = bytes + (TCP_SETUP + 2) * IP_TCP_HDR;
+    }
+    r->total_ns = host_wall_ns() - t0;
+
+    r = &runs[2];
+    int fd = http_connect(port);
+    t0 = host_wall_ns();
+    for (int i = 0; i < RUNS; i++) {
+        uint8_t duty = 64 + i % 128;
+        int64_t t = host_wall_ns();
+        size_t bytes = http_spray(fd, duty);
+        wait_applied(duty);
+        r->ns[i] = host_wall_ns() - t;
+        r->bytes = bytes + 2 * IP_TCP_HDR;
+    }
+    r->total_ns = host_wall_ns() - t0;
+    close(fd);
+
+    printf("                       p50 us  p99 us  max us     cmd/s   bytes\n");
+    report("udp", &runs[0]);
+    report("http, new connection", &runs[1]);
+    report("http, keep-alive", &runs[2]);
+    CHECK(runs[0].bytes * 3 < runs[2].bytes);
+    return 0;
+}
@@ -0,0 +1,107 @@
+// The WebSocket control channel against GET /spray, server side: frames
+// are checked against ws_control.h, then both transports run the same
+// speed changes until the control task has applied each one. Reports
+// commands per second, handler CPU and bytes each way per command.
+// tools/ws_load.py measures the same over the air.
+
+#include <string.h>
+#include "httpd_mock.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "web_server.h"
+#include "ws_control.h"
+
+#define RUNS            5000
+
+// What a browser sends for one command besides the URI: request line
+// framing, Host and the few headers fetch() can't drop
+#define HTTP_REQ_OVERHEAD   (strlen("GET  HTTP/1.1\r\nHost: 192.168.4.1\r\n" \
+                                    "Connection: keep-alive\r\nAccept: */*\r\n\r\n"))
+#define WS_CLIENT_FRAME     (2 + 4 + 3)   // Header, mask, payload
+
+static host_http_t ws;                // One connection for every frame
+
+static void ws_frame(const uint8_t *req, size_t len, uint8_t *resp)
+{
+    ws.resp_len = 0;
+    CHECK(host_http_ws(&ws, "/ws", HTTPD_WS_TYPE_BINARY, req, len) == ESP_OK);
+    CHECK_EQ(ws.resp_len, 2 + 4);
+    CHECK(ws.resp[0] == (0x80 | HTTPD_WS_TYPE_BINARY) && ws.resp[1] == 4);
+    memcpy(resp, ws.resp + 2, 4);
+}
+
+static void test_frames(void)
+{
+    uint8_t resp[4];
+    uint8_t speed[] = { WS_OP_SPEED, 7, 120 };
+    uint8_t stop[] = { WS_OP_STOP, 8, 0 };
+    uint8_t query[] = { WS_OP_QUERY, 9, 0 };
+    uint8_t bad[] = { 'Z', 10, 0 };
+    uint8_t long_frame[] = { WS_OP_SPEED, 11, 1, 0 };
+
+    host_http_init(&ws, HTTP_GET, "/ws");
+    CHECK(host_http_run(&ws) == ESP_OK);  // Handshake
+
+    ws_frame(speed, sizeof(speed), resp);
+    CHECK(resp[0] == (WS_OP_SPEED | 0x80) && resp[1] == 7 && resp[2] == WS_STATUS_OK);
+    CHECK_EQ(resp[3], 120);           // The command, applied or not yet
+    host_settle();
+    ws_frame(query, sizeof(query), resp);
+    CHECK(resp[0] == (WS_OP_QUERY | 0x80) && resp[1] == 9 && resp[3] == 120);
+
+    ws_frame(stop, sizeof(stop), resp);
+    CHECK(resp[2] == WS_STATUS_OK && resp[3] == 0);
+    host_settle();
+    CHECK_EQ(pump_get_speed(), 0);
+
+    ws_frame(bad, sizeof(bad), resp);
+    CHECK(resp[2] == WS_STATUS_BAD);
+
+    // Wrong size or type: refused, and httpd drops the connection
+    CHECK(host_http_ws(&ws, "/ws", HTTPD_WS_TYPE_BINARY, long_frame, sizeof(long_frame)) != ESP_OK);
+    CHECK(host_http_ws(&ws, "/ws", HTTPD_WS_TYPE_TEXT, speed, sizeof(speed)) != ESP_OK);
+}
+
+int main(void)
+{
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+    test_frames();
+
+    uint8_t resp[4];
+    size_t ws_resp_bytes = 0;
+    int64_t t0 = host_wall_ns();
+    double ws_ns = BENCH_NS(i, RUNS, {
+        uint8_t req[3] = { WS_OP_SPEED, (uint8_t)i, 1 + i % 255 };
+        ws_frame(req, sizeof(req), resp);
+        ws_resp_bytes = ws.resp_len;
+        host_settle();
+    });
+    double ws_rate = RUNS / ((host_wall_ns() - t0) / 1e9);
+    CHECK_EQ(pump_get_speed(), 1 + (RUNS - 1) % 255);
+
+    host_http_t h;
+    char uri[32];
+    size_t http_req_bytes = 0, http_resp_bytes = 0;
+    t0 = host_wall_ns();
+    double http_ns = BENCH_NS(i, RUNS, {
+        snprintf(uri, sizeof(uri), "/spray?pwm=%ld", 1 + i % 255);
+        host_http_init(&h, HTTP_GET, uri);
+        CHECK(host_http_run(&h) == ESP_OK);
+        http_req_bytes = strlen(uri) + HTTP_REQ_OVERHEAD;
+        http_resp_bytes = host_http_wire_bytes(&h);
+        host_http_free(&h);
+        host_settle();
+    });
+    double http_rate = RUNS / ((host_wall_ns() - t0) / 1e9);
+
+    printf("                 cmd/s   CPU/cmd   bytes in   bytes out\n");
+    printf("websocket:    %8.0f  %6.0f ns  %9d  %10zu\n", ws_rate, ws_ns, WS_CLIENT_FRAME,
+           ws_resp_bytes);
+    printf("GET /spray:   %8.0f  %6.0f ns  %9zu  %10zu\n", http_rate, http_ns, http_req_bytes,
+           http_resp_bytes);
+    CHECK(WS_CLIENT_FRAME + ws_resp_bytes < (http_req_bytes + http_resp_bytes) / 4);
+    return 0;
+}
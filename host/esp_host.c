@@ -0,0 +1,92 @@
+// The rest of ESP-IDF the app uses: error names, logging switch, heap
+// figures, restart, and mbedtls SHA-256 on OpenSSL.
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <openssl/evp.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "mbedtls/sha256.h"
+#include "host.h"
+
+#define HOST_HEAP_FREE      180000    // Roughly what the app leaves free on a device
+#define HOST_HEAP_MIN_FREE  150000
+
+static atomic_int restarts;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+    default:                        return "UNKNOWN ERROR";
+    }
+}
+
+int host_log_verbose(void)
+{
+    static int verbose = -1;
+
+    if (verbose < 0) {
+        const char *env = getenv("HOST_LOG");
+        verbose = env && atoi(env) > 0;
+    }
+    return verbose;
+}
+
+void esp_restart(void)
+{
+    atomic_fetch_add(&restarts, 1);
+}
+
+int host_restarts(void)
+{
+    return atomic_load(&restarts);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return HOST_HEAP_FREE;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return HOST_HEAP_MIN_FREE;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    ctx->md = EVP_MD_CTX_new();
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    EVP_MD_CTX_free(ctx->md);
+    ctx->md = NULL;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    return EVP_DigestInit_ex(ctx->md, is224 ? EVP_sha224() : EVP_sha256(), NULL) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t len)
+{
+    return EVP_DigestUpdate(ctx->md, input, len) == 1 ? 0 : -1;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    return EVP_DigestFinal_ex(ctx->md, output, NULL) == 1 ? 0 : -1;
+}
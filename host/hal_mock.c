@@ -0,0 +1,485 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include "esp_timer.h"
+#include "hal_mock.h"
+#include "host.h"
+
+#define ADC_POOL_SAMPLES    2048
+#define OTA_MAGIC           0xE9      // First byte of an ESP32 app image
+#define OTA_DIGEST_LEN      32        // SHA-256 appended by the build
+
+typedef struct {
+    uint32_t duty;                    // Latched, or where the fade started
+    bool fading;
+    uint32_t target;
+    int64_t start_us;
+    int64_t end_us;
+    esp_timer_handle_t timer;         // Fires at end_us like the fade-end interrupt
+} pwm_state_t;
+
+hal_mock_pwm_timer_t hal_mock_pwm_timers[HAL_MOCK_PWM_TIMERS];
+hal_mock_pwm_channel_t hal_mock_pwm_channels[HAL_MOCK_PWM_CHANNELS];
+uint32_t hal_mock_pwm_batches;
+uint32_t hal_mock_pwm_lost_ends;
+hal_mock_adc_t hal_mock_adc;
+hal_mock_flash_stats_t hal_mock_journal_stats;
+hal_mock_ota_t hal_mock_ota = { .fail_write_at = -1 };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pwm_state_t pwm[HAL_MOCK_PWM_CHANNELS];
+static bool (*fade_on_end)(uint8_t channel);
+
+static int32_t pulses;
+static bool pulses_on;
+
+static hal_adc_sample_t adc_pool[ADC_POOL_SAMPLES];
+static int adc_head, adc_count;
+static uint32_t adc_overflows;
+static void (*adc_on_frame)(void *arg);
+static void *adc_on_frame_arg;
+
+static uint8_t *journal;
+static uint32_t journal_size;
+
+static const uint8_t *assets;
+static uint32_t assets_size;
+
+static size_t ota_erased;
+
+// ---- PWM ----
+
+static uint32_t duty_at(const pwm_state_t *p, int64_t now)
+{
+    if (!p->fading) {
+        return p->duty;
+    }
+    if (now >= p->end_us) {
+        return p->target;
+    }
+    int64_t span = (int64_t)p->target - p->duty;
+    return p->duty + span * (now - p->start_us) / (p->end_us - p->start_us);
+}
+
+static void fade_end(void *arg)
+{
+    uint8_t channel = (uint8_t)(uintptr_t)arg;
+    pwm_state_t *p = &pwm[channel];
+
+    pthread_mutex_lock(&lock);
+    // A fade stopped, or stopped and restarted, after this one fell due
+    if (!p->fading || esp_timer_get_time() < p->end_us) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    p->duty = p->target;
+    p->fading = false;
+    bool lost = hal_mock_pwm_lost_ends > 0;
+    if (lost) {
+        hal_mock_pwm_lost_ends--;
+    } else {
+        hal_mock_pwm_channels[channel].fade_ends++;
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (fade_on_end && !lost) {
+        fade_on_end(channel);
+    }
+}
+
+esp_err_t hal_pwm_timer_init(uint8_t timer, uint32_t freq_hz, uint8_t resolution_bits)
+{
+    if (timer >= HAL_MOCK_PWM_TIMERS || freq_hz == 0 || resolution_bits < 1 ||
+        resolution_bits > 20 || (uint64_t)freq_hz << resolution_bits > 80000000) {
+        return ESP_ERR_INVALID_ARG;   // LEDC divides an 80 MHz clock
+    }
+    hal_mock_pwm_timers[timer].freq_hz = freq_hz;
+    hal_mock_pwm_timers[timer].resolution_bits = resolution_bits;
+    return ESP_OK;
+}
+
+esp_err_t hal_pwm_channel_init(uint8_t channel, uint8_t timer, int gpio, bool invert)
+{
+    if (channel >= HAL_MOCK_PWM_CHANNELS || timer >= HAL_MOCK_PWM_TIMERS ||
+        hal_mock_pwm_timers[timer].freq_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hal_mock_pwm_channel_t *c = &hal_mock_pwm_channels[channel];
+    c->configured = true;
+    c->timer = timer;
+    c->gpio = gpio;
+    c->invert = invert;
+    pthread_mutex_lock(&lock);
+    pwm[channel].duty = 0;
+    pwm[channel].fading = false;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t hal_pwm_set_duty_batch(const uint8_t *channels, const uint32_t *duty, int n)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&lock);
+    hal_mock_pwm_batches++;
+    for (int i = 0; i < n; i++) {
+        uint8_t ch = channels[i];
+        if (ch >= HAL_MOCK_PWM_CHANNELS || !hal_mock_pwm_channels[ch].configured) {
+            err = ESP_ERR_INVALID_ARG;
+            continue;
+        }
+        // ledc_update_duty() doesn't cancel a fade; the fade keeps overwriting
+        if (!pwm[ch].fading) {
+            pwm[ch].duty = duty[i];
+        } else {
+            hal_mock_pwm_channels[ch].busy_latches++;
+        }
+        hal_mock_pwm_channels[ch].latches++;
+        hal_mock_pwm_channels[ch].latched_ns = host_wall_ns();
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+uint32_t hal_pwm_get_duty(uint8_t channel)
+{
+    if (channel >= HAL_MOCK_PWM_CHANNELS) {
+        return 0;
+    }
+    pthread_mutex_lock(&lock);
+    uint32_t duty = duty_at(&pwm[channel], esp_timer_get_time());
+    pthread_mutex_unlock(&lock);
+    return duty;
+}
+
+bool hal_mock_pwm_fading(uint8_t channel)
+{
+    pthread_mutex_lock(&lock);
+    bool fading = pwm[channel].fading;
+    pthread_mutex_unlock(&lock);
+    return fading;
+}
+
+esp_err_t hal_pwm_fade_init(uint8_t channel_mask, bool (*on_end)(uint8_t channel))
+{
+    fade_on_end = on_end;
+    for (int ch = 0; ch < HAL_MOCK_PWM_CHANNELS; ch++) {
+        if (!(channel_mask & (1 << ch)) || pwm[ch].timer) {
+            continue;
+        }
+        esp_timer_create_args_t args = {
+            .callback = fade_end,
+            .arg = (void *)(uintptr_t)ch,
+            .name = "fade",
+        };
+        esp_err_t err = esp_timer_create(&args, &pwm[ch].timer);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t hal_pwm_fade(uint8_t channel, uint32_t duty, uint32_t ms)
+{
+    if (channel >= HAL_MOCK_PWM_CHANNELS || !pwm[channel].timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pwm_state_t *p = &pwm[channel];
+    int64_t now = esp_timer_get_time();
+
+    pthread_mutex_lock(&lock);
+    if (p->fading) {
+        hal_mock_pwm_channels[channel].busy_fades++;
+        pthread_mutex_unlock(&lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    p->fading = true;
+    p->target = duty;
+    p->start_us = now;
+    p->end_us = now + (int64_t)ms * 1000;
+    hal_mock_pwm_channels[channel].fades++;
+    hal_mock_pwm_channels[channel].fade_target = duty;
+    hal_mock_pwm_channels[channel].fade_ms = ms;
+    pthread_mutex_unlock(&lock);
+
+    return esp_timer_start_once(p->timer, (uint64_t)ms * 1000);
+}
+
+esp_err_t hal_pwm_fade_stop(uint8_t channel)
+{
+    if (channel >= HAL_MOCK_PWM_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pwm_state_t *p = &pwm[channel];
+
+    pthread_mutex_lock(&lock);
+    if (p->fading) {
+        p->duty = duty_at(p, esp_timer_get_time());
+        p->fading = false;
+        hal_mock_pwm_channels[channel].fade_stops++;
+    }
+    pthread_mutex_unlock(&lock);
+    if (p->timer) {
+        esp_timer_stop(p->timer);     // Not running is fine
+    }
+    return ESP_OK;
+}
+
+// ---- Pulse counter ----
+
+esp_err_t hal_pulse_counter_init(int gpio)
+{
+    pthread_mutex_lock(&lock);
+    pulses = 0;
+    pulses_on = true;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+esp_err_t hal_pulse_counter_read(int32_t *count)
+{
+    pthread_mutex_lock(&lock);
+    *count = pulses;
+    pthread_mutex_unlock(&lock);
+    return pulses_on ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+void hal_mock_pulses(int32_t n)
+{
+    pthread_mutex_lock(&lock);
+    pulses += n;
+    pthread_mutex_unlock(&lock);
+}
+
+// ---- ADC stream ----
+
+esp_err_t hal_adc_stream_start(const int *gpios, int n, uint32_t rate_hz,
+                               void (*on_frame)(void *arg), void *arg)
+{
+    if (n < 1 || n > (int)(sizeof(hal_mock_adc.gpios) / sizeof(hal_mock_adc.gpios[0]))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&lock);
+    memcpy(hal_mock_adc.gpios, gpios, n * sizeof(*gpios));
+    hal_mock_adc.n = n;
+    hal_mock_adc.rate_hz = rate_hz;
+    adc_on_frame = on_frame;
+    adc_on_frame_arg = arg;
+    adc_head = adc_count = 0;
+    pthread_mutex_unlock(&lock);
+    return ESP_OK;
+}
+
+void hal_mock_adc_push(const hal_adc_sample_t *samples, int n)
+{
+    pthread_mutex_lock(&lock);
+    if (adc_count + n > ADC_POOL_SAMPLES) {
+        adc_overflows++;
+    } else {
+        for (int i = 0; i < n; i++) {
+            adc_pool[(adc_head + adc_count + i) % ADC_POOL_SAMPLES] = samples[i];
+        }
+        adc_count += n;
+    }
+    pthread_mutex_unlock(&lock);
+    if (adc_on_frame) {
+        adc_on_frame(adc_on_frame_arg);
+    }
+}
+
+int hal_adc_stream_read(hal_adc_sample_t *out, int max)
+{
+    pthread_mutex_lock(&lock);
+    int n = adc_count < max ? adc_count : max;
+    for (int i = 0; i < n; i++) {
+        out[i] = adc_pool[(adc_head + i) % ADC_POOL_SAMPLES];
+    }
+    adc_head = (adc_head + n) % ADC_POOL_SAMPLES;
+    adc_count -= n;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+uint32_t hal_adc_stream_overflows(void)
+{
+    pthread_mutex_lock(&lock);
+    uint32_t n = adc_overflows;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+int hal_adc_raw_to_mv(uint16_t raw)
+{
+    return raw * 3100 / 4095;         // hal_esp.c without eFuse calibration
+}
+
+// ---- Journal partition ----
+
+void hal_mock_journal_init(uint32_t size)
+{
+    free(journal);
+    journal = size ? malloc(size) : NULL;
+    journal_size = size;
+    if (journal) {
+        memset(journal, 0xFF, size);
+    }
+    memset(&hal_mock_journal_stats, 0, sizeof(hal_mock_journal_stats));
+}
+
+uint8_t *hal_mock_journal_data(void)
+{
+    return journal;
+}
+
+esp_err_t hal_flash_journal_open(uint32_t *size)
+{
+    if (!journal) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *size = journal_size;
+    return ESP_OK;
+}
+
+esp_err_t hal_flash_journal_read(uint32_t off, void *buf, size_t len)
+{
+    if (off > journal_size || len > journal_size - off) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buf, journal + off, len);
+    hal_mock_journal_stats.bytes_read += len;
+    return ESP_OK;
+}
+
+esp_err_t hal_flash_journal_write(uint32_t off, const void *buf, size_t len)
+{
+    const uint8_t *src = buf;
+
+    if (off > journal_size || len > journal_size - off) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t i = 0; i < len; i++) {
+        journal[off + i] &= src[i];
+    }
+    hal_mock_journal_stats.writes++;
+    hal_mock_journal_stats.bytes_written += len;
+    return ESP_OK;
+}
+
+esp_err_t hal_flash_journal_erase(uint32_t off, size_t len)
+{
+    if (off % HAL_FLASH_SECTOR || len % HAL_FLASH_SECTOR || off > journal_size ||
+        len > journal_size - off) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(journal + off, 0xFF, len);
+    hal_mock_journal_stats.erases += len / HAL_FLASH_SECTOR;
+    return ESP_OK;
+}
+
+// ---- Assets partition ----
+
+void hal_mock_assets_set(const uint8_t *data, uint32_t size)
+{
+    assets = data;
+    assets_size = size;
+}
+
+esp_err_t hal_flash_assets_map(const uint8_t **data, uint32_t *size)
+{
+    if (!assets) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *data = assets;
+    *size = assets_size;
+    return ESP_OK;
+}
+
+// ---- OTA ----
+
+esp_err_t hal_ota_begin(void)
+{
+    hal_mock_ota_t *o = &hal_mock_ota;
+
+    if (!o->data) {
+        o->data = malloc(HAL_MOCK_OTA_SLOT);
+    }
+    o->writing = true;
+    o->len = 0;
+    ota_erased = 0;
+    return ESP_OK;
+}
+
+esp_err_t hal_ota_write(const void *buf, size_t len)
+{
+    hal_mock_ota_t *o = &hal_mock_ota;
+
+    if (!o->writing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len > HAL_MOCK_OTA_SLOT - o->len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (o->fail_write_at >= 0 && (int64_t)o->len >= o->fail_write_at) {
+        return ESP_FAIL;
+    }
+    // Erase ahead of the data like OTA_WITH_SEQUENTIAL_WRITES
+    while (ota_erased < o->len + len) {
+        memset(o->data + ota_erased, 0xFF, HAL_FLASH_SECTOR);
+        ota_erased += HAL_FLASH_SECTOR;
+        o->stats.erases++;
+        if (o->sector_us) {
+            usleep(o->sector_us);
+        }
+    }
+    memcpy(o->data + o->len, buf, len);
+    o->len += len;
+    o->stats.writes++;
+    o->stats.bytes_written += len;
+    return ESP_OK;
+}
+
+// Like esp_ota_end(): image magic and the digest the build appends
+esp_err_t hal_ota_finish(void)
+{
+    hal_mock_ota_t *o = &hal_mock_ota;
+    uint8_t digest[OTA_DIGEST_LEN];
+
+    if (!o->writing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    o->writing = false;
+    if (o->len < 2 * OTA_DIGEST_LEN || o->data[0] != OTA_MAGIC) {
+        return ESP_ERR_INVALID_ARG;   // ESP_ERR_OTA_VALIDATE_FAILED on the device
+    }
+    EVP_Digest(o->data, o->len - OTA_DIGEST_LEN, digest, NULL, EVP_sha256(), NULL);
+    if (memcmp(digest, o->data + o->len - OTA_DIGEST_LEN, OTA_DIGEST_LEN) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    o->boot_changed = true;
+    return ESP_OK;
+}
+
+void hal_ota_abort(void)
+{
+    hal_mock_ota.writing = false;
+}
+
+bool hal_ota_pending_verify(void)
+{
+    return hal_mock_ota.pending_verify;
+}
+
+esp_err_t hal_ota_confirm(void)
+{
+    hal_mock_ota.confirmed++;
+    hal_mock_ota.pending_verify = false;
+    return ESP_OK;
+}
+
+void hal_ota_rollback(void)
+{
+    hal_mock_ota.rolled_back++;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+
+// Mock backend for hal.h: the hardware as plain memory the host tests can
+// set up and inspect.
+//
+// PWM fades run on the host clock and end with an esp_timer standing in
+// for the fade-end interrupt. The ADC stream delivers whatever the test
+// pushes, the journal and OTA slot are NOR flash in RAM (programming only
+// clears bits) with erase and write counters, and the assets partition is
+// whatever buffer the test maps.
+
+#define HAL_MOCK_PWM_TIMERS     4
+#define HAL_MOCK_PWM_CHANNELS   8
+
+typedef struct {
+    uint32_t freq_hz;                 // 0 until configured
+    uint8_t resolution_bits;
+} hal_mock_pwm_timer_t;
+
+typedef struct {
+    bool configured;
+    uint8_t timer;
+    int gpio;
+    bool invert;
+    uint32_t latches;                 // Duty changes outside fades
+    int64_t latched_ns;               // host_wall_ns() of the last one
+    uint32_t fades;                   // Fades started
+    uint32_t fade_stops;
+    uint32_t fade_target;             // The last fade started: duty it heads for
+    uint32_t fade_ms;                 // and over how long
+    uint32_t fade_ends;               // Fade-end interrupts delivered
+    uint32_t busy_fades;              // Fades started on a channel still fading
+    uint32_t busy_latches;            // Duties written to a channel still fading
+} hal_mock_pwm_channel_t;
+
+extern hal_mock_pwm_timer_t hal_mock_pwm_timers[HAL_MOCK_PWM_TIMERS];
+extern hal_mock_pwm_channel_t hal_mock_pwm_channels[HAL_MOCK_PWM_CHANNELS];
+
+// hal_pwm_set_duty_batch() calls
+extern uint32_t hal_mock_pwm_batches;
+
+// A fade is running on the channel
+bool hal_mock_pwm_fading(uint8_t channel);
+
+// Fade-end interrupts to lose: each fade that ends while this is nonzero
+// finishes without calling on_end, and takes one off
+extern uint32_t hal_mock_pwm_lost_ends;
+
+// Add rising edges to the pulse counter
+void hal_mock_pulses(int32_t n);
+
+// ADC stream as configured by hal_adc_stream_start(): GPIO per index, count
+// and total sample rate; n is 0 before it starts
+typedef struct {
+    int gpios[4];
+    int n;
+    uint32_t rate_hz;
+} hal_mock_adc_t;
+
+extern hal_mock_adc_t hal_mock_adc;
+
+// Queue samples and signal a DMA frame; samples past the buffer count as
+// an overflow, as the driver drops whole frames
+void hal_mock_adc_push(const hal_adc_sample_t *samples, int n);
+
+// Flash figures for one mocked partition
+typedef struct {
+    uint32_t erases;                  // Sectors erased
+    uint32_t writes;                  // Program calls
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+} hal_mock_flash_stats_t;
+
+// Journal partition of size bytes, erased; 0 removes it
+void hal_mock_journal_init(uint32_t size);
+uint8_t *hal_mock_journal_data(void);
+extern hal_mock_flash_stats_t hal_mock_journal_stats;
+
+// Make data the "assets" partition; NULL removes it
+void hal_mock_assets_set(const uint8_t *data, uint32_t size);
+
+// OTA slot the app isn't running from
+typedef struct {
+    uint8_t *data;                    // HAL_MOCK_OTA_SLOT bytes
+    size_t len;                       // Written so far
+    bool writing;                     // Between hal_ota_begin and finish/abort
+    bool boot_changed;                // hal_ota_finish() accepted an image
+    int64_t fail_write_at;            // Writes fail once len reaches this, -1: never
+    uint32_t sector_us;               // Real time one sector erase takes
+    hal_mock_flash_stats_t stats;
+
+    // Running image
+    bool pending_verify;
+    int confirmed;
+    int rolled_back;
+} hal_mock_ota_t;
+
+#define HAL_MOCK_OTA_SLOT   0x180000
+
+extern hal_mock_ota_t hal_mock_ota;
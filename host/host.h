@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Host runtime: FreeRTOS, esp_timer and friends on pthreads, for the unit
+// tests and benchmarks under host/.
+//
+// The clock runs in real time unless a test calls host_clock_manual();
+// from then on only host_advance_us() moves it, firing esp_timers and
+// waking delayed tasks in time order, each one allowed to finish reacting
+// before the next. That turns a timeline into a deterministic simulation.
+
+// Freeze the clock where it is
+void host_clock_manual(void);
+
+// Manual clock: move time forward by us, running everything that falls due
+// on the way at its exact time
+void host_advance_us(int64_t us);
+
+// Wait until every task is blocked with nothing to do: no pending
+// notification, queue item or bits it waits for, no timeout already due.
+// Aborts the test if that takes over ten seconds of real time.
+void host_settle(void);
+
+// Stack bytes a task reports as never used (uxTaskGetStackHighWaterMark),
+// a quarter of its stack unless set here
+void host_task_set_stack_free(TaskHandle_t task, uint32_t bytes);
+
+// Times esp_restart() was called
+int host_restarts(void);
+
+// Nanosecond clocks for benchmarks: CPU time of the calling thread, and wall
+// time
+int64_t host_thread_ns(void);
+int64_t host_wall_ns(void);
@@ -0,0 +1,524 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "httpd_mock.h"
+
+#define FIRST_FD        50            // Like lwIP, sockets don't start at 0
+#define WORK_QUEUE_LEN  16
+
+typedef struct {
+    httpd_work_fn_t fn;
+    void *arg;
+} work_t;
+
+typedef struct {
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+} session_t;
+
+static httpd_config_t config;
+static httpd_uri_t *handlers;
+static int n_handlers;
+static QueueHandle_t work_queue;
+static int next_fd = FIRST_FD;
+static host_sock_t socks[HOST_SOCK_MAX];
+static session_t sessions[HOST_SOCK_MAX];
+
+static host_http_t *mock(httpd_req_t *req)
+{
+    return (host_http_t *)req;
+}
+
+static void httpd_task(void *arg)
+{
+    work_t w;
+
+    for (;;) {
+        xQueueReceive(work_queue, &w, portMAX_DELAY);
+        w.fn(w.arg);
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *cfg)
+{
+    if (handlers) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    config = *cfg;
+    handlers = calloc(cfg->max_uri_handlers, sizeof(*handlers));
+    work_queue = xQueueCreate(WORK_QUEUE_LEN, sizeof(work_t));
+    xTaskCreatePinnedToCore(httpd_task, "httpd", cfg->stack_size, NULL, cfg->task_priority,
+                            NULL, cfg->core_id);
+    *handle = &config;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri)
+{
+    for (int i = 0; i < n_handlers; i++) {
+        if (strcmp(handlers[i].uri, uri->uri) == 0 && handlers[i].method == uri->method) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (n_handlers == config.max_uri_handlers) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    handlers[n_handlers++] = *uri;
+    return ESP_OK;
+}
+
+// "/a/*" matches "/a/" and anything under it, "/a?" matches "/a" and "/a/"
+bool httpd_uri_match_wildcard(const char *tpl, const char *uri, size_t len)
+{
+    size_t tpl_len = strlen(tpl);
+
+    if (tpl_len && tpl[tpl_len - 1] == '*') {
+        return len >= tpl_len - 1 && strncmp(tpl, uri, tpl_len - 1) == 0;
+    }
+    if (tpl_len && tpl[tpl_len - 1] == '?') {
+        tpl_len--;
+        if (len == tpl_len + 1 && uri[tpl_len] == tpl[tpl_len - 1]) {
+            len--;
+        }
+    }
+    return len == tpl_len && strncmp(tpl, uri, len) == 0;
+}
+
+void host_http_init(host_http_t *h, httpd_method_t method, const char *uri)
+{
+    memset(h, 0, sizeof(*h));
+    h->req.handle = &config;
+    h->req.method = method;
+    snprintf((char *)h->req.uri, sizeof(h->req.uri), "%s", uri);
+    h->req.aux = h;
+    const char *q = strchr(h->req.uri, '?');
+    h->query = q ? q + 1 : NULL;
+    h->fd = next_fd++;
+}
+
+void host_http_set_hdr(host_http_t *h, const char *name, const char *value)
+{
+    if (h->n_hdr < HOST_HTTP_MAX_HEADERS) {
+        snprintf(h->hdr[h->n_hdr].name, sizeof(h->hdr[0].name), "%s", name);
+        snprintf(h->hdr[h->n_hdr].value, sizeof(h->hdr[0].value), "%s", value);
+        h->n_hdr++;
+    }
+}
+
+void host_http_set_body(host_http_t *h, const void *body, size_t len)
+{
+    h->body = body;
+    h->req.content_len = len;
+    h->body_pos = 0;
+}
+
+static const httpd_uri_t *find_handler(const char *uri, int method)
+{
+    size_t len = strcspn(uri, "?");
+
+    for (int i = 0; i < n_handlers; i++) {
+        const httpd_uri_t *u = &handlers[i];
+        bool match = config.uri_match_fn ? config.uri_match_fn(u->uri, uri, len)
+                                         : strlen(u->uri) == len && strncmp(u->uri, uri, len) == 0;
+        if (match && (int)u->method == method) {
+            return u;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t call(host_http_t *h, const httpd_uri_t *u)
+{
+    session_t *s = &sessions[h->fd % HOST_SOCK_MAX];
+
+    h->req.user_ctx = u->user_ctx;
+    h->req.sess_ctx = s->ctx;
+    h->req.free_ctx = s->free_ctx;
+    esp_err_t err = u->handler(&h->req);
+    s->ctx = h->req.sess_ctx;
+    s->free_ctx = h->req.free_ctx;
+    return err;
+}
+
+esp_err_t host_http_run(host_http_t *h)
+{
+    const httpd_uri_t *u = find_handler(h->req.uri, h->req.method);
+
+    if (!u) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    h->timeouts_left = h->recv_timeouts;
+    return call(h, u);
+}
+
+esp_err_t host_http_ws(host_http_t *h, const char *uri, httpd_ws_type_t type,
+                       const void *payload, size_t len)
+{
+    const httpd_uri_t *u = find_handler(uri, HTTP_GET);
+
+    if (!u || !u->is_websocket) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    h->req.method = 0;                // Data frames, not the handshake
+    h->ws_type = type;
+    h->ws_payload = payload;
+    h->ws_len = len;
+    return call(h, u);
+}
+
+const char *host_http_resp_hdr(const host_http_t *h, const char *name)
+{
+    for (int i = 0; i < h->n_resp_hdr; i++) {
+        if (strcasecmp(h->resp_hdr[i].name, name) == 0) {
+            return h->resp_hdr[i].value;
+        }
+    }
+    return NULL;
+}
+
+int host_http_status(const host_http_t *h)
+{
+    return h->status[0] ? atoi(h->status) : 200;
+}
+
+size_t host_http_wire_bytes(const host_http_t *h)
+{
+    char line[160];
+    size_t n = snprintf(line, sizeof(line), "HTTP/1.1 %s\r\n", h->status[0] ? h->status : "200 OK");
+
+    if (h->raw) {
+        return h->resp_len;
+    }
+    n += snprintf(line, sizeof(line), "Content-Type: %s\r\n", h->type[0] ? h->type : "text/html");
+    for (int i = 0; i < h->n_resp_hdr; i++) {
+        n += strlen(h->resp_hdr[i].name) + strlen(h->resp_hdr[i].value) + 4;
+    }
+    if (h->chunks) {
+        n += strlen("Transfer-Encoding: chunked\r\n") + strlen("\r\n");
+        n += h->resp_len + strlen("0\r\n\r\n");
+        // Each chunk: hex length, CRLF, data, CRLF. Sizes aren't kept; four
+        // hex digits covers any chunk httpd would send.
+        n += h->chunks * (4 + 2 + 2);
+    } else {
+        n += snprintf(line, sizeof(line), "Content-Length: %zu\r\n\r\n", h->resp_len) + h->resp_len;
+    }
+    return n;
+}
+
+void host_http_free(host_http_t *h)
+{
+    free(h->resp);
+    h->resp = NULL;
+    h->resp_len = h->resp_cap = 0;
+}
+
+// ---- Request side ----
+
+size_t httpd_req_get_url_query_len(httpd_req_t *req)
+{
+    const char *q = mock(req)->query;
+
+    return q ? strlen(q) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t len)
+{
+    const char *q = mock(req)->query;
+
+    if (!q) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(buf, len, "%s", q);
+    return strlen(q) < len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t len)
+{
+    size_t key_len = strlen(key);
+
+    for (const char *p = qry; p && *p; p = strchr(p, '&'), p = p ? p + 1 : NULL) {
+        if (strncmp(p, key, key_len) != 0 || p[key_len] != '=') {
+            continue;
+        }
+        const char *v = p + key_len + 1;
+        size_t v_len = strcspn(v, "&");
+        size_t n = v_len < len - 1 ? v_len : len - 1;
+        memcpy(val, v, n);
+        val[n] = '\0';
+        return v_len < len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static const char *req_hdr(httpd_req_t *req, const char *field)
+{
+    host_http_t *h = mock(req);
+
+    for (int i = 0; i < h->n_hdr; i++) {
+        if (strcasecmp(h->hdr[i].name, field) == 0) {
+            return h->hdr[i].value;
+        }
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *req, const char *field)
+{
+    const char *v = req_hdr(req, field);
+
+    return v ? strlen(v) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *val,
+                                      size_t len)
+{
+    const char *v = req_hdr(req, field);
+
+    if (!v) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(val, len, "%s", v);
+    return strlen(v) < len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+int httpd_req_recv(httpd_req_t *req, char *buf, size_t len)
+{
+    host_http_t *h = mock(req);
+    size_t left = req->content_len - h->body_pos;
+
+    if (h->timeouts_left != 0) {
+        if (h->timeouts_left > 0) {
+            h->timeouts_left--;
+        }
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (h->drop_at && h->body_pos >= h->drop_at) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    if (h->drop_at && h->drop_at - h->body_pos < left) {
+        left = h->drop_at - h->body_pos;
+    }
+    if (len > left) {
+        len = left;
+    }
+    if (h->recv_max && len > h->recv_max) {
+        len = h->recv_max;
+    }
+    memcpy(buf, h->body + h->body_pos, len);
+    h->body_pos += len;
+    h->timeouts_left = h->recv_timeouts;
+    return (int)len;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *req)
+{
+    return mock(req)->fd;
+}
+
+// ---- Response side ----
+
+static void append(host_http_t *h, const void *buf, size_t len)
+{
+    if (h->resp_len + len > h->resp_cap) {
+        h->resp_cap = (h->resp_len + len) * 2;
+        h->resp = realloc(h->resp, h->resp_cap + 1);
+    }
+    if (len) {
+        memcpy(h->resp + h->resp_len, buf, len);
+    }
+    h->resp_len += len;
+    if (h->resp) {
+        h->resp[h->resp_len] = '\0';  // Text bodies read as strings
+    }
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status)
+{
+    snprintf(mock(req)->status, sizeof(mock(req)->status), "%s", status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type)
+{
+    snprintf(mock(req)->type, sizeof(mock(req)->type), "%s", type);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value)
+{
+    host_http_t *h = mock(req);
+
+    if (h->n_resp_hdr >= config.max_resp_headers || h->n_resp_hdr >= HOST_HTTP_MAX_HEADERS) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    snprintf(h->resp_hdr[h->n_resp_hdr].name, sizeof(h->resp_hdr[0].name), "%s", field);
+    snprintf(h->resp_hdr[h->n_resp_hdr].value, sizeof(h->resp_hdr[0].value), "%s", value);
+    h->n_resp_hdr++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    host_http_t *h = mock(req);
+
+    if (h->finished || h->chunks) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    append(h, buf, len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)len);
+    h->sent_from = buf;
+    h->finished = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    host_http_t *h = mock(req);
+
+    if (h->finished) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if (len == HTTPD_RESP_USE_STRLEN) {
+        len = buf ? strlen(buf) : 0;
+    }
+    if (buf == NULL || len == 0) {
+        h->finished = true;
+        return ESP_OK;
+    }
+    append(h, buf, len);
+    h->chunks++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    static const struct {
+        httpd_err_code_t code;
+        const char *status;
+    } names[] = {
+        { HTTPD_400_BAD_REQUEST, "400 Bad Request" },
+        { HTTPD_403_FORBIDDEN, "403 Forbidden" },
+        { HTTPD_404_NOT_FOUND, "404 Not Found" },
+        { HTTPD_408_REQ_TIMEOUT, "408 Request Timeout" },
+        { HTTPD_413_CONTENT_TOO_LARGE, "413 Content Too Large" },
+        { HTTPD_500_INTERNAL_SERVER_ERROR, "500 Internal Server Error" },
+    };
+    const char *status = "500 Internal Server Error";
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (names[i].code == error) {
+            status = names[i].status;
+        }
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_send(req, msg ? msg : status, HTTPD_RESP_USE_STRLEN);
+    return ESP_FAIL;                  // As httpd: the handler's caller drops the socket
+}
+
+int httpd_send(httpd_req_t *req, const char *buf, size_t len)
+{
+    host_http_t *h = mock(req);
+
+    h->raw = true;
+    append(h, buf, len);
+    return (int)len;
+}
+
+// ---- Sockets and sessions ----
+
+host_sock_t *host_sock(int fd)
+{
+    return &socks[fd % HOST_SOCK_MAX];
+}
+
+int httpd_socket_send(httpd_handle_t handle, int fd, const char *buf, size_t len, int flags)
+{
+    host_sock_t *s = host_sock(fd);
+
+    if (s->closed) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    if (s->send_limit > 0 && len > (size_t)s->send_limit) {
+        len = s->send_limit;
+    } else if (s->send_limit < 0) {
+        // Negative: that many sends succeed, then the peer stops reading
+        if (++s->send_limit == 0) {
+            s->send_limit = 1;
+        }
+    }
+    s->bytes += len;
+    s->sends++;
+    // Keep the tail: whatever fits of the old output, then the new
+    size_t take = len < HOST_SOCK_KEEP ? len : HOST_SOCK_KEEP;
+    size_t keep = s->last_len < HOST_SOCK_KEEP - take ? s->last_len : HOST_SOCK_KEEP - take;
+    memmove(s->last, s->last + s->last_len - keep, keep);
+    memcpy(s->last + keep, buf + len - take, take);
+    s->last_len = keep + take;
+    return (int)len;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t fn, void *arg)
+{
+    work_t w = { fn, arg };
+
+    return xQueueSend(work_queue, &w, 0) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+static void close_work(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    session_t *s = &sessions[fd % HOST_SOCK_MAX];
+
+    host_sock(fd)->closed = true;
+    if (s->ctx && s->free_ctx) {
+        s->free_ctx(s->ctx);
+    }
+    s->ctx = NULL;
+    s->free_ctx = NULL;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int fd)
+{
+    return httpd_queue_work(handle, close_work, (void *)(intptr_t)fd);
+}
+
+void host_http_close(int fd)
+{
+    httpd_sess_trigger_close(&config, fd);
+}
+
+// ---- WebSocket ----
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    host_http_t *h = mock(req);
+
+    pkt->type = h->ws_type;
+    pkt->final = true;
+    pkt->len = h->ws_len;
+    if (max_len == 0) {
+        return ESP_OK;                // Length only
+    }
+    if (max_len < h->ws_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(pkt->payload, h->ws_payload, h->ws_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+    host_http_t *h = mock(req);
+    // Server frames: 2 byte header for payloads under 126 bytes
+    uint8_t hdr[2] = { 0x80 | pkt->type, (uint8_t)pkt->len };
+
+    h->raw = true;
+    append(h, hdr, sizeof(hdr));
+    append(h, pkt->payload, pkt->len);
+    return ESP_OK;
+}
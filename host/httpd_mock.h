@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_http_server.h"
+
+// Mock esp_http_server for the host tests.
+//
+// httpd_start() registers handlers as usual; a test builds a request with
+// host_http_init(), adds headers and a body, and host_http_run() dispatches
+// it the way httpd would (first matching URI and method) on the calling
+// thread. The response lands in the request: status, headers, body and how
+// it was chunked. Work queued with httpd_queue_work() runs in an "httpd"
+// task, as on the device; host_settle() waits for it.
+
+#define HOST_HTTP_MAX_HEADERS   8
+#define HOST_SOCK_MAX           128   // File descriptors 0..127
+#define HOST_SOCK_KEEP          4096  // Bytes of each socket's output kept for inspection
+
+typedef struct {
+    char name[32];
+    char value[128];
+} host_http_hdr_t;
+
+typedef struct host_http_req {
+    httpd_req_t req;                  // Handed to the handler
+
+    // Request
+    const char *query;                // After '?' in the URI, NULL without one
+    host_http_hdr_t hdr[HOST_HTTP_MAX_HEADERS];
+    int n_hdr;
+    const uint8_t *body;
+    size_t body_pos;
+    size_t recv_max;                  // Most bytes one httpd_req_recv() returns, 0 for any
+    int recv_timeouts;                // Timeouts before each piece of body, -1: stalls for good
+    size_t drop_at;                   // Connection breaks after this many body bytes, 0: never
+    int timeouts_left;
+    int fd;
+
+    // WebSocket frame being delivered (host_http_ws)
+    const uint8_t *ws_payload;
+    size_t ws_len;
+    httpd_ws_type_t ws_type;
+
+    // Response
+    char status[48];
+    char type[64];
+    host_http_hdr_t resp_hdr[HOST_HTTP_MAX_HEADERS];
+    int n_resp_hdr;
+    uint8_t *resp;
+    size_t resp_len;
+    size_t resp_cap;
+    const void *sent_from;            // Buffer handed to httpd_resp_send()
+    int chunks;                       // httpd_resp_send_chunk() calls with data
+    bool finished;                    // Complete response sent
+    bool raw;                         // Wrote to the socket itself (httpd_send)
+} host_http_t;
+
+// Fresh request; uri may carry a query string. A new socket unless fd is set
+// afterwards.
+void host_http_init(host_http_t *h, httpd_method_t method, const char *uri);
+void host_http_set_hdr(host_http_t *h, const char *name, const char *value);
+void host_http_set_body(host_http_t *h, const void *body, size_t len);
+
+// Dispatch to the registered handler; ESP_ERR_NOT_FOUND if none matches
+esp_err_t host_http_run(host_http_t *h);
+
+// Deliver one WebSocket frame on h's socket to the handler for uri
+esp_err_t host_http_ws(host_http_t *h, const char *uri, httpd_ws_type_t type,
+                       const void *payload, size_t len);
+
+// Response header value, NULL if not set
+const char *host_http_resp_hdr(const host_http_t *h, const char *name);
+
+// Status code of the response (200 unless set)
+int host_http_status(const host_http_t *h);
+
+// Bytes the response would take on the wire: status line, headers,
+// chunk framing and body
+size_t host_http_wire_bytes(const host_http_t *h);
+
+void host_http_free(host_http_t *h);
+
+// What went out on a socket outside request handlers (httpd_socket_send)
+typedef struct {
+    uint64_t bytes;
+    uint32_t sends;
+    bool closed;                      // Session closed, free_ctx called
+    int send_limit;                   // Peer takes at most this per send; -1 for any
+    char last[HOST_SOCK_KEEP];        // Tail of the output
+    size_t last_len;
+} host_sock_t;
+
+host_sock_t *host_sock(int fd);
+
+// The client on fd goes away: its session context is freed in the httpd task
+void host_http_close(int fd);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+#include "esp_err.h"
+
+// Warnings and errors go to stderr; info and below only with HOST_LOG=1 in
+// the environment, so benchmarks aren't timing printf
+int host_log_verbose(void);
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do {                                            \
+        if (host_log_verbose()) {                                               \
+            fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__);             \
+        }                                                                       \
+    } while (0)
+#define ESP_LOGD(tag, fmt, ...) ESP_LOGI(tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,58 @@
+#pragma once
+
+// The ROM's streaming tinfl API on top of zlib. Output goes into the
+// caller's circular dictionary exactly as with tinfl; zlib keeps its own
+// window besides, which only costs host memory.
+
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE              32768
+#define TINFL_FLAG_PARSE_ZLIB_HEADER    1
+#define TINFL_FLAG_HAS_MORE_INPUT       2
+
+typedef enum {
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+
+typedef struct {
+    z_stream zs;
+    int started;
+} tinfl_decompressor;
+
+static inline void tinfl_init(tinfl_decompressor *r)
+{
+    if (r->started) {
+        inflateEnd(&r->zs);
+    }
+    memset(r, 0, sizeof(*r));
+    inflateInit(&r->zs);
+    r->started = 1;
+}
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const unsigned char *in,
+                                            size_t *in_size, unsigned char *dict_start,
+                                            unsigned char *out, size_t *out_size, int flags)
+{
+    (void)dict_start;
+    (void)flags;
+    r->zs.next_in = (unsigned char *)in;
+    r->zs.avail_in = (uInt)*in_size;
+    r->zs.next_out = out;
+    r->zs.avail_out = (uInt)*out_size;
+
+    int ret = inflate(&r->zs, Z_NO_FLUSH);
+    *in_size -= r->zs.avail_in;
+    *out_size -= r->zs.avail_out;
+    if (ret == Z_STREAM_END) {
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return TINFL_STATUS_FAILED;
+    }
+    return r->zs.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -0,0 +1,26 @@
+// Configuration of the host build: the sdkconfig defaults, with the
+// optional sensors, the UDP listener and firmware updates switched on so
+// their code is built and tested too. A test can override an option on its
+// own target.
+#pragma once
+
+#define CONFIG_FREERTOS_HZ                  100
+#define CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_0 1
+#define CONFIG_LWIP_MAX_SOCKETS             16
+#define CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE 1
+
+#define CONFIG_PLANTDOC_FLOW_SENSOR         1
+#define CONFIG_PLANTDOC_FLOW_SENSOR_GPIO    34
+#define CONFIG_PLANTDOC_FLOW_PULSES_PER_L   450
+#define CONFIG_PLANTDOC_SENSORS             1
+#define CONFIG_PLANTDOC_SOIL_GPIO           36
+#define CONFIG_PLANTDOC_SOIL_DRY_MV         2600
+#define CONFIG_PLANTDOC_SOIL_WET_MV         1100
+#define CONFIG_PLANTDOC_CURRENT_GPIO        39
+#define CONFIG_PLANTDOC_CURRENT_SHUNT_MOHM  500
+#define CONFIG_PLANTDOC_UDP_CONTROL         1
+#define CONFIG_PLANTDOC_UDP_PORT            3333
+#define CONFIG_PLANTDOC_OTA                 1
+#define CONFIG_PLANTDOC_OTA_KEY             "host-test-ota-key"
+#define CONFIG_PLANTDOC_SSE_INTERVAL_MS     200
+#define CONFIG_PLANTDOC_HTTPD_STACK         8192
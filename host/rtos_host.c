@@ -0,0 +1,800 @@
+// FreeRTOS and esp_timer on pthreads (see host.h).
+//
+// One lock guards every emulated object; every state change broadcasts one
+// condition, and each blocked task re-checks what it waits for. Crude, but
+// with a handful of tasks it costs nothing and makes host_settle() simple:
+// the runtime always knows what each task is waiting for.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "host.h"
+
+#define TICK_US             (1000000LL / configTICK_RATE_HZ)
+#define REAL_POLL_US        1000      // Real clock: blocked tasks re-check this often
+#define SETTLE_LIMIT_NS     10000000000LL
+
+typedef bool (*ready_fn)(void *ctx);
+
+struct host_task {
+    pthread_t thread;
+    char name[16];
+    TaskFunction_t fn;
+    void *arg;
+    uint32_t stack_bytes;
+    uint32_t stack_free;
+    UBaseType_t prio;
+    int core;
+    uint32_t notify;
+    bool live;                        // Created and not deleted
+    bool blocked;                     // In wait_locked()
+    bool suspended;
+    bool deleted;                     // vTaskDelete() on it, exiting at its next wait
+    bool exited;
+    ready_fn ready;                   // What it waits for
+    void *ready_ctx;
+    int64_t wake_us;                  // Its timeout, INT64_MAX for none
+    struct host_task *next;
+};
+
+_Static_assert(sizeof(struct host_task) <= sizeof(StaticTask_t), "StaticTask_t too small");
+
+struct host_queue {
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+};
+
+struct host_event_group {
+    EventBits_t bits;
+};
+
+struct esp_timer {
+    void (*callback)(void *arg);
+    void *arg;
+    const char *name;
+    int64_t due_us;                   // INT64_MAX while stopped
+    int64_t period_us;                // 0 for one-shot
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t critical;      // Recursive: every portMUX
+static struct host_task *tasks;       // Live tasks, newest first
+static __thread struct host_task *self;
+static struct host_task main_task = { .name = "main", .live = true, .wake_us = INT64_MAX };
+
+static struct esp_timer *timers;
+static struct host_task *timer_task;
+
+static int64_t clock_start_ns;
+static atomic_bool clock_manual;
+static atomic_llong manual_us;
+
+static void init(void)
+{
+    pthread_condattr_t ca;
+    pthread_mutexattr_t ma;
+
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&changed, &ca);
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_settype(&ma, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical, &ma);
+    clock_start_ns = host_wall_ns();
+}
+
+static void lock_host(void)
+{
+    pthread_once(&init_once, init);
+    pthread_mutex_lock(&lock);
+}
+
+static void unlock_host(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+int64_t host_wall_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t host_thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    if (atomic_load_explicit(&clock_manual, memory_order_acquire)) {
+        return atomic_load_explicit(&manual_us, memory_order_relaxed);
+    }
+    pthread_once(&init_once, init);
+    return (host_wall_ns() - clock_start_ns) / 1000;
+}
+
+void host_clock_manual(void)
+{
+    lock_host();
+    atomic_store(&manual_us, esp_timer_get_time());
+    atomic_store(&clock_manual, true);
+    unlock_host();
+}
+
+void host_critical_enter(void)
+{
+    pthread_once(&init_once, init);
+    pthread_mutex_lock(&critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&critical);
+}
+
+static struct host_task *current(void)
+{
+    if (!self) {
+        self = &main_task;            // Threads the runtime didn't start act as "main"
+    }
+    return self;
+}
+
+static void exit_locked(struct host_task *t)
+{
+    t->live = false;
+    t->exited = true;
+    for (struct host_task **p = &tasks; *p; p = &(*p)->next) {
+        if (*p == t) {
+            *p = t->next;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&changed);
+    unlock_host();
+    pthread_exit(NULL);
+}
+
+// Block the calling task until ready(ctx) holds or ticks pass; true if
+// ready. Called and returns with the lock held.
+static bool wait_locked(ready_fn ready, void *ctx, TickType_t ticks)
+{
+    struct host_task *t = current();
+    int64_t deadline = ticks == portMAX_DELAY ? INT64_MAX : esp_timer_get_time() + ticks * TICK_US;
+    bool ok;
+
+    t->ready = ready;
+    t->ready_ctx = ctx;
+    t->wake_us = deadline;
+    t->blocked = true;
+    pthread_cond_broadcast(&changed);   // For host_settle()
+
+    for (;;) {
+        if (t->deleted) {
+            exit_locked(t);
+        }
+        if ((ok = ready(ctx)) || esp_timer_get_time() >= deadline) {
+            break;
+        }
+        if (atomic_load(&clock_manual)) {
+            pthread_cond_wait(&changed, &lock);
+        } else {
+            int64_t until = esp_timer_get_time() + REAL_POLL_US;
+            if (deadline < until) {
+                until = deadline;
+            }
+            int64_t ns = clock_start_ns + until * 1000;
+            struct timespec ts = { .tv_sec = ns / 1000000000LL, .tv_nsec = ns % 1000000000LL };
+            pthread_cond_timedwait(&changed, &lock, &ts);
+        }
+    }
+    t->blocked = false;
+    t->ready = NULL;
+    t->wake_us = INT64_MAX;
+    return ok;
+}
+
+static bool never(void *ctx)
+{
+    return false;
+}
+
+// A task with nothing to do until something else happens
+static bool settled(const struct host_task *t)
+{
+    return t->suspended ||
+           (t->blocked && !t->ready(t->ready_ctx) && t->wake_us > esp_timer_get_time());
+}
+
+void host_settle(void)
+{
+    int64_t give_up = host_wall_ns() + SETTLE_LIMIT_NS;
+
+    lock_host();
+    for (;;) {
+        struct host_task *busy = NULL;
+        for (struct host_task *t = tasks; t && !busy; t = t->next) {
+            if (t != self && !settled(t)) {
+                busy = t;
+            }
+        }
+        if (!busy) {
+            break;
+        }
+        if (host_wall_ns() > give_up) {
+            fprintf(stderr, "host_settle: task %s never settled\n", busy->name);
+            abort();
+        }
+        int64_t ns = host_wall_ns() + 1000000;
+        struct timespec ts = { .tv_sec = ns / 1000000000LL, .tv_nsec = ns % 1000000000LL };
+        pthread_cond_timedwait(&changed, &lock, &ts);
+    }
+    unlock_host();
+}
+
+// Earliest timeout or timer after now, INT64_MAX if none
+static int64_t next_event_locked(void)
+{
+    int64_t next = INT64_MAX;
+
+    for (struct host_task *t = tasks; t; t = t->next) {
+        if (t->blocked && !t->suspended && t->wake_us < next) {
+            next = t->wake_us;
+        }
+    }
+    for (struct esp_timer *tm = timers; tm; tm = tm->next) {
+        if (tm->due_us < next) {
+            next = tm->due_us;
+        }
+    }
+    return next;
+}
+
+void host_advance_us(int64_t us)
+{
+    int64_t target = esp_timer_get_time() + us;
+
+    for (;;) {
+        host_settle();
+        lock_host();
+        int64_t next = next_event_locked();
+        if (next > target) {
+            atomic_store(&manual_us, target);
+            pthread_cond_broadcast(&changed);
+            unlock_host();
+            break;
+        }
+        if (next > atomic_load(&manual_us)) {
+            atomic_store(&manual_us, next);
+        }
+        pthread_cond_broadcast(&changed);
+        unlock_host();
+    }
+    host_settle();
+}
+
+// ---- Tasks ----
+
+static void *task_entry(void *arg)
+{
+    struct host_task *t = arg;
+
+    self = t;
+    t->fn(t->arg);
+    fprintf(stderr, "Task %s returned from its function\n", t->name);
+    abort();                          // As FreeRTOS would
+}
+
+static struct host_task *start_task(struct host_task *t, TaskFunction_t fn, const char *name,
+                                    uint32_t stack_bytes, void *arg, UBaseType_t prio,
+                                    BaseType_t core)
+{
+    pthread_attr_t attr;
+
+    memset(t, 0, sizeof(*t));
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    t->fn = fn;
+    t->arg = arg;
+    t->stack_bytes = stack_bytes;
+    t->stack_free = stack_bytes / 4;
+    t->prio = prio;
+    t->core = core == tskNO_AFFINITY ? 0 : core;
+    t->wake_us = INT64_MAX;
+    t->live = true;
+
+    lock_host();
+    t->next = tasks;
+    tasks = t;
+    unlock_host();
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t->thread, &attr, task_entry, t) != 0) {
+        abort();
+    }
+    pthread_attr_destroy(&attr);
+    return t;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_bytes,
+                                   void *arg, UBaseType_t prio, TaskHandle_t *out,
+                                   BaseType_t core)
+{
+    // Never freed: a handle may outlive its task, as with FreeRTOS
+    struct host_task *t = start_task(malloc(sizeof(*t)), fn, name, stack_bytes, arg, prio, core);
+
+    if (out) {
+        *out = t;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name,
+                                           uint32_t stack_bytes, void *arg, UBaseType_t prio,
+                                           StackType_t *stack, StaticTask_t *tcb,
+                                           BaseType_t core)
+{
+    return start_task((struct host_task *)tcb, fn, name, stack_bytes, arg, prio, core);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    struct host_task *t = task ? task : current();
+
+    lock_host();
+    if (t == current()) {
+        exit_locked(t);
+    }
+    if (t->live) {
+        t->deleted = true;
+        t->suspended = false;
+        pthread_cond_broadcast(&changed);
+        // Blocked tasks leave right away; the storage may be reused next
+        while (t->blocked && !t->exited) {
+            pthread_cond_wait(&changed, &lock);
+        }
+    }
+    unlock_host();
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    struct host_task *t = task ? task : current();
+
+    if (t != current()) {
+        abort();                      // Only self-suspension is used
+    }
+    lock_host();
+    t->suspended = true;
+    wait_locked(never, NULL, portMAX_DELAY);
+    unlock_host();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    lock_host();
+    wait_locked(never, NULL, ticks);
+    unlock_host();
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *prev_wake, TickType_t increment)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wake = *prev_wake + increment;
+
+    *prev_wake = wake;
+    if ((int32_t)(wake - now) <= 0) {
+        return pdFALSE;
+    }
+    vTaskDelay(wake - now);
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current();
+}
+
+TaskHandle_t xTaskGetHandle(const char *name)
+{
+    struct host_task *found = NULL;
+
+    lock_host();
+    for (struct host_task *t = tasks; t && !found; t = t->next) {
+        if (strcmp(t->name, name) == 0) {
+            found = t;
+        }
+    }
+    unlock_host();
+    return found;
+}
+
+eTaskState eTaskGetState(TaskHandle_t task)
+{
+    eTaskState st;
+
+    lock_host();
+    if (!task->live) {
+        st = eDeleted;                // Including static storage never started
+    } else if (task->suspended) {
+        st = eSuspended;
+    } else if (task == current()) {
+        st = eRunning;
+    } else {
+        st = task->blocked ? eBlocked : eReady;
+    }
+    unlock_host();
+    return st;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return (task ? task : current())->prio;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return (task ? task : current())->stack_free;
+}
+
+void host_task_set_stack_free(TaskHandle_t task, uint32_t bytes)
+{
+    task->stack_free = bytes;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return current()->core;
+}
+
+static bool notified(void *ctx)
+{
+    return ((struct host_task *)ctx)->notify != 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct host_task *t = current();
+    uint32_t value;
+
+    lock_host();
+    wait_locked(notified, t, ticks);
+    value = t->notify;
+    if (value) {
+        t->notify = clear_on_exit ? 0 : value - 1;
+    }
+    unlock_host();
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    if (!task) {
+        abort();                      // FreeRTOS asserts too
+    }
+    lock_host();
+    task->notify++;
+    pthread_cond_broadcast(&changed);
+    unlock_host();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken) {
+        *woken = pdTRUE;
+    }
+}
+
+// ---- Queues and semaphores ----
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *q = calloc(1, sizeof(*q));
+
+    q->length = length;
+    q->item_size = item_size;
+    q->items = calloc(length, item_size ? item_size : 1);
+    return q;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size,
+                                 uint8_t *storage, StaticQueue_t *buf)
+{
+    return xQueueCreate(length, item_size);
+}
+
+static bool has_room(void *ctx)
+{
+    struct host_queue *q = ctx;
+
+    return q->count < q->length;
+}
+
+static bool has_item(void *ctx)
+{
+    return ((struct host_queue *)ctx)->count != 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    lock_host();
+    bool ok = wait_locked(has_room, q, ticks);
+    if (ok) {
+        if (q->item_size) {
+            memcpy(q->items + (q->head + q->count) % q->length * q->item_size, item, q->item_size);
+        }
+        q->count++;
+        pthread_cond_broadcast(&changed);
+    }
+    unlock_host();
+    return ok ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    lock_host();
+    bool ok = wait_locked(has_item, q, ticks);
+    if (ok) {
+        if (q->item_size) {
+            memcpy(item, q->items + q->head * q->item_size, q->item_size);
+        }
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_broadcast(&changed);
+    }
+    unlock_host();
+    return ok ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    lock_host();
+    q->count = 0;
+    q->head = 0;
+    pthread_cond_broadcast(&changed);
+    unlock_host();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    lock_host();
+    UBaseType_t n = q->count;
+    unlock_host();
+    return n;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    free(q->items);
+    free(q);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf)
+{
+    return xSemaphoreCreateBinary();
+}
+
+// No priority inheritance or owner tracking; a mutex starts out given
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t m = xQueueCreate(1, 0);
+
+    m->count = 1;
+    return m;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf)
+{
+    return xSemaphoreCreateMutex();
+}
+
+// ---- Event groups ----
+
+typedef struct {
+    struct host_event_group *group;
+    EventBits_t bits;
+    bool all;
+} bits_wait_t;
+
+static bool bits_set(void *ctx)
+{
+    bits_wait_t *w = ctx;
+    EventBits_t have = w->group->bits & w->bits;
+
+    return w->all ? have == w->bits : have != 0;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct host_event_group));
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf)
+{
+    return xEventGroupCreate();
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    lock_host();
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&changed);
+    unlock_host();
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    lock_host();
+    EventBits_t was = group->bits;
+    group->bits &= ~bits;
+    unlock_host();
+    return was;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    lock_host();
+    EventBits_t now = group->bits;
+    unlock_host();
+    return now;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+                                BaseType_t clear_on_exit, BaseType_t wait_all,
+                                TickType_t ticks)
+{
+    bits_wait_t w = { group, bits, wait_all };
+
+    lock_host();
+    bool ok = wait_locked(bits_set, &w, ticks);
+    EventBits_t now = group->bits;
+    if (ok && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    unlock_host();
+    return now;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    free(group);
+}
+
+// ---- esp_timer: one dispatch task, as ESP_TIMER_TASK ----
+
+static bool timer_due(void *ctx)
+{
+    int64_t now = esp_timer_get_time();
+
+    for (struct esp_timer *t = timers; t; t = t->next) {
+        if (t->due_us <= now) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void timer_task_fn(void *arg)
+{
+    lock_host();
+    for (;;) {
+        struct esp_timer *fire = NULL;
+
+        wait_locked(timer_due, NULL, portMAX_DELAY);
+        for (struct esp_timer *t = timers; t; t = t->next) {
+            if (!fire || t->due_us < fire->due_us) {
+                fire = t;
+            }
+        }
+        fire->due_us = fire->period_us ? fire->due_us + fire->period_us : INT64_MAX;
+        unlock_host();
+        fire->callback(fire->arg);
+        lock_host();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    struct esp_timer *t = calloc(1, sizeof(*t));
+
+    t->callback = args->callback;
+    t->arg = args->arg;
+    t->name = args->name;
+    t->due_us = INT64_MAX;
+
+    lock_host();
+    bool first = timer_task == NULL;
+    t->next = timers;
+    timers = t;
+    unlock_host();
+    if (first) {
+        xTaskCreatePinnedToCore(timer_task_fn, "esp_timer", 4096, NULL, 22,
+                                (TaskHandle_t *)&timer_task, 0);
+    }
+    *out = t;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t t, uint64_t us, int64_t period)
+{
+    esp_err_t err = ESP_OK;
+
+    lock_host();
+    if (t->due_us != INT64_MAX) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        t->due_us = esp_timer_get_time() + (int64_t)us;
+        t->period_us = period;
+        pthread_cond_broadcast(&changed);
+    }
+    unlock_host();
+    return err;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, (int64_t)period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t err = ESP_OK;
+
+    lock_host();
+    if (timer->due_us == INT64_MAX) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    timer->due_us = INT64_MAX;
+    pthread_cond_broadcast(&changed);
+    unlock_host();
+    return err;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    lock_host();
+    bool active = timer->due_us != INT64_MAX;
+    unlock_host();
+    return active;
+}
@@ -0,0 +1,285 @@
+// The assets partition end to end: tools/asset_pack.py packs a directory,
+// the image goes into a mock partition, and GET serves every file from it.
+// Each file comes back with its type and validator, gzipped only when that
+// made it smaller, and the body handed to httpd is the mapped partition
+// itself, not a copy. Without a valid archive nothing is served: no
+// partition, a damaged image, a bad header or table of contents.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "assets.h"
+#include "esp_rom_crc.h"
+#include "hal_mock.h"
+#include "httpd_mock.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define PART_SIZE       0x10000
+
+typedef struct {
+    const char *path;
+    const char *type;
+    uint8_t *data;
+    size_t len;
+    bool gzip;                        // Expected: compresses
+} file_t;
+
+static file_t files[] = {
+    { "/index.html", "text/html", NULL, 6000, true },
+    { "/app.js", "application/javascript", NULL, 3000, true },
+    { "/img.txt", "text/plain", NULL, 40, false },
+    { "/img/logo.png", "image/png", NULL, 900, false },
+};
+
+#define N_FILES         (sizeof(files) / sizeof(files[0]))
+
+static char dir[] = "/tmp/test_assets_XXXXXX";
+static uint8_t *part;
+static uint8_t *image;
+static size_t image_len;
+
+static void write_file(const char *path, const void *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+
+    CHECK(f != NULL);
+    CHECK(fwrite(data, 1, len, f) == len);
+    fclose(f);
+}
+
+// Text that gzip shrinks, or noise it can't
+static void make_files(void)
+{
+    char path[256];
+    uint32_t x = 12345;
+
+    CHECK(mkdtemp(dir) != NULL);
+    snprintf(path, sizeof(path), "%s/img", dir);
+    CHECK(mkdir(path, 0700) == 0);
+    for (size_t i = 0; i < N_FILES; i++) {
+        file_t *f = &files[i];
+        f->data = malloc(f->len);
+        for (size_t j = 0; j < f->len; j++) {
+            x = x * 1103515245 + 12345;
+            f->data[j] = f->gzip ? "<div class=\"pump\">spray</div>\n"[j % 30] : x >> 24;
+        }
+        snprintf(path, sizeof(path), "%s%s", dir, f->path);
+        write_file(path, f->data, f->len);
+    }
+}
+
+static void pack(void)
+{
+    char cmd[512], path[256];
+
+    // Next to the directory, not in it, or a second pack would take it in
+    snprintf(path, sizeof(path), "%s.bin", dir);
+    snprintf(cmd, sizeof(cmd), "%s %s/tools/asset_pack.py %s %s %d > /dev/null", HOST_PYTHON,
+             HOST_SOURCE_DIR, dir, path, PART_SIZE);
+    CHECK(system(cmd) == 0);
+
+    // Lists what it packed, and refuses a partition too small for it
+    char line[128];
+    int listed = 0;
+    snprintf(cmd, sizeof(cmd), "%s %s/tools/asset_pack.py --list %s", HOST_PYTHON,
+             HOST_SOURCE_DIR, path);
+    FILE *p = popen(cmd, "r");
+    CHECK(p != NULL);
+    CHECK(fgets(line, sizeof(line), p) && strstr(line, "crc ok") != NULL);
+    while (fgets(line, sizeof(line), p)) {
+        listed++;
+    }
+    CHECK(pclose(p) == 0);
+    CHECK_EQ(listed, N_FILES);
+    snprintf(cmd, sizeof(cmd), "%s %s/tools/asset_pack.py %s %s 0x100 2> /dev/null", HOST_PYTHON,
+             HOST_SOURCE_DIR, dir, path);
+    CHECK(system(cmd) != 0);
+
+    FILE *f = fopen(path, "rb");
+    CHECK(f != NULL);
+    image = malloc(PART_SIZE);
+    image_len = fread(image, 1, PART_SIZE, f);
+    fclose(f);
+    CHECK(image_len > sizeof(assets_hdr_t));
+    unlink(path);
+}
+
+// The partition as flashed: the image, erased flash after it
+static void flash(const uint8_t *img, size_t len)
+{
+    memset(part, 0xFF, PART_SIZE);
+    memcpy(part, img, len);
+    hal_mock_assets_set(part, PART_SIZE);
+}
+
+static void reseal(uint8_t *img)
+{
+    assets_hdr_t *h = (assets_hdr_t *)img;
+
+    h->crc = esp_rom_crc32_le(0, img + sizeof(*h), h->size - sizeof(*h));
+}
+
+static void get(host_http_t *h, const char *uri, const char *inm)
+{
+    host_http_init(h, HTTP_GET, uri);
+    if (inm) {
+        host_http_set_hdr(h, "If-None-Match", inm);
+    }
+    host_http_run(h);
+}
+
+static int status_of(const char *uri)
+{
+    host_http_t h;
+
+    get(&h, uri, NULL);
+    int status = host_http_status(&h);
+    host_http_free(&h);
+    return status;
+}
+
+// Every way to spoil the image is refused, and nothing gets served
+static void test_refused(void)
+{
+    uint8_t *bad = malloc(image_len);
+    assets_hdr_t *h = (assets_hdr_t *)bad;
+    assets_entry_t *toc = (assets_entry_t *)(bad + sizeof(*h));
+    host_http_t r;
+
+    hal_mock_assets_set(NULL, 0);
+    CHECK(assets_init() == ESP_ERR_NOT_FOUND);
+
+    flash(image, image_len - 1);      // Cut short: erased tail fails the CRC
+    CHECK(assets_init() == ESP_ERR_INVALID_CRC);
+
+    memcpy(bad, image, image_len);
+    bad[image_len - 8] ^= 0x40;       // One flipped bit in a file
+    flash(bad, image_len);
+    CHECK(assets_init() == ESP_ERR_INVALID_CRC);
+
+    memcpy(bad, image, image_len);
+    h->magic ^= 1;
+    flash(bad, image_len);
+    CHECK(assets_init() == ESP_ERR_INVALID_CRC);
+
+    memcpy(bad, image, image_len);
+    h->size = PART_SIZE + 4;          // Larger than the partition
+    flash(bad, image_len);
+    CHECK(assets_init() == ESP_ERR_INVALID_CRC);
+
+    // Consistent CRCs, broken table: out of order, or a file past the end
+    memcpy(bad, image, image_len);
+    assets_entry_t e = toc[0];
+    toc[0] = toc[1];
+    toc[1] = e;
+    reseal(bad);
+    flash(bad, image_len);
+    CHECK(assets_init() == ESP_ERR_INVALID_CRC);
+
+    memcpy(bad, image, image_len);
+    toc[N_FILES - 1].len = h->size;
+    reseal(bad);
+    flash(bad, image_len);
+    CHECK(assets_init() == ESP_ERR_INVALID_CRC);
+
+    get(&r, "/", NULL);
+    CHECK_EQ(host_http_status(&r), 404);
+    CHECK(strstr((char *)r.resp, "assets-flash") != NULL);
+    host_http_free(&r);
+    free(bad);
+}
+
+static void check_body(const host_http_t *h, const file_t *f)
+{
+    if (!f->gzip) {
+        CHECK(h->resp_len == f->len && memcmp(h->resp, f->data, f->len) == 0);
+        return;
+    }
+    uint8_t *out = malloc(f->len + 1);
+    z_stream z = { .next_in = h->resp, .avail_in = h->resp_len,
+                   .next_out = out, .avail_out = f->len + 1 };
+    CHECK(inflateInit2(&z, 16 + MAX_WBITS) == Z_OK);
+    CHECK(inflate(&z, Z_FINISH) == Z_STREAM_END);
+    CHECK(z.total_out == f->len && memcmp(out, f->data, f->len) == 0);
+    CHECK(h->resp_len < f->len);
+    inflateEnd(&z);
+    free(out);
+}
+
+static void test_served(void)
+{
+    host_http_t h;
+    size_t raw = 0, sent = 0;
+
+    flash(image, image_len);
+    CHECK(assets_init() == ESP_OK);
+
+    for (size_t i = 0; i < N_FILES; i++) {
+        const file_t *f = &files[i];
+        get(&h, f->path, NULL);
+        CHECK_EQ(host_http_status(&h), 200);
+        CHECK(strcmp(h.type, f->type) == 0);
+        const char *enc = host_http_resp_hdr(&h, "Content-Encoding");
+        CHECK(f->gzip ? enc && strcmp(enc, "gzip") == 0 : enc == NULL);
+        check_body(&h, f);
+        // Straight from the mapping
+        CHECK((const uint8_t *)h.sent_from >= part + sizeof(assets_hdr_t));
+        CHECK((const uint8_t *)h.sent_from + h.resp_len <= part + image_len);
+        raw += f->len;
+        sent += h.resp_len;
+
+        // The validator is the stored file's CRC; presenting it gets a 304
+        char etag[16];
+        snprintf(etag, sizeof(etag), "\"%08lx\"",
+                 (unsigned long)crc32(0, h.resp, h.resp_len));
+        CHECK(strcmp(host_http_resp_hdr(&h, "ETag"), etag) == 0);
+        host_http_free(&h);
+        get(&h, f->path, etag);
+        CHECK_EQ(host_http_status(&h), 304);
+        CHECK_EQ(h.resp_len, 0);
+        host_http_free(&h);
+    }
+
+    // "/" is the page; anything not in the archive is a plain 404
+    get(&h, "/", NULL);
+    CHECK_EQ(host_http_status(&h), 200);
+    check_body(&h, &files[0]);
+    host_http_free(&h);
+    CHECK_EQ(status_of("/img"), 404);
+    CHECK_EQ(status_of("/img/"), 404);
+    CHECK_EQ(status_of("/index.htm"), 404);
+    CHECK_EQ(status_of("/zzz"), 404);
+    get(&h, "/missing.js", NULL);
+    CHECK(strstr((char *)h.resp, "assets-flash") == NULL);
+    host_http_free(&h);
+
+    printf("%zu files, %zu bytes -> %zu byte image, %zu bytes served\n", N_FILES, raw,
+           image_len, sent);
+}
+
+int main(void)
+{
+    make_files();
+    pack();
+    part = malloc(PART_SIZE);
+    CHECK(start_webserver() != NULL);
+
+    test_refused();
+    test_served();
+
+    for (size_t i = 0; i < N_FILES; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s%s", dir, files[i].path);
+        unlink(path);
+    }
+    char path[256];
+    snprintf(path, sizeof(path), "%s/img", dir);
+    rmdir(path);
+    rmdir(dir);
+    printf("test_assets: ok\n");
+    return 0;
+}
@@ -0,0 +1,315 @@
+// boot.c's init scheduler on the manual clock, with app_main's stage table
+// and simulated stage durations (each stage sleeps for its time, so two
+// workers overlap as two cores would). Checks that the pump's safe state is
+// the first thing started, that no stage starts before its prerequisites
+// have finished, that at most one stage runs per core, and that boot takes
+// the graph's critical path rather than the sum of the stages. A failed
+// required stage skips everything that needs it and fails boot; a failed
+// optional one doesn't; a table that could never run is refused. /boot
+// reports the records.
+
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "boot.h"
+#include "httpd_mock.h"
+#include "test_util.h"
+#include "web_server.h"
+
+// As in main.c
+enum {
+    STAGE_PUMP, STAGE_NVS, STAGE_JOURNAL, STAGE_SETTINGS, STAGE_PUMP_CTRL, STAGE_PROGRAM,
+    STAGE_FLOW, STAGE_SENSORS, STAGE_CLASSIFY, STAGE_WIFI, STAGE_ASSETS, STAGE_WEB,
+    STAGE_UDP, STAGE_COUNT
+};
+
+// Simulated durations, ms, roughly as measured on the rig
+static const int stage_ms[STAGE_COUNT] = {
+    [STAGE_PUMP] = 1, [STAGE_NVS] = 25, [STAGE_JOURNAL] = 12, [STAGE_SETTINGS] = 2,
+    [STAGE_PUMP_CTRL] = 2, [STAGE_PROGRAM] = 1, [STAGE_FLOW] = 1, [STAGE_SENSORS] = 2,
+    [STAGE_CLASSIFY] = 30, [STAGE_WIFI] = 110, [STAGE_ASSETS] = 8, [STAGE_WEB] = 6,
+    [STAGE_UDP] = 1,
+};
+
+static esp_err_t results[STAGE_COUNT];
+static uint32_t ran;                  // Stages whose run() was called
+static atomic_int running;
+static atomic_int max_running;
+static atomic_int core_busy[portNUM_PROCESSORS];
+static const boot_stage_t *table;
+
+static esp_timer_handle_t timers[portNUM_PROCESSORS];
+static TaskHandle_t waiting[portNUM_PROCESSORS];
+
+static void stage_done(void *arg)
+{
+    xTaskNotifyGive(waiting[(intptr_t)arg]);
+}
+
+// Busy for the stage's time; a timer per core rather than vTaskDelay(), as
+// ticks are coarser than most stages
+static void work(int ms)
+{
+    int core = xPortGetCoreID();
+
+    waiting[core] = xTaskGetCurrentTaskHandle();
+    CHECK(esp_timer_start_once(timers[core], ms * 1000) == ESP_OK);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+static esp_err_t sim(int i)
+{
+    const boot_record_t *rec;
+    bool done;
+    uint32_t total;
+
+    // Every prerequisite finished before this started
+    boot_get_records(&rec, &done, &total);
+    for (int j = 0; j < STAGE_COUNT; j++) {
+        if (table[i].after & BOOT_AFTER(j)) {
+            CHECK(rec[j].end_us != 0 && rec[j].end_us <= rec[i].start_us);
+        }
+    }
+    int core = xPortGetCoreID();
+    CHECK_EQ(atomic_fetch_add(&core_busy[core], 1), 0);
+    int now = atomic_fetch_add(&running, 1) + 1;
+    int max = atomic_load(&max_running);
+    while (now > max && !atomic_compare_exchange_weak(&max_running, &max, now)) {
+    }
+    ran |= BOOT_AFTER(i);
+
+    work(stage_ms[i]);
+
+    atomic_fetch_sub(&running, 1);
+    atomic_fetch_sub(&core_busy[core], 1);
+    return results[i];
+}
+
+#define STAGE_FN(id)    static esp_err_t run_##id(void) { return sim(id); }
+STAGE_FN(STAGE_PUMP) STAGE_FN(STAGE_NVS) STAGE_FN(STAGE_JOURNAL) STAGE_FN(STAGE_SETTINGS)
+STAGE_FN(STAGE_PUMP_CTRL) STAGE_FN(STAGE_PROGRAM) STAGE_FN(STAGE_FLOW)
+STAGE_FN(STAGE_SENSORS) STAGE_FN(STAGE_CLASSIFY) STAGE_FN(STAGE_WIFI)
+STAGE_FN(STAGE_ASSETS) STAGE_FN(STAGE_WEB) STAGE_FN(STAGE_UDP)
+
+static const boot_stage_t stages[STAGE_COUNT] = {
+    [STAGE_PUMP]      = { "pump", run_STAGE_PUMP, 0 },
+    [STAGE_NVS]       = { "nvs", run_STAGE_NVS, 0 },
+    [STAGE_JOURNAL]   = { "journal", run_STAGE_JOURNAL, 0 },
+    [STAGE_SETTINGS]  = { "settings", run_STAGE_SETTINGS,
+                          BOOT_AFTER(STAGE_PUMP) | BOOT_AFTER(STAGE_JOURNAL) },
+    [STAGE_PUMP_CTRL] = { "pump_ctrl", run_STAGE_PUMP_CTRL, BOOT_AFTER(STAGE_SETTINGS) },
+    [STAGE_PROGRAM]   = { "program", run_STAGE_PROGRAM, 0 },
+    [STAGE_FLOW]      = { "flow", run_STAGE_FLOW, BOOT_AFTER(STAGE_PUMP_CTRL), true },
+    [STAGE_SENSORS]   = { "sensors", run_STAGE_SENSORS, 0, true },
+    [STAGE_CLASSIFY]  = { "classify", run_STAGE_CLASSIFY, 0 },
+    [STAGE_WIFI]      = { "wifi", run_STAGE_WIFI, BOOT_AFTER(STAGE_NVS) },
+    [STAGE_ASSETS]    = { "assets", run_STAGE_ASSETS, 0, true },
+    [STAGE_WEB]       = { "web", run_STAGE_WEB,
+                          BOOT_AFTER(STAGE_WIFI) | BOOT_AFTER(STAGE_PUMP_CTRL) |
+                          BOOT_AFTER(STAGE_PROGRAM) | BOOT_AFTER(STAGE_FLOW) |
+                          BOOT_AFTER(STAGE_SENSORS) | BOOT_AFTER(STAGE_CLASSIFY) |
+                          BOOT_AFTER(STAGE_ASSETS) },
+    [STAGE_UDP]       = { "udp", run_STAGE_UDP,
+                          BOOT_AFTER(STAGE_WIFI) | BOOT_AFTER(STAGE_PUMP_CTRL), true },
+};
+
+static const boot_stage_t *run_list;
+static int run_n;
+static volatile bool returned;
+static esp_err_t run_err;
+
+static void app_task(void *arg)
+{
+    run_err = boot_run(run_list, run_n);
+    returned = true;
+    vTaskDelete(NULL);
+}
+
+// app_main's task on core 0 runs boot; the clock moves a millisecond at a
+// time until it returns. Returns the simulated boot time, ms.
+static int64_t boot(const boot_stage_t *list, int n, esp_err_t *err)
+{
+    int64_t t0 = esp_timer_get_time();
+
+    table = list;
+    run_list = list;
+    run_n = n;
+    returned = false;
+    ran = 0;
+    atomic_store(&max_running, 0);
+    CHECK(xTaskCreatePinnedToCore(app_task, "main", 4096, NULL, 1, NULL, 0) == pdPASS);
+    host_settle();
+    for (int ms = 0; !returned; ms++) {
+        CHECK(ms < 10000);
+        host_advance_us(1000);
+    }
+    host_settle();
+    *err = run_err;
+    return (esp_timer_get_time() - t0) / 1000;
+}
+
+// Longest chain of durations through the graph, ms
+static int critical_path_ms(int *end)
+{
+    int longest = 0;
+
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        int ready = 0;
+        for (int j = 0; j < i; j++) {
+            if ((stages[i].after & BOOT_AFTER(j)) && end[j] > ready) {
+                ready = end[j];
+            }
+        }
+        end[i] = ready + stage_ms[i];
+        longest = end[i] > longest ? end[i] : longest;
+    }
+    return longest;
+}
+
+static void test_schedule(void)
+{
+    const boot_record_t *rec;
+    bool done;
+    uint32_t total_us;
+    esp_err_t err;
+    int earliest[STAGE_COUNT];
+    int sum = 0;
+
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        sum += stage_ms[i];
+    }
+    int critical = critical_path_ms(earliest);
+    int64_t took = boot(stages, STAGE_COUNT, &err);
+    CHECK(err == ESP_OK);
+    CHECK_EQ(ran, BOOT_AFTER(STAGE_COUNT) - 1);
+    CHECK_EQ(boot_get_records(&rec, &done, &total_us), STAGE_COUNT);
+    CHECK(done);
+    CHECK_EQ(total_us / 1000, took);
+
+    // Two workers, never two stages on one core, both cores used
+    CHECK_EQ(atomic_load(&max_running), 2);
+    bool used[portNUM_PROCESSORS] = { false };
+    uint32_t t0 = rec[STAGE_PUMP].start_us;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        CHECK(rec[i].err == ESP_OK);
+        CHECK(rec[i].start_us >= t0);
+        CHECK_EQ((rec[i].end_us - rec[i].start_us) / 1000, stage_ms[i]);
+        used[rec[i].core] = true;
+    }
+    CHECK(used[0] && used[1]);
+    // The pump's safe state first, on app_main's own core
+    CHECK_EQ(rec[STAGE_PUMP].core, 0);
+    CHECK_EQ(t0, (uint32_t)(esp_timer_get_time() - took * 1000));
+
+    CHECK(took >= critical && took <= critical + 2);
+    CHECK(took * 4 < sum * 3);
+    int ctrl = (rec[STAGE_PUMP_CTRL].end_us - t0) / 1000;
+    CHECK(ctrl <= earliest[STAGE_PUMP_CTRL] + 2);
+    printf("boot: %lld ms on 2 cores, critical path %d ms, %d ms of stages run one by one\n",
+           (long long)took, critical, sum);
+    printf("pump_ctrl accepting commands at %d ms (earliest possible %d)\n", ctrl,
+           earliest[STAGE_PUMP_CTRL]);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        printf("  %-9s core %u  %4lu .. %4lu ms\n", rec[i].name, rec[i].core,
+               (unsigned long)(rec[i].start_us - t0) / 1000,
+               (unsigned long)(rec[i].end_us - t0) / 1000);
+    }
+
+    // /boot reports the same records
+    host_http_t h;
+    host_http_init(&h, HTTP_GET, "/boot");
+    CHECK(host_http_run(&h) == ESP_OK);
+    CHECK(strstr((char *)h.resp, "\"done\":true") != NULL);
+    char want[64];
+    snprintf(want, sizeof(want), "{\"name\":\"wifi\",\"core\":%u,", rec[STAGE_WIFI].core);
+    CHECK(strstr((char *)h.resp, want) != NULL);
+    CHECK(strstr((char *)h.resp, "\"name\":\"udp\"") != NULL);
+    host_http_free(&h);
+}
+
+static void test_failures(void)
+{
+    const boot_record_t *rec;
+    bool done;
+    uint32_t total_us;
+    esp_err_t err;
+
+    // A required stage fails: whatever needs it, directly or not, is
+    // skipped without running; the rest of the graph still comes up
+    results[STAGE_JOURNAL] = ESP_ERR_INVALID_CRC;
+    boot(stages, STAGE_COUNT, &err);
+    CHECK(err == ESP_ERR_INVALID_CRC);
+    boot_get_records(&rec, &done, &total_us);
+    const uint32_t skipped = BOOT_AFTER(STAGE_SETTINGS) | BOOT_AFTER(STAGE_PUMP_CTRL) |
+                             BOOT_AFTER(STAGE_FLOW) | BOOT_AFTER(STAGE_WEB) |
+                             BOOT_AFTER(STAGE_UDP);
+    CHECK_EQ(ran, (BOOT_AFTER(STAGE_COUNT) - 1) & ~skipped);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (skipped & BOOT_AFTER(i)) {
+            CHECK(rec[i].err == ESP_ERR_INVALID_STATE);
+            CHECK_EQ(rec[i].end_us, rec[i].start_us);
+        }
+    }
+    CHECK(rec[STAGE_WIFI].err == ESP_OK && rec[STAGE_CLASSIFY].err == ESP_OK);
+    results[STAGE_JOURNAL] = ESP_OK;
+
+    // Optional ones only report it, their dependents still run
+    results[STAGE_SENSORS] = ESP_FAIL;
+    results[STAGE_UDP] = ESP_ERR_NOT_SUPPORTED;
+    boot(stages, STAGE_COUNT, &err);
+    CHECK(err == ESP_OK);
+    CHECK_EQ(ran, BOOT_AFTER(STAGE_COUNT) - 1);
+    boot_get_records(&rec, &done, &total_us);
+    CHECK(rec[STAGE_SENSORS].err == ESP_FAIL && rec[STAGE_WEB].err == ESP_OK);
+    results[STAGE_SENSORS] = results[STAGE_UDP] = ESP_OK;
+
+    // Two required failures: the first in table order is the one returned
+    results[STAGE_CLASSIFY] = ESP_ERR_NO_MEM;
+    results[STAGE_NVS] = ESP_ERR_NOT_FOUND;
+    boot(stages, STAGE_COUNT, &err);
+    CHECK(err == ESP_ERR_NOT_FOUND);
+    results[STAGE_CLASSIFY] = results[STAGE_NVS] = ESP_OK;
+
+    // A forward or self reference could never run; nor can too many stages
+    boot_stage_t bad[3] = { stages[0], stages[1], stages[2] };
+    ran = 0;
+    bad[1].after = BOOT_AFTER(2);
+    CHECK(boot_run(bad, 3) == ESP_ERR_INVALID_ARG);
+    bad[1].after = BOOT_AFTER(1);
+    CHECK(boot_run(bad, 3) == ESP_ERR_INVALID_ARG);
+    CHECK(boot_run(stages, BOOT_MAX_STAGES + 1) == ESP_ERR_INVALID_ARG);
+    CHECK_EQ(ran, 0);
+}
+
+// A free worker takes the first ready stage in table order
+static void test_pick(void)
+{
+    const uint32_t all = BOOT_AFTER(STAGE_COUNT) - 1;
+
+    CHECK_EQ(boot_pick(stages, STAGE_COUNT, 0, 0), STAGE_PUMP);
+    CHECK_EQ(boot_pick(stages, STAGE_COUNT, BOOT_AFTER(STAGE_PUMP), 0), STAGE_NVS);
+    // Settings waits for the journal even with the pump done
+    uint32_t taken = BOOT_AFTER(STAGE_PUMP) | BOOT_AFTER(STAGE_NVS) | BOOT_AFTER(STAGE_JOURNAL);
+    CHECK_EQ(boot_pick(stages, STAGE_COUNT, taken, BOOT_AFTER(STAGE_PUMP)), STAGE_PROGRAM);
+    CHECK_EQ(boot_pick(stages, STAGE_COUNT, taken, taken), STAGE_SETTINGS);
+    // Web last: it needs everything but udp
+    CHECK_EQ(boot_pick(stages, STAGE_COUNT, all & ~BOOT_AFTER(STAGE_WEB),
+                       all & ~BOOT_AFTER(STAGE_WEB) & ~BOOT_AFTER(STAGE_UDP)), STAGE_WEB);
+    CHECK_EQ(boot_pick(stages, STAGE_COUNT, all, all), -1);
+}
+
+int main(void)
+{
+    host_clock_manual();
+    for (intptr_t c = 0; c < portNUM_PROCESSORS; c++) {
+        esp_timer_create_args_t args = { .callback = stage_done, .arg = (void *)c, .name = "stage" };
+        CHECK(esp_timer_create(&args, &timers[c]) == ESP_OK);
+    }
+    CHECK(start_webserver() != NULL);
+
+    test_pick();
+    test_schedule();
+    test_failures();
+    printf("test_boot: ok\n");
+    return 0;
+}
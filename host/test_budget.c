@@ -0,0 +1,395 @@
+// The memory budget, both halves. On the device side, mem_budget.c built
+// with CONFIG_PLANTDOC_STATIC_ALLOC: stacks judged against their high-water
+// marks at the boundaries of each verdict, tasks started into their static
+// storage, ended by themselves or by others and started again in the same
+// storage, and the totals split between static and heap stacks. On the
+// build side, tools/mem_budget.py on a made-up linker map and sources, in
+// both modes, with every figure of the report checked; and on main/ as it
+// is, where every MEM_TASK() has to resolve to a size.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mem_budget.h"
+#include "test_util.h"
+
+MEM_TASK(a_mem, "budget_a", 2048);
+MEM_TASK(b_mem, "budget_b", 4096);
+
+// ---- mem_budget_aggregate() ----
+
+typedef struct {
+    uint32_t stack, free_min;
+    uint32_t used, suggested;
+    mem_verdict_t verdict;
+} stack_case_t;
+
+static const stack_case_t cases[] = {
+    { 3072, UINT32_MAX, 0, 3072, MEM_STACK_UNKNOWN },  // Never sampled
+    { 3072, 4000, 0, 3072, MEM_STACK_UNKNOWN },        // Can't be: adopted with the wrong size
+    { 3072, 0, 3072, 3840, MEM_STACK_TIGHT },          // Overflowed, or about to
+    { 3072, 511, 2561, 3328, MEM_STACK_TIGHT },
+    { 3072, 512, 2560, 3328, MEM_STACK_OK },           // Headroom a quarter of what's used
+    { 1024, 800, 224, 768, MEM_STACK_OK },             // Headroom at least MEM_STACK_MIN_FREE
+    { 4095, 1791, 2304, 3072, MEM_STACK_OK },          // A byte short of MEM_STACK_SHRINK to spare
+    { 4096, 1792, 2304, 3072, MEM_STACK_LOOSE },
+    { 8192, 6000, 2192, 2816, MEM_STACK_LOOSE },
+};
+
+#define N_CASES         (sizeof(cases) / sizeof(cases[0]))
+
+static void test_verdicts(void)
+{
+    mem_task_t list[N_CASES];
+    mem_stack_t per[N_CASES];
+    mem_totals_t tot;
+    uint32_t heap = 0, used = 0, suggested = 0;
+    int tight = 0, loose = 0;
+
+    for (size_t i = 0; i < N_CASES; i++) {
+        list[i] = (mem_task_t){ .name = "t", .stack_bytes = cases[i].stack,
+                                .free_min = cases[i].free_min };
+        heap += cases[i].stack;
+        used += cases[i].used;
+        suggested += cases[i].suggested;
+        tight += cases[i].verdict == MEM_STACK_TIGHT;
+        loose += cases[i].verdict == MEM_STACK_LOOSE;
+    }
+    mem_budget_aggregate(list, N_CASES, per, &tot);
+    for (size_t i = 0; i < N_CASES; i++) {
+        CHECK_EQ(per[i].used, cases[i].used);
+        CHECK_EQ(per[i].suggested, cases[i].suggested);
+        CHECK_EQ(per[i].verdict, cases[i].verdict);
+    }
+    CHECK_EQ(tot.stack_static, 0);
+    CHECK_EQ(tot.stack_heap, heap);
+    CHECK_EQ(tot.stack_used, used);
+    CHECK_EQ(tot.stack_suggested, suggested);
+    CHECK_EQ(tot.tight, tight);
+    CHECK_EQ(tot.loose, loose);
+
+    // Every high-water mark of a 16 KB stack: a suggestion is whole
+    // MEM_STACK_ROUNDs holding the use plus its headroom, and no more
+    for (uint32_t free_min = 0; free_min <= 16384; free_min++) {
+        mem_task_t t = { .name = "t", .stack_bytes = 16384, .free_min = free_min };
+        mem_stack_t s;
+        mem_budget_aggregate(&t, 1, &s, &tot);
+        uint32_t need = s.used + (s.used / 4 > MEM_STACK_MIN_FREE ? s.used / 4 : MEM_STACK_MIN_FREE);
+        CHECK_EQ(s.used, 16384 - free_min);
+        CHECK(s.suggested % MEM_STACK_ROUND == 0);
+        CHECK(s.suggested >= need && s.suggested < need + MEM_STACK_ROUND);
+        CHECK_EQ(s.verdict, free_min < MEM_STACK_MIN_FREE ? MEM_STACK_TIGHT :
+                            16384 >= s.suggested + MEM_STACK_SHRINK ? MEM_STACK_LOOSE :
+                            MEM_STACK_OK);
+    }
+    CHECK(strcmp(mem_verdict_name(MEM_STACK_LOOSE), "loose") == 0);
+}
+
+// ---- Static tasks ----
+
+static void ends_itself(void *arg)
+{
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    mem_task_end(arg);
+    CHECK(false);                     // Suspended until reaped
+}
+
+static void waits(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+static const mem_task_t *find(const mem_task_t *list, int n, const char *name)
+{
+    for (int i = 0; i < n; i++) {
+        if (strcmp(list[i].name, name) == 0) {
+            return &list[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_static(void)
+{
+    mem_task_t list[MEM_MAX_TASKS];
+    mem_stack_t per[MEM_MAX_TASKS];
+    mem_totals_t tot;
+    TaskHandle_t a, b, fw;
+
+    // The storage is the declaration's own, sized in bytes
+    CHECK(MEM_STATIC);
+    CHECK(a_mem.stack == a_mem_stack && a_mem.tcb == &a_mem_tcb);
+    CHECK_EQ(sizeof(b_mem_stack), 4096);
+    CHECK_EQ(mem_budget_snapshot(list, MEM_MAX_TASKS), 0);
+
+    CHECK(mem_task_start(&a_mem, ends_itself, &a_mem, 5, 0, &a) == ESP_OK);
+    CHECK(a == (TaskHandle_t)&a_mem_tcb);
+    CHECK(mem_task_start(&a_mem, ends_itself, &a_mem, 5, 0, NULL) == ESP_ERR_INVALID_STATE);
+    CHECK(mem_task_start(&b_mem, waits, NULL, 5, 1, &b) == ESP_OK);
+    CHECK(b == (TaskHandle_t)&b_mem_tcb);
+
+    // A framework task, by name, on the heap; one that doesn't exist isn't counted
+    CHECK(xTaskCreatePinnedToCore(waits, "budget_fw", 6000, NULL, 5, &fw, 0) == pdPASS);
+    mem_task_adopt("budget_fw", 6000);
+    mem_task_adopt("budget_none", 1000);
+    host_settle();
+
+    host_task_set_stack_free(a, 300);
+    host_task_set_stack_free(b, 3000);
+    host_task_set_stack_free(fw, 1500);
+    int n = mem_budget_snapshot(list, MEM_MAX_TASKS);
+    CHECK_EQ(n, 3);
+    CHECK_EQ(mem_budget_snapshot(list, 2), 2);  // Never more than asked for
+    n = mem_budget_snapshot(list, MEM_MAX_TASKS);
+    CHECK(find(list, n, "budget_none") == NULL);
+    CHECK_EQ(find(list, n, "budget_a")->free_min, 300);
+    CHECK(find(list, n, "budget_a")->stack == a_mem_stack);
+    CHECK(find(list, n, "budget_fw")->stack == NULL);
+    mem_budget_aggregate(list, n, per, &tot);
+    CHECK_EQ(tot.stack_static, 2048 + 4096);
+    CHECK_EQ(tot.stack_heap, 6000);
+    CHECK_EQ(tot.stack_used, 1748 + 1096 + 4500);
+    CHECK_EQ(tot.tight, 1);
+    CHECK_EQ(tot.loose, 1);           // b: 1096 used of 4096
+    CHECK_EQ(mem_budget_check(), 1);
+
+    // a ends itself: suspended, its high-water mark kept, not running
+    xTaskNotifyGive(a);
+    host_settle();
+    CHECK(eTaskGetState(a) == eSuspended);
+    n = mem_budget_snapshot(list, MEM_MAX_TASKS);
+    CHECK(find(list, n, "budget_a")->handle == NULL);
+    CHECK_EQ(find(list, n, "budget_a")->free_min, 300);
+    mem_task_end(&a_mem);             // Already ended: nothing to do
+
+    // Started again in the same storage, after the old run is reaped;
+    // registered once, sampled afresh
+    CHECK(mem_task_start(&a_mem, ends_itself, &a_mem, 5, 1, &a) == ESP_OK);
+    CHECK(a == (TaskHandle_t)&a_mem_tcb);
+    host_settle();
+    CHECK(eTaskGetState(a) == eBlocked);
+    n = mem_budget_snapshot(list, MEM_MAX_TASKS);
+    CHECK_EQ(n, 3);
+    CHECK_EQ(find(list, n, "budget_a")->free_min, 2048 / 4);
+    CHECK_EQ(mem_budget_check(), 0);
+
+    // b is ended by another task, mid-wait
+    mem_task_end(&b_mem);
+    CHECK(eTaskGetState(b) == eDeleted);
+    n = mem_budget_snapshot(list, MEM_MAX_TASKS);
+    CHECK(find(list, n, "budget_b")->handle == NULL);
+    CHECK_EQ(find(list, n, "budget_b")->free_min, 3000);
+    CHECK(mem_task_start(&b_mem, waits, NULL, 5, 1, &b) == ESP_OK);
+    host_settle();
+    CHECK(eTaskGetState(b) == eBlocked);
+    CHECK_EQ(mem_budget_snapshot(list, MEM_MAX_TASKS), 3);
+
+    // Registering stops at MEM_MAX_TASKS; the tasks still run
+    for (int i = 0; i < MEM_MAX_TASKS; i++) {
+        mem_task_adopt("budget_fw", 6000);
+    }
+    CHECK_EQ(mem_budget_snapshot(list, MEM_MAX_TASKS), MEM_MAX_TASKS);
+    printf("static: %lu bytes of stacks, %lu from the heap\n", (unsigned long)tot.stack_static,
+           (unsigned long)tot.stack_heap);
+}
+
+// ---- tools/mem_budget.py ----
+
+static char dir[] = "/tmp/test_budget_XXXXXX";
+
+static void write_file(const char *name, const char *text)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    CHECK(f != NULL);
+    fputs(text, f);
+    fclose(f);
+}
+
+// Two modules, sized through a #define, sdkconfig, and a plain number;
+// z_mem is left out of the map, as the linker drops a feature that's off
+static const char x_c[] =
+    "#define X_STACK (2 * X_UNIT)   // Bytes\n"
+    "#define X_UNIT 1024\n"
+    "MEM_TASK(x_mem, \"x\", X_STACK);\n";
+static const char y_c[] =
+    "MEM_TASK(y_mem, \"y\", CONFIG_Y_STACK + 512);\n"
+    "MEM_TASK(z_mem, \"z\", 1024);\n";
+
+static const char sdkconfig_common[] =
+    "CONFIG_Y_STACK=2560\n"
+    "CONFIG_PLANTDOC_HTTPD_STACK=8192\n"
+    "CONFIG_FREERTOS_IDLE_TASK_STACKSIZE=1536\n"
+    "CONFIG_ESP_WIFI_STATIC_RX_BUFFER_NUM=10\n"
+    "CONFIG_ESP_WIFI_DYNAMIC_RX_BUFFER_NUM=32\n"
+    "CONFIG_ESP_WIFI_DYNAMIC_TX_BUFFER_NUM=32\n";
+
+// Input sections as ld prints them: name and placement on one line, or the
+// name alone when it's long; only the app's RAM sections count
+static const char map_common[] =
+    "Archive member included to satisfy reference by file (symbol)\n"
+    "\n"
+    "Linker script and memory map\n"
+    "\n"
+    " .data.x_mem    0x3ffb0000       0x30 esp-idf/main/libmain.a(x.c.obj)\n"
+    " .data.y_mem    0x3ffb0030       0x30 esp-idf/main/libmain.a(y.c.obj)\n"
+    " .bss.ring_with_a_name_too_long_for_one_line\n"
+    "                0x3ffb0060      0x400 esp-idf/main/libmain.a(y.c.obj)\n"
+    " .dram1.3       0x3ffb0460       0x20 esp-idf/main/libmain.a(x.c.obj)\n"
+    "                0x3ffb0460                table\n"
+    " .bss.empty     0x3ffb0480        0x0 esp-idf/main/libmain.a(x.c.obj)\n"
+    " .text.x_task   0x400d0000      0x100 esp-idf/main/libmain.a(x.c.obj)\n"
+    " .bss.pool      0x3ffb0480      0x800 esp-idf/lwip/liblwip.a(pbuf.c.obj)\n";
+
+static const char map_static[] =
+    " .bss.x_mem_stack\n"
+    "                0x3ffb1000      0x800 esp-idf/main/libmain.a(x.c.obj)\n"
+    " .bss.x_mem_tcb 0x3ffb1800      0x160 esp-idf/main/libmain.a(x.c.obj)\n"
+    " .bss.y_mem_stack\n"
+    "                0x3ffb1960      0xc00 esp-idf/main/libmain.a(y.c.obj)\n"
+    " .bss.y_mem_tcb 0x3ffb2560      0x160 esp-idf/main/libmain.a(y.c.obj)\n";
+
+// The report's line that starts with label, and its first number
+static long report_value(const char *report, const char *label)
+{
+    for (const char *p = report; p; p = strchr(p, '\n')) {
+        p += *p == '\n';
+        if (strncmp(p, label, strlen(label)) == 0) {
+            return strtol(p + strlen(label), NULL, 10);
+        }
+    }
+    fprintf(stderr, "no \"%s\" in the report:\n%s", label, report);
+    exit(1);
+}
+
+// Run the tool; returns the report, as printed and as written to the file
+static char *run_tool(const char *main_dir, const char *sdkconfig)
+{
+    static char out[16384];
+    char cmd[1024], path[256];
+    size_t len = 0;
+
+    snprintf(path, sizeof(path), "%s/report.txt", dir);
+    snprintf(cmd, sizeof(cmd), "%s %s/tools/mem_budget.py %s/app.map %s %s %s", HOST_PYTHON,
+             HOST_SOURCE_DIR, dir, main_dir, sdkconfig, path);
+    FILE *p = popen(cmd, "r");
+    CHECK(p != NULL);
+    while ((len += fread(out + len, 1, sizeof(out) - 1 - len, p)) < sizeof(out) - 1 && !feof(p)) {
+    }
+    out[len] = 0;
+    CHECK(pclose(p) == 0);
+
+    char file[sizeof(out)];
+    FILE *f = fopen(path, "r");
+    CHECK(f != NULL);
+    file[fread(file, 1, sizeof(file) - 1, f)] = 0;
+    fclose(f);
+    CHECK(strcmp(file, out) == 0);
+    unlink(path);
+    return out;
+}
+
+static void make_tree(const char *sdkconfig, const char *map)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/sdkconfig", dir);
+    FILE *f = fopen(path, "w");
+    CHECK(f != NULL);
+    fputs(sdkconfig_common, f);
+    fputs(sdkconfig, f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/app.map", dir);
+    f = fopen(path, "w");
+    CHECK(f != NULL);
+    fputs(map_common, f);
+    fputs(map, f);
+    fclose(f);
+}
+
+static void test_tool(void)
+{
+    char sdkconfig[256];
+    const long app = 0x30 + 0x30 + 0x400 + 0x20;     // x_mem, y_mem, ring, table
+    const long framework = 8192 + 2 * 1536;
+    const long wifi = 10 * 1600;
+
+    CHECK(mkdtemp(dir) != NULL);
+    write_file("x.c", x_c);
+    write_file("y.c", y_c);
+    snprintf(sdkconfig, sizeof(sdkconfig), "%s/sdkconfig", dir);
+
+    // Heap stacks: counted on their own, the static regions are the rest
+    make_tree("# CONFIG_PLANTDOC_STATIC_ALLOC is not set\n", "");
+    const char *r = run_tool(dir, sdkconfig);
+    CHECK(strstr(r, "Memory budget (heap task stacks)") != NULL);
+    CHECK(strstr(r, "  x            x.c                  2048  heap\n") != NULL);
+    CHECK(strstr(r, "  y            y.c                  3072  heap\n") != NULL);
+    CHECK(strstr(r, "  z            y.c                  1024  not built\n") != NULL);
+    CHECK(strstr(r, "ring_with_a_name_too_long_for_one_line") != NULL);
+    CHECK(strstr(r, "    table ") != NULL);
+    CHECK(strstr(r, "pool") == NULL && strstr(r, "x_task") == NULL && strstr(r, "empty") == NULL);
+    CHECK_EQ(report_value(r, "Static regions, app:"), app);
+    CHECK_EQ(report_value(r, "  of which task stacks"), 0);
+    CHECK_EQ(report_value(r, "App stacks from heap"), 2048 + 3072);
+    CHECK_EQ(report_value(r, "Framework stacks"), framework);
+    CHECK_EQ(report_value(r, "Wi-Fi buffers at init"), wifi);
+    CHECK_EQ(report_value(r, "Committed"), app + 2048 + 3072 + framework + wifi);
+
+    // Static stacks: regions of their own, marked, and counted only once
+    make_tree("CONFIG_PLANTDOC_STATIC_ALLOC=y\n", map_static);
+    r = run_tool(dir, sdkconfig);
+    const long stacks = 0x800 + 0xc00, tcbs = 2 * 0x160;
+    CHECK(strstr(r, "Memory budget (static task stacks)") != NULL);
+    CHECK(strstr(r, "  x            x.c                  2048  static\n") != NULL);
+    CHECK(strstr(r, "  y            y.c                  3072  static\n") != NULL);
+    CHECK(strstr(r, "  z            y.c                  1024  not built\n") != NULL);
+    CHECK(strstr(r, "y_mem_stack                        3072  stack of y\n") != NULL);
+    CHECK(strstr(r, "x_mem_tcb                           352  TCB of x\n") != NULL);
+    CHECK_EQ(report_value(r, "Static regions, app:"), app + stacks + tcbs);
+    CHECK_EQ(report_value(r, "  of which task stacks"), 2048 + 3072);
+    CHECK_EQ(report_value(r, "App stacks from heap"), 0);
+    CHECK_EQ(report_value(r, "Committed"), app + stacks + tcbs + framework + wifi);
+
+    // main/ as it is: every declaration found and sized through its file
+    // and the project's sdkconfig, none built without a map
+    char cmd[512], line[64];
+    snprintf(cmd, sizeof(cmd), "cat %s/main/*.c | grep -c '^MEM_TASK('", HOST_SOURCE_DIR);
+    FILE *p = popen(cmd, "r");
+    CHECK(p != NULL && fgets(line, sizeof(line), p));
+    pclose(p);
+    int declared = atoi(line);
+    CHECK(declared >= 9);
+    make_tree("", "");
+    snprintf(sdkconfig, sizeof(sdkconfig), "%s/sdkconfig", HOST_SOURCE_DIR);
+    snprintf(cmd, sizeof(cmd), "%s/main", HOST_SOURCE_DIR);
+    r = run_tool(cmd, sdkconfig);
+    int not_built = 0;
+    for (const char *q = r; (q = strstr(q, "  not built\n")); q++) {
+        not_built++;
+    }
+    CHECK_EQ(not_built, declared);
+    CHECK(strstr(r, "  pump_ctrl    pump_ctrl.c          3072  not built\n") != NULL);
+    CHECK(strstr(r, "  httpd        sdkconfig            8192\n") != NULL);
+    printf("main/: %d tasks declared, %ld bytes of framework stacks\n", declared,
+           report_value(r, "Framework stacks"));
+
+    snprintf(cmd, sizeof(cmd), "rm -r %s", dir);
+    CHECK(system(cmd) == 0);
+}
+
+int main(void)
+{
+    test_verdicts();
+    test_static();
+    test_tool();
+    printf("test_budget: ok\n");
+    return 0;
+}
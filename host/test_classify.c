@@ -0,0 +1,212 @@
+// The embedded classifier on images it was not fitted on: tom.png and
+// sugarcane.png decoded whole on the device path get their disease and
+// spray PWM, and held-out images that are neither photo (flat colours,
+// gradients, noise, tiles, the photos recoloured or drained) mostly land in
+// no_match. The rest are why ?spray=1 is off by default: /upload and
+// /classify refuse it and the pump stays off. Reports the false disease
+// rate, per-layer latency and the arena peak.
+
+#include <string.h>
+#include "classify.h"
+#include "httpd_mock.h"
+#include "img_decode.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define PX              (IMG_OUT_SIZE * IMG_OUT_SIZE)
+#define NEGATIVES       120           // Of each of the six kinds: 20
+#define MAX_FALSE       (NEGATIVES / 20)  // Confident diseases among them, 5 %
+#define RUNS            200
+
+static img_decoder_t dec;
+static uint32_t seed = 0x2545F491;    // Not the training script's stream
+
+static uint32_t rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+
+    CHECK(f != NULL);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*len);
+    CHECK(fread(buf, 1, *len, f) == *len);
+    fclose(f);
+    return buf;
+}
+
+static void decode(const uint8_t *png, size_t len, uint8_t *rgb)
+{
+    const img_result_t *img;
+
+    img_decode_begin(&dec);
+    CHECK(img_decode_feed(&dec, png, len) == ESP_OK);
+    CHECK(img_decode_end(&dec, &img) == ESP_OK);
+    memcpy(rgb, img->rgb, sizeof(img->rgb));
+}
+
+// One of six kinds of image that is neither leaf, the last two made from
+// the decoded photos
+static void negative(int i, uint8_t photos[2][PX * 3], uint8_t *rgb)
+{
+    uint8_t a[3], b[3];
+    const uint8_t *src = photos[rnd() & 1];
+    int tile = rnd() & 1 ? 4 : 8;
+    uint32_t tile_seed = rnd();
+
+    for (int c = 0; c < 3; c++) {
+        a[c] = rnd();
+        b[c] = rnd();
+    }
+    for (int p = 0; p < PX; p++) {
+        int x = p % IMG_OUT_SIZE, y = p / IMG_OUT_SIZE;
+        uint8_t *o = rgb + 3 * p;
+        const uint8_t *s = src + 3 * p;
+        switch (i % 6) {
+        case 0:                       // Flat colour
+            memcpy(o, a, 3);
+            break;
+        case 1:                       // Gradient
+            for (int c = 0; c < 3; c++) {
+                o[c] = a[c] + (b[c] - a[c]) * x / (IMG_OUT_SIZE - 1);
+            }
+            break;
+        case 2:                       // Noise
+            for (int c = 0; c < 3; c++) {
+                o[c] = rnd();
+            }
+            break;
+        case 3: {                     // Random tiles
+            uint32_t h = tile_seed ^ ((y / tile) * 131 + (x / tile)) * 2654435761u;
+            o[0] = h >> 8;
+            o[1] = h >> 16;
+            o[2] = h >> 24;
+            break;
+        }
+        case 4:                       // Photo with red and blue swapped
+            o[0] = s[2];
+            o[1] = s[1];
+            o[2] = s[0];
+            break;
+        default:                      // Photo in grey
+            o[0] = o[1] = o[2] = (299 * s[0] + 587 * s[1] + 114 * s[2]) / 1000;
+            break;
+        }
+    }
+}
+
+static bool post(const char *uri, const void *body, size_t len, int *status)
+{
+    host_http_t h;
+
+    host_http_init(&h, HTTP_POST, uri);
+    host_http_set_body(&h, body, len);
+    h.recv_max = 1400;                // One TCP segment at a time
+    esp_err_t err = host_http_run(&h);
+    *status = host_http_status(&h);
+    CHECK((err == ESP_OK) == (*status == 200));
+    bool sprayed = h.resp && strstr((char *)h.resp, "\"sprayed\":true") != NULL;
+    host_http_free(&h);
+    host_settle();
+    return sprayed;
+}
+
+int main(void)
+{
+    static const struct {
+        const char *file;
+        const char *label;
+    } photos[] = {
+        { HOST_SOURCE_DIR "/main/www/tom.png", "tomato_early_blight" },
+        { HOST_SOURCE_DIR "/main/www/sugarcane.png", "sugarcane_red_rot" },
+    };
+    static uint8_t photo_rgb[2][PX * 3];
+    uint8_t rgb[PX * 3];
+    classify_result_t res;
+    int status;
+
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(classify_init() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+    CHECK_EQ(classify_input_size(), sizeof(rgb));
+
+    // The photos: their disease, confidently, and the pump at its PWM
+    for (int i = 0; i < 2; i++) {
+        size_t len;
+        uint8_t *png = read_file(photos[i].file, &len);
+        decode(png, len, photo_rgb[i]);
+        CHECK(classify_rgb(photo_rgb[i], &res) == ESP_OK);
+        printf("%-14s %-20s %.3f\n", strrchr(photos[i].file, '/') + 1, res.label->name,
+               res.confidence);
+        CHECK(strcmp(res.label->name, photos[i].label) == 0);
+        CHECK(res.spray && classify_spray_pwm(&res, CLASSIFY_LESION_FULL_PERMILLE) > 0);
+
+        CHECK(!post("/upload", png, len, &status));
+        CHECK_EQ(status, 200);
+        CHECK(!post("/upload?spray=1", png, len, &status));
+        CHECK_EQ(status, 403);
+        CHECK_EQ(pump_get_speed(), 0);
+        free(png);
+    }
+
+    // Held-out images that are neither: no_match, or too unsure, nearly always
+    int rejected = 0, unsure = 0, wrong = 0, worst = -1;
+    float worst_conf = 0;
+    for (int i = 0; i < NEGATIVES; i++) {
+        negative(i, photo_rgb, rgb);
+        CHECK(classify_rgb(rgb, &res) == ESP_OK);
+        CHECK_EQ(classify_spray_pwm(&res, CLASSIFY_LESION_FULL_PERMILLE) > 0, res.spray);
+        rejected += res.label->pwm == 0;
+        unsure += res.label->pwm != 0 && !res.spray;
+        wrong += res.spray;
+        if (res.spray && res.confidence > worst_conf) {
+            worst = i;
+            worst_conf = res.confidence;
+        }
+    }
+    printf("%d held-out non-leaf images: %d no_match, %d below %.0f %% confidence, "
+           "%d taken for a disease", NEGATIVES, rejected, unsure,
+           CLASSIFY_MIN_CONFIDENCE * 100, wrong);
+    if (worst >= 0) {
+        printf(" (worst: kind %d at %.3f)", worst % 6, worst_conf);
+    }
+    printf("\n");
+    CHECK(wrong <= MAX_FALSE);
+
+    // Which is why the endpoints won't act on ?spray=1
+    negative(2, photo_rgb, rgb);
+    CHECK(!post("/classify?spray=1", rgb, sizeof(rgb), &status));
+    CHECK_EQ(status, 403);
+    CHECK(!post("/classify", rgb, sizeof(rgb), &status));
+    CHECK_EQ(status, 200);
+    CHECK_EQ(pump_get_speed(), 0);
+
+    // Per-layer latency, best of RUNS
+    uint32_t best[NN_MAX_LAYERS];
+    memset(best, 0xff, sizeof(best));
+    for (int r = 0; r < RUNS; r++) {
+        CHECK(classify_rgb(photo_rgb[r & 1], &res) == ESP_OK);
+        for (int l = 0; l < classify_layer_count(); l++) {
+            best[l] = res.nn.layer_us[l] < best[l] ? res.nn.layer_us[l] : best[l];
+        }
+    }
+    uint32_t total = 0;
+    for (int l = 0; l < classify_layer_count(); l++) {
+        printf("layer %d: %u us\n", l, best[l]);
+        total += best[l];
+    }
+    printf("total %u us, arena peak %zu bytes\n", total, classify_peak_bytes());
+    printf("test_classify: ok\n");
+    return 0;
+}
@@ -0,0 +1,221 @@
+// /events fan-out on the manual clock: a subscriber gets the state as soon
+// as it connects; a burst of changes goes out at most once per interval,
+// formatted once and sent once to each subscriber; an idle stream only gets
+// its keepalive; a peer that can't take a whole frame is dropped without
+// holding up the others, and its slot serves the next page; a full table
+// answers 503. Reports the sends a burst costs, and the httpd task's CPU
+// and bytes per subscriber for each frame with 1 to 8 subscribers (the mock
+// socket takes a send for free, so that's the server's own share).
+
+#include <string.h>
+#include "esp_timer.h"
+#include "httpd_mock.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "state_events.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define INTERVAL_US     (CONFIG_PLANTDOC_SSE_INTERVAL_MS * 1000LL)
+#define BURST_MS        1000          // One speed change per millisecond
+#define KEEPALIVE_S     15
+#define COST_FRAMES     500
+
+static int fds[STATE_EVENTS_MAX_CLIENTS];
+static int n_subs;
+
+// GET /events; the status it answered with
+static int subscribe(int *fd)
+{
+    host_http_t h;
+
+    host_http_init(&h, HTTP_GET, "/events");
+    CHECK(host_http_run(&h) == ESP_OK);
+    int status = host_http_status(&h);
+    if (h.raw) {
+        const char *r = (const char *)h.resp;
+        CHECK(strncmp(r, "HTTP/1.1 200 OK\r\n", 17) == 0);
+        CHECK(strstr(r, "Content-Type: text/event-stream\r\n") != NULL);
+        CHECK(strstr(r, "\r\n\r\nretry: ") != NULL);
+        CHECK(strstr(r, "event: state\n") != NULL && strstr(r, "\"duty\":[") != NULL);
+        status = 200;
+    }
+    *fd = h.fd;
+    host_http_free(&h);
+    host_settle();
+    return status;
+}
+
+static void unsubscribe_all(void)
+{
+    for (int i = 0; i < n_subs; i++) {
+        host_http_close(fds[i]);
+    }
+    host_settle();
+    n_subs = 0;
+}
+
+static void advance_ms(int ms)
+{
+    for (int i = 0; i < ms; i++) {
+        host_advance_us(1000);
+    }
+    host_settle();
+}
+
+static uint32_t sends(int fd)
+{
+    return host_sock(fd)->sends;
+}
+
+// The last frame a subscriber got, from its output tail
+static const char *last_frame(int fd, char buf[HOST_SOCK_KEEP + 1])
+{
+    host_sock_t *s = host_sock(fd);
+
+    memcpy(buf, s->last, s->last_len);
+    buf[s->last_len] = '\0';
+    char *p = buf, *q;
+    while ((q = strstr(p + 1, "event: state\n")) != NULL) {
+        p = q;
+    }
+    return p;
+}
+
+static httpd_handle_t server;
+
+static void stamp_work(void *arg)
+{
+    *(int64_t *)arg = host_thread_ns();
+}
+
+// CPU time the httpd task has used so far, read in the task itself
+static int64_t httpd_cpu_ns(void)
+{
+    int64_t ns;
+
+    CHECK(httpd_queue_work(server, stamp_work, &ns) == ESP_OK);
+    host_settle();
+    return ns;
+}
+
+static char buf[HOST_SOCK_KEEP + 1], first[HOST_SOCK_KEEP + 1];
+
+static void test_fan_out(void)
+{
+    uint32_t before[STATE_EVENTS_MAX_CLIENTS];
+    int extra;
+
+    for (n_subs = 0; n_subs < STATE_EVENTS_MAX_CLIENTS; n_subs++) {
+        CHECK_EQ(subscribe(&fds[n_subs]), 200);
+    }
+    CHECK_EQ(subscribe(&extra), 503);
+
+    // Nothing changed since connecting: nothing more to send
+    advance_ms(5000);
+    for (int i = 0; i < n_subs; i++) {
+        CHECK_EQ(sends(fds[i]), 0);
+    }
+
+    // A second of changes, one per millisecond: one frame per interval at
+    // most, each subscriber sent each frame once, the last one current
+    for (int ms = 1; ms <= BURST_MS; ms++) {
+        CHECK(pump_ctrl_set_speed(1 + ms % 255) == ESP_OK);
+        host_advance_us(1000);
+    }
+    advance_ms(2 * CONFIG_PLANTDOC_SSE_INTERVAL_MS);
+    uint32_t frames = sends(fds[0]);
+    CHECK(frames >= BURST_MS * 1000 / INTERVAL_US - 1);
+    CHECK(frames <= BURST_MS * 1000 / INTERVAL_US + 1);
+    char want[32];
+    snprintf(want, sizeof(want), "\"duty\":[%d", 1 + BURST_MS % 255);
+    for (int i = 0; i < n_subs; i++) {
+        CHECK_EQ(sends(fds[i]), frames);
+        CHECK(strstr(last_frame(fds[i], buf), want) != NULL);
+        CHECK(strstr(last_frame(fds[i], buf), "\"mode\":\"manual\"") != NULL);
+    }
+    printf("burst: %d changes in %d ms -> %u frames, %u sends to %d subscribers "
+           "(%d uncoalesced)\n", BURST_MS, BURST_MS, frames, frames * n_subs, n_subs,
+           BURST_MS * n_subs);
+
+    // Idle: a keepalive comment once the stream has been quiet long enough
+    for (int i = 0; i < n_subs; i++) {
+        before[i] = sends(fds[i]);
+    }
+    advance_ms((KEEPALIVE_S - 1) * 1000);
+    CHECK_EQ(sends(fds[0]), before[0]);
+    advance_ms(2000);
+    for (int i = 0; i < n_subs; i++) {
+        host_sock_t *s = host_sock(fds[i]);
+        CHECK_EQ(s->sends, before[i] + 1);
+        CHECK(s->last_len >= 13 && memcmp(s->last + s->last_len - 13, ": keepalive\n\n", 13) == 0);
+    }
+
+    // A peer taking only part of a frame is dropped; the others still get it
+    host_sock(fds[3])->send_limit = 16;
+    for (int i = 0; i < n_subs; i++) {
+        before[i] = sends(fds[i]);
+    }
+    pump_ctrl_stop();
+    advance_ms(2 * CONFIG_PLANTDOC_SSE_INTERVAL_MS);
+    CHECK(host_sock(fds[3])->closed);
+    for (int i = 0; i < n_subs; i++) {
+        CHECK_EQ(sends(fds[i]), before[i] + 1);
+        if (i != 3) {
+            CHECK(!host_sock(fds[i])->closed);
+            CHECK(strstr(last_frame(fds[i], buf), "\"mode\":\"idle\"") != NULL);
+        }
+    }
+    // Its slot takes the next page
+    CHECK_EQ(subscribe(&fds[3]), 200);
+    CHECK_EQ(subscribe(&extra), 503);
+    unsubscribe_all();
+}
+
+// httpd task CPU for one state frame going out to subs subscribers
+static double frame_cost_ns(int subs)
+{
+    for (n_subs = 0; n_subs < subs; n_subs++) {
+        CHECK_EQ(subscribe(&fds[n_subs]), 200);
+    }
+    uint32_t sent0 = sends(fds[0]);
+    uint64_t bytes0 = host_sock(fds[0])->bytes;
+    int64_t t0 = httpd_cpu_ns();
+    for (int f = 0; f < COST_FRAMES; f++) {
+        CHECK(pump_ctrl_set_speed(1 + f % 255) == ESP_OK);
+        host_settle();
+        host_advance_us(INTERVAL_US);
+        host_settle();
+    }
+    double ns = (double)(httpd_cpu_ns() - t0) / COST_FRAMES;
+    CHECK_EQ(sends(fds[0]) - sent0, COST_FRAMES);
+    // Formatted once: every subscriber holds the same last frame, id and all
+    for (int i = 1; i < subs; i++) {
+        CHECK_EQ(sends(fds[i]), sends(fds[0]));
+        CHECK(strcmp(last_frame(fds[i], buf), last_frame(fds[0], first)) == 0);
+    }
+    printf("%d subscriber%-2s %6.2f us/frame, %3.0f bytes each\n", subs, subs > 1 ? "s:" : ":",
+           ns / 1000, (double)(host_sock(fds[0])->bytes - bytes0) / COST_FRAMES);
+    unsubscribe_all();
+    return ns;
+}
+
+int main(void)
+{
+    host_clock_manual();
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    server = start_webserver();
+    CHECK(server != NULL);
+
+    test_fan_out();
+
+    double one = frame_cost_ns(1);
+    frame_cost_ns(2);
+    frame_cost_ns(4);
+    double all = frame_cost_ns(STATE_EVENTS_MAX_CLIENTS);
+    printf("each subscriber past the first: %.1f us/frame\n",
+           (all - one) / (STATE_EVENTS_MAX_CLIENTS - 1) / 1000);
+    printf("test_events: ok\n");
+    return 0;
+}
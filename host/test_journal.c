@@ -0,0 +1,416 @@
+// The journal on a mocked flash partition, across reboots: every boot is a
+// forked child that starts from the image the last one left, so the
+// module's statics start over as they do on the device. Checks the flash
+// traffic the write-behind design promises: repeated settings coalesce into
+// one page, sessions go down in batches, a flush is two program calls and
+// a sector is erased once per sector-full, round-robin. State and sessions
+// come back after a reboot, and power lost mid-page or between a sector
+// header and its snapshot costs at most the flush being written. Reports
+// flash traffic per event and boot replay time and reads against how full
+// the ring is.
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "hal_mock.h"
+#include "journal.h"
+#include "test_util.h"
+
+#define PART_SIZE       0x10000       // partitions.csv
+#define MAX_SIZE        (64 * HAL_FLASH_SECTOR)
+#define SESSIONS        4000
+#define SESSION_GAP_S   600
+#define REPLAY_RUNS     20
+
+// As journal.c lays them out
+typedef struct {
+    uint32_t magic, seq, reserved, crc;
+} sector_hdr_t;
+
+typedef struct {
+    uint16_t magic, len;
+    uint32_t crc;
+} page_hdr_t;
+
+#define PAGE_SIZE(len)  ((sizeof(page_hdr_t) + (len) + 15) & ~15u)
+
+// Shared with the boots
+typedef struct {
+    uint8_t image[MAX_SIZE];
+    uint32_t size;
+    journal_state_t state;            // After the boot's work
+    journal_stats_t stats;
+    hal_mock_flash_stats_t flash;     // The whole boot
+    uint64_t replay_read;             // Bytes journal_init read
+    int32_t mark;                     // Whatever the work reports
+} boot_t;
+
+static boot_t *shm;
+
+// What the next boot is told to expect, set before the fork
+static journal_state_t want;
+static uint32_t n_sessions;
+
+// One boot from shm->image: journal_init, then run, then everything back
+// into shm. Checks inside run end the child; the parent sees that.
+static void boot(bool manual_clock, void (*run)(void))
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        hal_mock_journal_init(shm->size);
+        memcpy(hal_mock_journal_data(), shm->image, shm->size);
+        if (manual_clock) {
+            host_clock_manual();
+        }
+        CHECK(journal_init() == ESP_OK);
+        shm->replay_read = hal_mock_journal_stats.bytes_read;
+        if (run) {
+            run();
+        }
+        host_settle();
+        journal_get_state(&shm->state);
+        journal_get_stats(&shm->stats);
+        shm->flash = hal_mock_journal_stats;
+        memcpy(shm->image, hal_mock_journal_data(), shm->size);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void erase_image(uint32_t size)
+{
+    shm->size = size;
+    memset(shm->image, 0xFF, size);
+}
+
+static bool sector_hdr(uint32_t sector, sector_hdr_t *h)
+{
+    memcpy(h, shm->image + sector * HAL_FLASH_SECTOR, sizeof(*h));
+    return h->magic == 0x314e524au;
+}
+
+static uint32_t newest_sector(void)
+{
+    uint32_t best = 0, best_seq = 0;
+    sector_hdr_t h;
+
+    for (uint32_t s = 0; s < shm->size / HAL_FLASH_SECTOR; s++) {
+        if (sector_hdr(s, &h) && h.seq > best_seq) {
+            best = s;
+            best_seq = h.seq;
+        }
+    }
+    CHECK(best_seq > 0);
+    return best;
+}
+
+static void check_state(const journal_state_t *got)
+{
+    CHECK(memcmp(got->keys, want.keys, sizeof(want.keys)) == 0);
+    CHECK_EQ(got->sessions, want.sessions);
+    CHECK_EQ(got->spray_ms, want.spray_ms);
+}
+
+// --- Boots -----------------------------------------------------------------
+
+static void first_flush(void)
+{
+    CHECK_EQ(journal_get(JKEY_BOOT_COUNT), 1);
+    host_settle();
+    CHECK_EQ(hal_mock_journal_stats.writes, 0);    // Nothing due yet
+    CHECK(journal_flush() == ESP_OK);
+    CHECK_EQ(hal_mock_journal_stats.erases, 1);
+    CHECK_EQ(hal_mock_journal_stats.writes, 3);    // Sector header, page header, page
+}
+
+// A thousand changes to two settings within a minute: one page, when the
+// first change is a minute old
+static void coalesce(void)
+{
+    CHECK(journal_flush() == ESP_OK);              // The boot count
+    hal_mock_flash_stats_t f = hal_mock_journal_stats;
+
+    for (int i = 0; i < 1000; i++) {
+        journal_set(JKEY_PWM_PROFILE, i % 3);
+        journal_set(JKEY_BRAKE_MS, i);
+        host_advance_us(50 * 1000);
+    }
+    CHECK_EQ(hal_mock_journal_stats.writes, f.writes);
+    host_advance_us((JOURNAL_FLUSH_MS - 50000 + 1000) * 1000LL);
+    CHECK_EQ(hal_mock_journal_stats.writes, f.writes + 2);
+    CHECK_EQ(hal_mock_journal_stats.erases, f.erases);
+
+    // Changed and changed back: nothing to write
+    journal_set(JKEY_BRAKE_MS, 5);
+    journal_set(JKEY_BRAKE_MS, 999);
+    host_advance_us((JOURNAL_FLUSH_MS + 1000) * 1000LL);
+    CHECK(journal_flush() == ESP_OK);
+    CHECK_EQ(hal_mock_journal_stats.writes, f.writes + 2);
+}
+
+// Sessions wait for a batch, with no clock running
+static void batch_sessions(void)
+{
+    journal_state_t st;
+
+    journal_get_state(&st);
+    check_state(&st);
+    hal_mock_flash_stats_t f = hal_mock_journal_stats;
+    for (int i = 0; i < JOURNAL_SESSION_BATCH - 1; i++) {
+        journal_log_session(i, 1000, 200);
+        host_settle();
+    }
+    CHECK_EQ(hal_mock_journal_stats.writes, f.writes);
+    journal_log_session(JOURNAL_SESSION_BATCH, 1000, 200);
+    host_settle();
+    CHECK_EQ(hal_mock_journal_stats.writes, f.writes + 2);
+}
+
+// Months of use: a session every ten minutes, a speed change every third
+static void season(void)
+{
+    for (uint32_t i = 0; i < n_sessions; i++) {
+        journal_log_session(i * SESSION_GAP_S, 1000 + i % 7000, 255 - i % 200);
+        if (i % 3 == 0) {
+            journal_set(JKEY_LAST_SPEED + i % PUMP_MAX_CHANNELS, i % 255 + 1);
+        }
+        host_settle();
+    }
+    CHECK(journal_flush() == ESP_OK);
+}
+
+typedef struct {
+    uint32_t n;
+    journal_session_t last;
+    bool ordered;
+} visited_t;
+
+static bool visit(const journal_session_t *s, void *ctx)
+{
+    visited_t *v = ctx;
+
+    if (v->n > 0 && s->start_s != v->last.start_s + SESSION_GAP_S) {
+        v->ordered = false;
+    }
+    v->last = *s;
+    v->n++;
+    return true;
+}
+
+// After the season: the state as left, and the newest sessions the ring
+// still holds, oldest first, none missing in between
+static void after_season(void)
+{
+    journal_state_t st;
+    visited_t v = { .ordered = true };
+
+    journal_get_state(&st);
+    check_state(&st);
+    journal_for_each_session(visit, &v);
+    CHECK(v.ordered && v.n > 0);
+    CHECK_EQ(v.last.start_s, (n_sessions - 1) * SESSION_GAP_S);
+    CHECK_EQ(v.last.duration_ms, 1000 + (n_sessions - 1) % 7000);
+    CHECK_EQ(v.last.boot, want.keys[JKEY_BOOT_COUNT] - 1);
+    shm->mark = v.n;
+}
+
+// Setting changes until one opens a sector, then one more page behind it;
+// reports the value in the snapshot
+static void open_sector(void)
+{
+    journal_stats_t st;
+
+    CHECK(journal_flush() == ESP_OK);
+    journal_get_stats(&st);
+    uint16_t sector = st.sector;
+    int32_t v = 1000;
+    while (st.sector == sector) {
+        journal_set(JKEY_PWM_PROFILE, ++v);
+        CHECK(journal_flush() == ESP_OK);
+        journal_get_stats(&st);
+    }
+    journal_set(JKEY_PWM_PROFILE, v + 1);
+    CHECK(journal_flush() == ESP_OK);
+    shm->mark = v;
+}
+
+// After power loss: the expected state, and the next flush opens a fresh
+// sector instead of appending behind the damage
+static void after_loss(void)
+{
+    journal_state_t st;
+
+    journal_get_state(&st);
+    check_state(&st);
+    journal_set(JKEY_PWM_PROFILE, 7777);
+    CHECK(journal_flush() == ESP_OK);
+    CHECK_EQ(hal_mock_journal_stats.erases, 1);
+}
+
+static void check_boot(void)
+{
+    journal_state_t st;
+
+    journal_get_state(&st);
+    check_state(&st);
+}
+
+// --- Parent ----------------------------------------------------------------
+
+// Next boot's expectation: the last one's state, booted once more
+static void expect_reboot(void)
+{
+    want = shm->state;
+    want.keys[JKEY_BOOT_COUNT]++;
+}
+
+static void check_traffic(void)
+{
+    CHECK_EQ(shm->flash.erases, shm->stats.erases);
+    CHECK_EQ(shm->flash.writes, 2 * shm->stats.flushes + shm->stats.erases);
+}
+
+// Every sector used, in turn: sector s holds the sequence numbers s + 1,
+// s + 1 + n, ..., so erase counts differ by at most one
+static void check_round_robin(uint32_t total_erases)
+{
+    uint32_t n = shm->size / HAL_FLASH_SECTOR, max_seq = 0;
+    sector_hdr_t h;
+
+    for (uint32_t s = 0; s < n; s++) {
+        CHECK(sector_hdr(s, &h));
+        CHECK_EQ((h.seq - 1) % n, s);
+        max_seq = h.seq > max_seq ? h.seq : max_seq;
+    }
+    CHECK_EQ(max_seq, total_erases);
+    for (uint32_t s = 0; s < n; s++) {
+        sector_hdr(s, &h);
+        CHECK(h.seq > max_seq - n);
+    }
+}
+
+static void power_loss(void)
+{
+    static uint8_t saved[MAX_SIZE];
+
+    erase_image(PART_SIZE);
+    boot(true, NULL);
+    boot(true, open_sector);
+    int32_t v = shm->mark;
+    journal_state_t before = shm->state;
+    memcpy(saved, shm->image, PART_SIZE);
+
+    uint8_t *sector = shm->image + newest_sector() * HAL_FLASH_SECTOR;
+    page_hdr_t snap;
+    memcpy(&snap, sector + sizeof(sector_hdr_t), sizeof(snap));
+    uint8_t *last = sector + sizeof(sector_hdr_t) + PAGE_SIZE(snap.len);
+    page_hdr_t ph;
+    memcpy(&ph, last, sizeof(ph));
+    CHECK(ph.magic == 0x4750);
+
+    struct {
+        const char *what;
+        size_t from, to;              // Bytes of the newest sector never programmed
+        int32_t profile;              // What survives
+    } cases[] = {
+        { "torn page", last - sector + sizeof(ph) + ph.len / 2, HAL_FLASH_SECTOR, v },
+        { "page header only", last - sector + sizeof(ph), HAL_FLASH_SECTOR, v },
+        { "no snapshot", sizeof(sector_hdr_t), HAL_FLASH_SECTOR, v - 1 },
+        { "torn sector header", 8, HAL_FLASH_SECTOR, v - 1 },
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        memcpy(shm->image, saved, PART_SIZE);
+        memset(sector + cases[c].from, 0xFF, cases[c].to - cases[c].from);
+        want = before;
+        want.keys[JKEY_BOOT_COUNT]++;
+        want.keys[JKEY_PWM_PROFILE] = cases[c].profile;
+        boot(true, after_loss);
+        expect_reboot();
+        CHECK_EQ(want.keys[JKEY_PWM_PROFILE], 7777);
+        boot(true, check_boot);
+        printf("power lost, %-18s: profile %ld survives, next flush in a fresh sector\n",
+               cases[c].what, (long)cases[c].profile);
+    }
+}
+
+// Replay time and reads for whatever shm->image holds, best of several boots
+static void report_replay(const char *what)
+{
+    uint32_t best_us = UINT32_MAX;
+    static uint8_t saved[MAX_SIZE];
+
+    memcpy(saved, shm->image, shm->size);
+    for (int i = 0; i < REPLAY_RUNS; i++) {
+        memcpy(shm->image, saved, shm->size);
+        boot(false, NULL);
+        best_us = shm->stats.replay_us < best_us ? shm->stats.replay_us : best_us;
+    }
+    memcpy(shm->image, saved, shm->size);
+    printf("%-30s %4u KiB  %8llu  %6u\n", what, shm->size / 1024,
+           (unsigned long long)shm->replay_read, best_us);
+    CHECK(shm->replay_read <= shm->size / HAL_FLASH_SECTOR * sizeof(sector_hdr_t) +
+                              HAL_FLASH_SECTOR);
+}
+
+int main(void)
+{
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(shm != MAP_FAILED);
+
+    uint32_t erases = 0;
+    erase_image(PART_SIZE);
+    boot(true, first_flush);
+    check_traffic();
+    erases += shm->stats.erases;
+    boot(true, coalesce);
+    check_traffic();
+    erases += shm->stats.erases;
+    expect_reboot();
+    CHECK(want.keys[JKEY_PWM_PROFILE] == 0 && want.keys[JKEY_BRAKE_MS] == 999);
+    boot(true, batch_sessions);
+    check_traffic();
+    erases += shm->stats.erases;
+    CHECK_EQ(shm->state.sessions, JOURNAL_SESSION_BATCH);
+
+    n_sessions = SESSIONS;
+    boot(true, season);
+    check_traffic();
+    erases += shm->stats.erases;
+    check_round_robin(erases);
+    const journal_stats_t js = shm->stats;
+    const hal_mock_flash_stats_t fs = shm->flash;
+    uint32_t events = n_sessions + (n_sessions + 2) / 3;
+    // A sector is only left when the next page doesn't fit
+    CHECK(js.erases <= js.bytes_written / (HAL_FLASH_SECTOR - JOURNAL_PAGE_MAX) + 1);
+    expect_reboot();
+    boot(true, after_season);
+    printf("%u sessions + %u settings: %u flushes, %u erases (%.0f events each), "
+           "%u program calls, %llu bytes\n", n_sessions, events - n_sessions, js.flushes,
+           js.erases, (double)events / js.erases, fs.writes, (unsigned long long)fs.bytes_written);
+    printf("after reboot: state intact, newest %ld sessions readable in order\n",
+           (long)shm->mark);
+
+    power_loss();
+
+    printf("replay                          size  bytes read  host us\n");
+    erase_image(PART_SIZE);
+    report_replay("empty");
+    boot(true, first_flush);
+    report_replay("one page");
+    n_sessions = SESSIONS;
+    boot(true, season);
+    report_replay("ring wrapped");
+    erase_image(MAX_SIZE);
+    n_sessions = SESSIONS * 6;
+    boot(true, season);
+    CHECK(shm->stats.erases > 64);
+    report_replay("64 sectors, wrapped");
+    printf("test_journal: ok\n");
+    return 0;
+}
@@ -0,0 +1,250 @@
+// /metrics on the four-nozzle build with every task running: the scrape is
+// complete and well-formed whatever the chunk size, a line that can't fit
+// fails loudly instead of being cut, histogram buckets add up, and the
+// control latency is a summary. Reports what recording a metric costs,
+// alone and with several threads on one counter.
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include "flow_ctrl.h"
+#include "httpd_mock.h"
+#include "metrics.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define BIG             65536
+#define OLD_BUF         6144          // The handler's single buffer before chunking
+#define THREADS         4
+#define INCS            1000000
+#define RUNS            10000000
+
+typedef struct {
+    char *out;
+    size_t len;
+    int pieces;
+} sink_t;
+
+static esp_err_t collect(void *ctx, const char *buf, size_t len)
+{
+    sink_t *s = ctx;
+
+    CHECK(len > 0 && buf[len - 1] == '\n');  // Whole lines only
+    CHECK(s->len + len < BIG);
+    memcpy(s->out + s->len, buf, len);
+    s->len += len;
+    s->out[s->len] = '\0';
+    s->pieces++;
+    return ESP_OK;
+}
+
+static esp_err_t refuse(void *ctx, const char *buf, size_t len)
+{
+    return ESP_ERR_HTTPD_RESP_SEND;
+}
+
+static void write_with(size_t size, sink_t *s)
+{
+    char *buf = malloc(size);
+
+    s->len = 0;
+    s->pieces = 0;
+    CHECK(metrics_write(buf, size, collect, s) == ESP_OK);
+    free(buf);
+}
+
+// Value on the line starting with prefix; the line must exist
+static double value_of(const char *text, const char *prefix)
+{
+    size_t n = strlen(prefix);
+
+    for (const char *line = text; *line; line = strchr(line, '\n') + 1) {
+        if (strncmp(line, prefix, n) == 0 && line[n] == ' ') {
+            return strtod(line + n + 1, NULL);
+        }
+    }
+    fprintf(stderr, "missing: %s\n", prefix);
+    exit(1);
+}
+
+// Every line a comment naming a type, or a sample with a numeric value
+static void check_lines(const char *text)
+{
+    const char *line = text;
+    int samples = 0;
+
+    while (*line) {
+        const char *end = strchr(line, '\n');
+        CHECK(end != NULL);
+        if (strncmp(line, "# TYPE ", 7) == 0) {
+            const char *type = memchr(line + 7, ' ', end - line - 7);
+            CHECK(type != NULL);
+            CHECK(strncmp(type, " counter\n", 9) == 0 || strncmp(type, " gauge\n", 7) == 0 ||
+                  strncmp(type, " histogram\n", 11) == 0 || strncmp(type, " summary\n", 9) == 0);
+        } else {
+            const char *sp = end;
+            while (sp > line && sp[-1] != ' ') {
+                sp--;
+            }
+            char *num_end;
+            CHECK(sp > line + 1);
+            strtod(sp, &num_end);
+            CHECK(num_end == end);
+            samples++;
+        }
+        line = end + 1;
+    }
+    CHECK(samples > 0);
+}
+
+static void test_complete(void)
+{
+    static const size_t sizes[] = { 256, 300, 1024, 4096 };
+    sink_t whole = { .out = malloc(BIG) }, piece = { .out = malloc(BIG) };
+
+    write_with(BIG, &whole);
+    CHECK_EQ(whole.pieces, 1);
+    check_lines(whole.out);
+    printf("scrape: %zu bytes, the old buffer held %d\n", whole.len, OLD_BUF);
+    CHECK(whole.len > OLD_BUF);       // What used to be cut off
+
+    // Ends with the last family, stack minimums for every task
+    const char *last = strstr(whole.out, "# TYPE task_stack_free_min_bytes gauge\n");
+    CHECK(last != NULL && strstr(last, "task_stack_free_min_bytes{task=\"pump_ctrl\"}"));
+    CHECK(strstr(last, "task_stack_free_min_bytes{task=\"flow_ctrl\"}"));
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        char name[32];
+        snprintf(name, sizeof(name), "pump_duty{channel=\"%d\"}", ch);
+        value_of(whole.out, name);
+    }
+
+    // Same bytes whatever the buffer
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        write_with(sizes[i], &piece);
+        CHECK(piece.len == whole.len && memcmp(piece.out, whole.out, whole.len) == 0);
+        CHECK(piece.pieces >= (int)(whole.len / sizes[i]));
+    }
+
+    // Through the handler: chunked, and the same lines
+    host_http_t h;
+    host_http_init(&h, HTTP_GET, "/metrics");
+    CHECK(host_http_run(&h) == ESP_OK);
+    CHECK(h.finished && h.chunks > 1);
+    CHECK(h.resp_len > OLD_BUF && h.resp[h.resp_len - 1] == '\n');
+    check_lines((char *)h.resp);
+    host_http_free(&h);
+
+    // A line longer than the buffer, or a failing socket: an error, never
+    // short output passed off as complete
+    char small[48];
+    piece.len = 0;
+    CHECK(metrics_write(small, sizeof(small), collect, &piece) == ESP_ERR_INVALID_SIZE);
+    CHECK(metrics_write(small, sizeof(small), refuse, NULL) != ESP_OK);
+    free(whole.out);
+    free(piece.out);
+}
+
+static void test_histogram(void)
+{
+    // Bounds are inclusive: 100 us is in le="0.000100"
+    static const uint32_t samples[] = { 0, 100, 101, 250, 999, 250000, 250001, 3000000 };
+    static const struct {
+        const char *le;
+        int cum;
+    } want[] = {
+        { "0.000100", 2 }, { "0.000250", 4 }, { "0.000500", 4 }, { "0.001000", 5 },
+        { "0.100000", 5 }, { "0.250000", 6 }, { "+Inf", 8 },
+    };
+    sink_t s = { .out = malloc(BIG) };
+    char name[96];
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        metrics_observe_us(METRIC_HIST_HTTP_UPLOAD, samples[i]);
+        sum += samples[i];
+    }
+    write_with(BIG, &s);
+    for (size_t i = 0; i < sizeof(want) / sizeof(want[0]); i++) {
+        snprintf(name, sizeof(name),
+                 "http_request_duration_seconds_bucket{handler=\"upload\",le=\"%s\"}", want[i].le);
+        CHECK_EQ(value_of(s.out, name), want[i].cum);
+    }
+    CHECK_EQ(value_of(s.out, "http_request_duration_seconds_count{handler=\"upload\"}"), 8);
+    CHECK(fabs(value_of(s.out, "http_request_duration_seconds_sum{handler=\"upload\"}") * 1e6 -
+               sum) < 0.5);
+
+    // A timed handler lands in its own histogram and the request counter
+    double before = value_of(s.out, "http_request_duration_seconds_count{handler=\"spray\"}");
+    double requests = value_of(s.out, "http_requests_total");
+    host_http_t h;
+    host_http_init(&h, HTTP_GET, "/spray?pwm=10");
+    CHECK(host_http_run(&h) == ESP_OK);
+    host_http_free(&h);
+    host_settle();
+    write_with(BIG, &s);
+    CHECK_EQ(value_of(s.out, "http_request_duration_seconds_count{handler=\"spray\"}"), before + 1);
+    CHECK(value_of(s.out, "http_requests_total") >= requests + 1);
+
+    // Control latency is a summary with its sum and count
+    pump_ctrl_latency_t lat;
+    pump_ctrl_get_latency(&lat);
+    CHECK(strstr(s.out, "# TYPE pump_ctrl_latency_seconds summary\n") != NULL);
+    CHECK_EQ(value_of(s.out, "pump_ctrl_latency_seconds_count"), lat.count);
+    CHECK(fabs(value_of(s.out, "pump_ctrl_latency_seconds_sum") * 1e6 - lat.sum_us) < 0.5);
+    free(s.out);
+}
+
+static void *incrementer(void *arg)
+{
+    for (int i = 0; i < INCS; i++) {
+        metrics_inc(METRIC_UDP_REJECTED);
+    }
+    return NULL;
+}
+
+static void bench_recording(void)
+{
+    sink_t s = { .out = malloc(BIG) };
+    pthread_t threads[THREADS];
+
+    double inc_ns = BENCH_NS(i, RUNS, metrics_inc(METRIC_UDP_COMMANDS));
+    double fast_ns = BENCH_NS(i, RUNS, metrics_observe_us(METRIC_HIST_HTTP_CLASSIFY, 50));
+    double slow_ns = BENCH_NS(i, RUNS, metrics_observe_us(METRIC_HIST_HTTP_CLASSIFY, 1000000));
+
+    int64_t t0 = host_wall_ns();
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, incrementer, NULL);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double shared_ns = (double)(host_wall_ns() - t0) / (THREADS * INCS);
+
+    write_with(BIG, &s);
+    CHECK_EQ(value_of(s.out, "udp_commands_total"), RUNS);
+    CHECK_EQ(value_of(s.out, "udp_rejected_total"), THREADS * INCS);
+    CHECK_EQ(value_of(s.out, "http_request_duration_seconds_count{handler=\"classify\"}"), 2 * RUNS);
+
+    double scrape_ns = BENCH_NS(i, 1000, write_with(1024, &s));
+    printf("metrics_inc %.1f ns, %d threads on one counter %.1f ns wall per add\n", inc_ns,
+           THREADS, shared_ns);
+    printf("metrics_observe_us %.1f ns first bucket, %.1f ns +Inf\n", fast_ns, slow_ns);
+    printf("scrape %.1f us\n", scrape_ns / 1000);
+    free(s.out);
+}
+
+int main(void)
+{
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(flow_ctrl_start() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+
+    test_complete();
+    test_histogram();
+    bench_recording();
+    printf("test_metrics: ok\n");
+    return 0;
+}
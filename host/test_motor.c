@@ -0,0 +1,138 @@
+// pump.c driving a simulated DC pump motor through the L9110's two legs, on
+// the manual clock: the terminal voltage follows the leg duties, both legs
+// off leave the winding open (coast) and both fully on short it (brake),
+// and the rotor carries the impeller's load, which grows with the square
+// of speed. Stopping from full speed, a brake must bring the pump to a
+// standstill within the brake time and several times sooner than coasting;
+// a direction change must brake first, so the winding never takes more
+// than its stall current, where reversing the legs outright would take
+// two thirds more. Reports stop and reversal times and peak currents.
+
+#include <math.h>
+#include "hal.h"
+#include "hal_mock.h"
+#include "pump.h"
+#include "test_util.h"
+
+#define IA              0             // LEDC channels of pump 0
+#define IB              1
+#define STEP_US         50
+
+#define SUPPLY_V        6.0
+#define WINDING_OHM     4.0
+#define KE              0.004         // V per rad/s, and N·m per A
+#define INERTIA         2e-7          // kg·m², rotor and impeller
+#define LOAD            2e-9          // N·m per (rad/s)², impeller in water
+#define FRICTION        1e-4          // N·m, brushes and seal
+#define STALL_A         (SUPPLY_V / WINDING_OHM)
+#define STOPPED         0.05          // Of running speed
+
+typedef struct {
+    double w;                         // rad/s, forward positive
+    double amps;
+    double peak_amps;                 // Largest |amps| since reset
+} motor_t;
+
+static motor_t motor;
+static const pwm_profile_t *profile;
+
+static void motor_step(void)
+{
+    double full = 1u << profile->bits;
+    double a = hal_pwm_get_duty(IA) / full, b = hal_pwm_get_duty(IB) / full;
+
+    // Averaged over the PWM period: a driven leg connects the winding
+    motor.amps = a > 0 || b > 0 ? (SUPPLY_V * (a - b) - KE * motor.w) / WINDING_OHM : 0;
+    motor.peak_amps = fmax(motor.peak_amps, fabs(motor.amps));
+
+    double drag = LOAD * motor.w * fabs(motor.w) + copysign(FRICTION, motor.w);
+    double dw = (KE * motor.amps - drag) / INERTIA * (STEP_US / 1e6);
+    // Friction holds a stopped rotor rather than turning it backwards
+    motor.w = motor.w != 0 && (motor.w + dw) * motor.w < 0 ? 0 : motor.w + dw;
+}
+
+// Control task polling every millisecond, the motor in between
+static void run_us(int64_t us)
+{
+    for (int64_t t = 0; t < us; t += STEP_US) {
+        if (t % 1000 == 0) {
+            pump_poll();
+        }
+        host_advance_us(STEP_US);
+        motor_step();
+    }
+}
+
+// ms until cond holds, at most limit_ms
+#define RUN_UNTIL(cond, limit_ms) ({                                       \
+        int64_t us_ = 0;                                                    \
+        while (!(cond) && us_ < (limit_ms) * 1000LL) {                      \
+            run_us(STEP_US);                                                \
+            us_ += STEP_US;                                                 \
+        }                                                                   \
+        CHECK(cond);                                                        \
+        us_ / 1000.0;                                                       \
+    })
+
+static double spin_up(void)
+{
+    pump_set_speed(255);
+    run_us(3000 * 1000);
+    CHECK(motor.w > 0 && motor.amps > 0);
+    return motor.w;
+}
+
+static double stop_ms(pump_stop_mode_t mode, double running)
+{
+    motor.peak_amps = 0;
+    pump_stop_with(mode);
+    return RUN_UNTIL(motor.w < running * STOPPED, 20000);
+}
+
+int main(void)
+{
+    uint16_t brake_ms;
+
+    host_clock_manual();
+    pump_init();
+    profile = pump_profile_info(pump_get_profile());
+    CHECK(pump_set_stop_mode(PUMP_STOP_BRAKE, 0) == ESP_OK);
+    pump_get_stop_mode(&brake_ms);
+
+    double running = spin_up();
+    double running_amps = motor.amps;
+    double coast = stop_ms(PUMP_STOP_COAST, running);
+    CHECK_EQ(motor.peak_amps, 0);                   // Winding open throughout
+
+    spin_up();
+    double brake = stop_ms(PUMP_STOP_BRAKE, running);
+    double brake_amps = motor.peak_amps;
+    CHECK(brake < brake_ms);
+    CHECK(brake * 4 < coast);
+    CHECK(brake_amps <= STALL_A);
+    run_us(brake_ms * 1000);                        // Released to coast
+    CHECK(hal_pwm_get_duty(IA) == 0 && hal_pwm_get_duty(IB) == 0);
+
+    // Reversing at full speed: brake, then drive the other way
+    spin_up();
+    motor.peak_amps = 0;
+    double plugging = (SUPPLY_V + KE * running) / WINDING_OHM;
+    CHECK(pump_set_direction(0, PUMP_REVERSE) == ESP_OK);
+    pump_set_speed(255);
+    double reverse = RUN_UNTIL(motor.w < -running * (1 - STOPPED), 20000);
+    double reverse_amps = motor.peak_amps;
+    CHECK(reverse_amps <= STALL_A);
+    CHECK(plugging > 1.5 * STALL_A);
+    pump_stop_with(PUMP_STOP_BRAKE);
+    run_us(2 * brake_ms * 1000);
+    CHECK(fabs(motor.w) < running * STOPPED);
+
+    printf("running %.0f rpm at %.2f A, stall %.2f A\n", running * 60 / (2 * M_PI),
+           running_amps, STALL_A);
+    printf("stop, coast:            %6.0f ms\n", coast);
+    printf("stop, brake (%u ms):    %6.0f ms, peak %.2f A\n", brake_ms, brake, brake_amps);
+    printf("reverse via brake:      %6.0f ms, peak %.2f A (outright: %.2f A)\n", reverse,
+           reverse_amps, plugging);
+    printf("test_motor: ok\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+// The int8 engine against a plain reference: every layer of the shipped
+// model recomputed with one bounds-checked loop per op, no fast paths, on
+// random images and the edge cases (all 0, all 255). Activations must match
+// bit for bit after every layer, so the pointwise unrolling and the
+// depthwise interior walk can't drift from the padded path. Then
+// nn_model_load on damaged copies of the blob: each one is refused.
+
+#include <math.h>
+#include <string.h>
+#include "nn.h"
+#include "test_util.h"
+
+#define IMAGES          200
+#define LAYER_IMAGES    20            // Checked after every layer
+
+extern const uint8_t plant_cnn_bin_start[] asm("_binary_plant_cnn_bin_start");
+extern const uint8_t plant_cnn_bin_end[]   asm("_binary_plant_cnn_bin_end");
+
+static int8_t ref_a[NN_ARENA_SIZE / 2], ref_b[NN_ARENA_SIZE / 2];
+static uint32_t seed = 0x9E3779B9;
+
+static uint32_t rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static int8_t ref_requant(int32_t acc, int32_t mult, int shift, int zp, bool relu)
+{
+    int64_t v = (int64_t)acc * mult;
+    v = (v + ((int64_t)1 << (30 + shift))) >> (31 + shift);
+    int64_t q = v + zp;
+    int64_t lo = relu ? zp : -128;
+    return q < lo ? lo : q > 127 ? 127 : q;
+}
+
+// One layer, the slow obvious way. fc is a 1x1 conv over a 1x1 input.
+static void ref_layer(const uint8_t *blob, const nn_layer_t *l, const int8_t *in, int8_t *out)
+{
+    const int8_t *w = (const int8_t *)(blob + l->w_off);
+    const int32_t *bias = (const int32_t *)(blob + l->b_off);
+    const int32_t *mult = (const int32_t *)(blob + l->m_off);
+    const int8_t *shift = (const int8_t *)(blob + l->s_off);
+    const bool dw = l->op == NN_OP_DWCONV;
+    const int k = l->op == NN_OP_FC ? 1 : l->kernel, s = l->op == NN_OP_FC ? 1 : l->stride;
+
+    if (l->op == NN_OP_GAP) {
+        int px = l->in_h * l->in_w;
+        for (int c = 0; c < l->in_c; c++) {
+            int32_t sum = 0;
+            for (int p = 0; p < px; p++) {
+                sum += in[p * l->in_c + c];
+            }
+            out[c] = (sum >= 0 ? sum + px / 2 : sum - px / 2) / px;
+        }
+        return;
+    }
+    int pt = ((l->out_h - 1) * s + k - l->in_h) / 2, pl = ((l->out_w - 1) * s + k - l->in_w) / 2;
+    pt = pt > 0 ? pt : 0;
+    pl = pl > 0 ? pl : 0;
+    for (int oy = 0; oy < l->out_h; oy++) {
+        for (int ox = 0; ox < l->out_w; ox++) {
+            for (int oc = 0; oc < l->out_c; oc++) {
+                int32_t acc = bias[oc];
+                for (int ky = 0; ky < k; ky++) {
+                    for (int kx = 0; kx < k; kx++) {
+                        int iy = oy * s - pt + ky, ix = ox * s - pl + kx;
+                        bool pad = iy < 0 || iy >= l->in_h || ix < 0 || ix >= l->in_w;
+                        for (int ic = dw ? oc : 0; ic < (dw ? oc + 1 : l->in_c); ic++) {
+                            int32_t x = pad ? l->in_zp : in[(iy * l->in_w + ix) * l->in_c + ic];
+                            int32_t wt = dw ? w[(ky * k + kx) * l->in_c + ic]
+                                            : w[((oc * k + ky) * k + kx) * l->in_c + ic];
+                            acc += x * wt;
+                        }
+                    }
+                }
+                out[(oy * l->out_w + ox) * l->out_c + oc] =
+                    ref_requant(acc, mult[oc], shift[oc], l->out_zp, l->relu);
+            }
+        }
+    }
+}
+
+// The engine's answer for the model cut after n layers, every value of
+// that layer's output taken as a class. The confidence is a sum over all of
+// them, so it only comes out bit-identical if every value matches.
+static void check_cut(const nn_model_t *m, int n, const uint8_t *rgb, const int8_t *want)
+{
+    const nn_layer_t *l = &m->layers[n - 1];
+    nn_header_t h = *m->hdr;
+    nn_model_t cut = *m;
+    nn_result_t res;
+
+    h.n_layers = n;
+    h.n_classes = l->out_h * l->out_w * l->out_c;
+    cut.hdr = &h;
+    CHECK(nn_run(&cut, rgb, &res) == ESP_OK);
+
+    int best = 0;
+    for (int i = 1; i < h.n_classes; i++) {
+        best = want[i] > want[best] ? i : best;
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < h.n_classes; i++) {
+        sum += expf(h.out_scale * (want[i] - want[best]));
+    }
+    CHECK_EQ(res.class_id, best);
+    CHECK(res.confidence == 1.0f / sum);
+}
+
+// The reference through every layer, checked at each one or only the last
+static void check_image(const nn_model_t *m, const uint8_t *rgb, bool every_layer)
+{
+    const nn_header_t *hdr = m->hdr;
+    int8_t *cur = ref_a, *next = ref_b;
+
+    for (int i = 0; i < hdr->in_h * hdr->in_w * 3; i++) {
+        cur[i] = rgb[i] + hdr->in_zp;
+    }
+    for (int n = 1; n <= hdr->n_layers; n++) {
+        ref_layer(m->blob, &m->layers[n - 1], cur, next);
+        int8_t *t = cur;
+        cur = next;
+        next = t;
+        if (every_layer || n == hdr->n_layers) {
+            check_cut(m, n, rgb, cur);
+        }
+    }
+}
+
+static void check_damaged(void)
+{
+    static uint8_t blob[16384] __attribute__((aligned(4)));
+    const size_t len = plant_cnn_bin_end - plant_cnn_bin_start;
+    nn_model_t m;
+
+    CHECK(len <= sizeof(blob));
+#define DAMAGED(expr, want)                                     \
+    do {                                                        \
+        memcpy(blob, plant_cnn_bin_start, len);                 \
+        nn_header_t *h = (nn_header_t *)blob;                   \
+        nn_layer_t *l = (nn_layer_t *)(blob + h->layers_off);   \
+        (void)l;                                                \
+        size_t n = len;                                         \
+        expr;                                                   \
+        CHECK(nn_model_load(&m, blob, n) == (want));            \
+    } while (0)
+
+    DAMAGED((void)0, ESP_OK);
+    CHECK((const void *)m.hdr == blob);
+    DAMAGED(n = sizeof(nn_header_t) - 1, ESP_ERR_INVALID_SIZE);
+    DAMAGED(n = len - 1, ESP_ERR_INVALID_SIZE);           // One byte short
+    DAMAGED(h->magic ^= 1, ESP_ERR_INVALID_ARG);
+    DAMAGED(h->n_layers = NN_MAX_LAYERS + 1, ESP_ERR_INVALID_ARG);
+    DAMAGED(h->in_c = 1, ESP_ERR_INVALID_ARG);
+    DAMAGED(h->n_classes++, ESP_ERR_INVALID_ARG);         // Not what the last layer gives
+    DAMAGED(h->layers_off = len, ESP_ERR_INVALID_SIZE);
+    DAMAGED(l[1].in_c++, ESP_ERR_INVALID_ARG);            // Shape chain broken
+    DAMAGED(l[0].kernel = 5, ESP_ERR_INVALID_ARG);
+    DAMAGED(l[0].op = 9, ESP_ERR_INVALID_ARG);
+    DAMAGED(l[0].w_off = len - 1, ESP_ERR_INVALID_SIZE);
+    DAMAGED(l[0].b_off += 1, ESP_ERR_INVALID_SIZE);       // Misaligned int32
+    DAMAGED(l[0].out_c = 64, ESP_ERR_NO_MEM);             // 16x16x64 > half the arena
+#undef DAMAGED
+}
+
+int main(void)
+{
+    static uint8_t rgb[NN_ARENA_SIZE / 2];
+    nn_model_t m;
+
+    CHECK(nn_model_load(&m, plant_cnn_bin_start, plant_cnn_bin_end - plant_cnn_bin_start) == ESP_OK);
+    size_t n_in = (size_t)m.hdr->in_h * m.hdr->in_w * 3;
+    CHECK(n_in <= sizeof(rgb));
+
+    for (int img = 0; img < IMAGES; img++) {
+        for (size_t i = 0; i < n_in; i++) {
+            rgb[i] = img == 0 ? 0 : img == 1 ? 255 : rnd();
+        }
+        check_image(&m, rgb, img < LAYER_IMAGES);
+    }
+    check_damaged();
+    printf("%d images match the reference, damaged blobs refused\n", IMAGES);
+    printf("test_nn: ok\n");
+    return 0;
+}
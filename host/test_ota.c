@@ -0,0 +1,258 @@
+// Firmware updates into the mock OTA slot. Throughput with the receiver
+// paced like the AP and the flash taking its time per sector: the double
+// buffer should overlap the two, so an update takes about the longer of
+// them, not their sum. Through POST /ota: an authenticated image is
+// flashed and the device restarts; one with the wrong key, a changed byte,
+// a stream that breaks or stalls, a failing flash or a truncated image is
+// never made bootable, releases the pump and leaves the next update
+// working. The pump stays stopped for the whole of an update, a second
+// update meanwhile is refused, and a new image on probation is kept or
+// rolled back by ota_boot_check().
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include "hal_mock.h"
+#include "httpd_mock.h"
+#include "ota.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "web_server.h"
+
+#define IMAGE_SIZE      (512 * 1024 + 1000)  // Not a whole number of chunks
+#define PACKET          1436          // TCP payload per segment on the AP
+#define RADIO_KBPS      1000          // Paced receive, KB/s
+#define SECTOR_US       4000          // Erase and write of one 4 KB sector: ~1 MB/s
+
+static uint8_t *image;
+
+// An app image as the build makes it: magic byte, then the SHA-256 of the
+// rest appended
+static void make_image(void)
+{
+    uint32_t x = 1;
+
+    image = malloc(IMAGE_SIZE);
+    for (size_t i = 0; i < IMAGE_SIZE; i++) {
+        x = x * 1103515245 + 12345;
+        image[i] = x >> 24;
+    }
+    image[0] = 0xE9;
+    EVP_Digest(image, IMAGE_SIZE - 32, image + IMAGE_SIZE - 32, NULL, EVP_sha256(), NULL);
+}
+
+static void mac_of(const char *key, const uint8_t *data, size_t len, uint8_t mac[OTA_MAC_LEN])
+{
+    unsigned int n;
+
+    HMAC(EVP_sha256(), key, strlen(key), data, len, mac, &n);
+    CHECK_EQ(n, OTA_MAC_LEN);
+}
+
+static void hex_of(const uint8_t *mac, char hex[OTA_MAC_LEN * 2 + 1])
+{
+    for (int i = 0; i < OTA_MAC_LEN; i++) {
+        sprintf(hex + 2 * i, "%02x", mac[i]);
+    }
+}
+
+// ---- Throughput, straight into ota_receive() ----
+
+typedef struct {
+    const uint8_t *data;
+    size_t pos, len;
+    int64_t us_per_packet;            // 0: as fast as memcpy
+    int64_t busy_us;                  // Spent "on the air"
+    bool checked;
+} stream_t;
+
+static int stream_recv(void *ctx, uint8_t *buf, size_t len)
+{
+    stream_t *s = ctx;
+
+    if (!s->checked) {
+        // Mid-update: the pump refuses commands and a second update is refused
+        uint8_t mac[OTA_MAC_LEN] = {0};
+        CHECK(pump_ctrl_set_speed(100) != ESP_OK);
+        CHECK(ota_receive(stream_recv, s, 1, mac, NULL) == ESP_ERR_INVALID_STATE);
+        s->checked = true;
+    }
+    len = len < PACKET ? len : PACKET;
+    len = len < s->len - s->pos ? len : s->len - s->pos;
+    if (s->us_per_packet) {
+        usleep(s->us_per_packet);
+        s->busy_us += s->us_per_packet;
+    }
+    memcpy(buf, s->data + s->pos, len);
+    s->pos += len;
+    return (int)len;
+}
+
+static ota_stats_t receive(int64_t us_per_packet, uint32_t sector_us, int64_t *radio_us)
+{
+    stream_t s = { image, 0, IMAGE_SIZE, us_per_packet };
+    uint8_t mac[OTA_MAC_LEN];
+    ota_stats_t st;
+
+    mac_of(CONFIG_PLANTDOC_OTA_KEY, image, IMAGE_SIZE, mac);
+    hal_mock_ota.sector_us = sector_us;
+    hal_mock_ota.boot_changed = false;
+    CHECK(ota_receive(stream_recv, &s, IMAGE_SIZE, mac, &st) == ESP_OK);
+    CHECK(hal_mock_ota.boot_changed);
+    CHECK_EQ(hal_mock_ota.len, IMAGE_SIZE);
+    CHECK(memcmp(hal_mock_ota.data, image, IMAGE_SIZE) == 0);
+    CHECK_EQ(st.bytes, IMAGE_SIZE);
+    // Held until the restart into the new image, which doesn't happen here
+    CHECK(pump_ctrl_set_speed(50) != ESP_OK);
+    pump_ctrl_hold(false);
+    *radio_us = s.busy_us;
+    return st;
+}
+
+static void test_throughput(void)
+{
+    int64_t radio_us;
+    int64_t packet_us = (int64_t)PACKET * 1000 / RADIO_KBPS;
+
+    ota_stats_t st = receive(0, 0, &radio_us);
+    printf("unpaced: %d KB in %.1f ms, %.0f KB/s (hashing and copying only)\n",
+           IMAGE_SIZE / 1024, st.total_us / 1000.0, IMAGE_SIZE / 1024.0 / (st.total_us / 1e6));
+
+    st = receive(packet_us, SECTOR_US, &radio_us);
+    double serial_us = radio_us + st.flash_us;
+    printf("paced: radio %.0f ms + flash %.0f ms -> %.0f ms, %.0f KB/s (%.0f%% of one after "
+           "the other); receive waited %.0f ms\n", radio_us / 1000.0, st.flash_us / 1000.0,
+           st.total_us / 1000.0, IMAGE_SIZE / 1024.0 / (st.total_us / 1e6),
+           100.0 * st.total_us / serial_us, st.recv_wait_us / 1000.0);
+    // Overlapped: about the slower of the two plus a chunk of the other
+    CHECK(st.total_us < 0.75 * serial_us);
+    int64_t slower = radio_us > st.flash_us ? radio_us : st.flash_us;
+    CHECK(st.total_us < slower * 1.25 + 20000);
+    hal_mock_ota.sector_us = 0;
+}
+
+// ---- POST /ota ----
+
+// An upload request, signed with key unless NULL
+static void post(const uint8_t *data, size_t len, const char *key, host_http_t *h)
+{
+    uint8_t mac[OTA_MAC_LEN];
+    char hex[OTA_MAC_LEN * 2 + 1];
+
+    host_http_init(h, HTTP_POST, "/ota");
+    if (key) {
+        mac_of(key, data, len, mac);
+        hex_of(mac, hex);
+        host_http_set_hdr(h, "X-Image-HMAC", hex);
+    }
+    host_http_set_body(h, data, len);
+    h->recv_max = PACKET;
+}
+
+// A failed update: nothing made bootable, the slot closed, the pump free
+static void check_refused(host_http_t *h, int want_status, bool replied)
+{
+    int restarts = host_restarts();
+
+    hal_mock_ota.boot_changed = false;
+    esp_err_t err = host_http_run(h);
+    if (replied) {
+        CHECK_EQ(host_http_status(h), want_status);
+    } else {
+        CHECK(err == ESP_FAIL);       // Connection dropped, nobody to reply to
+    }
+    CHECK(!hal_mock_ota.boot_changed);
+    CHECK(!hal_mock_ota.writing);
+    CHECK_EQ(host_restarts(), restarts);
+    CHECK(pump_ctrl_set_speed(50) == ESP_OK);
+    pump_ctrl_stop();
+    host_http_free(h);
+}
+
+static void test_updates(void)
+{
+    host_http_t h;
+
+    // Unauthenticated: no header, or a key the device doesn't have
+    post(image, IMAGE_SIZE, NULL, &h);
+    check_refused(&h, 400, true);
+    post(image, IMAGE_SIZE, "someone-elses-ota-key", &h);
+    check_refused(&h, 403, true);
+
+    // Authenticated, then one byte changed on the way
+    uint8_t *bad = malloc(IMAGE_SIZE);
+    memcpy(bad, image, IMAGE_SIZE);
+    post(bad, IMAGE_SIZE, CONFIG_PLANTDOC_OTA_KEY, &h);
+    bad[IMAGE_SIZE / 2] ^= 1;
+    check_refused(&h, 403, true);
+
+    // The connection breaks halfway, or the client stops sending
+    post(image, IMAGE_SIZE, CONFIG_PLANTDOC_OTA_KEY, &h);
+    h.drop_at = IMAGE_SIZE / 2;
+    check_refused(&h, 0, false);
+    CHECK(hal_mock_ota.len <= IMAGE_SIZE / 2);
+    post(image, IMAGE_SIZE, CONFIG_PLANTDOC_OTA_KEY, &h);
+    h.recv_timeouts = -1;
+    check_refused(&h, 0, false);
+
+    // The flash fails partway
+    post(image, IMAGE_SIZE, CONFIG_PLANTDOC_OTA_KEY, &h);
+    hal_mock_ota.fail_write_at = 64 * 1024;
+    check_refused(&h, 400, true);
+    hal_mock_ota.fail_write_at = -1;
+
+    // Authentic but cut short by the sender: the image's own digest fails
+    post(image, IMAGE_SIZE - 4096, CONFIG_PLANTDOC_OTA_KEY, &h);
+    check_refused(&h, 400, true);
+
+    // After all that, a good one goes through and the device restarts into it
+    int restarts = host_restarts();
+    post(image, IMAGE_SIZE, CONFIG_PLANTDOC_OTA_KEY, &h);
+    hal_mock_ota.boot_changed = false;
+    CHECK(host_http_run(&h) == ESP_OK);
+    CHECK_EQ(host_http_status(&h), 200);
+    CHECK(strncmp((char *)h.resp, "ok ", 3) == 0);
+    CHECK(hal_mock_ota.boot_changed);
+    CHECK(memcmp(hal_mock_ota.data, image, IMAGE_SIZE) == 0);
+    CHECK_EQ(host_restarts(), restarts + 1);
+    // Held until the restart, which on the device never returns
+    CHECK(pump_ctrl_set_speed(50) != ESP_OK);
+    pump_ctrl_hold(false);
+    host_http_free(&h);
+    free(bad);
+}
+
+// The new image boots on probation: kept once boot went through, else the
+// old one comes back
+static void test_boot_check(void)
+{
+    ota_boot_check(false);            // Confirmed image: nothing to do
+    CHECK_EQ(hal_mock_ota.rolled_back, 0);
+
+    hal_mock_ota.pending_verify = true;
+    ota_boot_check(false);
+    CHECK_EQ(hal_mock_ota.rolled_back, 1);
+
+    hal_mock_ota.pending_verify = true;
+    ota_boot_check(true);
+    CHECK_EQ(hal_mock_ota.confirmed, 1);
+    CHECK(!hal_mock_ota.pending_verify);
+}
+
+int main(void)
+{
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+    CHECK(ota_enabled());
+    make_image();
+
+    test_throughput();
+    test_updates();
+    test_boot_check();
+    printf("test_ota: ok\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+// Spray programs on a simulated timeline: the clock only moves when the
+// test says so, so every step has to start on its exact microsecond and
+// reach the pump there. Also the slot table's 409 after a stop and the
+// bounded body receive of POST /program.
+
+#include <string.h>
+#include "esp_timer.h"
+#include "host.h"
+#include "httpd_mock.h"
+#include "program.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "trace.h"
+#include "web_server.h"
+
+#define MAX_CHANGES     32
+
+typedef struct {
+    int64_t at_us;
+    uint8_t speed;
+} change_t;
+
+static int post_program(const char *body, int recv_timeouts)
+{
+    host_http_t h;
+
+    host_http_init(&h, HTTP_POST, "/program");
+    host_http_set_body(&h, body, strlen(body));
+    h.recv_max = 7;                   // Several pieces, a timeout before each
+    h.recv_timeouts = recv_timeouts;
+    esp_err_t err = host_http_run(&h);
+    // An error reply drops the connection too; -1 is none at all
+    int status = err == ESP_OK || h.status[0] ? host_http_status(&h) : -1;
+    host_http_free(&h);
+    return status;
+}
+
+// Step the clock 1 ms at a time for ms, noting every speed the pump takes
+static int record(int ms, change_t *out, int n)
+{
+    for (int i = 0; i < ms; i++) {
+        host_advance_us(1000);
+        uint8_t speed = pump_get_speed();
+        if (n == 0 || out[n - 1].speed != speed) {
+            CHECK(n < MAX_CHANGES);
+            out[n].at_us = esp_timer_get_time();
+            out[n].speed = speed;
+            n++;
+        }
+    }
+    return n;
+}
+
+// Step start times the sequencer traced, relative to t0
+static int traced_steps(int64_t t0, int64_t *at_us, int max)
+{
+    static uint8_t buf[TRACE_DUMP_MAX_SIZE];
+    size_t len = trace_dump(buf, sizeof(buf));
+    const trace_rec_t *rec = (const trace_rec_t *)(buf + sizeof(trace_dump_hdr_t));
+    int n = 0;
+
+    for (size_t i = 0; i < (len - sizeof(trace_dump_hdr_t)) / sizeof(*rec); i++) {
+        if (rec[i].id == TRACE_PROGRAM_STEP && (uint32_t)(rec[i].ts_us - (uint32_t)t0) < 100000000u) {
+            CHECK(n < max);
+            at_us[n++] = (uint32_t)(rec[i].ts_us - (uint32_t)t0);
+        }
+    }
+    return n;
+}
+
+// Three uneven steps twice over: each speed lands on its exact millisecond,
+// the sequencer fires on its exact microsecond, and the pump stops at the end
+static void test_timeline(void)
+{
+    static const uint8_t duty[] = { 128, 0, 200 };
+    static const int ms[] = { 333, 250, 17 };
+    change_t seen[MAX_CHANGES];
+    int64_t traced[MAX_CHANGES];
+    program_state_t st;
+
+    int64_t t0 = esp_timer_get_time();
+    CHECK_EQ(post_program("steps=128:333,0:250,200:17&repeat=2&slot=1", 0), 200);
+    host_settle();
+    seen[0].at_us = t0;
+    seen[0].speed = pump_get_speed();  // First step straight away
+    int n = record(1300, seen, 1);
+
+    // One change per step boundary, then the final stop
+    CHECK_EQ(n, 7);
+    int64_t at = 0;
+    for (int i = 0; i < 6; i++) {
+        CHECK_EQ(seen[i].at_us - t0, at);
+        CHECK_EQ(seen[i].speed, duty[i % 3]);
+        at += ms[i % 3] * 1000;
+    }
+    CHECK_EQ(seen[6].at_us - t0, at);
+    CHECK_EQ(seen[6].speed, 0);
+
+    int steps = traced_steps(t0, traced, MAX_CHANGES);
+    CHECK_EQ(steps, 6);
+    at = 0;
+    for (int i = 0; i < steps; i++) {
+        CHECK_EQ(traced[i], at);
+        at += ms[i % 3] * 1000;
+    }
+
+    program_get_state(&st);
+    CHECK(!st.running);
+}
+
+// A stop mid-program frees the slot for a new program straight away, even
+// before the sequencer's timer has fired and noticed; a program that still
+// owns the pump keeps its slot
+static void test_store_after_stop(void)
+{
+    program_state_t st;
+
+    CHECK_EQ(post_program("steps=90:1000&slot=2", 0), 200);
+    host_advance_us(10000);
+    CHECK_EQ(pump_get_speed(), 90);
+    CHECK_EQ(post_program("steps=50:1000&slot=2&run=0", 0), 409);
+    CHECK_EQ(post_program("steps=50:1000&slot=3&run=0", 0), 200);
+
+    // Fields that aren't whole numbers in range are refused, not read as
+    // far as they go
+    CHECK_EQ(post_program("steps=50:1000&slot=1x&run=0", 0), 400);
+    CHECK_EQ(post_program("steps=50:1000&slot=3&repeat=2abc&run=0", 0), 400);
+    CHECK_EQ(post_program("steps=50:1000&slot=3&run=junk", 0), 400);
+    CHECK_EQ(post_program("steps=50:1000&slot=3&run=2", 0), 400);
+    CHECK_EQ(post_program("steps=50:1000&slot=&run=0", 0), 400);
+    CHECK_EQ(post_program("steps=50:1000&slot=99999999999&run=0", 0), 400);
+    CHECK_EQ(pump_get_speed(), 90);   // Still the running program
+
+    host_http_t h;
+    host_http_init(&h, HTTP_GET, "/stop");
+    CHECK(host_http_run(&h) == ESP_OK);
+    host_http_free(&h);
+    host_settle();
+    program_get_state(&st);
+    CHECK(!st.running);
+    CHECK_EQ(post_program("steps=60:100&slot=2", 0), 200);
+    host_advance_us(10000);
+    CHECK_EQ(pump_get_speed(), 60);
+    host_advance_us(100000);
+    CHECK_EQ(pump_get_speed(), 0);
+}
+
+// A slow client is waited for a few timeouts; one that stops sending is
+// dropped instead of holding the httpd task
+static void test_stalled_body(void)
+{
+    CHECK_EQ(post_program("steps=70:100&slot=0&run=0", 2), 200);
+    CHECK_EQ(post_program("steps=70:100&slot=0&run=0", -1), -1);
+}
+
+int main(void)
+{
+    host_clock_manual();
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(program_init() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+
+    test_timeline();
+    test_store_after_stop();
+    test_stalled_body();
+    printf("test_program: ok\n");
+    return 0;
+}
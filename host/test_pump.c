@@ -0,0 +1,262 @@
+// pump.c on the mock HAL: leg duties per direction and speed, limits,
+// brake and coast, profile switches and ramps on the fade engine.
+
+#include <string.h>
+#include "esp_timer.h"
+#include "hal_mock.h"
+#include "history.h"
+#include "pump.h"
+#include "test_util.h"
+
+#define IA  0                         // LEDC channels of pump 0
+#define IB  1
+
+static const pwm_profile_t *profile;
+
+static void check_legs(uint32_t ia, uint32_t ib)
+{
+    CHECK_EQ(hal_pwm_get_duty(IA), ia);
+    CHECK_EQ(hal_pwm_get_duty(IB), ib);
+}
+
+// Poll every millisecond for ms, as a control task woken by each fade end
+// would be at the latest
+static void run_for(int ms)
+{
+    for (int i = 0; i < ms; i++) {
+        pump_poll();
+        host_advance_us(1000);
+    }
+}
+
+// Same, until nothing is pending
+static void run_until_idle(void)
+{
+    for (int i = 0; i < 10000; i++) {
+        if (pump_poll() < 0) {
+            return;
+        }
+        host_advance_us(1000);
+    }
+    CHECK(!"pump never went idle");
+}
+
+static void test_init(void)
+{
+    pump_init();
+    profile = pump_profile_info(pump_get_profile());
+
+    CHECK_EQ(hal_mock_pwm_timers[0].freq_hz, profile->freq_hz);
+    CHECK_EQ(hal_mock_pwm_timers[0].resolution_bits, profile->bits);
+    CHECK(hal_mock_pwm_channels[IA].configured && hal_mock_pwm_channels[IB].configured);
+    CHECK_EQ(hal_mock_pwm_channels[IA].gpio, 25);
+    CHECK_EQ(hal_mock_pwm_channels[IB].gpio, 26);
+    check_legs(0, 0);
+}
+
+static void test_speed(void)
+{
+    pump_set_speed(128);
+    check_legs(profile->lut[128], 0);
+    CHECK_EQ(pump_get_speed(), 128);
+
+    // One batch latches both legs together
+    uint32_t batches = hal_mock_pwm_batches;
+    pump_set_speed(255);
+    CHECK_EQ(hal_mock_pwm_batches, batches + 1);
+    check_legs(profile->lut[255], 0);
+
+    CHECK(pump_set_channel(PUMP_NUM_CHANNELS, 10) == ESP_ERR_INVALID_ARG);
+}
+
+static void test_coast(void)
+{
+    pump_set_speed(200);
+    pump_stop_with(PUMP_STOP_COAST);
+    check_legs(0, 0);
+    CHECK(!pump_is_braking(0));
+    CHECK_EQ(pump_get_speed(), 0);
+}
+
+static void test_brake(void)
+{
+    uint32_t full = 1u << profile->bits;
+    uint16_t brake_ms;
+
+    CHECK(pump_set_stop_mode(PUMP_STOP_BRAKE, 300) == ESP_OK);
+    CHECK(pump_get_stop_mode(&brake_ms) == PUMP_STOP_BRAKE && brake_ms == 300);
+    CHECK(pump_set_stop_mode(PUMP_STOP_BRAKE, PUMP_BRAKE_MS_MAX + 1) == ESP_ERR_INVALID_ARG);
+
+    pump_set_speed(200);
+    pump_stop();
+    CHECK(pump_is_braking(0));
+    check_legs(full, full);
+
+    // Due at the brake time, released to coast then
+    CHECK_EQ(pump_poll(), 300);
+    host_advance_us(299 * 1000);
+    pump_poll();
+    CHECK(pump_is_braking(0));
+    host_advance_us(1000);
+    CHECK_EQ(pump_poll(), -1);
+    CHECK(!pump_is_braking(0));
+    check_legs(0, 0);
+
+    // A stopped pump doesn't brake
+    pump_stop();
+    CHECK(!pump_is_braking(0));
+}
+
+static void test_direction(void)
+{
+    uint32_t full = 1u << profile->bits;
+
+    pump_set_speed(100);
+    CHECK(pump_set_direction(0, PUMP_REVERSE) == ESP_OK);
+
+    // Never straight into the other direction: brake, and a speed command
+    // meanwhile waits for the release
+    check_legs(full, full);
+    pump_set_speed(150);
+    check_legs(full, full);
+    run_until_idle();
+    check_legs(0, profile->lut[150]);
+    CHECK(pump_get_direction(0) == PUMP_REVERSE);
+
+    pump_stop_with(PUMP_STOP_COAST);
+    CHECK(pump_set_direction(0, PUMP_FORWARD) == ESP_OK);
+    CHECK(!pump_is_braking(0));       // Standing still: nothing to brake
+    pump_set_speed(150);
+    check_legs(profile->lut[150], 0);
+    pump_stop_with(PUMP_STOP_COAST);
+}
+
+static void test_compensation(void)
+{
+    static uint8_t table[256];
+
+    for (int i = 0; i < 256; i++) {
+        table[i] = i / 2;
+    }
+    pump_set_compensation(0, table, pump_get_profile());
+    pump_set_speed(200);
+    CHECK_EQ(pump_get_command(0), 200);
+    CHECK_EQ(pump_get_channel(0), 100);
+    check_legs(profile->lut[100], 0);
+
+    // Only while the profile it was made for is active
+    pump_set_compensation(0, table, pump_get_profile() + 1);
+    pump_set_speed(200);
+    CHECK_EQ(pump_get_channel(0), 200);
+    pump_set_compensation(0, NULL, 0);
+    pump_stop_with(PUMP_STOP_COAST);
+}
+
+static void test_profile(void)
+{
+    uint8_t old = pump_get_profile();
+
+    pump_set_speed(180);
+    host_advance_us(100000);
+    uint32_t samples, bytes;
+    history_stats(&samples, &bytes);
+    uint64_t on_us = pump_get_on_time_us();
+    CHECK(pump_set_profile(1) == ESP_OK);
+    const pwm_profile_t *p = pump_profile_info(1);
+    CHECK_EQ(hal_mock_pwm_timers[0].freq_hz, p->freq_hz);
+    CHECK_EQ(hal_mock_pwm_timers[0].resolution_bits, p->bits);
+    check_legs(p->lut[180], 0);       // Same command, new table
+
+    // Not a stop and a start: no speed points, the running time goes on
+    uint32_t samples_after;
+    history_stats(&samples_after, &bytes);
+    CHECK_EQ(samples_after, samples);
+    host_advance_us(100000);
+    CHECK_EQ(pump_get_on_time_us(), on_us + 100000);
+
+    uint8_t count = 0;
+    while (pump_profile_info(count)) {
+        count++;
+    }
+    CHECK(pump_set_profile(count) == ESP_ERR_INVALID_ARG);
+    CHECK_EQ(pump_get_profile(), 1);
+    CHECK(pump_set_profile(old) == ESP_OK);
+    pump_stop_with(PUMP_STOP_COAST);
+}
+
+static void test_ramp(void)
+{
+    uint16_t ms;
+
+    CHECK(pump_set_ramp(PUMP_RAMP_LINEAR, 500) == ESP_OK);
+    CHECK(pump_get_ramp(&ms) == PUMP_RAMP_LINEAR && ms == 500);
+
+    uint32_t fades = hal_mock_pwm_channels[IA].fades;
+    int64_t t0 = esp_timer_get_time();
+    pump_set_speed(255);
+    CHECK(pump_is_ramping(0));
+    CHECK_EQ(pump_get_channel(0), 255);  // The target, from the start
+
+    // Halfway through, the duty is on its way and still rising
+    run_for(250);
+    uint32_t mid = hal_pwm_get_duty(IA);
+    CHECK(mid > 0 && mid < profile->lut[255]);
+
+    run_until_idle();
+    CHECK(!pump_is_ramping(0));
+    check_legs(profile->lut[255], 0);
+    // Whole segments: 8 of 62 ms
+    int64_t took = esp_timer_get_time() - t0;
+    CHECK(took >= PUMP_RAMP_SEGMENTS * (500 / PUMP_RAMP_SEGMENTS) * 1000 && took <= 505 * 1000);
+    CHECK(hal_mock_pwm_channels[IA].fades - fades <= PUMP_RAMP_SEGMENTS);
+
+    // Retarget mid-ramp: carries on from wherever the duty got to, back up
+    pump_set_speed(0);
+    run_for(100);
+    uint32_t at = hal_pwm_get_duty(IA);
+    CHECK(at < profile->lut[255]);
+    pump_set_speed(255);
+    CHECK(pump_is_ramping(0));
+    CHECK_EQ(hal_pwm_get_duty(IA), at);
+    run_until_idle();
+    check_legs(profile->lut[255], 0);
+
+    // A step too small to split into fades jumps
+    pump_set_speed(254);
+    CHECK(!pump_is_ramping(0));
+    check_legs(profile->lut[254], 0);
+
+    // Stops never ramp
+    pump_stop_with(PUMP_STOP_COAST);
+    CHECK(!pump_is_ramping(0));
+    check_legs(0, 0);
+    CHECK(pump_set_ramp(PUMP_RAMP_OFF, 0) == ESP_OK);
+}
+
+static void test_on_time(void)
+{
+    uint64_t before = pump_get_on_time_us();
+
+    pump_set_speed(50);
+    host_advance_us(2000 * 1000);
+    CHECK_EQ(pump_get_on_time_us() - before, 2000 * 1000);
+    pump_stop_with(PUMP_STOP_COAST);
+    host_advance_us(1000 * 1000);
+    CHECK_EQ(pump_get_on_time_us() - before, 2000 * 1000);
+}
+
+int main(void)
+{
+    host_clock_manual();
+    test_init();
+    test_speed();
+    test_coast();
+    test_brake();
+    test_direction();
+    test_compensation();
+    test_profile();
+    test_ramp();
+    test_on_time();
+    printf("test_pump: ok\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+// pump_ctrl's command ring under several producer threads: nothing lost or
+// applied twice, manual producers never cancel each other, a stop discards
+// what was queued before it, and ownership tokens go stale as documented.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+
+#define PRODUCERS       4
+#define POSTS           20000
+#define RACE_ROUNDS     500
+
+static pthread_barrier_t start_line, finish_line;
+static atomic_uint ring_full;
+
+static uint32_t applied(void)
+{
+    pump_ctrl_latency_t lat;
+
+    pump_ctrl_get_latency(&lat);
+    return lat.count;
+}
+
+// Wait for the control task to catch up with count commands
+static void wait_applied(uint32_t count)
+{
+    for (int i = 0; i < 5000 && applied() < count; i++) {
+        usleep(1000);
+    }
+    CHECK_EQ(applied(), count);
+}
+
+static void post_retrying(uint8_t speed)
+{
+    esp_err_t err;
+
+    while ((err = pump_ctrl_set_speed(speed)) == ESP_ERR_NO_MEM) {
+        atomic_fetch_add(&ring_full, 1);
+        sched_yield();                // Let the control task drain it
+    }
+    CHECK(err == ESP_OK);
+}
+
+static void *producer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+
+    pthread_barrier_wait(&start_line);
+    for (int i = 0; i < POSTS; i++) {
+        post_retrying(1 + (id * POSTS + i) % 255);
+    }
+    return NULL;
+}
+
+// Every accepted command is applied exactly once
+static void test_producers(void)
+{
+    pthread_t threads[PRODUCERS];
+    uint32_t before = applied();
+
+    pthread_barrier_init(&start_line, NULL, PRODUCERS);
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&start_line);
+    wait_applied(before + PRODUCERS * POSTS);
+    CHECK(pump_get_speed() != 0);
+    printf("%d producers x %d commands, ring full %u times\n", PRODUCERS, POSTS,
+           atomic_load(&ring_full));
+}
+
+static void *racer(void *arg)
+{
+    for (int round = 0; round < RACE_ROUNDS; round++) {
+        pthread_barrier_wait(&start_line);
+        post_retrying(1 + round % 255);
+        pthread_barrier_wait(&finish_line);
+    }
+    return NULL;
+}
+
+// An automation owns the pump, then manual producers all post at once:
+// they take over together, and none of their commands goes stale
+static void test_takeover_race(void)
+{
+    pthread_t threads[PRODUCERS];
+
+    pthread_barrier_init(&start_line, NULL, PRODUCERS + 1);
+    pthread_barrier_init(&finish_line, NULL, PRODUCERS + 1);
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], NULL, racer, NULL);
+    }
+    for (int round = 0; round < RACE_ROUNDS; round++) {
+        uint32_t before = applied();
+        uint32_t token = pump_ctrl_acquire();
+
+        pthread_barrier_wait(&start_line);
+        pthread_barrier_wait(&finish_line);
+        CHECK(!pump_ctrl_owns(token));
+        wait_applied(before + PRODUCERS);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&start_line);
+    pthread_barrier_destroy(&finish_line);
+}
+
+// With the control task held up mid-command, queue speeds and then a stop:
+// the stop goes first and the speeds behind it are dropped
+static void test_stop_preempts(void)
+{
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t before = applied();
+
+    pump_ctrl_stop_with(PUMP_STOP_COAST);
+    wait_applied(before + 1);
+
+    // Every portMUX is one lock on the host: the control task blocks on it
+    // in pump_set_batch until released
+    portENTER_CRITICAL(&mux);
+    CHECK(pump_ctrl_set_speed(100) == ESP_OK);
+    usleep(20000);
+    for (int i = 0; i < 5; i++) {
+        CHECK(pump_ctrl_set_speed(50 + i) == ESP_OK);
+    }
+    pump_ctrl_stop_with(PUMP_STOP_COAST);
+    portEXIT_CRITICAL(&mux);
+
+    wait_applied(before + 3);         // The first command and the stop only
+    usleep(20000);
+    CHECK_EQ(applied(), before + 3);
+    CHECK_EQ(pump_get_speed(), 0);
+}
+
+static void test_ownership(void)
+{
+    uint32_t before = applied();
+    uint32_t a = pump_ctrl_acquire();
+
+    CHECK(pump_ctrl_owns(a));
+    CHECK(pump_ctrl_post(80, a) == ESP_OK);
+    wait_applied(before + 1);
+    CHECK_EQ(pump_get_speed(), 80);
+
+    // A newer owner makes a's commands stale
+    uint32_t b = pump_ctrl_acquire();
+    CHECK(!pump_ctrl_owns(a) && pump_ctrl_owns(b));
+    CHECK(pump_ctrl_post(90, a) == ESP_OK);
+    CHECK(pump_ctrl_post(70, b) == ESP_OK);
+    wait_applied(before + 2);
+    CHECK_EQ(pump_get_speed(), 70);
+
+    // Manual commands and stops take over too
+    CHECK(pump_ctrl_set_speed(60) == ESP_OK);
+    CHECK(!pump_ctrl_owns(b));
+    wait_applied(before + 3);
+    pump_ctrl_stop();
+    wait_applied(before + 4);
+
+    // Held: refused from everyone until released
+    pump_ctrl_hold(true);
+    CHECK(pump_ctrl_set_speed(10) == ESP_ERR_INVALID_STATE);
+    CHECK(pump_ctrl_post(10, pump_ctrl_acquire()) == ESP_ERR_INVALID_STATE);
+    pump_ctrl_hold(false);
+    wait_applied(before + 5);         // The hold's stop
+    CHECK(pump_ctrl_set_speed(10) == ESP_OK);
+    wait_applied(before + 6);
+    CHECK_EQ(pump_get_speed(), 10);
+}
+
+int main(void)
+{
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    test_producers();
+    test_takeover_race();
+    test_stop_preempts();
+    test_ownership();
+
+    pump_ctrl_latency_t lat;
+    pump_ctrl_get_latency(&lat);
+    CHECK(lat.p50_us <= lat.p99_us);
+    printf("latency p50 %u us, p99 %u us, max %u us\n", lat.p50_us, lat.p99_us, lat.max_us);
+    printf("test_pump_ctrl: ok\n");
+    return 0;
+}
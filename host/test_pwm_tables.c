@@ -0,0 +1,106 @@
+// The generated PWM linearization tables against main/pwm_profiles.csv:
+// each one spans 0..full duty, rises with every speed step, starts above
+// the dead zone and follows the profile's curve, and the pump latches
+// exactly the table's duty under each profile. Reports the cost of the
+// table load against working the curve out per command.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "pump.h"
+#include "pwm_tables.h"
+#include "test_util.h"
+
+#define LOOKUPS         10000000
+
+typedef struct {
+    char name[32];
+    double dead_zone;
+    double gamma;
+} csv_profile_t;
+
+// The profile rows of pwm_profiles.csv, in order
+static int load_csv(csv_profile_t *out, int max)
+{
+    FILE *f = fopen(HOST_SOURCE_DIR "/main/pwm_profiles.csv", "r");
+    char line[256];
+    int n = 0;
+
+    CHECK(f != NULL);
+    while (fgets(line, sizeof(line), f)) {
+        unsigned freq, bits;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        CHECK(n < max);
+        CHECK(sscanf(p, "%31[^,], %u, %u, %lf, %lf", out[n].name, &freq, &bits,
+                     &out[n].dead_zone, &out[n].gamma) == 5);
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static void check_table(const pwm_profile_t *p, const csv_profile_t *c)
+{
+    uint32_t top = (1u << p->bits) - 1;
+
+    CHECK(strcmp(p->name, c->name) == 0);
+    CHECK((uint64_t)p->freq_hz << p->bits <= 80000000);  // LEDC's 80 MHz clock
+    CHECK_EQ(p->lut[0], 0);
+    CHECK_EQ(p->lut[255], top);
+    CHECK(p->lut[1] >= c->dead_zone * top);
+    for (int s = 1; s < 256; s++) {
+        CHECK(p->lut[s] > p->lut[s - 1]);
+        double want = c->dead_zone * top + (top - c->dead_zone * top) * pow(s / 255.0, c->gamma);
+        CHECK(fabs(p->lut[s] - want) <= 0.5);
+    }
+}
+
+// Every speed under every profile reaches the forward leg as the table's duty
+static void check_pump(void)
+{
+    for (uint8_t i = 0; i < PWM_PROFILE_COUNT; i++) {
+        CHECK(pump_set_profile(i) == ESP_OK);
+        CHECK(strcmp(pump_profile_info(i)->name, pwm_profiles[i].name) == 0);
+        for (int s = 0; s < 256; s++) {
+            pump_set_speed(s);
+            CHECK_EQ(hal_pwm_get_duty(0), pwm_profiles[i].lut[s]);
+        }
+    }
+    CHECK(pump_profile_info(PWM_PROFILE_COUNT) == NULL);
+    pump_set_speed(0);
+}
+
+// What the hot path would do without the tables
+static uint32_t curve_duty(const pwm_profile_t *p, const csv_profile_t *c, uint8_t speed)
+{
+    uint32_t top = (1u << p->bits) - 1;
+    double dead = c->dead_zone * top;
+
+    return speed ? (uint32_t)lround(dead + (top - dead) * pow(speed / 255.0, c->gamma)) : 0;
+}
+
+int main(void)
+{
+    csv_profile_t csv[PWM_PROFILE_COUNT + 1];
+    volatile uint32_t sink;
+
+    CHECK_EQ(load_csv(csv, PWM_PROFILE_COUNT + 1), PWM_PROFILE_COUNT);
+    for (int i = 0; i < PWM_PROFILE_COUNT; i++) {
+        check_table(&pwm_profiles[i], &csv[i]);
+    }
+    pump_init();
+    check_pump();
+
+    const pwm_profile_t *volatile p = &pwm_profiles[1];
+    double lut_ns = BENCH_NS(i, LOOKUPS, sink = p->lut[i & 0xff]);
+    double curve_ns = BENCH_NS(i, LOOKUPS, sink = curve_duty(p, &csv[1], i & 0xff));
+    (void)sink;
+    printf("speed to duty: table %.2f ns, curve %.2f ns\n", lut_ns, curve_ns);
+    CHECK(lut_ns < curve_ns);
+    printf("test_pwm_tables: ok\n");
+    return 0;
+}
@@ -0,0 +1,347 @@
+// Speed ramps on the mock fade engine, driven the way the control task
+// drives them: pump_poll() runs only when a fade-end interrupt arrives or
+// when the deadline it last returned falls due. Checks how each ramp is cut
+// into hardware fades (where each one heads and for how long, segments that
+// don't move the duty folded into the next, small steps jumping), that
+// completion comes from the interrupt alone, that a lost interrupt only
+// delays a ramp by the grace time, and that a new command mid-ramp carries
+// on from the duty reached without a jump, even with a stale fade end
+// pending. Stops and direction changes cut a ramp short. No fade is ever
+// started on, or a duty written to, a channel still fading.
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "hal_mock.h"
+#include "pump.h"
+#include "test_util.h"
+
+#define IA              0             // LEDC channels of pump 0
+#define IB              1
+#define MIN_SEG_MS      10            // pump.c: RAMP_MIN_SEG_MS
+#define GRACE_MS        20            // pump.c: RAMP_GRACE_US
+#define MAX_FADES       64
+
+typedef struct {
+    int64_t at_ms;                    // Started, from the command
+    uint32_t target;
+    uint32_t ms;
+} fade_t;
+
+static const pwm_profile_t *profile;
+static fade_t fades[MAX_FADES];
+static int n_fades;
+static uint32_t seen_fades, seen_ends;
+static int64_t t0_ms, due_ms = -1;
+static int deadline_wakes;
+
+static int64_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+// Log the fade a poll or command started on the driving leg, if any
+static void note_fade(void)
+{
+    const hal_mock_pwm_channel_t *c = &hal_mock_pwm_channels[IA];
+
+    if (c->fades == seen_fades) {
+        return;
+    }
+    CHECK_EQ(c->fades - seen_fades, 1);
+    CHECK(n_fades < MAX_FADES);
+    fades[n_fades++] = (fade_t){ now_ms() - t0_ms, c->fade_target, c->fade_ms };
+    seen_fades = c->fades;
+}
+
+static void poll(void)
+{
+    seen_ends = hal_mock_pwm_channels[IA].fade_ends;
+    int32_t ms = pump_poll();
+    due_ms = ms < 0 ? -1 : now_ms() + ms;
+    note_fade();
+}
+
+// A command reaches the control task, which applies it and polls
+static void command(uint8_t speed)
+{
+    pump_set_speed(speed);
+    note_fade();
+    poll();
+}
+
+// One millisecond of the control task blocked in its notification wait
+static void tick(void)
+{
+    host_advance_us(1000);
+    bool ended = hal_mock_pwm_channels[IA].fade_ends != seen_ends;
+    if (ended || (due_ms >= 0 && now_ms() >= due_ms)) {
+        deadline_wakes += !ended;
+        poll();
+    }
+}
+
+// Run for ms, the duty only moving in dir (+1 up, -1 down)
+static void run_monotone(int ms, int dir)
+{
+    for (int i = 0; i < ms; i++) {
+        uint32_t before = hal_pwm_get_duty(IA);
+        tick();
+        int64_t step = (int64_t)hal_pwm_get_duty(IA) - before;
+        CHECK(step * dir >= 0);
+    }
+}
+
+static int64_t run_until_idle(void)
+{
+    for (int i = 0; i < 20000 && pump_is_ramping(0); i++) {
+        tick();
+    }
+    CHECK(!pump_is_ramping(0));
+    return now_ms() - t0_ms;
+}
+
+// Lowest speed whose duty reaches duty: where a ramp from duty starts
+static uint8_t speed_of(uint32_t duty)
+{
+    int s = 0;
+
+    while (s < 255 && profile->lut[s] < duty) {
+        s++;
+    }
+    return s;
+}
+
+// Speed at the end of segment k of n, as the shapes are specified
+static int shape_point(pump_ramp_t shape, int from, int to, int k, int n)
+{
+    if (shape == PUMP_RAMP_SCURVE) {
+        return from + (to - from) * k * k * (3 * n - 2 * k) / (n * n * n);
+    }
+    return from + (to - from) * k / n;
+}
+
+// Settle at from without ramping, then start a fresh fade log
+static void start_at(uint8_t from, pump_ramp_t shape, uint16_t ramp_ms)
+{
+    CHECK(pump_set_ramp(PUMP_RAMP_OFF, 0) == ESP_OK);
+    pump_set_speed(from);
+    CHECK(pump_set_ramp(shape, ramp_ms) == ESP_OK);
+    CHECK_EQ(hal_pwm_get_duty(IA), profile->lut[from]);
+    poll();
+    n_fades = 0;
+    deadline_wakes = 0;
+    t0_ms = now_ms();
+}
+
+// Ramp from -> to and check every fade against the specified segmentation;
+// returns the number of segments
+static int check_segments(pump_ramp_t shape, uint16_t ramp_ms, uint8_t from, uint8_t to)
+{
+    start_at(from, shape, ramp_ms);
+    command(to);
+
+    uint32_t ms = (uint32_t)ramp_ms * abs(to - from) / 255;
+    int n = ms / MIN_SEG_MS > PUMP_RAMP_SEGMENTS ? PUMP_RAMP_SEGMENTS : ms / MIN_SEG_MS;
+    if (n == 0) {
+        CHECK(!pump_is_ramping(0));
+        CHECK_EQ(n_fades, 0);
+        CHECK_EQ(hal_pwm_get_duty(IA), profile->lut[to]);
+        return 0;
+    }
+    uint32_t seg = ms / n;
+    int64_t took = run_until_idle();
+
+    // Each fade covers the segments up to the next change of duty
+    uint32_t duty = profile->lut[from];
+    int64_t at = 0;
+    int f = 0;
+    for (int k = 1; k <= n; k++) {
+        uint32_t end = profile->lut[shape_point(shape, from, to, k, n)];
+        if (end == duty) {
+            continue;
+        }
+        CHECK(f < n_fades);
+        CHECK_EQ(fades[f].target, end);
+        CHECK_EQ(fades[f].ms, k * seg - at);
+        CHECK_EQ(fades[f].at_ms, at);
+        at = k * seg;
+        duty = end;
+        f++;
+    }
+    CHECK_EQ(f, n_fades);
+    CHECK_EQ(took, (int64_t)n * seg);
+    CHECK_EQ(hal_pwm_get_duty(IA), profile->lut[to]);
+    CHECK_EQ(deadline_wakes, 0);
+    printf("%-6s %3d -> %3d over %4u ms: %d segments of %3u ms, %d fades\n",
+           shape == PUMP_RAMP_SCURVE ? "scurve" : "linear", from, to, ramp_ms, n, seg, n_fades);
+    return n;
+}
+
+static void test_segments(void)
+{
+    CHECK_EQ(check_segments(PUMP_RAMP_LINEAR, 800, 0, 255), PUMP_RAMP_SEGMENTS);
+    CHECK_EQ(n_fades, PUMP_RAMP_SEGMENTS);
+
+    // Gentle at both ends: the first and last segments move the least
+    CHECK_EQ(check_segments(PUMP_RAMP_SCURVE, 800, 0, 255), PUMP_RAMP_SEGMENTS);
+    int first = speed_of(fades[0].target);
+    int mid = speed_of(fades[PUMP_RAMP_SEGMENTS / 2].target) -
+              speed_of(fades[PUMP_RAMP_SEGMENTS / 2 - 1].target);
+    int last = 255 - speed_of(fades[PUMP_RAMP_SEGMENTS - 2].target);
+    CHECK(first * 3 < mid && last * 3 < mid);
+
+    // Part of full scale takes that part of the time; down works the same
+    check_segments(PUMP_RAMP_LINEAR, 800, 0, 128);
+    check_segments(PUMP_RAMP_SCURVE, 800, 200, 40);
+
+    // Eight segments over five speeds: those that don't change the speed
+    // fold into the next fade
+    CHECK_EQ(check_segments(PUMP_RAMP_LINEAR, 5000, 250, 255), PUMP_RAMP_SEGMENTS);
+    CHECK(n_fades < PUMP_RAMP_SEGMENTS);
+
+    // Shorter than one segment: jumps; just long enough: a single fade
+    CHECK_EQ(check_segments(PUMP_RAMP_LINEAR, 500, 100, 105), 0);
+    CHECK_EQ(check_segments(PUMP_RAMP_LINEAR, 500, 100, 106), 1);
+    CHECK_EQ(n_fades, 1);
+}
+
+// Every new command mid-ramp starts from the duty reached, proportionally
+// timed; no jump at the switch, no turning back within a leg
+static void test_retarget(void)
+{
+    start_at(0, PUMP_RAMP_LINEAR, 1000);
+    uint32_t stops = hal_mock_pwm_channels[IA].fade_stops;
+
+    command(255);
+    run_monotone(500, +1);
+    uint32_t at = hal_pwm_get_duty(IA);
+    CHECK(at > profile->lut[100] && at < profile->lut[255]);
+    command(100);
+    CHECK_EQ(hal_pwm_get_duty(IA), at);
+    CHECK_EQ(hal_mock_pwm_channels[IA].fade_stops, stops + 1);
+    CHECK_EQ(pump_get_channel(0), 100);
+    run_monotone(60, -1);
+
+    at = hal_pwm_get_duty(IA);
+    CHECK(at > profile->lut[100]);
+    int64_t t = now_ms();
+    int n0 = n_fades;
+    command(200);
+    CHECK_EQ(hal_pwm_get_duty(IA), at);
+    CHECK_EQ(hal_mock_pwm_channels[IA].fade_stops, stops + 2);
+    while (pump_is_ramping(0)) {
+        run_monotone(1, +1);
+    }
+    CHECK_EQ(hal_pwm_get_duty(IA), profile->lut[200]);
+
+    // The last leg is timed from where it started
+    uint32_t ms = 1000 * (200 - speed_of(at)) / 255;
+    int n = ms / MIN_SEG_MS > PUMP_RAMP_SEGMENTS ? PUMP_RAMP_SEGMENTS : ms / MIN_SEG_MS;
+    CHECK_EQ(now_ms() - t, (int64_t)n * (ms / n));
+    CHECK_EQ(fades[n0].at_ms, t - t0_ms);
+    printf("retarget: 0 -> 255, at 500 ms -> 100, at 560 ms -> 200 from %u: %d fades, done at "
+           "%lld ms\n", speed_of(at), n_fades, (long long)(now_ms() - t0_ms));
+
+    // Retargeted on the very tick a fade ended, before the control task got
+    // to it: that end must not cut the new ramp's first fade short
+    start_at(0, PUMP_RAMP_LINEAR, 800);
+    command(255);
+    run_monotone(99, +1);
+    host_advance_us(1000);            // Fade 1 ends; the task hasn't run yet
+    CHECK_EQ(hal_pwm_get_duty(IA), fades[0].target);
+    command(128);
+    CHECK(pump_is_ramping(0));
+    fade_t first = fades[n_fades - 1];
+    CHECK_EQ(first.at_ms, 100);
+    while (pump_is_ramping(0)) {
+        run_monotone(1, +1);
+    }
+    CHECK_EQ(fades[n_fades - 1].at_ms + fades[n_fades - 1].ms, now_ms() - t0_ms);
+    CHECK(n_fades >= 3 && fades[2].at_ms == first.at_ms + first.ms);
+    CHECK_EQ(hal_pwm_get_duty(IA), profile->lut[128]);
+}
+
+// With the interrupt lost, the deadline pump_poll() returned carries the ramp
+// on at most the grace time late
+static void test_lost_end(void)
+{
+    start_at(0, PUMP_RAMP_LINEAR, 800);
+    hal_mock_pwm_lost_ends = 2;
+    command(255);
+    int64_t took = run_until_idle();
+    CHECK_EQ(hal_mock_pwm_lost_ends, 0);
+    CHECK_EQ(deadline_wakes, 2);
+    CHECK(took > 800 && took <= 800 + 2 * (GRACE_MS + 1));
+    CHECK_EQ(hal_pwm_get_duty(IA), profile->lut[255]);
+    printf("2 fade ends lost: done at %lld ms instead of 800\n", (long long)took);
+}
+
+// Stops and direction changes cut a ramp short on the spot; a speed held
+// through the brake ramps up from standstill on the other leg
+static void test_cut_short(void)
+{
+    start_at(0, PUMP_RAMP_LINEAR, 800);
+    command(255);
+    run_monotone(250, +1);
+    pump_stop_with(PUMP_STOP_COAST);
+    CHECK(!pump_is_ramping(0));
+    CHECK_EQ(hal_pwm_get_duty(IA), 0);
+    uint32_t n = hal_mock_pwm_channels[IA].fades;
+    for (int i = 0; i < 1000; i++) {
+        tick();
+    }
+    CHECK_EQ(hal_mock_pwm_channels[IA].fades, n);
+    CHECK_EQ(hal_pwm_get_duty(IA), 0);
+
+    command(200);
+    run_monotone(200, +1);
+    uint32_t ib_fades = hal_mock_pwm_channels[IB].fades;
+    CHECK(pump_set_direction(0, PUMP_REVERSE) == ESP_OK);
+    CHECK(!pump_is_ramping(0));
+    CHECK_EQ(hal_pwm_get_duty(IA), hal_pwm_get_duty(IB));   // Braking
+    CHECK(hal_pwm_get_duty(IA) > 0);
+    command(200);                     // Held until the brake releases
+    CHECK(pump_is_braking(0) && !pump_is_ramping(0));
+    for (int i = 0; i < 2000 && !pump_is_ramping(0); i++) {
+        tick();
+    }
+    CHECK(!pump_is_braking(0) && pump_is_ramping(0));
+    CHECK_EQ(hal_pwm_get_duty(IA), 0);
+    CHECK(hal_pwm_get_duty(IB) < profile->lut[200]);
+    for (int i = 0; i < 2000 && pump_is_ramping(0); i++) {
+        host_advance_us(1000);
+        pump_poll();
+    }
+    CHECK(!pump_is_ramping(0));
+    CHECK(hal_mock_pwm_channels[IB].fades > ib_fades);
+    CHECK_EQ(hal_pwm_get_duty(IA), 0);
+    CHECK_EQ(hal_pwm_get_duty(IB), profile->lut[200]);
+    pump_stop_with(PUMP_STOP_COAST);
+    CHECK(pump_set_direction(0, PUMP_FORWARD) == ESP_OK);
+    for (int i = 0; i < 2000; i++) {
+        host_advance_us(1000);
+        pump_poll();
+    }
+}
+
+int main(void)
+{
+    host_clock_manual();
+    pump_init();
+    profile = pump_profile_info(pump_get_profile());
+    seen_fades = hal_mock_pwm_channels[IA].fades;
+
+    test_segments();
+    test_retarget();
+    test_lost_end();
+    test_cut_short();
+
+    for (int leg = IA; leg <= IB; leg++) {
+        CHECK_EQ(hal_mock_pwm_channels[leg].busy_fades, 0);
+        CHECK_EQ(hal_mock_pwm_channels[leg].busy_latches, 0);
+    }
+    CHECK(pump_set_ramp(PUMP_RAMP_OFF, 0) == ESP_OK);
+    printf("test_ramp: ok\n");
+    return 0;
+}
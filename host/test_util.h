@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "host.h"
+
+// Checks for the host tests: the first one that fails ends the test with
+// its location, so ctest shows exactly what broke.
+
+#define CHECK(cond) do {                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ(a, b) do {                                                 \
+        long long a_ = (long long)(a), b_ = (long long)(b);                 \
+        if (a_ != b_) {                                                     \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+                    __FILE__, __LINE__, #a, #b, a_, b_);                    \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+// Thread CPU time per run of the statement for var = 0..n-1, in nanoseconds
+#define BENCH_NS(var, n, ...) ({                                           \
+        long n_ = (n);                                                      \
+        int64_t t0_ = host_thread_ns();                                     \
+        for (long var = 0; var < n_; var++) {                               \
+            __VA_ARGS__;                                                    \
+        }                                                                   \
+        (double)(host_thread_ns() - t0_) / n_;                              \
+    })
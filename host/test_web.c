@@ -0,0 +1,60 @@
+// The pump endpoints through the mock httpd: /spray and /stop reach the
+// control task, bad parameters get a 400, and nothing else matches.
+
+#include <string.h>
+#include "httpd_mock.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "test_util.h"
+#include "web_server.h"
+
+static int get(const char *uri, const char *want_body)
+{
+    host_http_t h;
+
+    host_http_init(&h, HTTP_GET, uri);
+    CHECK(host_http_run(&h) == ESP_OK || host_http_status(&h) >= 400);
+    CHECK(h.finished);
+    if (want_body) {
+        CHECK(h.resp && strcmp((char *)h.resp, want_body) == 0);
+    }
+    int status = host_http_status(&h);
+    host_http_free(&h);
+    host_settle();                    // Let the control task act on it
+    return status;
+}
+
+int main(void)
+{
+    pump_init();
+    CHECK(pump_ctrl_start() == ESP_OK);
+    CHECK(start_webserver() != NULL);
+
+    CHECK_EQ(get("/spray?pwm=128", "OK"), 200);
+    CHECK_EQ(pump_get_speed(), 128);
+    CHECK_EQ(get("/spray?pwm=40&ch=0", "OK"), 200);
+    CHECK_EQ(pump_get_speed(), 40);
+
+    // Out of range: ignored, or refused when it names a channel
+    CHECK_EQ(get("/spray?pwm=300", "OK"), 200);
+    CHECK_EQ(pump_get_speed(), 40);
+    CHECK_EQ(get("/spray?pwm=10&ch=9", NULL), 400);
+    CHECK_EQ(pump_get_speed(), 40);
+
+    CHECK_EQ(get("/stop?mode=slide", NULL), 400);
+    CHECK_EQ(pump_get_speed(), 40);
+    CHECK_EQ(get("/stop?mode=coast", "OK"), 200);
+    CHECK_EQ(pump_get_speed(), 0);
+    CHECK(!pump_is_braking(0));
+
+    CHECK_EQ(get("/spray?pwm=200", "OK"), 200);
+    CHECK_EQ(get("/stop", "OK"), 200);
+    CHECK_EQ(pump_get_speed(), 0);
+
+    host_http_t h;
+    host_http_init(&h, HTTP_PUT, "/spray?pwm=1");
+    CHECK(host_http_run(&h) == ESP_ERR_NOT_FOUND);
+
+    printf("test_web: ok\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "hal.h"
+#include "assets.h"
+
+static const char *TAG = "assets";
+
+static const assets_hdr_t *hdr;       // NULL until a valid archive is mapped
+static const assets_entry_t *toc;
+
+static bool entry_valid(const assets_entry_t *e, uint32_t data_start, uint32_t size)
+{
+    return e->path[0] == '/' && memchr(e->path, '\0', sizeof(e->path)) != NULL &&
+           memchr(e->type, '\0', sizeof(e->type)) != NULL &&
+           e->offset >= data_start && e->offset <= size && e->len <= size - e->offset;
+}
+
+static bool header_valid(const assets_hdr_t *h, uint32_t part_size, uint32_t toc_end)
+{
+    if (h->magic != ASSETS_MAGIC || h->version != ASSETS_VERSION ||
+        h->size > part_size || h->size < toc_end) {
+        return false;
+    }
+#if CONFIG_PLANTDOC_FAST_BOOT
+    return true;                      // Trust the flash rather than read all of it
+#else
+    return esp_rom_crc32_le(0, (const uint8_t *)h + sizeof(*h), h->size - sizeof(*h)) == h->crc;
+#endif
+}
+
+esp_err_t assets_init(void)
+{
+    const uint8_t *base;
+    uint32_t part_size;
+    int64_t t0 = esp_timer_get_time();
+
+    esp_err_t err = hal_flash_assets_map(&base, &part_size);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No assets partition, web UI unavailable");
+        return err;
+    }
+
+    const assets_hdr_t *h = (const assets_hdr_t *)base;
+    uint32_t toc_end = sizeof(*h) + h->count * sizeof(assets_entry_t);
+    if (!header_valid(h, part_size, toc_end)) {
+        ESP_LOGW(TAG, "No valid archive in the assets partition; run idf.py assets-flash");
+        return ESP_ERR_INVALID_CRC;
+    }
+    const assets_entry_t *t = (const assets_entry_t *)(base + sizeof(*h));
+    for (int i = 0; i < h->count; i++) {
+        if (!entry_valid(&t[i], toc_end, h->size) ||
+            (i > 0 && strcmp(t[i - 1].path, t[i].path) >= 0)) {
+            ESP_LOGW(TAG, "Bad table of contents entry %d", i);
+            return ESP_ERR_INVALID_CRC;
+        }
+    }
+
+    toc = t;
+    hdr = h;
+    ESP_LOGI(TAG, "%u files, %lu bytes, checked in %lu us", h->count,
+             (unsigned long)h->size, (unsigned long)(esp_timer_get_time() - t0));
+    return ESP_OK;
+}
+
+bool assets_find(const char *path, asset_t *out)
+{
+    int lo = 0, hi = hdr ? hdr->count : 0;
+
+    // Binary search; the packer sorts the table by path
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(path, toc[mid].path);
+        if (cmp == 0) {
+            const assets_entry_t *e = &toc[mid];
+            out->data = (const uint8_t *)hdr + e->offset;
+            out->len = e->len;
+            out->type = e->type;
+            out->crc = e->crc;
+            out->gzip = e->flags & ASSET_GZIP;
+            return true;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Web UI assets in the "assets" flash partition.
+//
+// tools/asset_pack.py packs main/www into an archive that is flashed on its
+// own (idf.py assets-flash), so a UI change doesn't need an app rebuild.
+// At boot the partition is memory-mapped and checked once; lookups return
+// pointers into the mapping, which handlers send from without copying.
+//
+// Layout, little-endian: an assets_hdr_t, count assets_entry_t sorted by
+// path, then the file data. crc covers everything after the header up to
+// size. Files are stored precompressed (ASSET_GZIP) unless gzip doesn't
+// shrink them.
+
+#define ASSETS_MAGIC        0x31414450    // "PDA1"
+#define ASSETS_VERSION      1
+#define ASSETS_PATH_MAX     40
+#define ASSETS_TYPE_MAX     24
+
+#define ASSET_GZIP          0x1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;                    // Whole archive, header included
+    uint32_t crc;                     // CRC-32 of bytes [sizeof(hdr), size)
+} assets_hdr_t;
+
+typedef struct {
+    char path[ASSETS_PATH_MAX];       // "/index.html", NUL padded
+    char type[ASSETS_TYPE_MAX];       // Content-Type, NUL padded
+    uint32_t offset;                  // From the start of the archive
+    uint32_t len;                     // Stored (possibly compressed) bytes
+    uint32_t crc;                     // CRC-32 of the stored bytes, the ETag
+    uint32_t flags;                   // ASSET_*
+} assets_entry_t;
+
+_Static_assert(sizeof(assets_hdr_t) == 16, "wire layout, see asset_pack.py");
+_Static_assert(sizeof(assets_entry_t) == 80, "wire layout, see asset_pack.py");
+
+typedef struct {
+    const uint8_t *data;              // In the flash mapping
+    size_t len;
+    const char *type;
+    uint32_t crc;
+    bool gzip;
+} asset_t;
+
+// Map the partition and validate the archive. ESP_ERR_NOT_FOUND without the
+// partition, ESP_ERR_INVALID_CRC when it holds no valid archive (not
+// flashed yet, or flashed with a different layout).
+esp_err_t assets_init(void);
+
+// Look a file up by path ("/index.html"); false if absent or not mounted
+bool assets_find(const char *path, asset_t *out);
@@ -0,0 +1,162 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mem_budget.h"
+#include "boot.h"
+
+static const char *TAG = "boot";
+
+#define BOOT_WORKER_STACK   4096      // Stages run on it: WiFi init is the deepest
+#define BOOT_HELPER_BIT(c)  (1u << (BOOT_MAX_STAGES + (c)))
+
+_Static_assert(BOOT_MAX_STAGES + portNUM_PROCESSORS <= 24, "event group has 24 bits");
+
+static const boot_stage_t *stages;
+static int n_stages;
+static boot_record_t records[BOOT_MAX_STAGES];
+static EventGroupHandle_t resolved;   // Stage bits once finished or skipped, helper exit bits
+static StaticEventGroup_t resolved_buf;
+MEM_TASK(helper_mem, "boot", BOOT_WORKER_STACK);  // Dual core: one helper
+
+// Guarded by boot_lock
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t claimed;
+static uint32_t failed;               // Required stages that didn't succeed
+
+static volatile bool boot_done;
+static uint32_t boot_total_us;
+
+int boot_pick(const boot_stage_t *list, int n, uint32_t taken, uint32_t finished)
+{
+    for (int i = 0; i < n; i++) {
+        if (!(taken & BOOT_AFTER(i)) && (list[i].after & ~finished) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void run_stage(int i)
+{
+    const boot_stage_t *s = &stages[i];
+    boot_record_t *r = &records[i];
+
+    portENTER_CRITICAL(&boot_lock);
+    bool skip = (s->after & failed) != 0;
+    portEXIT_CRITICAL(&boot_lock);
+
+    r->core = xPortGetCoreID();
+    r->start_us = (uint32_t)esp_timer_get_time();
+    r->err = skip ? ESP_ERR_INVALID_STATE : s->run();
+    r->end_us = (uint32_t)esp_timer_get_time();
+
+    if (skip) {
+        ESP_LOGE(TAG, "%s skipped, a stage it needs failed", s->name);
+    } else if (r->err == ESP_ERR_NOT_SUPPORTED && s->optional) {
+        // Not configured in; nothing to say
+    } else if (r->err != ESP_OK && s->optional) {
+        ESP_LOGW(TAG, "%s failed: %s", s->name, esp_err_to_name(r->err));
+    } else if (r->err != ESP_OK) {
+        ESP_LOGE(TAG, "%s failed: %s", s->name, esp_err_to_name(r->err));
+    }
+    if (r->err != ESP_OK && !s->optional) {
+        portENTER_CRITICAL(&boot_lock);
+        failed |= BOOT_AFTER(i);
+        portEXIT_CRITICAL(&boot_lock);
+    }
+    xEventGroupSetBits(resolved, BOOT_AFTER(i));
+}
+
+// Take ready stages until none are left unclaimed
+static void worker(void)
+{
+    const uint32_t all = BOOT_AFTER(n_stages) - 1;
+
+    for (;;) {
+        uint32_t finished = xEventGroupGetBits(resolved) & all;
+
+        portENTER_CRITICAL(&boot_lock);
+        int i = boot_pick(stages, n_stages, claimed, finished);
+        if (i >= 0) {
+            claimed |= BOOT_AFTER(i);
+        }
+        bool left = (claimed & all) != all;
+        portEXIT_CRITICAL(&boot_lock);
+
+        if (i >= 0) {
+            run_stage(i);
+        } else if (left) {
+            // Everything left waits on a running stage: sleep until one ends
+            xEventGroupWaitBits(resolved, all & ~finished, pdFALSE, pdFALSE, portMAX_DELAY);
+        } else {
+            return;
+        }
+    }
+}
+
+static void helper_task(void *arg)
+{
+    worker();
+    xEventGroupSetBits(resolved, BOOT_HELPER_BIT(xPortGetCoreID()));
+    mem_task_end(&helper_mem);
+}
+
+esp_err_t boot_run(const boot_stage_t *list, int n)
+{
+    int64_t t0 = esp_timer_get_time();
+    uint32_t helpers = 0, busy_us = 0;
+    esp_err_t err = ESP_OK;
+
+    if (n > BOOT_MAX_STAGES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < n; i++) {
+        if (list[i].after & ~(BOOT_AFTER(i) - 1)) {
+            return ESP_ERR_INVALID_ARG;   // Forward or self reference: could never run
+        }
+        records[i] = (boot_record_t){ .name = list[i].name };
+    }
+    claimed = failed = 0;
+    boot_done = false;
+    stages = list;
+    n_stages = n;
+    resolved = xEventGroupCreateStatic(&resolved_buf);
+
+    // This task works on its own core, a helper on each of the others. If a
+    // helper can't be created the stages just run on fewer cores.
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        if (c != xPortGetCoreID() &&
+            mem_task_start(&helper_mem, helper_task, NULL, uxTaskPriorityGet(NULL), c,
+                           NULL) == ESP_OK) {
+            helpers |= BOOT_HELPER_BIT(c);
+        }
+    }
+    worker();
+    if (helpers) {
+        xEventGroupWaitBits(resolved, helpers, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    vEventGroupDelete(resolved);
+
+    for (int i = 0; i < n; i++) {
+        busy_us += records[i].end_us - records[i].start_us;
+        if (err == ESP_OK && (failed & BOOT_AFTER(i))) {
+            err = records[i].err;
+        }
+    }
+    boot_total_us = (uint32_t)(esp_timer_get_time() - t0);
+    boot_done = true;
+    ESP_LOGI(TAG, "%d stages in %lu ms (%lu ms of work), %lu ms after app start", n,
+             (unsigned long)(boot_total_us / 1000), (unsigned long)(busy_us / 1000),
+             (unsigned long)(esp_timer_get_time() / 1000));
+    return err;
+}
+
+int boot_get_records(const boot_record_t **out, bool *done, uint32_t *total_us)
+{
+    *out = records;
+    *done = boot_done;
+    *total_us = boot_done ? boot_total_us : 0;
+    return n_stages;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Boot sequencing.
+//
+// app_main describes bring-up as a table of stages, each naming the stages
+// that must finish before it. boot_run() works through the table with one
+// worker per core: a free worker takes the first stage, in table order,
+// whose prerequisites are all done, so independent stages (WiFi, the
+// classifier model, the asset archive...) overlap instead of queueing
+// behind each other. List the pump's safe state first and it is the first
+// thing started.
+//
+// A stage that fails skips everything after it in the graph and makes
+// boot_run() fail, unless it is optional (a missing sensor, a disabled
+// listener); ESP_ERR_NOT_SUPPORTED from an optional stage isn't logged.
+// Every stage records when it ran and on which core, for /boot.
+
+#define BOOT_MAX_STAGES     16
+#define BOOT_AFTER(i)       (1u << (i))
+
+typedef struct {
+    const char *name;
+    esp_err_t (*run)(void);
+    uint32_t after;                   // BOOT_AFTER() of each prerequisite
+    bool optional;
+} boot_stage_t;
+
+typedef struct {
+    const char *name;
+    uint32_t start_us;                // esp_timer time, i.e. since the app started
+    uint32_t end_us;                  // 0 until the stage finishes
+    esp_err_t err;
+    uint8_t core;
+} boot_record_t;
+
+// Run every stage and return once all have finished or been skipped:
+// ESP_OK, or the error of the first required stage in table order that
+// failed. Stages may only depend on earlier ones.
+esp_err_t boot_run(const boot_stage_t *stages, int n);
+
+// The stage a free worker takes next: the first one not claimed whose
+// prerequisites are in resolved, or -1
+int boot_pick(const boot_stage_t *stages, int n, uint32_t claimed, uint32_t resolved);
+
+// Records of the stages in table order, complete or not; returns the count.
+// done is set once boot_run() has returned, total_us to how long it took.
+int boot_get_records(const boot_record_t **records, bool *done, uint32_t *total_us);
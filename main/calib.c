@@ -0,0 +1,306 @@
+#include <math.h>
+#include <string.h>
+#include "calib.h"
+
+#define CALIB_MIN_STALL_MA  5         // Less than this at the first points: no current sensor
+#define CALIB_BREAKAWAY_DROP 12       // Percent below the stall line at breakaway
+#define CALIB_CURRENT_SIGMA 10        // mA, ADC noise across the shunt: least scatter believed
+#define CALIB_MOTION_SIGMAS 4         // Current drop off the stall line, in its scatter, that is motion
+
+// Sensor reading at a speed -> output (flow, or speed permille from current)
+static int32_t output(const calib_sweep_t *sw, uint8_t speed, int32_t value)
+{
+    int32_t v = value - sw->base;
+
+    if (sw->source == CALIB_SRC_FLOW) {
+        return v;
+    }
+    if (speed == 0 || sw->stall_ratio == 0) {
+        return 0;
+    }
+    int32_t ratio = (int64_t)v * 1024 / sw->lut[speed];
+    int32_t y = 1000 - (int64_t)ratio * 1000 / sw->stall_ratio;
+    return y < -1000 ? -1000 : y > 1000 ? 1000 : y;
+}
+
+// Output at speed that means the motor turns. Current is read with a fixed
+// error in mA, which at low duty is a large share of the stall current, so
+// the threshold rises there with the scatter measured about the stall line.
+static bool moving(const calib_sweep_t *sw, uint8_t speed, int32_t y)
+{
+    int32_t min = sw->noise;
+
+    if (sw->source == CALIB_SRC_CURRENT && speed > 0) {
+        int64_t stall_ma = (int64_t)sw->stall_ratio * sw->lut[speed] / 1024;
+        int64_t t = stall_ma > 0 ? (int64_t)CALIB_MOTION_SIGMAS * sw->stall_sigma * 1000 / stall_ma
+                                 : 1000;
+        min = t > min ? t : min;
+    }
+    return y > min;
+}
+
+static bool fail(calib_sweep_t *sw, const char *why)
+{
+    sw->phase = CALIB_FAILED;
+    sw->error = why;
+    sw->speed = 0;
+    return false;
+}
+
+// Least-squares monotone fit (pool adjacent violators), in place
+static void fit_monotone(int32_t *y, int n)
+{
+    int64_t sum[CALIB_POINTS];
+    int len[CALIB_POINTS];
+    int blocks = 0;
+
+    for (int i = 0; i < n; i++) {
+        sum[blocks] = y[i];
+        len[blocks] = 1;
+        blocks++;
+        // Merge while the previous block's mean exceeds this one's
+        while (blocks > 1 && sum[blocks - 2] * len[blocks - 1] > sum[blocks - 1] * len[blocks - 2]) {
+            sum[blocks - 2] += sum[blocks - 1];
+            len[blocks - 2] += len[blocks - 1];
+            blocks--;
+        }
+    }
+    for (int b = 0, i = 0; b < blocks; b++) {
+        for (int j = 0; j < len[b]; j++) {
+            y[i++] = (int32_t)(sum[b] / len[b]);
+        }
+    }
+}
+
+// Scatter of one current reading, mA, from the top half of the up sweep:
+// current changes slowly with speed there, so second differences are
+// noise, with 6 sigma^2 of variance
+static double current_sigma(const calib_sweep_t *sw)
+{
+    double sum = 0;
+    int n = 0;
+
+    for (int i = CALIB_POINTS / 2; i < CALIB_POINTS - 1; i++, n++) {
+        double e = (double)sw->up[i - 1] - 2.0 * sw->up[i] + sw->up[i + 1];
+        sum += e * e;
+    }
+    double sigma = sqrt(sum / n / 6);
+    return sigma > CALIB_CURRENT_SIGMA ? sigma : CALIB_CURRENT_SIGMA;
+}
+
+// Up sweep complete: derive the stall ratio and motion threshold, then
+// bracket the start threshold
+static bool analyze_up(calib_sweep_t *sw)
+{
+    if (sw->source == CALIB_SRC_CURRENT) {
+        if (sw->up[1] - sw->base < CALIB_MIN_STALL_MA) {
+            return fail(sw, "no motor current");
+        }
+        // Stalled, current is proportional to duty, so the points before
+        // breakaway fit a line through the baseline to within the reading
+        // scatter, and the first turning point drops well below it. Walking
+        // up until the line stops fitting, breakaway is the last point to
+        // drop: a noisy early point can fake a drop off a two-point line,
+        // but the line then keeps fitting past it. A motor turning from the
+        // first point on leaves no stall line to measure speed against.
+        double sigma = current_sigma(sw);
+        double sid = 0, sdd = 0, sii = 0, best_sid = 0, best_sdd = 0, best_spread = 0;
+        for (int i = 1; i < CALIB_POINTS; i++) {
+            double d = sw->lut[calib_point_speed(i)];
+            double cur = sw->up[i] - sw->base;
+            if (i >= 3) {
+                int dof = i - 2;
+                double ss = sii - sid * sid / sdd;
+                double line = sid / sdd * d;
+                double z = (line - cur) / (sigma * sqrt(1 + d * d / sdd));
+                if (ss > sigma * sigma * (dof + CALIB_MOTION_SIGMAS * sqrt(2.0 * dof))) {
+                    break;                    // Already turning before this point
+                }
+                if (z >= CALIB_MOTION_SIGMAS && (line - cur) * 100 >= CALIB_BREAKAWAY_DROP * line) {
+                    best_sid = sid;
+                    best_sdd = sdd;
+                    best_spread = sigma * sqrt(1 + d * d / sdd);
+                }
+            }
+            sid += cur * d;
+            sdd += d * d;
+            sii += cur * cur;
+        }
+        if (best_sdd == 0) {
+            return fail(sw, "no stall region, current can't tell speed");
+        }
+        sw->stall_ratio = best_sid * 1024 / best_sdd;
+        sw->stall_sigma = ceil(best_spread);
+        for (int i = 0; i < CALIB_POINTS; i++) {
+            sw->up[i] = output(sw, calib_point_speed(i), sw->up[i]);
+        }
+    }
+
+    int32_t top = 0;
+    for (int i = 0; i < CALIB_POINTS; i++) {
+        if (sw->up[i] > top) {
+            top = sw->up[i];
+        }
+    }
+    sw->noise = sw->source == CALIB_SRC_FLOW ? CALIB_FLOW_NOISE : CALIB_CURRENT_NOISE;
+    if (top / 50 > sw->noise) {
+        sw->noise = top / 50;
+    }
+
+    // Start: first point from which every later one moves
+    int first = CALIB_POINTS;
+    while (first > 1 && moving(sw, calib_point_speed(first - 1), sw->up[first - 1])) {
+        first--;
+    }
+    if (first == CALIB_POINTS) {
+        return fail(sw, "motor never moved");
+    }
+    sw->lo = calib_point_speed(first - 1);
+    sw->hi = calib_point_speed(first);
+    sw->start_output = sw->up[first];
+    return true;
+}
+
+// Fit the up sweep and place the knots. Below the start threshold the
+// motor doesn't turn from rest, so the curve is 0 there and then jumps to
+// the output measured at the threshold.
+static void fit_curve(calib_sweep_t *sw)
+{
+    calib_curve_t *c = &sw->curve;
+    uint8_t sp[CALIB_POINTS + 1];
+    int32_t y[CALIB_POINTS + 1];
+    int n = 0;
+
+    sp[n] = c->start;
+    y[n++] = sw->start_output;
+    for (int i = 1; i < CALIB_POINTS; i++) {
+        if (calib_point_speed(i) > c->start) {
+            sp[n] = calib_point_speed(i);
+            y[n++] = sw->up[i];
+        }
+    }
+    fit_monotone(y, n);
+
+    int sat = n - 1;
+    while (sat > 0 && (int64_t)y[sat - 1] * 1000 >= (int64_t)y[n - 1] * CALIB_SAT_PERMILLE) {
+        sat--;
+    }
+    c->saturation = sp[sat];
+    c->full_output = y[sat];
+
+    c->knots[0] = c->start;
+    c->knots[CALIB_KNOTS - 1] = c->saturation;
+    for (int k = 1; k < CALIB_KNOTS - 1; k++) {
+        int32_t target = (int64_t)c->full_output * k / (CALIB_KNOTS - 1);
+        int i = 0;
+        while (i < sat && y[i] < target) {
+            i++;
+        }
+        int s = sp[i];
+        if (i > 0 && y[i] > y[i - 1] && target > y[i - 1]) {
+            s = sp[i - 1] + (sp[i] - sp[i - 1]) * (target - y[i - 1]) / (y[i] - y[i - 1]);
+        }
+        c->knots[k] = s < c->knots[k - 1] ? c->knots[k - 1] : s;
+    }
+}
+
+void calib_begin(calib_sweep_t *sw, calib_source_t source, const pwm_profile_t *profile)
+{
+    memset(sw, 0, sizeof(*sw));
+    sw->source = source;
+    sw->lut = profile->lut;
+    sw->phase = CALIB_BASELINE;
+    sw->speed = 0;
+    sw->from_rest = true;
+}
+
+bool calib_step(calib_sweep_t *sw, int32_t value)
+{
+    switch (sw->phase) {
+    case CALIB_BASELINE:
+        sw->base = value;
+        sw->up[0] = sw->source == CALIB_SRC_FLOW ? 0 : value;
+        sw->phase = CALIB_UP;
+        sw->idx = 1;
+        sw->speed = calib_point_speed(1);
+        sw->from_rest = false;
+        return true;
+
+    case CALIB_UP:
+        // Raw for now; current needs the stall ratio, known only at the end
+        sw->up[sw->idx] = sw->source == CALIB_SRC_FLOW ? value - sw->base : value;
+        if (++sw->idx < CALIB_POINTS) {
+            sw->speed = calib_point_speed(sw->idx);
+            return true;
+        }
+        if (!analyze_up(sw)) {
+            return false;
+        }
+        sw->phase = CALIB_REFINE;
+        sw->speed = (sw->lo + sw->hi) / 2;
+        sw->from_rest = true;
+        if (sw->hi - sw->lo > 1) {
+            return true;
+        }
+        value = 0;                    // Bracket already tight, nothing to probe
+        /* fall through */
+
+    case CALIB_REFINE:
+        if (sw->hi - sw->lo > 1) {
+            int32_t y = output(sw, sw->speed, value);
+            if (moving(sw, sw->speed, y)) {
+                sw->hi = sw->speed;
+                sw->start_output = y;
+            } else {
+                sw->lo = sw->speed;
+            }
+        }
+        if (sw->hi - sw->lo > 1) {
+            sw->speed = (sw->lo + sw->hi) / 2;
+            return true;
+        }
+        sw->curve.start = sw->hi;
+        sw->phase = CALIB_DOWN;
+        sw->idx = CALIB_POINTS - 1;
+        sw->speed = calib_point_speed(sw->idx);
+        sw->from_rest = false;
+        return true;
+
+    case CALIB_DOWN:
+        if (moving(sw, sw->speed, output(sw, sw->speed, value))) {
+            sw->curve.stall = sw->speed;
+            if (--sw->idx > 0) {
+                sw->speed = calib_point_speed(sw->idx);
+                return true;
+            }
+        }
+        if (sw->curve.stall == 0) {
+            return fail(sw, "motor stopped at full speed");
+        }
+        fit_curve(sw);
+        if (sw->curve.full_output <= 4 * sw->noise) {
+            return fail(sw, "output too small to characterize");
+        }
+        sw->phase = CALIB_DONE;
+        sw->speed = 0;
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+void calib_expand(const calib_curve_t *curve, uint8_t table[256])
+{
+    const int segs = CALIB_KNOTS - 1;
+
+    table[0] = 0;
+    for (int c = 1; c < 256; c++) {
+        // Position along the knots in 1/256 steps: command 1 -> knot 0, 255 -> last knot
+        int x = (c - 1) * segs * 256 / 254;
+        int k = x >> 8, f = x & 255;
+        int a = curve->knots[k];
+        int b = curve->knots[k < segs ? k + 1 : k];
+        table[c] = a + (((b - a) * f + 128) >> 8);
+    }
+}
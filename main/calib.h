@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "pwm_profile.h"
+
+// Pump characterization sweep.
+//
+// Pure state machine, no I/O: the caller applies calib_sweep_t.speed (after
+// stopping the motor and letting it settle if from_rest is set), measures
+// the output and feeds the average back with calib_step(). The sweep is
+//   1. baseline at speed 0 (sensor offset)
+//   2. up sweep in CALIB_STEP increments, motor never stopped
+//   3. bisection of the start threshold, every probe from rest
+//   4. down sweep from full speed until the motor stalls
+// and the fit turns the up sweep into a monotone output curve (pool
+// adjacent violators, so noise can't fold it) with knots at equal output
+// steps. Output is flow when a flow sensor is fitted; otherwise motor
+// speed estimated from current: with the L9110 coasting between PWM pulses
+// the average current is d * (V - Ke * w) / R, so 1 - I / (d * I_stall / d_stall)
+// is w relative to the no-load speed, whatever V and R are.
+
+#define CALIB_STEP          8
+#define CALIB_POINTS        33        // Speeds 0, 8, ..., 248, 255
+#define CALIB_KNOTS         9         // Output 0/8 ... 8/8 of full
+#define CALIB_SAT_PERMILLE  970       // Saturation: output within 3% of the top
+#define CALIB_CURRENT_NOISE 50        // Permille of no-load speed counted as motion
+#define CALIB_FLOW_NOISE    3         // mL/min counted as motion
+
+typedef enum {
+    CALIB_SRC_FLOW,                   // mL/min
+    CALIB_SRC_CURRENT,                // mA
+} calib_source_t;
+
+typedef enum {
+    CALIB_BASELINE,
+    CALIB_UP,
+    CALIB_REFINE,
+    CALIB_DOWN,
+    CALIB_DONE,
+    CALIB_FAILED,
+} calib_phase_t;
+
+// Per-unit compensation: knots[k] is the speed giving k/8 of full output,
+// knots[0] the lowest speed that starts the motor from rest
+typedef struct {
+    uint8_t start;                    // From rest, up sweep
+    uint8_t stall;                    // Lowest speed a running motor keeps turning
+    uint8_t saturation;               // More speed adds no output
+    uint8_t knots[CALIB_KNOTS];
+    int32_t full_output;              // Output at saturation, source units (permille for current)
+} calib_curve_t;
+
+typedef struct {
+    calib_source_t source;
+    const uint16_t *lut;              // Speed -> duty of the active PWM profile
+    calib_phase_t phase;
+    uint8_t speed;                    // Apply next, then feed its measurement
+    bool from_rest;                   // Stop and settle before applying speed
+    uint8_t idx;                      // Point within the phase
+    uint8_t lo, hi;                   // Refine bracket: lo stays put, hi starts
+    int32_t base;                     // Sensor reading at speed 0
+    int32_t noise;                    // Output above this is motion
+    int32_t stall_ratio;              // Current source: mA * 1024 / duty count, stalled
+    int32_t stall_sigma;              // Current source: mA scatter about the stall line at breakaway
+    int32_t up[CALIB_POINTS];         // Output of the up sweep
+    int32_t start_output;             // Output at the start threshold, from rest
+    calib_curve_t curve;
+    const char *error;                // Why the sweep failed
+} calib_sweep_t;
+
+// Speed of coarse point i
+static inline uint8_t calib_point_speed(int i)
+{
+    return i * CALIB_STEP > 255 ? 255 : i * CALIB_STEP;
+}
+
+void calib_begin(calib_sweep_t *sw, calib_source_t source, const pwm_profile_t *profile);
+
+// Feed the averaged measurement taken at sw->speed. Returns true while
+// there is another point to measure; the sweep then ends in CALIB_DONE with
+// sw->curve filled in, or CALIB_FAILED with sw->error set.
+bool calib_step(calib_sweep_t *sw, int32_t value);
+
+// Expand a curve into the speed -> speed table pump_set_compensation() takes
+void calib_expand(const calib_curve_t *curve, uint8_t table[256]);
@@ -0,0 +1,81 @@
+#include "classify.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "trace.h"
+
+static const char *TAG = "classify";
+
+// Packed model, generated from model/plant_cnn.json by tools/nn_pack.py
+extern const uint8_t plant_cnn_bin_start[] asm("_binary_plant_cnn_bin_start");
+extern const uint8_t plant_cnn_bin_end[]   asm("_binary_plant_cnn_bin_end");
+
+static nn_model_t model;
+static SemaphoreHandle_t lock;        // nn_run uses one static arena
+static StaticSemaphore_t lock_buf;
+
+esp_err_t classify_init(void)
+{
+    lock = xSemaphoreCreateMutexStatic(&lock_buf);
+    esp_err_t err = nn_model_load(&model, plant_cnn_bin_start,
+                                  plant_cnn_bin_end - plant_cnn_bin_start);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Embedded model rejected: %s", esp_err_to_name(err));
+        return err;
+    }
+    for (int i = 0; i < model.hdr->n_classes; i++) {
+        ESP_LOGI(TAG, "Class %d: %s / %s -> PWM %d", i, model.labels[i].plant,
+                 model.labels[i].disease, model.labels[i].pwm);
+    }
+    return ESP_OK;
+}
+
+size_t classify_input_size(void)
+{
+    return model.hdr ? (size_t)model.hdr->in_w * model.hdr->in_h * 3 : 0;
+}
+
+int classify_layer_count(void)
+{
+    return model.hdr ? model.hdr->n_layers : 0;
+}
+
+size_t classify_peak_bytes(void)
+{
+    return model.peak_bytes;
+}
+
+esp_err_t classify_rgb(const uint8_t *rgb, classify_result_t *out)
+{
+    if (!model.hdr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    esp_err_t err = nn_run(&model, rgb, &out->nn);
+    xSemaphoreGive(lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    out->label = &model.labels[out->nn.class_id];
+    out->confidence = out->nn.confidence;
+    out->spray = out->confidence >= CLASSIFY_MIN_CONFIDENCE && out->label->pwm > 0;
+    trace_event(TRACE_CLASSIFY, out->nn.class_id, (uint32_t)(out->confidence * 100.0f));
+    ESP_LOGI(TAG, "%s (%.1f%%) in %lu us", out->label->name, out->confidence * 100.0f,
+             (unsigned long)out->nn.total_us);
+    return ESP_OK;
+}
+
+uint8_t classify_spray_pwm(const classify_result_t *res, uint32_t lesion_permille)
+{
+    if (!res->spray) {
+        return 0;
+    }
+    uint32_t base = res->label->pwm;
+    if (lesion_permille > CLASSIFY_LESION_FULL_PERMILLE) {
+        lesion_permille = CLASSIFY_LESION_FULL_PERMILLE;
+    }
+    return base / 2 + (base - base / 2) * lesion_permille / CLASSIFY_LESION_FULL_PERMILLE;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nn.h"
+
+// Leaf disease classification with the embedded int8 model (nn.h).
+//
+// The model is packed from model/plant_cnn.json at build time. Each class
+// carries its own spray PWM, so the spray decision is made here on the
+// device rather than in the UI. A class with PWM 0 (no_match) is the
+// model's "none of these" answer and never sprays.
+
+#define CLASSIFY_MIN_CONFIDENCE 0.6f  // Below this a result never sprays
+#define CLASSIFY_LESION_FULL_PERMILLE 250  // Lesion ratio that earns the full class PWM
+
+typedef struct {
+    const nn_label_t *label;
+    float confidence;
+    bool spray;                       // Confident enough to act on a non-zero label->pwm
+    nn_result_t nn;                   // Class id and per-layer timing
+} classify_result_t;
+
+// Load and validate the embedded model
+esp_err_t classify_init(void);
+
+// Bytes of RGB888 input expected by classify_rgb (in_w * in_h * 3)
+size_t classify_input_size(void);
+
+// Number of layers and peak activation memory of the loaded model
+int classify_layer_count(void);
+size_t classify_peak_bytes(void);
+
+// Run the model on one input-sized RGB888 image. Thread-safe.
+esp_err_t classify_rgb(const uint8_t *rgb, classify_result_t *out);
+
+// Spray PWM for a result: 0 unless confident, otherwise between half and
+// all of the class PWM as the lesion ratio rises to CLASSIFY_LESION_FULL_PERMILLE
+uint8_t classify_spray_pwm(const classify_result_t *res, uint32_t lesion_permille);
@@ -0,0 +1,147 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "hal.h"
+#include "history.h"
+#include "mem_budget.h"
+#include "pid.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "flow_ctrl.h"
+
+static const char *TAG = "flow_ctrl";
+
+#define FLOW_PERIOD_MS      50        // 20 Hz control loop
+#define FLOW_WINDOW         10        // Ticks averaged for the flow estimate
+#define FLOW_WINDOW_MS      (FLOW_PERIOD_MS * FLOW_WINDOW)
+#define FLOW_TASK_STACK     3072
+#define FLOW_TASK_PRIO      (configMAX_PRIORITIES - 3)  // Just below pump_ctrl
+
+// Gains per loop period, duty counts per mL/min of error
+#define FLOW_KP             PID_GAIN(0.02)
+#define FLOW_KI             PID_GAIN(0.004)
+#define FLOW_KD             PID_GAIN(0.0)
+
+#ifndef CONFIG_PLANTDOC_FLOW_PULSES_PER_L
+#define CONFIG_PLANTDOC_FLOW_PULSES_PER_L 450
+#endif
+
+static portMUX_TYPE flow_lock = portMUX_INITIALIZER_UNLOCKED;
+static flow_ctrl_status_t status;     // Guarded by flow_lock
+static uint32_t owner_token;
+MEM_TASK(flow_task_mem, "flow_ctrl", FLOW_TASK_STACK);
+static pid_ctrl_t pid = {
+    .kp = FLOW_KP,
+    .ki = FLOW_KI,
+    .kd = FLOW_KD,
+    .out_min = 0,
+    .out_max = 255
+};
+
+static void flow_task(void *arg)
+{
+    uint16_t window[FLOW_WINDOW] = {0};
+    uint32_t window_sum = 0;
+    int w = 0;
+    int32_t last_count = 0;
+    TickType_t wake = xTaskGetTickCount();
+
+    hal_pulse_counter_read(&last_count);
+
+    for (;;) {
+        xTaskDelayUntil(&wake, pdMS_TO_TICKS(FLOW_PERIOD_MS));
+        int64_t t0 = esp_timer_get_time();
+
+        int32_t count;
+        hal_pulse_counter_read(&count);
+        uint16_t delta = (uint16_t)(count - last_count);
+        last_count = count;
+
+        window_sum += delta - window[w];
+        window[w] = delta;
+        w = (w + 1) % FLOW_WINDOW;
+
+        uint32_t flow = (uint32_t)((uint64_t)window_sum * 1000 * 60000 /
+                                   ((uint64_t)CONFIG_PLANTDOC_FLOW_PULSES_PER_L * FLOW_WINDOW_MS));
+        if (w == 0) {
+            history_append(HIST_FLOW, flow);  // Once per window
+        }
+
+        portENTER_CRITICAL(&flow_lock);
+        status.flow_mlpm = flow;
+        if (status.active && !pump_ctrl_owns(owner_token)) {
+            status.active = false;    // Manual command or stop took over
+        }
+        bool active = status.active;
+        uint32_t target = status.target_mlpm;
+        uint8_t prev_duty = status.duty;
+        uint8_t duty = prev_duty;
+        if (active) {
+            duty = (uint8_t)pid_update(&pid, target, flow);
+            status.duty = duty;
+        }
+        uint32_t token = owner_token;
+        portEXIT_CRITICAL(&flow_lock);
+
+        if (active && duty != prev_duty) {
+            pump_ctrl_post(duty, token);
+        }
+
+        uint32_t loop_us = (uint32_t)(esp_timer_get_time() - t0);
+        portENTER_CRITICAL(&flow_lock);
+        if (loop_us > status.loop_us_max) {
+            status.loop_us_max = loop_us;
+        }
+        portEXIT_CRITICAL(&flow_lock);
+    }
+}
+
+esp_err_t flow_ctrl_start(void)
+{
+#if CONFIG_PLANTDOC_FLOW_SENSOR
+    esp_err_t err = hal_pulse_counter_init(CONFIG_PLANTDOC_FLOW_SENSOR_GPIO);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Pulse counter init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = mem_task_start(&flow_task_mem, flow_task, NULL, FLOW_TASK_PRIO, tskNO_AFFINITY, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ESP_LOGI(TAG, "Flow sensor on GPIO %d, %d pulses/L",
+             CONFIG_PLANTDOC_FLOW_SENSOR_GPIO, CONFIG_PLANTDOC_FLOW_PULSES_PER_L);
+    return ESP_OK;
+#else
+    (void)flow_task;
+    (void)flow_task_mem;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t flow_ctrl_set_target(uint32_t mlpm)
+{
+#if CONFIG_PLANTDOC_FLOW_SENSOR
+    uint8_t duty = pump_get_command(0);
+    uint32_t token = pump_ctrl_acquire();
+
+    portENTER_CRITICAL(&flow_lock);
+    owner_token = token;
+    pid_reset(&pid, status.flow_mlpm, duty);  // Bumpless from the current duty
+    status.target_mlpm = mlpm;
+    status.duty = duty;
+    status.active = true;
+    portEXIT_CRITICAL(&flow_lock);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void flow_ctrl_get_status(flow_ctrl_status_t *out)
+{
+    portENTER_CRITICAL(&flow_lock);
+    *out = status;
+    portEXIT_CRITICAL(&flow_lock);
+}
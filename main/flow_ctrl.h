@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Closed-loop flow control (CONFIG_PLANTDOC_FLOW_SENSOR).
+//
+// A fixed-rate task measures flow from the PCNT pulse count and, while a
+// target is set, runs a fixed-point PID (pid.h) that posts duty updates to
+// pump_ctrl. Any manual command or stop takes pump ownership away and the
+// loop goes idle; flow keeps being measured for reporting.
+
+typedef struct {
+    bool active;                      // Loop is driving the pump
+    uint32_t target_mlpm;
+    uint32_t flow_mlpm;               // Measured, averaged over FLOW_WINDOW_MS
+    uint8_t duty;                     // Last duty posted by the loop
+    uint32_t loop_us_max;             // Worst-case loop iteration CPU time
+} flow_ctrl_status_t;
+
+// Start the sensor and control task. ESP_ERR_NOT_SUPPORTED without a sensor.
+esp_err_t flow_ctrl_start(void);
+
+// Hold the pump at a flow rate in mL/min, taking over pump control
+esp_err_t flow_ctrl_set_target(uint32_t mlpm);
+
+void flow_ctrl_get_status(flow_ctrl_status_t *out);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Thin hardware abstraction for the pump driver.
+//
+// The control logic in pump.c only talks to these functions, never to the
+// LEDC/GPIO drivers directly. hal_esp.c implements them on top of ESP-IDF;
+// another backend can be linked in instead to run the logic off-target.
+
+// Configure a PWM timer (0-3) with the given frequency and duty resolution
+esp_err_t hal_pwm_timer_init(uint8_t timer, uint32_t freq_hz, uint8_t resolution_bits);
+
+// Attach a PWM channel (0-7) to a timer and route it to a GPIO, duty 0.
+// An inverted channel outputs the complement of its duty.
+esp_err_t hal_pwm_channel_init(uint8_t channel, uint8_t timer, int gpio, bool invert);
+
+// Stage duties on n channels, then latch them all back-to-back so they
+// take effect on the same or next PWM period
+esp_err_t hal_pwm_set_duty_batch(const uint8_t *channels, const uint32_t *duty, int n);
+
+// Duty a PWM channel is outputting now, mid-fade included
+uint32_t hal_pwm_get_duty(uint8_t channel);
+
+// Enable hardware fades on the channels in mask. on_end runs in interrupt
+// context when a fade on one of them finishes, and returns true if it woke
+// a higher priority task.
+esp_err_t hal_pwm_fade_init(uint8_t channel_mask, bool (*on_end)(uint8_t channel));
+
+// Fade a channel linearly from its current duty to duty over ms, in
+// hardware; returns without waiting. A running fade must be stopped first.
+esp_err_t hal_pwm_fade(uint8_t channel, uint32_t duty, uint32_t ms);
+
+// Abort a fade, leaving the duty where it got to. on_end isn't called.
+esp_err_t hal_pwm_fade_stop(uint8_t channel);
+
+// Start counting rising edges on a GPIO (PCNT). The count is 32-bit and
+// keeps accumulating past the peripheral's 16-bit hardware limit.
+esp_err_t hal_pulse_counter_init(int gpio);
+
+// Read the accumulated pulse count
+esp_err_t hal_pulse_counter_read(int32_t *count);
+
+// One converted sample from the ADC stream; index is the position of its
+// GPIO in the list given to hal_adc_stream_start
+typedef struct {
+    uint8_t index;
+    uint16_t raw;                     // 12-bit
+} hal_adc_sample_t;
+
+// Sample the given ADC1 GPIOs round-robin with DMA at rate_hz total.
+// on_frame is called from ISR context each time a DMA frame is ready.
+esp_err_t hal_adc_stream_start(const int *gpios, int n, uint32_t rate_hz,
+                               void (*on_frame)(void *arg), void *arg);
+
+// Drain up to max converted samples without blocking; returns the count
+int hal_adc_stream_read(hal_adc_sample_t *out, int max);
+
+// DMA frames dropped because the driver's buffer was full
+uint32_t hal_adc_stream_overflows(void);
+
+// Convert a raw reading to millivolts (eFuse calibration when present)
+int hal_adc_raw_to_mv(uint16_t raw);
+
+#define HAL_FLASH_SECTOR    4096      // Erase unit
+
+// Open the "journal" data partition; reports its size in bytes
+esp_err_t hal_flash_journal_open(uint32_t *size);
+
+// Read, program (only clears bits) and erase whole sectors at a partition offset
+esp_err_t hal_flash_journal_read(uint32_t off, void *buf, size_t len);
+esp_err_t hal_flash_journal_write(uint32_t off, const void *buf, size_t len);
+esp_err_t hal_flash_journal_erase(uint32_t off, size_t len);
+
+// Map the whole "assets" data partition read-only into the address space
+// for as long as the firmware runs; reports where and its size in bytes
+esp_err_t hal_flash_assets_map(const uint8_t **data, uint32_t *size);
+
+// Firmware update into the OTA slot the app isn't running from. The slot
+// is erased a sector at a time as writes reach it, so no single call
+// blocks for the whole erase.
+esp_err_t hal_ota_begin(void);
+esp_err_t hal_ota_write(const void *buf, size_t len);
+
+// Check the written image (header, checksum, appended SHA-256) and boot it
+// next; hal_ota_abort() drops it instead. Either ends the update.
+esp_err_t hal_ota_finish(void);
+void hal_ota_abort(void);
+
+// The running image was just updated and hasn't been confirmed yet: if it
+// resets before hal_ota_confirm(), the bootloader goes back to the old one.
+// hal_ota_rollback() does that right away (reboots).
+bool hal_ota_pending_verify(void);
+esp_err_t hal_ota_confirm(void);
+void hal_ota_rollback(void);
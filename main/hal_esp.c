@@ -0,0 +1,371 @@
+#include <stdatomic.h>
+#include "hal.h"
+#include "driver/ledc.h"
+#include "driver/pulse_cnt.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_attr.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+// ESP-IDF backend for hal.h
+
+#define HAL_LEDC_MODE   LEDC_LOW_SPEED_MODE
+#define HAL_PCNT_LIMIT  32767         // Hardware counter wraps here, accum_count extends it
+
+#define HAL_ADC_MAX_CHANNELS    4
+#define HAL_ADC_FRAME_BYTES     256   // 128 conversions per DMA frame
+#define HAL_ADC_POOL_BYTES      2048  // Driver ring buffer
+#define HAL_ADC_ATTEN           ADC_ATTEN_DB_11  // ~0-3.1 V
+
+#define HAL_JOURNAL_SUBTYPE     0x40  // Custom data subtypes, see partitions.csv
+#define HAL_ASSETS_SUBTYPE      0x41
+
+static bool (*fade_on_end)(uint8_t channel);
+static pcnt_unit_handle_t pcnt_unit;
+static const esp_partition_t *journal_part;
+static const esp_partition_t *ota_part;
+static esp_ota_handle_t ota_handle;   // 0 when no update is in progress
+
+static adc_continuous_handle_t adc_handle;
+static adc_cali_handle_t adc_cali;
+static adc_channel_t adc_chan_map[HAL_ADC_MAX_CHANNELS];
+static int adc_chan_count;
+static void (*adc_on_frame)(void *arg);
+static void *adc_on_frame_arg;
+static atomic_uint adc_overflows;
+
+esp_err_t hal_pwm_timer_init(uint8_t timer, uint32_t freq_hz, uint8_t resolution_bits)
+{
+    ledc_timer_config_t timer_conf = {
+        .speed_mode = HAL_LEDC_MODE,
+        .duty_resolution = (ledc_timer_bit_t)resolution_bits,
+        .timer_num = (ledc_timer_t)timer,
+        .freq_hz = freq_hz,
+        .clk_cfg = LEDC_AUTO_CLK
+    };
+    return ledc_timer_config(&timer_conf);
+}
+
+esp_err_t hal_pwm_channel_init(uint8_t channel, uint8_t timer, int gpio, bool invert)
+{
+    ledc_channel_config_t channel_conf = {
+        .gpio_num = gpio,
+        .speed_mode = HAL_LEDC_MODE,
+        .channel = (ledc_channel_t)channel,
+        .timer_sel = (ledc_timer_t)timer,
+        .duty = 0,
+        .hpoint = 0,
+        .flags.output_invert = invert
+    };
+    return ledc_channel_config(&channel_conf);
+}
+
+esp_err_t hal_pwm_set_duty_batch(const uint8_t *channels, const uint32_t *duty, int n)
+{
+    esp_err_t err = ESP_OK;
+
+    // Staging doesn't touch the outputs; only the update latches the new duty
+    for (int i = 0; i < n; i++) {
+        if (ledc_set_duty(HAL_LEDC_MODE, (ledc_channel_t)channels[i], duty[i]) != ESP_OK) {
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        ledc_update_duty(HAL_LEDC_MODE, (ledc_channel_t)channels[i]);
+    }
+    return err;
+}
+
+uint32_t hal_pwm_get_duty(uint8_t channel)
+{
+    return ledc_get_duty(HAL_LEDC_MODE, (ledc_channel_t)channel);
+}
+
+static bool fade_cb(const ledc_cb_param_t *param, void *arg)
+{
+    if (param->event != LEDC_FADE_END_EVT || fade_on_end == NULL) {
+        return false;
+    }
+    return fade_on_end(param->channel);
+}
+
+esp_err_t hal_pwm_fade_init(uint8_t channel_mask, bool (*on_end)(uint8_t channel))
+{
+    ledc_cbs_t cbs = { .fade_cb = fade_cb };
+
+    esp_err_t err = ledc_fade_func_install(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {  // Already installed is fine
+        return err;
+    }
+    fade_on_end = on_end;
+    for (int ch = 0; ch < LEDC_CHANNEL_MAX; ch++) {
+        if (channel_mask & (1 << ch)) {
+            err = ledc_cb_register(HAL_LEDC_MODE, (ledc_channel_t)ch, &cbs, NULL);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t hal_pwm_fade(uint8_t channel, uint32_t duty, uint32_t ms)
+{
+    return ledc_set_fade_time_and_start(HAL_LEDC_MODE, (ledc_channel_t)channel, duty, ms,
+                                        LEDC_FADE_NO_WAIT);
+}
+
+esp_err_t hal_pwm_fade_stop(uint8_t channel)
+{
+    return ledc_fade_stop(HAL_LEDC_MODE, (ledc_channel_t)channel);
+}
+
+esp_err_t hal_pulse_counter_init(int gpio)
+{
+    pcnt_unit_config_t unit_conf = {
+        .low_limit = -HAL_PCNT_LIMIT,
+        .high_limit = HAL_PCNT_LIMIT,
+        .flags.accum_count = 1
+    };
+    pcnt_chan_config_t chan_conf = {
+        .edge_gpio_num = gpio,
+        .level_gpio_num = -1
+    };
+    pcnt_glitch_filter_config_t filter_conf = {
+        .max_glitch_ns = 1000
+    };
+    pcnt_channel_handle_t chan;
+    esp_err_t err;
+
+    if ((err = pcnt_new_unit(&unit_conf, &pcnt_unit)) != ESP_OK ||
+        (err = pcnt_unit_set_glitch_filter(pcnt_unit, &filter_conf)) != ESP_OK ||
+        (err = pcnt_new_channel(pcnt_unit, &chan_conf, &chan)) != ESP_OK ||
+        (err = pcnt_channel_set_edge_action(chan, PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+                                            PCNT_CHANNEL_EDGE_ACTION_HOLD)) != ESP_OK ||
+        (err = pcnt_unit_add_watch_point(pcnt_unit, HAL_PCNT_LIMIT)) != ESP_OK ||
+        (err = pcnt_unit_enable(pcnt_unit)) != ESP_OK ||
+        (err = pcnt_unit_clear_count(pcnt_unit)) != ESP_OK) {
+        return err;
+    }
+    return pcnt_unit_start(pcnt_unit);
+}
+
+esp_err_t hal_pulse_counter_read(int32_t *count)
+{
+    int val;
+    esp_err_t err = pcnt_unit_get_count(pcnt_unit, &val);
+
+    *count = val;
+    return err;
+}
+
+static bool IRAM_ATTR adc_conv_done(adc_continuous_handle_t handle,
+                                    const adc_continuous_evt_data_t *edata, void *user)
+{
+    adc_on_frame(adc_on_frame_arg);
+    return false;
+}
+
+static bool IRAM_ATTR adc_pool_ovf(adc_continuous_handle_t handle,
+                                   const adc_continuous_evt_data_t *edata, void *user)
+{
+    atomic_fetch_add_explicit(&adc_overflows, 1, memory_order_relaxed);
+    return false;
+}
+
+esp_err_t hal_adc_stream_start(const int *gpios, int n, uint32_t rate_hz,
+                               void (*on_frame)(void *arg), void *arg)
+{
+    adc_continuous_handle_cfg_t handle_conf = {
+        .max_store_buf_size = HAL_ADC_POOL_BYTES,
+        .conv_frame_size = HAL_ADC_FRAME_BYTES,
+    };
+    adc_digi_pattern_config_t pattern[HAL_ADC_MAX_CHANNELS] = {0};
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = adc_conv_done,
+        .on_pool_ovf = adc_pool_ovf,
+    };
+    esp_err_t err;
+
+    if (n < 1 || n > HAL_ADC_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < n; i++) {
+        adc_unit_t unit;
+        if ((err = adc_continuous_io_to_channel(gpios[i], &unit, &adc_chan_map[i])) != ESP_OK) {
+            return err;
+        }
+        if (unit != ADC_UNIT_1) {
+            return ESP_ERR_INVALID_ARG;  // ADC2 is unusable while Wi-Fi runs
+        }
+        pattern[i].atten = HAL_ADC_ATTEN;
+        pattern[i].channel = adc_chan_map[i];
+        pattern[i].unit = ADC_UNIT_1;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+    adc_chan_count = n;
+    adc_on_frame = on_frame;
+    adc_on_frame_arg = arg;
+
+    adc_continuous_config_t dig_conf = {
+        .pattern_num = n,
+        .adc_pattern = pattern,
+        .sample_freq_hz = rate_hz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    adc_cali_line_fitting_config_t cali_conf = {
+        .unit_id = ADC_UNIT_1,
+        .atten = HAL_ADC_ATTEN,
+        .bitwidth = ADC_BITWIDTH_12,
+    };
+    if (adc_cali_create_scheme_line_fitting(&cali_conf, &adc_cali) != ESP_OK) {
+        adc_cali = NULL;              // No eFuse data: fall back to nominal scaling
+    }
+
+    if ((err = adc_continuous_new_handle(&handle_conf, &adc_handle)) != ESP_OK ||
+        (err = adc_continuous_config(adc_handle, &dig_conf)) != ESP_OK ||
+        (err = adc_continuous_register_event_callbacks(adc_handle, &cbs, NULL)) != ESP_OK) {
+        return err;
+    }
+    return adc_continuous_start(adc_handle);
+}
+
+int hal_adc_stream_read(hal_adc_sample_t *out, int max)
+{
+    uint8_t frame[HAL_ADC_FRAME_BYTES];
+    int n = 0;
+
+    while (max - n >= HAL_ADC_FRAME_BYTES / SOC_ADC_DIGI_RESULT_BYTES) {
+        uint32_t len = 0;
+        if (adc_continuous_read(adc_handle, frame, sizeof(frame), &len, 0) != ESP_OK) {
+            break;                    // ESP_ERR_TIMEOUT: nothing left
+        }
+        for (uint32_t i = 0; i < len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            const adc_digi_output_data_t *d = (const adc_digi_output_data_t *)&frame[i];
+            for (int c = 0; c < adc_chan_count; c++) {
+                if (adc_chan_map[c] == d->type1.channel) {
+                    out[n].index = c;
+                    out[n].raw = d->type1.data;
+                    n++;
+                    break;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+uint32_t hal_adc_stream_overflows(void)
+{
+    return atomic_load_explicit(&adc_overflows, memory_order_relaxed);
+}
+
+int hal_adc_raw_to_mv(uint16_t raw)
+{
+    int mv;
+
+    if (adc_cali && adc_cali_raw_to_voltage(adc_cali, raw, &mv) == ESP_OK) {
+        return mv;
+    }
+    return raw * 3100 / 4095;
+}
+
+esp_err_t hal_flash_journal_open(uint32_t *size)
+{
+    journal_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                            HAL_JOURNAL_SUBTYPE, "journal");
+    if (!journal_part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *size = journal_part->size;
+    return ESP_OK;
+}
+
+esp_err_t hal_flash_journal_read(uint32_t off, void *buf, size_t len)
+{
+    return esp_partition_read(journal_part, off, buf, len);
+}
+
+esp_err_t hal_flash_journal_write(uint32_t off, const void *buf, size_t len)
+{
+    return esp_partition_write(journal_part, off, buf, len);
+}
+
+esp_err_t hal_flash_journal_erase(uint32_t off, size_t len)
+{
+    return esp_partition_erase_range(journal_part, off, len);
+}
+
+esp_err_t hal_flash_assets_map(const uint8_t **data, uint32_t *size)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           HAL_ASSETS_SUBTYPE, "assets");
+    esp_partition_mmap_handle_t handle;  // Never unmapped
+    const void *ptr;
+
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t err = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *data = ptr;
+    *size = part->size;
+    return ESP_OK;
+}
+
+esp_err_t hal_ota_begin(void)
+{
+    hal_ota_abort();
+    ota_part = esp_ota_get_next_update_partition(NULL);
+    if (!ota_part) {
+        return ESP_ERR_NOT_FOUND;     // Single-app partition table
+    }
+    return esp_ota_begin(ota_part, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+}
+
+esp_err_t hal_ota_write(const void *buf, size_t len)
+{
+    return esp_ota_write(ota_handle, buf, len);
+}
+
+esp_err_t hal_ota_finish(void)
+{
+    esp_ota_handle_t handle = ota_handle;
+
+    ota_handle = 0;
+    esp_err_t err = esp_ota_end(handle);  // Frees the handle whatever the result
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_ota_set_boot_partition(ota_part);
+}
+
+void hal_ota_abort(void)
+{
+    if (ota_handle) {
+        esp_ota_abort(ota_handle);
+        ota_handle = 0;
+    }
+}
+
+bool hal_ota_pending_verify(void)
+{
+    esp_ota_img_states_t state;
+
+    return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+           state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+esp_err_t hal_ota_confirm(void)
+{
+    return esp_ota_mark_app_valid_cancel_rollback();
+}
+
+void hal_ota_rollback(void)
+{
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
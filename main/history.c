@@ -0,0 +1,212 @@
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "history.h"
+
+typedef struct {
+    uint32_t gen;                     // Bumped on every reuse, 0 = never written
+    uint32_t t0_ms;                   // Time of the block's first record
+    uint32_t t1_ms;                   // Time of the block's last record
+    uint16_t len;                     // Bytes of data used
+    uint16_t count;                   // Records
+    uint8_t data[HISTORY_BLOCK_SIZE - 16];
+} hist_block_t;
+
+_Static_assert(sizeof(hist_block_t) == HISTORY_BLOCK_SIZE, "block layout");
+
+#define REC_MAX     10                // Two 5-byte varints
+
+static portMUX_TYPE hist_lock = portMUX_INITIALIZER_UNLOCKED;
+static hist_block_t blocks[HISTORY_BLOCKS];
+static uint32_t head;                 // Block being appended to
+static uint32_t next_gen = 1;
+// Encoder state for the head block; decoding starts from zero per block
+static uint32_t last_ms;
+static int32_t last_val[HISTORY_SERIES_MAX];
+
+uint32_t history_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+    uint32_t x = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7) {
+        uint8_t b = *p++;
+        x |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static void start_block(hist_block_t *b, uint32_t now)
+{
+    b->gen = next_gen++;
+    b->t0_ms = now;
+    b->t1_ms = now;
+    b->len = 0;
+    b->count = 0;
+    last_ms = now;
+    memset(last_val, 0, sizeof(last_val));
+}
+
+void history_append(history_series_t series, int32_t value)
+{
+    if ((unsigned)series >= HIST_SERIES_COUNT) {
+        return;
+    }
+
+    portENTER_CRITICAL(&hist_lock);
+    // Timestamp under the lock so records within a block are in order
+    uint32_t now = history_now_ms();
+    hist_block_t *b = &blocks[head];
+    if (b->gen == 0) {
+        start_block(b, now);
+    } else if (b->len + REC_MAX > sizeof(b->data) || now - last_ms >= (1u << 28)) {
+        head = (head + 1) % HISTORY_BLOCKS;
+        b = &blocks[head];
+        start_block(b, now);
+    }
+
+    uint8_t *p = b->data + b->len;
+    p = put_varint(p, (now - last_ms) << 4 | series);
+    p = put_varint(p, zigzag(value - last_val[series]));
+    b->len = p - b->data;
+    b->count++;
+    b->t1_ms = now;
+    last_ms = now;
+    last_val[series] = value;
+    portEXIT_CRITICAL(&hist_lock);
+}
+
+// Per-series accumulator for the bucket currently being filled
+typedef struct {
+    bool open;
+    uint32_t bucket;
+    history_bucket_t b;
+    int64_t sum;
+} acc_t;
+
+static bool flush(acc_t *a, history_emit_t emit, void *ctx)
+{
+    if (!a->open) {
+        return true;
+    }
+    a->open = false;
+    a->b.mean = (int32_t)(a->sum / a->b.count);
+    return emit(&a->b, ctx);
+}
+
+uint32_t history_query(uint32_t from_ms, uint32_t to_ms, uint32_t step_ms, uint16_t mask,
+                       history_emit_t emit, void *ctx)
+{
+    static hist_block_t copy;         // Queries are serialized by the caller (httpd)
+    acc_t acc[HISTORY_SERIES_MAX] = {0};
+    uint32_t scanned = 0;
+    bool more = true;
+
+    // Oldest block first: the one after head, wrapping round to head
+    portENTER_CRITICAL(&hist_lock);
+    uint32_t start = (head + 1) % HISTORY_BLOCKS;
+    portEXIT_CRITICAL(&hist_lock);
+
+    for (int i = 0; i < HISTORY_BLOCKS && more; i++) {
+        hist_block_t *src = &blocks[(start + i) % HISTORY_BLOCKS];
+
+        portENTER_CRITICAL(&hist_lock);
+        bool skip = src->gen == 0 || src->t1_ms < from_ms || src->t0_ms > to_ms;
+        if (!skip) {
+            memcpy(&copy, src, offsetof(hist_block_t, data) + src->len);
+        }
+        portEXIT_CRITICAL(&hist_lock);
+        if (skip) {
+            continue;
+        }
+
+        uint32_t t = copy.t0_ms;
+        int32_t val[HISTORY_SERIES_MAX] = {0};
+        const uint8_t *p = copy.data, *end = copy.data + copy.len;
+        while (p < end && more) {
+            uint32_t key, delta;
+            if (!(p = get_varint(p, end, &key)) || !(p = get_varint(p, end, &delta))) {
+                break;
+            }
+            uint8_t s = key & 0xf;
+            t += key >> 4;
+            val[s] += unzigzag(delta);
+            if (t < from_ms || t > to_ms || !(mask & (1u << s))) {
+                continue;
+            }
+            scanned++;
+
+            acc_t *a = &acc[s];
+            uint32_t bucket = step_ms ? (t - from_ms) / step_ms : t;
+            if (a->open && (a->bucket != bucket || step_ms == 0)) {
+                more = flush(a, emit, ctx);
+            }
+            if (!a->open) {
+                a->open = true;
+                a->bucket = bucket;
+                a->b.t_ms = step_ms ? from_ms + bucket * step_ms : t;
+                a->b.series = s;
+                a->b.count = 0;
+                a->b.min = a->b.max = val[s];
+                a->sum = 0;
+            }
+            a->b.count++;
+            a->sum += val[s];
+            if (val[s] < a->b.min) {
+                a->b.min = val[s];
+            }
+            if (val[s] > a->b.max) {
+                a->b.max = val[s];
+            }
+        }
+    }
+
+    for (int s = 0; s < HISTORY_SERIES_MAX && more; s++) {
+        more = flush(&acc[s], emit, ctx);
+    }
+    return scanned;
+}
+
+void history_stats(uint32_t *samples, uint32_t *bytes)
+{
+    uint32_t n = 0, len = 0;
+
+    portENTER_CRITICAL(&hist_lock);
+    for (int i = 0; i < HISTORY_BLOCKS; i++) {
+        if (blocks[i].gen) {
+            n += blocks[i].count;
+            len += offsetof(hist_block_t, data) + blocks[i].len;
+        }
+    }
+    portEXIT_CRITICAL(&hist_lock);
+    *samples = n;
+    *bytes = len;
+}
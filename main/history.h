@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pump.h"
+
+// Compact in-RAM time series of pump and sensor values.
+//
+// Samples are packed into a ring of fixed-size blocks: each record is a
+// varint of (ms since the previous record << 4 | series) followed by a
+// zigzag varint of the change from that series' previous value, so a
+// typical sample costs 2-3 bytes. Appending is O(1) and never allocates;
+// when the ring is full the oldest block is reused. Each block keeps its
+// time span, so range queries skip whole blocks without decoding them.
+
+#define HISTORY_BLOCK_SIZE  256       // Bytes per block, header included
+#define HISTORY_BLOCKS      64        // 16 KiB total
+#define HISTORY_SERIES_MAX  16        // Series ids fit in 4 bits
+
+typedef enum {
+    HIST_DUTY = 0,                    // + channel, 0..PUMP_MAX_CHANNELS-1
+    HIST_SOIL = PUMP_MAX_CHANNELS,    // Soil moisture, permille
+    HIST_CURRENT,                     // Motor current, mA
+    HIST_FLOW,                        // Flow, mL/min
+    HIST_SERIES_COUNT
+} history_series_t;
+
+_Static_assert(HIST_SERIES_COUNT <= HISTORY_SERIES_MAX, "series id is 4 bits");
+
+// One downsampled bucket
+typedef struct {
+    uint32_t t_ms;                    // Bucket start (first sample time when step is 0)
+    uint8_t series;
+    uint16_t count;
+    int32_t min, max, mean;
+} history_bucket_t;
+
+// Return false to stop the query early
+typedef bool (*history_emit_t)(const history_bucket_t *b, void *ctx);
+
+// Record a value now; safe from any task
+void history_append(history_series_t series, int32_t value);
+
+// Visit samples with from_ms <= t <= to_ms for the series in mask, reduced
+// to step_ms buckets (step_ms 0 = every sample). Buckets are emitted per
+// series as they complete, in time order within a series.
+// Returns the number of samples scanned.
+uint32_t history_query(uint32_t from_ms, uint32_t to_ms, uint32_t step_ms, uint16_t mask,
+                       history_emit_t emit, void *ctx);
+
+// Current time on the history clock (ms since boot)
+uint32_t history_now_ms(void);
+
+// Samples held and bytes used, for /metrics and sizing
+void history_stats(uint32_t *samples, uint32_t *bytes);
@@ -0,0 +1,316 @@
+#include "img_decode.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "img";
+
+static const uint8_t png_sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+#define CHUNK(a, b, c, d) ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (c) << 8 | (d))
+#define CHUNK_IHDR      CHUNK('I', 'H', 'D', 'R')
+#define CHUNK_IDAT      CHUNK('I', 'D', 'A', 'T')
+#define CHUNK_IEND      CHUNK('I', 'E', 'N', 'D')
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | p[2] << 8 | p[3];
+}
+
+void img_decode_begin(img_decoder_t *dec)
+{
+    // The window and line buffer are fully rewritten before use
+    memset(&dec->acc, 0, offsetof(img_decoder_t, result) - offsetof(img_decoder_t, acc));
+    memset(&dec->result, 0, sizeof(dec->result));
+    dec->state = IMG_ST_SIGNATURE;
+    dec->window_pos = 0;
+    dec->out_row = -1;
+    tinfl_init(&dec->inflator);
+}
+
+static void flush_out_row(img_decoder_t *dec)
+{
+    if (dec->out_row < 0) {
+        return;
+    }
+    uint8_t *dst = &dec->result.rgb[dec->out_row * IMG_OUT_SIZE * 3];
+    for (int x = 0; x < IMG_OUT_SIZE; x++) {
+        uint32_t n = dec->acc_n[x];
+        for (int c = 0; c < 3; c++) {
+            *dst++ = n ? (dec->acc[x][c] + n / 2) / n : 0;
+        }
+    }
+    memset(dec->acc, 0, sizeof(dec->acc));
+    memset(dec->acc_n, 0, sizeof(dec->acc_n));
+}
+
+// Fold one unfiltered scanline into the output and the lesion counts
+static void process_row(img_decoder_t *dec)
+{
+    img_result_t *res = &dec->result;
+    int sy = dec->row * IMG_OUT_SIZE / res->height;
+    if (sy != dec->out_row) {
+        flush_out_row(dec);
+        dec->out_row = sy;
+    }
+
+    const uint8_t *p = dec->line;
+    for (uint32_t x = 0; x < res->width; x++, p += dec->bpp) {
+        uint32_t r, g, b, a = 255;
+        if (dec->color & 2) {
+            r = p[0];
+            g = p[1];
+            b = p[2];
+        } else {
+            r = g = b = p[0];
+        }
+        if (dec->color & 4) {
+            a = p[dec->bpp - 1];
+        }
+
+        uint32_t *acc = dec->acc[x * IMG_OUT_SIZE / res->width];
+        acc[0] += r;
+        acc[1] += g;
+        acc[2] += b;
+        dec->acc_n[x * IMG_OUT_SIZE / res->width]++;
+
+        // Ignore transparent, dark and unsaturated (background) pixels
+        uint32_t mx = r > g ? (r > b ? r : b) : (g > b ? g : b);
+        uint32_t mn = r < g ? (r < b ? r : b) : (g < b ? g : b);
+        if (a < 128 || mx < 40 || mx - mn < 24) {
+            continue;
+        }
+        if (g >= r && g > b) {
+            res->leaf_px++;
+        } else if (r > g && r > b) {
+            res->lesion_px++;
+        }
+    }
+}
+
+static inline uint8_t paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+    return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+}
+
+// Consume inflated scanline bytes; rows are unfiltered in place over the
+// previous row, with up[] holding the prior-row bytes Paeth still needs.
+static esp_err_t consume_pixels(img_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    const uint32_t bpp = dec->bpp;
+
+    while (len > 0) {
+        if (dec->row >= dec->result.height) {
+            return ESP_ERR_INVALID_SIZE;  // Trailing data after the last row
+        }
+        if (dec->col == 0) {
+            dec->filter = *data++;
+            len--;
+            if (dec->filter > 4) {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            dec->col = 1;
+            continue;
+        }
+
+        uint32_t i = dec->col - 1;
+        size_t n = dec->stride - i;
+        if (n > len) {
+            n = len;
+        }
+        uint8_t *line = dec->line;
+        for (size_t k = 0; k < n; k++, i++) {
+            uint8_t x = *data++;
+            uint8_t up = line[i];
+            uint8_t left = i >= bpp ? line[i - bpp] : 0;
+            uint8_t upleft = i >= bpp ? dec->up[i % bpp] : 0;
+            switch (dec->filter) {
+            case 1: x += left; break;
+            case 2: x += up; break;
+            case 3: x += (left + up) >> 1; break;
+            case 4: x += paeth(left, up, upleft); break;
+            }
+            dec->up[i % bpp] = up;
+            line[i] = x;
+        }
+        len -= n;
+        dec->col = i + 1;
+
+        if (i == dec->stride) {
+            process_row(dec);
+            dec->row++;
+            dec->col = 0;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t inflate_idat(img_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    const int flags = TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT;
+
+    if (dec->inflate_done) {
+        return len ? ESP_ERR_INVALID_SIZE : ESP_OK;
+    }
+    for (;;) {
+        size_t in_n = len;
+        size_t out_n = TINFL_LZ_DICT_SIZE - dec->window_pos;
+        tinfl_status st = tinfl_decompress(&dec->inflator, data, &in_n, dec->window,
+                                           dec->window + dec->window_pos, &out_n, flags);
+        data += in_n;
+        len -= in_n;
+        if (out_n) {
+            esp_err_t err = consume_pixels(dec, dec->window + dec->window_pos, out_n);
+            if (err != ESP_OK) {
+                return err;
+            }
+            dec->window_pos = (dec->window_pos + out_n) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        if (st < TINFL_STATUS_DONE) {
+            ESP_LOGW(TAG, "Inflate failed: %d", st);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (st == TINFL_STATUS_DONE) {
+            dec->inflate_done = true;
+            return ESP_OK;
+        }
+        if (st == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            return ESP_OK;
+        }
+    }
+}
+
+static esp_err_t parse_ihdr(img_decoder_t *dec)
+{
+    const uint8_t *h = dec->ihdr;
+    uint32_t w = be32(h), ht = be32(h + 4);
+    uint8_t depth = h[8], color = h[9], interlace = h[12];
+    static const uint8_t channels[7] = { 1, 0, 3, 0, 2, 0, 4 };
+
+    if (w < IMG_OUT_SIZE || ht < IMG_OUT_SIZE || w > IMG_MAX_WIDTH || ht > IMG_MAX_HEIGHT) {
+        ESP_LOGW(TAG, "Unsupported size %lux%lu", (unsigned long)w, (unsigned long)ht);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (depth != 8 || color > 6 || channels[color] == 0 || interlace) {
+        ESP_LOGW(TAG, "Unsupported format: depth %d colour %d interlace %d",
+                 depth, color, interlace);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    dec->result.width = w;
+    dec->result.height = ht;
+    dec->color = color;
+    dec->bpp = channels[color];
+    dec->stride = w * dec->bpp;
+    memset(dec->line, 0, dec->stride);  // Row -1 is all zeros for the filters
+    dec->have_ihdr = true;
+    return ESP_OK;
+}
+
+esp_err_t img_decode_feed(img_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    dec->result.bytes_in += len;
+
+    while (len > 0) {
+        size_t n;
+        esp_err_t err;
+
+        switch (dec->state) {
+        case IMG_ST_SIGNATURE:
+        case IMG_ST_CHUNK_HEADER:
+        case IMG_ST_CHUNK_CRC: {
+            // Fixed-size fields, gathered across feeds
+            size_t want = dec->state == IMG_ST_CHUNK_CRC ? 4 : 8;
+            n = want - dec->hdr_len;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(dec->hdr + dec->hdr_len, data, n);
+            dec->hdr_len += n;
+            data += n;
+            len -= n;
+            if (dec->hdr_len < want) {
+                break;
+            }
+            dec->hdr_len = 0;
+
+            if (dec->state == IMG_ST_SIGNATURE) {
+                if (memcmp(dec->hdr, png_sig, 8) != 0) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                dec->state = IMG_ST_CHUNK_HEADER;
+            } else if (dec->state == IMG_ST_CHUNK_HEADER) {
+                dec->chunk_left = be32(dec->hdr);
+                dec->chunk_type = be32(dec->hdr + 4);
+                dec->crc = esp_rom_crc32_le(0, dec->hdr + 4, 4);
+                if (dec->chunk_type == CHUNK_IHDR && dec->chunk_left != sizeof(dec->ihdr)) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                if (dec->chunk_type != CHUNK_IHDR && !dec->have_ihdr) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                dec->state = dec->chunk_left ? IMG_ST_CHUNK_DATA : IMG_ST_CHUNK_CRC;
+            } else {
+                if (be32(dec->hdr) != dec->crc) {
+                    ESP_LOGW(TAG, "CRC mismatch in chunk %08lx", (unsigned long)dec->chunk_type);
+                    return ESP_ERR_INVALID_CRC;
+                }
+                if (dec->chunk_type == CHUNK_IHDR) {
+                    err = parse_ihdr(dec);
+                    if (err != ESP_OK) {
+                        return err;
+                    }
+                }
+                dec->state = dec->chunk_type == CHUNK_IEND ? IMG_ST_DONE : IMG_ST_CHUNK_HEADER;
+            }
+            break;
+        }
+
+        case IMG_ST_CHUNK_DATA:
+            n = dec->chunk_left < len ? dec->chunk_left : len;
+            dec->crc = esp_rom_crc32_le(dec->crc, data, n);
+            if (dec->chunk_type == CHUNK_IHDR) {
+                memcpy(dec->ihdr + sizeof(dec->ihdr) - dec->chunk_left, data, n);
+            } else if (dec->chunk_type == CHUNK_IDAT) {
+                err = inflate_idat(dec, data, n);
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
+            data += n;
+            len -= n;
+            dec->chunk_left -= n;
+            if (dec->chunk_left == 0) {
+                dec->state = IMG_ST_CHUNK_CRC;
+            }
+            break;
+
+        case IMG_ST_DONE:
+            return ESP_OK;            // Ignore anything after IEND
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t img_decode_end(img_decoder_t *dec, const img_result_t **out)
+{
+    if (dec->state != IMG_ST_DONE || !dec->inflate_done ||
+        dec->row != dec->result.height) {
+        return ESP_ERR_INVALID_SIZE;  // Truncated
+    }
+    flush_out_row(dec);
+    dec->out_row = -1;
+    *out = &dec->result;
+    return ESP_OK;
+}
+
+uint32_t img_lesion_permille(const img_result_t *res)
+{
+    uint32_t total = res->leaf_px + res->lesion_px;
+    return total ? (uint32_t)((uint64_t)res->lesion_px * 1000 / total) : 0;
+}
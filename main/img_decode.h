@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "rom/miniz.h"
+
+// Streaming PNG decoder with a built-in box downscaler.
+//
+// Bytes are fed in whatever pieces the network delivers; chunks are parsed
+// incrementally, IDAT data goes through the ROM inflater into a 32 KiB
+// window, and each scanline is unfiltered in place in a single line buffer
+// and folded into an IMG_OUT_SIZE square RGB image. The full file is never
+// held. While rows stream past, every pixel is also sorted into healthy leaf
+// tissue or lesion colour (brown / yellow / reddish) to give a severity
+// ratio. All state lives in img_decoder_t, sized at compile time.
+//
+// Supported: 8-bit greyscale, grey+alpha, RGB and RGBA, non-interlaced.
+
+#define IMG_OUT_SIZE    32            // Matches the classifier input
+#define IMG_MAX_WIDTH   2048
+#define IMG_MAX_HEIGHT  4096
+
+typedef enum {
+    IMG_ST_SIGNATURE,
+    IMG_ST_CHUNK_HEADER,
+    IMG_ST_CHUNK_DATA,
+    IMG_ST_CHUNK_CRC,
+    IMG_ST_DONE,
+} img_state_t;
+
+typedef struct {
+    uint16_t width, height;
+    uint32_t bytes_in;                // Compressed file bytes consumed
+    uint32_t leaf_px;                 // Healthy green pixels
+    uint32_t lesion_px;               // Lesion-coloured pixels
+    uint8_t rgb[IMG_OUT_SIZE * IMG_OUT_SIZE * 3];
+} img_result_t;
+
+typedef struct {
+    tinfl_decompressor inflator;
+    uint8_t window[TINFL_LZ_DICT_SIZE];
+    size_t window_pos;
+    uint8_t line[IMG_MAX_WIDTH * 4];  // Previous row, overwritten as we go
+    uint32_t acc[IMG_OUT_SIZE][3];    // One output row of channel sums
+    uint32_t acc_n[IMG_OUT_SIZE];
+
+    img_state_t state;
+    uint8_t hdr[8];                   // Signature, chunk header or CRC
+    uint8_t ihdr[13];
+    uint32_t hdr_len;
+    uint32_t chunk_left;
+    uint32_t chunk_type;
+    uint32_t crc;
+    bool have_ihdr;
+    bool inflate_done;
+
+    uint8_t bpp;                      // Bytes per pixel
+    uint8_t color;                    // PNG colour type
+    uint32_t stride;
+    uint32_t row, col;                // Next byte position (col 0 = filter byte)
+    uint8_t filter;
+    uint8_t up[4];                    // Prior-row bytes overwritten in-place
+    int out_row;                      // Output row being accumulated
+
+    img_result_t result;
+} img_decoder_t;
+
+void img_decode_begin(img_decoder_t *dec);
+
+// Feed the next piece of the file, any size
+esp_err_t img_decode_feed(img_decoder_t *dec, const uint8_t *data, size_t len);
+
+// Check the image was complete; out points into dec
+esp_err_t img_decode_end(img_decoder_t *dec, const img_result_t **out);
+
+// Lesion pixels per thousand leaf-coloured pixels
+uint32_t img_lesion_permille(const img_result_t *res);
@@ -0,0 +1,461 @@
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "hal.h"
+#include "journal.h"
+#include "mem_budget.h"
+
+static const char *TAG = "journal";
+
+#define SECTOR_MAGIC        0x314e524au  // "JRN1"
+#define PAGE_MAGIC          0x4750       // "PG"
+#define PAGE_ALIGN          16           // Keeps pages encryption-block aligned
+#define JOURNAL_TASK_STACK  3072
+#define JOURNAL_TASK_PRIO   2            // Flash writes are never urgent
+#define JOURNAL_MAX_SECTORS 64
+#define PENDING_MAX         (2 * JOURNAL_SESSION_BATCH)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;                     // Increases every time a sector is started
+    uint32_t reserved;
+    uint32_t crc;                     // Of the fields above
+} sector_hdr_t;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t len;                     // Payload bytes
+    uint32_t crc;                     // Of the payload
+} page_hdr_t;
+
+// Payload records: [type u8][len u8][body]
+enum {
+    REC_SNAPSHOT = 1,                 // journal_state_t
+    REC_SET,                          // key u8, value i32
+    REC_TOTALS,                       // sessions u32, spray_ms u64
+    REC_SESSION,                      // journal_session_t, not replayed into state
+};
+
+_Static_assert(sizeof(journal_state_t) < 256, "snapshot length is a u8");
+_Static_assert(2 + sizeof(journal_state_t) + 7 * JKEY_COUNT + 14 +
+               PENDING_MAX * (2 + sizeof(journal_session_t)) <= JOURNAL_PAGE_MAX,
+               "a full flush fits one page");
+
+static portMUX_TYPE jlock = portMUX_INITIALIZER_UNLOCKED;
+static journal_state_t live;          // Guarded by jlock
+static journal_session_t pending[PENDING_MAX];
+static int n_pending;
+static int64_t pending_since_us;      // 0 = nothing waiting
+
+// Flush side, guarded by flush_lock
+static SemaphoreHandle_t flush_lock;
+static StaticSemaphore_t flush_lock_buf;
+static TaskHandle_t journal_task_handle;
+MEM_TASK(journal_task_mem, "journal", JOURNAL_TASK_STACK);
+static journal_state_t disk;          // State as persisted
+static bool enabled;
+static uint32_t n_sectors;
+static uint32_t cur_sector;
+static uint32_t cur_seq;
+static uint32_t write_off;            // Next page offset inside cur_sector
+static journal_stats_t stats;
+
+static uint32_t page_size(size_t payload)
+{
+    return (sizeof(page_hdr_t) + payload + PAGE_ALIGN - 1) & ~(PAGE_ALIGN - 1);
+}
+
+static uint8_t *put_rec(uint8_t *p, uint8_t type, const void *body, uint8_t len)
+{
+    *p++ = type;
+    *p++ = len;
+    memcpy(p, body, len);
+    return p + len;
+}
+
+static void apply_records(journal_state_t *st, const uint8_t *p, const uint8_t *end,
+                          bool (*visit)(const journal_session_t *s, void *ctx), void *ctx,
+                          bool *stop)
+{
+    while (end - p >= 2 && end - p >= 2 + p[1]) {
+        uint8_t type = p[0], len = p[1];
+        const uint8_t *body = p + 2;
+        p += 2 + len;
+
+        if (type == REC_SNAPSHOT && len == sizeof(*st)) {
+            memcpy(st, body, len);
+        } else if (type == REC_SET && len == 5 && body[0] < JKEY_COUNT) {
+            memcpy(&st->keys[body[0]], body + 1, 4);
+        } else if (type == REC_TOTALS && len == 12) {
+            memcpy(&st->sessions, body, 4);
+            memcpy(&st->spray_ms, body + 4, 8);
+        } else if (type == REC_SESSION && len == sizeof(journal_session_t) && visit) {
+            journal_session_t s;
+            memcpy(&s, body, len);
+            if (!visit(&s, ctx)) {
+                *stop = true;
+                return;
+            }
+        }
+        // Unknown types or sizes are from another firmware version: skip
+    }
+}
+
+static bool read_sector_hdr(uint32_t sector, sector_hdr_t *h)
+{
+    return hal_flash_journal_read(sector * HAL_FLASH_SECTOR, h, sizeof(*h)) == ESP_OK &&
+           h->magic == SECTOR_MAGIC &&
+           h->crc == esp_rom_crc32_le(0, (const uint8_t *)h, offsetof(sector_hdr_t, crc));
+}
+
+// Walk the pages of one sector. Returns the offset after the last good page;
+// *torn is set if the sector ends in a damaged (not erased) page.
+static uint32_t scan_sector(uint32_t sector, journal_state_t *st,
+                            bool (*visit)(const journal_session_t *s, void *ctx), void *ctx,
+                            bool *torn, bool *stop)
+{
+    static uint8_t payload[JOURNAL_PAGE_MAX];
+    uint32_t base = sector * HAL_FLASH_SECTOR;
+    uint32_t off = sizeof(sector_hdr_t);
+
+    *torn = false;
+    while (off + sizeof(page_hdr_t) <= HAL_FLASH_SECTOR && !*stop) {
+        page_hdr_t ph;
+        if (hal_flash_journal_read(base + off, &ph, sizeof(ph)) != ESP_OK) {
+            break;
+        }
+        if (ph.magic == 0xffff && ph.len == 0xffff) {
+            break;                    // Erased: end of the log
+        }
+        if (ph.magic != PAGE_MAGIC || ph.len > JOURNAL_PAGE_MAX ||
+            off + page_size(ph.len) > HAL_FLASH_SECTOR ||
+            hal_flash_journal_read(base + off + sizeof(ph), payload, ph.len) != ESP_OK ||
+            esp_rom_crc32_le(0, payload, ph.len) != ph.crc) {
+            *torn = true;             // Power lost mid-write
+            break;
+        }
+        apply_records(st, payload, payload + ph.len, visit, ctx, stop);
+        off += page_size(ph.len);
+    }
+    return off;
+}
+
+static esp_err_t write_page(const uint8_t *payload, size_t len)
+{
+    page_hdr_t ph = {
+        .magic = PAGE_MAGIC,
+        .len = len,
+        .crc = esp_rom_crc32_le(0, payload, len),
+    };
+    uint32_t off = cur_sector * HAL_FLASH_SECTOR + write_off;
+    esp_err_t err;
+
+    // Header first: if power fails before the payload is down, replay sees a
+    // CRC mismatch and moves to a fresh sector rather than reusing the bytes
+    if ((err = hal_flash_journal_write(off, &ph, sizeof(ph))) != ESP_OK ||
+        (err = hal_flash_journal_write(off + sizeof(ph), payload, len)) != ESP_OK) {
+        return err;
+    }
+    write_off += page_size(len);
+    stats.bytes_written += page_size(len);
+    return ESP_OK;
+}
+
+static esp_err_t start_sector(void)
+{
+    uint32_t next = (cur_sector + 1) % n_sectors;
+    sector_hdr_t h = { .magic = SECTOR_MAGIC, .seq = cur_seq + 1 };
+    esp_err_t err;
+
+    h.crc = esp_rom_crc32_le(0, (const uint8_t *)&h, offsetof(sector_hdr_t, crc));
+    if ((err = hal_flash_journal_erase(next * HAL_FLASH_SECTOR, HAL_FLASH_SECTOR)) != ESP_OK ||
+        (err = hal_flash_journal_write(next * HAL_FLASH_SECTOR, &h, sizeof(h))) != ESP_OK) {
+        return err;
+    }
+    stats.erases++;
+    stats.bytes_written += sizeof(h);
+    cur_sector = next;
+    cur_seq = h.seq;
+    write_off = sizeof(h);
+    return ESP_OK;
+}
+
+static esp_err_t flush_locked(void)
+{
+    static uint8_t payload[JOURNAL_PAGE_MAX];
+    journal_session_t sessions[PENDING_MAX];
+    journal_state_t st;
+
+    portENTER_CRITICAL(&jlock);
+    st = live;
+    int n = n_pending;
+    memcpy(sessions, pending, n * sizeof(sessions[0]));
+    n_pending = 0;
+    pending_since_us = 0;
+    portEXIT_CRITICAL(&jlock);
+
+    if (!enabled) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Delta against what flash already holds
+    uint8_t *p = payload;
+    for (int k = 0; k < JKEY_COUNT; k++) {
+        if (st.keys[k] != disk.keys[k]) {
+            uint8_t body[5] = { k };
+            memcpy(body + 1, &st.keys[k], 4);
+            p = put_rec(p, REC_SET, body, sizeof(body));
+        }
+    }
+    if (st.sessions != disk.sessions || st.spray_ms != disk.spray_ms) {
+        uint8_t body[12];
+        memcpy(body, &st.sessions, 4);
+        memcpy(body + 4, &st.spray_ms, 8);
+        p = put_rec(p, REC_TOTALS, body, sizeof(body));
+    }
+    uint8_t *sess_start = p;
+    for (int i = 0; i < n; i++) {
+        p = put_rec(p, REC_SESSION, &sessions[i], sizeof(sessions[i]));
+    }
+    if (p == payload) {
+        return ESP_OK;
+    }
+
+    esp_err_t err;
+    size_t len = p - payload;
+    if (write_off + page_size(len) > HAL_FLASH_SECTOR) {
+        // New sector: a snapshot replaces the deltas, sessions follow it
+        size_t sess_len = p - sess_start;
+        memmove(payload + 2 + sizeof(st), sess_start, sess_len);
+        put_rec(payload, REC_SNAPSHOT, &st, sizeof(st));
+        len = 2 + sizeof(st) + sess_len;
+        if ((err = start_sector()) != ESP_OK) {
+            return err;
+        }
+    }
+    if ((err = write_page(payload, len)) != ESP_OK) {
+        write_off = HAL_FLASH_SECTOR;  // Don't append after a failed write
+        return err;
+    }
+    disk = st;
+    stats.flushes++;
+    return ESP_OK;
+}
+
+esp_err_t journal_flush(void)
+{
+    if (!flush_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(flush_lock, portMAX_DELAY);
+    esp_err_t err = flush_locked();
+    xSemaphoreGive(flush_lock);
+    return err;
+}
+
+static void journal_task(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+
+        portENTER_CRITICAL(&jlock);
+        bool due = pending_since_us != 0 &&
+                   (n_pending >= JOURNAL_SESSION_BATCH ||
+                    esp_timer_get_time() - pending_since_us >= JOURNAL_FLUSH_MS * 1000LL);
+        portEXIT_CRITICAL(&jlock);
+
+        if (due && journal_flush() != ESP_OK) {
+            ESP_LOGW(TAG, "Flush failed");
+        }
+    }
+}
+
+static void mark_pending(void)
+{
+    if (pending_since_us == 0) {
+        pending_since_us = esp_timer_get_time();
+    }
+}
+
+void journal_set(journal_key_t key, int32_t value)
+{
+    if ((unsigned)key >= JKEY_COUNT) {
+        return;
+    }
+    portENTER_CRITICAL(&jlock);
+    if (live.keys[key] != value) {
+        live.keys[key] = value;
+        mark_pending();
+    }
+    portEXIT_CRITICAL(&jlock);
+}
+
+int32_t journal_get(journal_key_t key)
+{
+    if ((unsigned)key >= JKEY_COUNT) {
+        return 0;
+    }
+    portENTER_CRITICAL(&jlock);
+    int32_t v = live.keys[key];
+    portEXIT_CRITICAL(&jlock);
+    return v;
+}
+
+void journal_log_session(uint32_t start_s, uint32_t duration_ms, uint8_t peak_duty)
+{
+    portENTER_CRITICAL(&jlock);
+    if (n_pending < PENDING_MAX) {
+        pending[n_pending++] = (journal_session_t){
+            .boot = live.keys[JKEY_BOOT_COUNT],
+            .start_s = start_s,
+            .duration_ms = duration_ms,
+            .peak_duty = peak_duty,
+        };
+    }
+    live.sessions++;
+    live.spray_ms += duration_ms;
+    mark_pending();
+    int n = n_pending;
+    portEXIT_CRITICAL(&jlock);
+
+    if (n >= JOURNAL_SESSION_BATCH && journal_task_handle) {
+        xTaskNotifyGive(journal_task_handle);
+    }
+}
+
+void journal_get_state(journal_state_t *out)
+{
+    portENTER_CRITICAL(&jlock);
+    *out = live;
+    portEXIT_CRITICAL(&jlock);
+}
+
+void journal_get_stats(journal_stats_t *out)
+{
+    xSemaphoreTake(flush_lock, portMAX_DELAY);
+    *out = stats;
+    out->sector = cur_sector;
+    out->sectors = n_sectors;
+    xSemaphoreGive(flush_lock);
+}
+
+void journal_for_each_session(bool (*visit)(const journal_session_t *s, void *ctx), void *ctx)
+{
+    if (!enabled) {
+        return;
+    }
+    xSemaphoreTake(flush_lock, portMAX_DELAY);
+
+    // Oldest sector first: sequence numbers are unique and increasing
+    uint32_t last_seq = 0;
+    bool stop = false;
+    for (uint32_t pass = 0; pass < n_sectors && !stop; pass++) {
+        uint32_t best = UINT32_MAX, best_seq = UINT32_MAX;
+        sector_hdr_t h;
+        for (uint32_t s = 0; s < n_sectors; s++) {
+            if (read_sector_hdr(s, &h) && h.seq > last_seq && h.seq < best_seq) {
+                best = s;
+                best_seq = h.seq;
+            }
+        }
+        if (best == UINT32_MAX) {
+            break;
+        }
+        journal_state_t scratch;
+        bool torn;
+        scan_sector(best, &scratch, visit, ctx, &torn, &stop);
+        last_seq = best_seq;
+    }
+    xSemaphoreGive(flush_lock);
+}
+
+// Newest sector with a sequence number below seq; false if there is none
+static bool older_sector(uint32_t seq, uint32_t *sector, uint32_t *sector_seq)
+{
+    sector_hdr_t h;
+    bool found = false;
+
+    for (uint32_t s = 0; s < n_sectors; s++) {
+        if (read_sector_hdr(s, &h) && h.seq < seq && (!found || h.seq > *sector_seq)) {
+            *sector = s;
+            *sector_seq = h.seq;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void replay(void)
+{
+    int64_t t0 = esp_timer_get_time();
+    sector_hdr_t h;
+    bool found = false;
+
+    for (uint32_t s = 0; s < n_sectors; s++) {
+        if (read_sector_hdr(s, &h) && (!found || h.seq > cur_seq)) {
+            cur_sector = s;
+            cur_seq = h.seq;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        cur_sector = n_sectors - 1;   // First flush starts sector 0
+        write_off = HAL_FLASH_SECTOR;
+        ESP_LOGI(TAG, "Empty journal");
+    } else {
+        bool torn, stop = false;
+        write_off = scan_sector(cur_sector, &disk, NULL, NULL, &torn, &stop);
+        if (torn) {
+            write_off = HAL_FLASH_SECTOR;  // Never append after a damaged page
+            ESP_LOGW(TAG, "Torn page in sector %lu, moving on", (unsigned long)cur_sector);
+        }
+        if (write_off <= sizeof(sector_hdr_t)) {
+            // Power lost before the sector's snapshot was down: the state is
+            // the last one an older sector holds, and this one takes no deltas
+            uint32_t sector, seq = cur_seq;
+            uint32_t off = sizeof(sector_hdr_t);
+            while (off == sizeof(sector_hdr_t) && older_sector(seq, &sector, &seq)) {
+                off = scan_sector(sector, &disk, NULL, NULL, &torn, &stop);
+            }
+            write_off = HAL_FLASH_SECTOR;
+            ESP_LOGW(TAG, "Sector %lu has no snapshot, state from seq %lu",
+                     (unsigned long)cur_sector, (unsigned long)seq);
+        }
+    }
+    live = disk;
+    stats.replay_us = (uint32_t)(esp_timer_get_time() - t0);
+}
+
+esp_err_t journal_init(void)
+{
+    uint32_t size;
+
+    flush_lock = xSemaphoreCreateMutexStatic(&flush_lock_buf);
+
+    if (hal_flash_journal_open(&size) != ESP_OK) {
+        ESP_LOGW(TAG, "No journal partition, settings will not persist");
+    } else {
+        n_sectors = size / HAL_FLASH_SECTOR;
+        if (n_sectors > JOURNAL_MAX_SECTORS) {
+            n_sectors = JOURNAL_MAX_SECTORS;
+        }
+        enabled = n_sectors >= 2;
+        if (enabled) {
+            replay();
+            ESP_LOGI(TAG, "Replayed sector %lu (seq %lu) in %lu us: %lu sessions, %llu s sprayed",
+                     (unsigned long)cur_sector, (unsigned long)cur_seq,
+                     (unsigned long)stats.replay_us, (unsigned long)live.sessions,
+                     (unsigned long long)(live.spray_ms / 1000));
+        }
+    }
+    journal_set(JKEY_BOOT_COUNT, live.keys[JKEY_BOOT_COUNT] + 1);
+
+    return mem_task_start(&journal_task_mem, journal_task, NULL, JOURNAL_TASK_PRIO,
+                          tskNO_AFFINITY, &journal_task_handle);
+}
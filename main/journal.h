@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "pump.h"
+
+// Write-behind journal for settings and spray sessions.
+//
+// Updates land in RAM (a spinlock and a few stores, safe from the control
+// task) and a background task commits them in batches, either once a
+// session batch fills or JOURNAL_FLUSH_MS after the first pending change.
+// Repeated settings coalesce, so a flush writes each changed key once.
+//
+// On flash the "journal" partition is a ring of 4 KiB sectors. Each flush
+// appends one CRC-checked page. Sectors are used round-robin, so erases are
+// spread evenly and happen once per sector-full of pages, not per event.
+// Every sector opens with a snapshot of the full state, so boot replay
+// only reads sector headers plus the newest sector, whatever the history.
+
+#define JOURNAL_FLUSH_MS        60000 // Longest a change waits in RAM
+#define JOURNAL_SESSION_BATCH   8     // Sessions that force an early flush
+#define JOURNAL_PAGE_MAX        768   // Largest page payload
+
+typedef enum {
+    JKEY_BOOT_COUNT,
+    JKEY_PWM_PROFILE,
+    JKEY_STOP_MODE,                   // pump_stop_mode_t
+    JKEY_BRAKE_MS,                    // 0 until first set: PUMP_BRAKE_MS_DEFAULT
+    JKEY_LAST_SPEED,                  // + channel, last non-zero speed
+    JKEY_CALIB = JKEY_LAST_SPEED + PUMP_MAX_CHANNELS,  // + 3 * channel, pump_calib.c
+    JKEY_RAMP_SHAPE = JKEY_CALIB + 3 * PUMP_MAX_CHANNELS,  // pump_ramp_t
+    JKEY_RAMP_MS,                     // 0 until first set: PUMP_RAMP_MS_DEFAULT
+    JKEY_COUNT
+} journal_key_t;
+
+_Static_assert(JKEY_COUNT <= 32, "key ids fit a u8, pending set is a u32 mask");
+
+typedef struct {
+    uint16_t boot;                    // Boot count when it happened
+    uint32_t start_s;                 // Uptime at start
+    uint32_t duration_ms;
+    uint8_t peak_duty;
+} journal_session_t;
+
+typedef struct {
+    int32_t keys[JKEY_COUNT];
+    uint32_t sessions;                // Sessions ever recorded
+    uint64_t spray_ms;                // Their total duration
+} journal_state_t;
+
+typedef struct {
+    uint32_t flushes;
+    uint32_t bytes_written;
+    uint32_t erases;
+    uint32_t replay_us;               // Boot replay time
+    uint16_t sector;                  // Sector being appended to
+    uint16_t sectors;
+} journal_stats_t;
+
+// Replay the partition and start the flush task. Without a journal
+// partition everything still works, it just isn't persisted.
+esp_err_t journal_init(void);
+
+// Set a key (coalesced until the next flush)
+void journal_set(journal_key_t key, int32_t value);
+
+int32_t journal_get(journal_key_t key);
+
+// Record a finished spray session
+void journal_log_session(uint32_t start_s, uint32_t duration_ms, uint8_t peak_duty);
+
+// Commit everything pending now (e.g. before a reboot)
+esp_err_t journal_flush(void);
+
+void journal_get_state(journal_state_t *out);
+void journal_get_stats(journal_stats_t *out);
+
+// Visit recorded sessions oldest first, reading back through the partition.
+// Return false from visit to stop.
+void journal_for_each_session(bool (*visit)(const journal_session_t *s, void *ctx), void *ctx);
@@ -0,0 +1,199 @@
+#include <string.h>
+#include "esp_log.h"
+#include "mem_budget.h"
+
+static const char *TAG = "mem_budget";
+
+static portMUX_TYPE budget_lock = portMUX_INITIALIZER_UNLOCKED;
+static mem_task_t *tasks[MEM_MAX_TASKS];  // Guarded by budget_lock, as are their handles
+static int n_tasks;
+static mem_task_t adopted[MEM_MAX_TASKS];
+
+static void add_task(mem_task_t *t)
+{
+    portENTER_CRITICAL(&budget_lock);
+    for (int i = 0; i < n_tasks; i++) {
+        if (tasks[i] == t) {
+            portEXIT_CRITICAL(&budget_lock);
+            return;                   // Started before
+        }
+    }
+    if (n_tasks < MEM_MAX_TASKS) {
+        tasks[n_tasks++] = t;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+// Take the task's last high-water mark and forget its handle
+static TaskHandle_t detach(mem_task_t *t)
+{
+    portENTER_CRITICAL(&budget_lock);
+    TaskHandle_t h = t->handle;
+    if (h) {
+        t->free_min = uxTaskGetStackHighWaterMark(h);
+        t->handle = NULL;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+    return h;
+}
+
+esp_err_t mem_task_start(mem_task_t *t, TaskFunction_t fn, void *arg, UBaseType_t prio,
+                         BaseType_t core, TaskHandle_t *out)
+{
+    TaskHandle_t h;
+
+    if (t->handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#if CONFIG_PLANTDOC_STATIC_ALLOC
+    // Reap the previous run, suspended by mem_task_end(), before its TCB
+    // and stack are reused. A static task's handle is its TCB, and one
+    // that never ran is in no list, which reads as deleted.
+    h = (TaskHandle_t)t->tcb;
+    if (eTaskGetState(h) != eDeleted) {
+        while (eTaskGetState(h) != eSuspended) {
+            vTaskDelay(1);            // Still on its way out
+        }
+        vTaskDelete(h);
+    }
+    h = xTaskCreateStaticPinnedToCore(fn, t->name, t->stack_bytes, arg, prio,
+                                      t->stack, t->tcb, core);
+#else
+    if (xTaskCreatePinnedToCore(fn, t->name, t->stack_bytes, arg, prio, &h, core) != pdPASS) {
+        h = NULL;
+    }
+#endif
+    if (!h) {
+        ESP_LOGE(TAG, "Can't create task %s (%lu byte stack)", t->name,
+                 (unsigned long)t->stack_bytes);
+        return ESP_ERR_NO_MEM;
+    }
+    portENTER_CRITICAL(&budget_lock);
+    t->handle = h;
+    portEXIT_CRITICAL(&budget_lock);
+    add_task(t);
+    if (out) {
+        *out = h;
+    }
+    return ESP_OK;
+}
+
+void mem_task_end(mem_task_t *t)
+{
+    TaskHandle_t h = detach(t);
+
+    if (!h) {
+        return;                       // Already ended; vTaskDelete(NULL) would end the caller
+    }
+#if CONFIG_PLANTDOC_STATIC_ALLOC
+    if (h == xTaskGetCurrentTaskHandle()) {
+        vTaskSuspend(NULL);           // Deleted by the next mem_task_start()
+    }
+#endif
+    vTaskDelete(h);
+}
+
+void mem_task_adopt(const char *name, uint32_t stack_bytes)
+{
+    TaskHandle_t h = xTaskGetHandle(name);
+
+    if (!h) {
+        ESP_LOGW(TAG, "No task %s to account for", name);
+        return;
+    }
+    portENTER_CRITICAL(&budget_lock);
+    for (int i = 0; i < MEM_MAX_TASKS; i++) {
+        if (adopted[i].name == NULL) {
+            adopted[i] = (mem_task_t){ .name = name, .stack_bytes = stack_bytes,
+                                       .handle = h, .free_min = UINT32_MAX };
+            portEXIT_CRITICAL(&budget_lock);
+            add_task(&adopted[i]);
+            return;
+        }
+    }
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+int mem_budget_snapshot(mem_task_t *out, int max)
+{
+    int n = 0;
+
+    portENTER_CRITICAL(&budget_lock);
+    for (int i = 0; i < n_tasks && n < max; i++) {
+        mem_task_t *t = tasks[i];
+        if (t->handle) {
+            // ESP-IDF FreeRTOS reports the high-water mark in bytes
+            t->free_min = uxTaskGetStackHighWaterMark(t->handle);
+        }
+        out[n++] = *t;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+    return n;
+}
+
+void mem_budget_aggregate(const mem_task_t *list, int n, mem_stack_t *per,
+                          mem_totals_t *totals)
+{
+    memset(totals, 0, sizeof(*totals));
+
+    for (int i = 0; i < n; i++) {
+        const mem_task_t *t = &list[i];
+        mem_stack_t s = { .suggested = t->stack_bytes, .verdict = MEM_STACK_UNKNOWN };
+
+        if (t->free_min <= t->stack_bytes) {
+            s.used = t->stack_bytes - t->free_min;
+            uint32_t headroom = s.used / 4 > MEM_STACK_MIN_FREE ? s.used / 4 : MEM_STACK_MIN_FREE;
+            s.suggested = (s.used + headroom + MEM_STACK_ROUND - 1) / MEM_STACK_ROUND * MEM_STACK_ROUND;
+            if (t->free_min < MEM_STACK_MIN_FREE) {
+                s.verdict = MEM_STACK_TIGHT;
+                totals->tight++;
+            } else if (t->stack_bytes >= s.suggested + MEM_STACK_SHRINK) {
+                s.verdict = MEM_STACK_LOOSE;
+                totals->loose++;
+            } else {
+                s.verdict = MEM_STACK_OK;
+            }
+        }
+        if (t->stack) {
+            totals->stack_static += t->stack_bytes;
+        } else {
+            totals->stack_heap += t->stack_bytes;
+        }
+        totals->stack_used += s.used;
+        totals->stack_suggested += s.suggested;
+        per[i] = s;
+    }
+}
+
+const char *mem_verdict_name(mem_verdict_t v)
+{
+    static const char *const names[] = {
+        [MEM_STACK_UNKNOWN] = "unknown",
+        [MEM_STACK_OK]      = "ok",
+        [MEM_STACK_TIGHT]   = "tight",
+        [MEM_STACK_LOOSE]   = "loose",
+    };
+    return names[v];
+}
+
+int mem_budget_check(void)
+{
+    mem_task_t list[MEM_MAX_TASKS];
+    mem_stack_t per[MEM_MAX_TASKS];
+    mem_totals_t tot;
+    int n = mem_budget_snapshot(list, MEM_MAX_TASKS);
+
+    mem_budget_aggregate(list, n, per, &tot);
+    for (int i = 0; i < n; i++) {
+        if (per[i].verdict == MEM_STACK_TIGHT) {
+            ESP_LOGW(TAG, "Task %s used %lu of its %lu byte stack; give it %lu", list[i].name,
+                     (unsigned long)per[i].used, (unsigned long)list[i].stack_bytes,
+                     (unsigned long)per[i].suggested);
+        }
+    }
+    ESP_LOGI(TAG, "%d task stacks: %lu bytes static, %lu from the heap, %lu used at most, "
+             "%lu suggested (%d tight, %d loose)", n, (unsigned long)tot.stack_static,
+             (unsigned long)tot.stack_heap, (unsigned long)tot.stack_used,
+             (unsigned long)tot.stack_suggested, tot.tight, tot.loose);
+    return tot.tight;
+}
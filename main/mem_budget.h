@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+// Task stacks and the memory budget.
+//
+// Every task the app creates is declared with MEM_TASK() and started with
+// mem_task_start(). With CONFIG_PLANTDOC_STATIC_ALLOC its stack and TCB are
+// static arrays, so they are placed by the linker and listed in the budget
+// report (tools/mem_budget.py, "idf.py mem-budget"). Otherwise they come
+// from the heap as before. The app's queues, semaphores and event groups
+// are static in either mode: they are created once and never freed, so
+// that costs nothing.
+//
+// Started tasks, plus the framework tasks adopted with mem_task_adopt(),
+// are registered so their stack high-water marks can be compared against
+// the size they were given (/budget, /metrics). That is how stacks get
+// right-sized.
+
+#define MEM_MAX_TASKS       16
+#define MEM_STACK_MIN_FREE  512       // Less left at the high-water mark is too tight
+#define MEM_STACK_ROUND     256       // Suggested sizes are multiples of this
+#define MEM_STACK_SHRINK    1024      // Only suggest shrinking by at least this much
+
+typedef struct {
+    const char *name;                 // FreeRTOS task name
+    uint32_t stack_bytes;
+    StackType_t *stack;               // Static storage, NULL for the heap
+    StaticTask_t *tcb;
+    TaskHandle_t handle;              // NULL when not running
+    uint32_t free_min;                // Bytes never touched; UINT32_MAX until sampled
+} mem_task_t;
+
+#if CONFIG_PLANTDOC_STATIC_ALLOC
+#define MEM_STATIC          1
+#define MEM_TASK(var, task_name, bytes)                                         \
+    static StackType_t var##_stack[(bytes) / sizeof(StackType_t)];              \
+    static StaticTask_t var##_tcb;                                              \
+    static mem_task_t var = { .name = task_name, .stack_bytes = (bytes),        \
+                              .stack = var##_stack, .tcb = &var##_tcb,          \
+                              .free_min = UINT32_MAX }
+#else
+#define MEM_STATIC          0
+#define MEM_TASK(var, task_name, bytes)                                         \
+    static mem_task_t var = { .name = task_name, .stack_bytes = (bytes),        \
+                              .free_min = UINT32_MAX }
+#endif
+
+// Create the task on core (tskNO_AFFINITY for either) and register it.
+// *out gets the handle if out isn't NULL. ESP_ERR_INVALID_STATE if t is
+// still running, ESP_ERR_NO_MEM if FreeRTOS refuses.
+esp_err_t mem_task_start(mem_task_t *t, TaskFunction_t fn, void *arg, UBaseType_t prio,
+                         BaseType_t core, TaskHandle_t *out);
+
+// End t, keeping its high-water mark; called by the task itself as its
+// last act, or on it by another task. A task ending itself with static
+// storage suspends rather than deletes, and the next mem_task_start()
+// deletes it: FreeRTOS frees a self-deleted task's TCB later, from the idle
+// task, and the storage can't be reused before then.
+void mem_task_end(mem_task_t *t);
+
+// Register a task the framework created (httpd, lwIP) by its name, with
+// the stack size it was configured with
+void mem_task_adopt(const char *name, uint32_t stack_bytes);
+
+typedef enum {
+    MEM_STACK_UNKNOWN,                // Never sampled
+    MEM_STACK_OK,
+    MEM_STACK_TIGHT,                  // Under MEM_STACK_MIN_FREE left
+    MEM_STACK_LOOSE,                  // Could give back MEM_STACK_SHRINK or more
+} mem_verdict_t;
+
+typedef struct {
+    uint32_t used;                    // High-water mark
+    uint32_t suggested;               // Used plus headroom, rounded up
+    mem_verdict_t verdict;
+} mem_stack_t;
+
+typedef struct {
+    uint32_t stack_static;            // Task stacks in static storage
+    uint32_t stack_heap;              // Task stacks from the heap
+    uint32_t stack_used;              // Sum of the sampled high-water marks
+    uint32_t stack_suggested;         // Sum of the suggested sizes
+    int tight;
+    int loose;
+} mem_totals_t;
+
+// Copy every registered task into out with fresh high-water marks; returns
+// the count
+int mem_budget_snapshot(mem_task_t *out, int max);
+
+// Judge each task's stack (per[i] for tasks[i]) and total them up. Pure,
+// so it runs on the host as well.
+void mem_budget_aggregate(const mem_task_t *tasks, int n, mem_stack_t *per,
+                          mem_totals_t *totals);
+
+// Check every registered stack now and log the tight ones and the
+// totals; returns the number of tight stacks
+int mem_budget_check(void);
+
+const char *mem_verdict_name(mem_verdict_t v);
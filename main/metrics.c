@@ -0,0 +1,208 @@
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "history.h"
+#include "mem_budget.h"
+#include "metrics.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "sensors.h"
+
+static const char *TAG = "metrics";
+
+static const char *const counter_names[METRIC_COUNTER_COUNT] = {
+    [METRIC_DUTY_CHANGES]   = "pump_duty_changes_total",
+    [METRIC_PUMP_STOPS]     = "pump_stops_total",
+    [METRIC_CTRL_RING_FULL] = "pump_ctrl_ring_full_total",
+    [METRIC_HTTP_REQUESTS]  = "http_requests_total",
+    [METRIC_SSE_FRAMES]     = "sse_frames_total",
+    [METRIC_SSE_DROPS]      = "sse_dropped_clients_total",
+    [METRIC_UDP_COMMANDS]   = "udp_commands_total",
+    [METRIC_UDP_REJECTED]   = "udp_rejected_total",
+};
+
+static const char *const hist_handlers[METRIC_HIST_COUNT] = {
+    [METRIC_HIST_HTTP_ROOT]     = "root",
+    [METRIC_HIST_HTTP_SPRAY]    = "spray",
+    [METRIC_HIST_HTTP_STOP]     = "stop",
+    [METRIC_HIST_HTTP_CLASSIFY] = "classify",
+    [METRIC_HIST_HTTP_UPLOAD]   = "upload",
+};
+
+// Bucket upper bounds in microseconds; one extra bucket for +Inf
+static const uint32_t hist_bounds_us[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+#define HIST_BUCKETS (sizeof(hist_bounds_us) / sizeof(hist_bounds_us[0]) + 1)
+
+typedef struct {
+    atomic_uint buckets[HIST_BUCKETS];
+    atomic_ullong sum_us;
+} hist_t;
+
+static atomic_uint counters[portNUM_PROCESSORS][METRIC_COUNTER_COUNT];
+static hist_t hists[METRIC_HIST_COUNT];
+
+void metrics_inc(metric_counter_t c)
+{
+    atomic_fetch_add_explicit(&counters[xPortGetCoreID()][c], 1, memory_order_relaxed);
+}
+
+void metrics_observe_us(metric_hist_t h, uint32_t us)
+{
+    size_t b = 0;
+
+    while (b < HIST_BUCKETS - 1 && us > hist_bounds_us[b]) {
+        b++;
+    }
+    atomic_fetch_add_explicit(&hists[h].buckets[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hists[h].sum_us, us, memory_order_relaxed);
+}
+
+// Output buffer handed to emit whenever the next line doesn't fit. Lines
+// are never split: one longer than the whole buffer fails the scrape.
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    metrics_emit_fn emit;
+    void *ctx;
+    esp_err_t err;                    // First failure; later output is dropped
+} out_t;
+
+static void out_flush(out_t *o)
+{
+    if (o->err == ESP_OK && o->len > 0) {
+        o->err = o->emit(o->ctx, o->buf, o->len);
+    }
+    o->len = 0;
+}
+
+static void out_printf(out_t *o, const char *fmt, ...)
+{
+    va_list ap;
+
+    while (o->err == ESP_OK) {
+        va_start(ap, fmt);
+        int n = vsnprintf(o->buf + o->len, o->size - o->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            o->err = ESP_FAIL;
+        } else if (o->len + n < o->size) {
+            o->len += n;
+            return;
+        } else if (o->len == 0) {
+            ESP_LOGE(TAG, "%d byte line doesn't fit the %u byte buffer", n, (unsigned)o->size);
+            o->err = ESP_ERR_INVALID_SIZE;
+        } else {
+            out_flush(o);             // Send the complete lines, retry on an empty buffer
+        }
+    }
+}
+
+// Prometheus wants seconds; print microseconds as a fixed-point decimal
+#define SECONDS_FMT         "%llu.%06llu"
+#define SECONDS_ARG(us)     (unsigned long long)((us) / 1000000), (unsigned long long)((us) % 1000000)
+
+esp_err_t metrics_write(char *buf, size_t size, metrics_emit_fn emit, void *ctx)
+{
+    out_t o = { .buf = buf, .size = size, .emit = emit, .ctx = ctx, .err = ESP_OK };
+
+    if (size == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        unsigned long total = 0;
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            total += atomic_load_explicit(&counters[core][c], memory_order_relaxed);
+        }
+        out_printf(&o, "# TYPE %s counter\n%s %lu\n", counter_names[c], counter_names[c], total);
+    }
+
+    out_printf(&o, "# TYPE http_request_duration_seconds histogram\n");
+    for (int h = 0; h < METRIC_HIST_COUNT; h++) {
+        unsigned long cum = 0;
+        for (size_t b = 0; b < HIST_BUCKETS; b++) {
+            cum += atomic_load_explicit(&hists[h].buckets[b], memory_order_relaxed);
+            if (b < HIST_BUCKETS - 1) {
+                out_printf(&o, "http_request_duration_seconds_bucket{handler=\"%s\",le=\"" SECONDS_FMT "\"} %lu\n",
+                           hist_handlers[h], SECONDS_ARG(hist_bounds_us[b]), cum);
+            } else {
+                out_printf(&o, "http_request_duration_seconds_bucket{handler=\"%s\",le=\"+Inf\"} %lu\n",
+                           hist_handlers[h], cum);
+            }
+        }
+        unsigned long long sum = atomic_load_explicit(&hists[h].sum_us, memory_order_relaxed);
+        out_printf(&o, "http_request_duration_seconds_sum{handler=\"%s\"} " SECONDS_FMT "\n",
+                   hist_handlers[h], SECONDS_ARG(sum));
+        out_printf(&o, "http_request_duration_seconds_count{handler=\"%s\"} %lu\n",
+                   hist_handlers[h], cum);
+    }
+
+    uint64_t on_us = pump_get_on_time_us();
+    out_printf(&o, "# TYPE pump_on_seconds_total counter\npump_on_seconds_total " SECONDS_FMT "\n",
+               SECONDS_ARG(on_us));
+
+    out_printf(&o, "# TYPE pump_duty gauge\n");
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        out_printf(&o, "pump_duty{channel=\"%d\"} %u\n", ch, pump_get_channel(ch));
+    }
+
+    pump_ctrl_latency_t lat;
+    pump_ctrl_get_latency(&lat);
+    out_printf(&o, "# TYPE pump_ctrl_latency_seconds summary\n"
+                   "pump_ctrl_latency_seconds{quantile=\"0.5\"} " SECONDS_FMT "\n"
+                   "pump_ctrl_latency_seconds{quantile=\"0.99\"} " SECONDS_FMT "\n"
+                   "pump_ctrl_latency_seconds_sum " SECONDS_FMT "\n"
+                   "pump_ctrl_latency_seconds_count %lu\n",
+               SECONDS_ARG(lat.p50_us), SECONDS_ARG(lat.p99_us), SECONDS_ARG(lat.sum_us),
+               (unsigned long)lat.count);
+
+    sensors_reading_t sens;
+    sensors_get(&sens);
+    if (sens.seq) {
+        out_printf(&o, "# TYPE soil_moisture_ratio gauge\nsoil_moisture_ratio %u.%03u\n",
+                   sens.soil_permille / 1000, sens.soil_permille % 1000);
+        out_printf(&o, "# TYPE motor_current_amps gauge\nmotor_current_amps %u.%03u\n",
+                   sens.current_ma / 1000, sens.current_ma % 1000);
+        out_printf(&o, "# TYPE adc_samples_total counter\nadc_samples_total %lu\n",
+                   (unsigned long)sens.samples);
+        out_printf(&o, "# TYPE adc_overflows_total counter\nadc_overflows_total %lu\n",
+                   (unsigned long)sens.overflows);
+    }
+
+    uint32_t hist_samples, hist_bytes;
+    history_stats(&hist_samples, &hist_bytes);
+    out_printf(&o, "# TYPE history_samples gauge\nhistory_samples %lu\n",
+               (unsigned long)hist_samples);
+    out_printf(&o, "# TYPE history_bytes gauge\nhistory_bytes %lu\n",
+               (unsigned long)hist_bytes);
+
+    out_printf(&o, "# TYPE heap_free_bytes gauge\nheap_free_bytes %lu\n",
+               (unsigned long)esp_get_free_heap_size());
+    out_printf(&o, "# TYPE heap_min_free_bytes gauge\nheap_min_free_bytes %lu\n",
+               (unsigned long)esp_get_minimum_free_heap_size());
+
+    mem_task_t tasks[MEM_MAX_TASKS];
+    int n = mem_budget_snapshot(tasks, MEM_MAX_TASKS);
+    out_printf(&o, "# TYPE task_stack_size_bytes gauge\n");
+    for (int i = 0; i < n; i++) {
+        out_printf(&o, "task_stack_size_bytes{task=\"%s\"} %lu\n", tasks[i].name,
+                   (unsigned long)tasks[i].stack_bytes);
+    }
+    out_printf(&o, "# TYPE task_stack_free_min_bytes gauge\n");
+    for (int i = 0; i < n; i++) {
+        if (tasks[i].free_min != UINT32_MAX) {
+            out_printf(&o, "task_stack_free_min_bytes{task=\"%s\"} %lu\n", tasks[i].name,
+                       (unsigned long)tasks[i].free_min);
+        }
+    }
+
+    out_flush(&o);
+    return o.err;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Device metrics served in Prometheus text format at /metrics.
+//
+// Counters are per-core atomics summed at scrape time, histograms use fixed
+// latency buckets; recording is one relaxed atomic add (plus a short bucket
+// scan for histograms) and never allocates.
+
+typedef enum {
+    METRIC_DUTY_CHANGES,              // Channel duty updates applied
+    METRIC_PUMP_STOPS,
+    METRIC_CTRL_RING_FULL,            // Commands rejected with a full pump_ctrl ring
+    METRIC_HTTP_REQUESTS,
+    METRIC_SSE_FRAMES,                // State frames broadcast to /events subscribers
+    METRIC_SSE_DROPS,                 // Subscribers dropped for not keeping up
+    METRIC_UDP_COMMANDS,              // UDP control frames applied
+    METRIC_UDP_REJECTED,              // UDP frames malformed, corrupt or out of order
+    METRIC_COUNTER_COUNT
+} metric_counter_t;
+
+typedef enum {
+    METRIC_HIST_HTTP_ROOT,
+    METRIC_HIST_HTTP_SPRAY,
+    METRIC_HIST_HTTP_STOP,
+    METRIC_HIST_HTTP_CLASSIFY,
+    METRIC_HIST_HTTP_UPLOAD,
+    METRIC_HIST_COUNT
+} metric_hist_t;
+
+void metrics_inc(metric_counter_t c);
+
+// Record one latency sample in microseconds
+void metrics_observe_us(metric_hist_t h, uint32_t us);
+
+// Receives the output piece by piece; anything but ESP_OK ends the write
+typedef esp_err_t (*metrics_emit_fn)(void *ctx, const char *buf, size_t len);
+
+// Format every metric through buf, passing it to emit each time the next
+// line wouldn't fit and once at the end. Pieces always end on a line
+// boundary. ESP_ERR_INVALID_SIZE if a single line is longer than buf, or
+// emit's error; the output so far is then incomplete.
+esp_err_t metrics_write(char *buf, size_t size, metrics_emit_fn emit, void *ctx);
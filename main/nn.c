@@ -0,0 +1,319 @@
+#include "nn.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "nn";
+
+// Ping-pong activation buffers. Word-aligned so int8 rows can be read in
+// groups; nn_run is not reentrant (callers serialize).
+static int8_t arena[NN_ARENA_SIZE] __attribute__((aligned(4)));
+
+#define HALF (NN_ARENA_SIZE / 2)
+
+static inline int8_t requant(int32_t acc, int32_t mult, int shift, int32_t zp, int32_t lo)
+{
+    int total = 31 + shift;
+    int64_t v = (int64_t)acc * mult;
+    v = (v + ((int64_t)1 << (total - 1))) >> total;
+    int32_t q = (int32_t)v + zp;
+    if (q < lo) {
+        q = lo;
+    }
+    if (q > 127) {
+        q = 127;
+    }
+    return (int8_t)q;
+}
+
+// TF "same" padding: pad before = half of the total padding, rounded down
+static inline int pad_before(int in, int out, int k, int s)
+{
+    int total = (out - 1) * s + k - in;
+    return total > 0 ? total / 2 : 0;
+}
+
+static void run_conv(const nn_layer_t *l, const uint8_t *blob, const int8_t *in, int8_t *out)
+{
+    const int8_t *w = (const int8_t *)(blob + l->w_off);
+    const int32_t *bias = (const int32_t *)(blob + l->b_off);
+    const int32_t *mult = (const int32_t *)(blob + l->m_off);
+    const int8_t *shift = (const int8_t *)(blob + l->s_off);
+    const int k = l->kernel, s = l->stride, ic_n = l->in_c, oc_n = l->out_c;
+    const int lo = l->relu ? l->out_zp : -128;
+
+    if (k == 1 && s == 1) {
+        // Pointwise: one matrix-vector product per pixel, the hot path
+        const int px = l->in_h * l->in_w;
+        for (int p = 0; p < px; p++) {
+            const int8_t *x = in + p * ic_n;
+            for (int oc = 0; oc < oc_n; oc++) {
+                const int8_t *wr = w + oc * ic_n;
+                int32_t acc = bias[oc];
+                int ic = 0;
+                for (; ic + 4 <= ic_n; ic += 4) {
+                    acc += x[ic] * wr[ic] + x[ic + 1] * wr[ic + 1] +
+                           x[ic + 2] * wr[ic + 2] + x[ic + 3] * wr[ic + 3];
+                }
+                for (; ic < ic_n; ic++) {
+                    acc += x[ic] * wr[ic];
+                }
+                *out++ = requant(acc, mult[oc], shift[oc], l->out_zp, lo);
+            }
+        }
+        return;
+    }
+
+    // Out-of-bounds taps read the input zero point: the folded bias assumes
+    // every tap contributes in_zp * w.
+    const int pt = pad_before(l->in_h, l->out_h, k, s);
+    const int pl = pad_before(l->in_w, l->out_w, k, s);
+    for (int oy = 0; oy < l->out_h; oy++) {
+        for (int ox = 0; ox < l->out_w; ox++) {
+            const int iy0 = oy * s - pt, ix0 = ox * s - pl;
+            for (int oc = 0; oc < oc_n; oc++) {
+                const int8_t *wr = w + oc * k * k * ic_n;
+                int32_t acc = bias[oc];
+                for (int ky = 0; ky < k; ky++) {
+                    const int iy = iy0 + ky;
+                    for (int kx = 0; kx < k; kx++, wr += ic_n) {
+                        const int ix = ix0 + kx;
+                        if (iy < 0 || iy >= l->in_h || ix < 0 || ix >= l->in_w) {
+                            for (int ic = 0; ic < ic_n; ic++) {
+                                acc += l->in_zp * wr[ic];
+                            }
+                            continue;
+                        }
+                        const int8_t *x = in + (iy * l->in_w + ix) * ic_n;
+                        for (int ic = 0; ic < ic_n; ic++) {
+                            acc += x[ic] * wr[ic];
+                        }
+                    }
+                }
+                *out++ = requant(acc, mult[oc], shift[oc], l->out_zp, lo);
+            }
+        }
+    }
+}
+
+static void run_dwconv(const nn_layer_t *l, const uint8_t *blob, const int8_t *in, int8_t *out)
+{
+    const int8_t *w = (const int8_t *)(blob + l->w_off);
+    const int32_t *bias = (const int32_t *)(blob + l->b_off);
+    const int32_t *mult = (const int32_t *)(blob + l->m_off);
+    const int8_t *shift = (const int8_t *)(blob + l->s_off);
+    const int s = l->stride, c_n = l->in_c, h = l->in_h, wd = l->in_w;
+    const int lo = l->relu ? l->out_zp : -128;
+    const int pt = pad_before(h, l->out_h, 3, s);
+    const int pl = pad_before(wd, l->out_w, 3, s);
+
+    for (int oy = 0; oy < l->out_h; oy++) {
+        const int iy0 = oy * s - pt;
+        for (int ox = 0; ox < l->out_w; ox++) {
+            const int ix0 = ox * s - pl;
+            const bool interior = iy0 >= 0 && ix0 >= 0 && iy0 + 3 <= h && ix0 + 3 <= wd;
+            const int8_t *base = in + (iy0 * wd + ix0) * c_n;
+            for (int c = 0; c < c_n; c++) {
+                int32_t acc = bias[c];
+                if (interior) {
+                    // No bounds checks: walk the 3x3 window channel-strided
+                    const int8_t *x = base + c;
+                    const int8_t *wc = w + c;
+                    for (int ky = 0; ky < 3; ky++, x += wd * c_n, wc += 3 * c_n) {
+                        acc += x[0] * wc[0] + x[c_n] * wc[c_n] + x[2 * c_n] * wc[2 * c_n];
+                    }
+                } else {
+                    for (int ky = 0; ky < 3; ky++) {
+                        for (int kx = 0; kx < 3; kx++) {
+                            const int iy = iy0 + ky, ix = ix0 + kx;
+                            int32_t v = l->in_zp;
+                            if (iy >= 0 && iy < h && ix >= 0 && ix < wd) {
+                                v = in[(iy * wd + ix) * c_n + c];
+                            }
+                            acc += v * w[(ky * 3 + kx) * c_n + c];
+                        }
+                    }
+                }
+                *out++ = requant(acc, mult[c], shift[c], l->out_zp, lo);
+            }
+        }
+    }
+}
+
+static void run_gap(const nn_layer_t *l, const int8_t *in, int8_t *out)
+{
+    // Same scale and zero point in and out: a rounded mean per channel
+    const int px = l->in_h * l->in_w;
+    for (int c = 0; c < l->in_c; c++) {
+        int32_t sum = 0;
+        for (int p = 0; p < px; p++) {
+            sum += in[p * l->in_c + c];
+        }
+        int32_t q = (sum >= 0 ? sum + px / 2 : sum - px / 2) / px;
+        out[c] = (int8_t)q;
+    }
+}
+
+static void run_fc(const nn_layer_t *l, const uint8_t *blob, const int8_t *in, int8_t *out)
+{
+    const int8_t *w = (const int8_t *)(blob + l->w_off);
+    const int32_t *bias = (const int32_t *)(blob + l->b_off);
+    const int32_t *mult = (const int32_t *)(blob + l->m_off);
+    const int8_t *shift = (const int8_t *)(blob + l->s_off);
+    const int lo = l->relu ? l->out_zp : -128;
+
+    for (int oc = 0; oc < l->out_c; oc++) {
+        const int8_t *wr = w + oc * l->in_c;
+        int32_t acc = bias[oc];
+        for (int ic = 0; ic < l->in_c; ic++) {
+            acc += in[ic] * wr[ic];
+        }
+        out[oc] = requant(acc, mult[oc], shift[oc], l->out_zp, lo);
+    }
+}
+
+static size_t act_bytes(int h, int w, int c)
+{
+    return (size_t)h * w * c;
+}
+
+static bool in_blob(size_t len, uint32_t off, size_t bytes)
+{
+    return off <= len && bytes <= len - off;
+}
+
+esp_err_t nn_model_load(nn_model_t *model, const uint8_t *blob, size_t len)
+{
+    if (len < sizeof(nn_header_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const nn_header_t *hdr = (const nn_header_t *)blob;
+    if (hdr->magic != NN_MAGIC || hdr->n_layers == 0 ||
+        hdr->n_layers > NN_MAX_LAYERS || hdr->n_classes == 0 || hdr->in_c != 3) {
+        ESP_LOGE(TAG, "Bad model header");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!in_blob(len, hdr->layers_off, hdr->n_layers * sizeof(nn_layer_t)) ||
+        !in_blob(len, hdr->labels_off, hdr->n_classes * sizeof(nn_label_t))) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const nn_layer_t *layers = (const nn_layer_t *)(blob + hdr->layers_off);
+    size_t peak = 0;
+    int h = hdr->in_h, w = hdr->in_w, c = hdr->in_c;
+    for (int i = 0; i < hdr->n_layers; i++) {
+        const nn_layer_t *l = &layers[i];
+        if (l->in_h != h || l->in_w != w || l->in_c != c) {
+            ESP_LOGE(TAG, "Layer %d: shape mismatch", i);
+            return ESP_ERR_INVALID_ARG;
+        }
+        size_t in_b = act_bytes(l->in_h, l->in_w, l->in_c);
+        size_t out_b = act_bytes(l->out_h, l->out_w, l->out_c);
+        if (in_b > HALF || out_b > HALF) {
+            ESP_LOGE(TAG, "Layer %d: activation exceeds arena", i);
+            return ESP_ERR_NO_MEM;
+        }
+        if (in_b + out_b > peak) {
+            peak = in_b + out_b;
+        }
+
+        size_t n_w = 0;
+        switch (l->op) {
+        case NN_OP_CONV:
+            if (l->kernel != 1 && l->kernel != 3) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            n_w = (size_t)l->out_c * l->kernel * l->kernel * l->in_c;
+            break;
+        case NN_OP_DWCONV:
+            if (l->kernel != 3 || l->out_c != l->in_c) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            n_w = 9 * (size_t)l->in_c;
+            break;
+        case NN_OP_FC:
+            n_w = (size_t)l->out_c * l->in_c;
+            break;
+        case NN_OP_GAP:
+            break;
+        default:
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (l->op != NN_OP_GAP &&
+            (!in_blob(len, l->w_off, n_w) ||
+             !in_blob(len, l->b_off, 4 * (size_t)l->out_c) ||
+             !in_blob(len, l->m_off, 4 * (size_t)l->out_c) ||
+             !in_blob(len, l->s_off, l->out_c) ||
+             (l->b_off | l->m_off) & 3)) {
+            ESP_LOGE(TAG, "Layer %d: parameters out of range", i);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        h = l->out_h;
+        w = l->out_w;
+        c = l->out_c;
+    }
+    if (h * w != 1 || c != hdr->n_classes) {
+        ESP_LOGE(TAG, "Output is %dx%dx%d, expected %d logits", h, w, c, hdr->n_classes);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    model->blob = blob;
+    model->hdr = hdr;
+    model->layers = layers;
+    model->labels = (const nn_label_t *)(blob + hdr->labels_off);
+    model->peak_bytes = peak;
+    ESP_LOGI(TAG, "Model: %d layers, %dx%d input, %d classes, peak arena %u bytes",
+             hdr->n_layers, hdr->in_w, hdr->in_h, hdr->n_classes, (unsigned)peak);
+    return ESP_OK;
+}
+
+esp_err_t nn_run(const nn_model_t *model, const uint8_t *rgb, nn_result_t *out)
+{
+    if (!model->hdr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const nn_header_t *hdr = model->hdr;
+    int64_t t0 = esp_timer_get_time();
+
+    int8_t *cur = arena, *next = arena + HALF;
+    size_t n_in = act_bytes(hdr->in_h, hdr->in_w, hdr->in_c);
+    for (size_t i = 0; i < n_in; i++) {
+        cur[i] = (int8_t)(rgb[i] + hdr->in_zp);
+    }
+
+    int64_t t = t0;
+    for (int i = 0; i < hdr->n_layers; i++) {
+        const nn_layer_t *l = &model->layers[i];
+        switch (l->op) {
+        case NN_OP_CONV:   run_conv(l, model->blob, cur, next); break;
+        case NN_OP_DWCONV: run_dwconv(l, model->blob, cur, next); break;
+        case NN_OP_GAP:    run_gap(l, cur, next); break;
+        case NN_OP_FC:     run_fc(l, model->blob, cur, next); break;
+        }
+        int8_t *tmp = cur;
+        cur = next;
+        next = tmp;
+        int64_t now = esp_timer_get_time();
+        out->layer_us[i] = (uint32_t)(now - t);
+        t = now;
+    }
+
+    // Softmax over the dequantized logits for a confidence figure
+    int best = 0;
+    for (int i = 1; i < hdr->n_classes; i++) {
+        if (cur[i] > cur[best]) {
+            best = i;
+        }
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < hdr->n_classes; i++) {
+        sum += expf(hdr->out_scale * (cur[i] - cur[best]));
+    }
+    out->class_id = best;
+    out->confidence = 1.0f / sum;
+    out->total_us = (uint32_t)(t - t0);
+    return ESP_OK;
+}
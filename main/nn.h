@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Minimal int8 CNN inference engine.
+//
+// Models are packed by tools/nn_pack.py into a flat little-endian blob: a
+// header, a fixed-size record per layer and the int8 weights / int32 biases /
+// requantization parameters they point at. Weights are read in place (flash);
+// activations ping-pong between the two halves of a static arena, so a run
+// never allocates. Quantization follows the usual scheme:
+//   real = scale * (q - zero_point)
+// with per-tensor activations and per-output-channel weights; input zero
+// points are folded into the biases at pack time.
+
+#define NN_MAGIC            0x31304e4eu     // "NN01"
+#define NN_MAX_LAYERS       16
+#define NN_ARENA_SIZE       (2 * 4096)      // Two activation buffers
+#define NN_LABEL_LEN        32
+
+typedef enum {
+    NN_OP_CONV,                       // Standard conv, kernel 1 or 3
+    NN_OP_DWCONV,                     // Depthwise 3x3
+    NN_OP_GAP,                        // Global average pool
+    NN_OP_FC,                         // Fully connected
+} nn_op_t;
+
+typedef struct {
+    uint8_t op;                       // nn_op_t
+    uint8_t kernel;
+    uint8_t stride;
+    uint8_t relu;
+    uint16_t in_h, in_w, in_c;
+    uint16_t out_h, out_w, out_c;
+    int8_t in_zp;
+    int8_t out_zp;
+    uint8_t reserved[2];
+    uint32_t w_off;                   // int8 [out_c][k][k][in_c], depthwise [k][k][c]
+    uint32_t b_off;                   // int32 [out_c], zero point folded in
+    uint32_t m_off;                   // int32 [out_c] requant multiplier, Q31
+    uint32_t s_off;                   // int8 [out_c] requant right shift
+} nn_layer_t;
+
+typedef struct {
+    char name[NN_LABEL_LEN];          // Short id, e.g. "tomato_early_blight"
+    char plant[NN_LABEL_LEN];
+    char disease[NN_LABEL_LEN];
+    char treatment[NN_LABEL_LEN];
+    uint8_t pwm;                      // Spray intensity for this class
+    uint8_t reserved[3];
+} nn_label_t;
+
+typedef struct {
+    uint32_t magic;                   // NN_MAGIC
+    uint16_t n_layers;
+    uint16_t n_classes;
+    uint16_t in_h, in_w, in_c;
+    int8_t in_zp;                     // Input is q = pixel + in_zp (scale 1/255)
+    uint8_t reserved;
+    float out_scale;                  // Logit scale of the last layer
+    int8_t out_zp;
+    uint8_t reserved2[3];
+    uint32_t layers_off;              // nn_layer_t[n_layers]
+    uint32_t labels_off;              // nn_label_t[n_classes]
+} nn_header_t;
+
+typedef struct {
+    const uint8_t *blob;
+    const nn_header_t *hdr;
+    const nn_layer_t *layers;
+    const nn_label_t *labels;
+    size_t peak_bytes;                // Largest in+out activation pair
+} nn_model_t;
+
+typedef struct {
+    int class_id;
+    float confidence;                 // Softmax probability of class_id
+    uint32_t total_us;
+    uint32_t layer_us[NN_MAX_LAYERS];
+} nn_result_t;
+
+// Validate a packed model and check every activation fits the arena
+esp_err_t nn_model_load(nn_model_t *model, const uint8_t *blob, size_t len);
+
+// Classify one in_h x in_w RGB888 image
+esp_err_t nn_run(const nn_model_t *model, const uint8_t *rgb, nn_result_t *out);
@@ -0,0 +1,250 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "hal.h"
+#include "journal.h"
+#include "mem_budget.h"
+#include "pump_ctrl.h"
+#include "trace.h"
+#include "ota.h"
+
+static const char *TAG = "ota";
+
+#define OTA_WRITER_STACK    4096
+#define OTA_WRITER_PRIO     5         // Level with httpd: neither starves the other
+#define OTA_MAC_BLOCK       64        // SHA-256 block, the HMAC key pad
+
+#if CONFIG_PLANTDOC_OTA
+#define OTA_KEY             CONFIG_PLANTDOC_OTA_KEY
+#else
+#define OTA_KEY             ""        // Updates off: nothing authenticates
+#endif
+
+typedef struct {
+    uint8_t *data;                    // NULL: no more, writer exits
+    size_t len;
+} ota_chunk_t;
+
+static uint8_t bufs[2][OTA_CHUNK];
+static atomic_bool busy;
+MEM_TASK(writer_mem, "ota_write", OTA_WRITER_STACK);
+
+// Shared with the writer task for one update
+static QueueHandle_t full_q;          // Filled buffers, to the writer
+static QueueHandle_t free_q;          // Written buffers, back to the receiver
+static SemaphoreHandle_t writer_done;
+static StaticQueue_t full_q_buf, free_q_buf;
+static uint8_t full_q_items[2 * sizeof(ota_chunk_t)];
+static uint8_t free_q_items[2 * sizeof(uint8_t *)];
+static StaticSemaphore_t writer_done_buf;
+static mbedtls_sha256_context sha;    // Inner HMAC hash, writer only
+static volatile esp_err_t write_err;
+static uint32_t flash_us;
+
+// Writes until it gets the end of the image, then waits there to be ended
+// by ota_receive(): ending itself, it could still be registered as running
+// when the next update starts
+static void writer_task(void *arg)
+{
+    ota_chunk_t c;
+
+    for (;;) {
+        xQueueReceive(full_q, &c, portMAX_DELAY);
+        if (c.data == NULL) {
+            xSemaphoreGive(writer_done);
+            continue;
+        }
+        // After a failed write the rest is only handed back, not written
+        if (write_err == ESP_OK) {
+            int64_t t0 = esp_timer_get_time();
+            mbedtls_sha256_update(&sha, c.data, c.len);
+            write_err = hal_ota_write(c.data, c.len);
+            flash_us += (uint32_t)(esp_timer_get_time() - t0);
+        }
+        xQueueSend(free_q, &c.data, portMAX_DELAY);
+    }
+}
+
+// Start one half of the HMAC: the key, zero padded to a block, xored with pad
+static void mac_start(mbedtls_sha256_context *c, uint8_t pad)
+{
+    uint8_t block[OTA_MAC_BLOCK];
+    size_t len = strlen(OTA_KEY);
+
+    for (int i = 0; i < OTA_MAC_BLOCK; i++) {
+        block[i] = (i < len ? OTA_KEY[i] : 0) ^ pad;
+    }
+    mbedtls_sha256_starts(c, 0);
+    mbedtls_sha256_update(c, block, sizeof(block));
+}
+
+// Finish the HMAC over what the writer hashed and compare it with the
+// client's without an early exit, so timing doesn't leak how much matched
+static bool mac_matches(const uint8_t mac[OTA_MAC_LEN])
+{
+    mbedtls_sha256_context outer;
+    uint8_t digest[OTA_MAC_LEN];
+    uint8_t diff = 0;
+
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_init(&outer);
+    mac_start(&outer, 0x5c);
+    mbedtls_sha256_update(&outer, digest, sizeof(digest));
+    mbedtls_sha256_finish(&outer, digest);
+    mbedtls_sha256_free(&outer);
+    for (int i = 0; i < OTA_MAC_LEN; i++) {
+        diff |= digest[i] ^ mac[i];
+    }
+    return diff == 0;
+}
+
+bool ota_enabled(void)
+{
+    size_t len = strlen(OTA_KEY);
+
+    return len >= OTA_KEY_MIN && len <= OTA_KEY_MAX;
+}
+
+// Fill buffers from recv and queue them to the writer until the image is
+// in, the stream breaks or a write fails
+static esp_err_t pump_stream(ota_recv_fn recv, void *ctx, uint32_t size, ota_stats_t *st)
+{
+    uint32_t left = size;
+
+    while (left > 0) {
+        uint8_t *buf;
+        size_t fill = 0;
+        int64_t t0 = esp_timer_get_time();
+
+        xQueueReceive(free_q, &buf, portMAX_DELAY);
+        st->recv_wait_us += (uint32_t)(esp_timer_get_time() - t0);
+        if (write_err != ESP_OK) {
+            return write_err;
+        }
+        while (fill < OTA_CHUNK && left > 0) {
+            size_t want = OTA_CHUNK - fill < left ? OTA_CHUNK - fill : left;
+            int n = recv(ctx, buf + fill, want);
+            if (n <= 0) {
+                return ESP_ERR_INVALID_SIZE;  // Ended or broke: either way cut short
+            }
+            fill += n;
+            left -= n;
+        }
+        ota_chunk_t c = { buf, fill };
+        xQueueSend(full_q, &c, portMAX_DELAY);
+        st->bytes += fill;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ota_receive(ota_recv_fn recv, void *ctx, uint32_t size,
+                      const uint8_t mac[OTA_MAC_LEN], ota_stats_t *stats)
+{
+    ota_stats_t st = {0};
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err;
+
+    if (!ota_enabled()) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (atomic_exchange(&busy, true)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pump_ctrl_hold(true);
+
+    full_q = xQueueCreateStatic(2, sizeof(ota_chunk_t), full_q_items, &full_q_buf);
+    free_q = xQueueCreateStatic(2, sizeof(uint8_t *), free_q_items, &free_q_buf);
+    writer_done = xSemaphoreCreateBinaryStatic(&writer_done_buf);
+    for (int i = 0; i < 2; i++) {
+        uint8_t *b = bufs[i];
+        xQueueSend(free_q, &b, 0);
+    }
+    write_err = ESP_OK;
+    flash_us = 0;
+    mbedtls_sha256_init(&sha);
+    mac_start(&sha, 0x36);
+
+    err = hal_ota_begin();
+    if (err != ESP_OK) {
+        goto out;
+    }
+    err = mem_task_start(&writer_mem, writer_task, NULL, OTA_WRITER_PRIO, tskNO_AFFINITY, NULL);
+    if (err != ESP_OK) {
+        hal_ota_abort();
+        goto out;
+    }
+    ESP_LOGI(TAG, "Receiving %lu byte image", (unsigned long)size);
+
+    err = pump_stream(recv, ctx, size, &st);
+
+    // Let the writer finish what it has, then check the whole image
+    ota_chunk_t end = { NULL, 0 };
+    xQueueSend(full_q, &end, portMAX_DELAY);
+    xSemaphoreTake(writer_done, portMAX_DELAY);
+    mem_task_end(&writer_mem);
+    if (err == ESP_OK) {
+        err = write_err;
+    }
+    if (err == ESP_OK && !mac_matches(mac)) {
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (err == ESP_OK) {
+        err = hal_ota_finish();
+    } else {
+        hal_ota_abort();
+    }
+
+out:
+    mbedtls_sha256_free(&sha);
+    vSemaphoreDelete(writer_done);
+    vQueueDelete(free_q);
+    vQueueDelete(full_q);
+
+    st.flash_us = flash_us;
+    st.total_us = (uint32_t)(esp_timer_get_time() - t0);
+    if (stats) {
+        *stats = st;
+    }
+    if (err == ESP_OK) {
+        // The pump stays held until the restart into the new image
+        trace_event(TRACE_OTA_DONE, st.total_us / 1000000, st.bytes);
+        ESP_LOGI(TAG, "%lu bytes in %lu ms (flash busy %lu ms, receive held up %lu ms)",
+                 (unsigned long)st.bytes, (unsigned long)(st.total_us / 1000),
+                 (unsigned long)(st.flash_us / 1000), (unsigned long)(st.recv_wait_us / 1000));
+    } else {
+        pump_ctrl_hold(false);
+        trace_event(TRACE_OTA_FAIL, 0, err);
+        ESP_LOGW(TAG, "Update failed after %lu bytes: %s", (unsigned long)st.bytes,
+                 esp_err_to_name(err));
+    }
+    atomic_store(&busy, false);
+    return err;
+}
+
+void ota_boot_check(bool healthy)
+{
+    if (!hal_ota_pending_verify()) {
+        return;
+    }
+    if (healthy) {
+        hal_ota_confirm();
+        ESP_LOGI(TAG, "New firmware booted, keeping it");
+    } else {
+        ESP_LOGE(TAG, "New firmware failed to boot, rolling back");
+        hal_ota_rollback();
+    }
+}
+
+void ota_restart(void)
+{
+    vTaskDelay(pdMS_TO_TICKS(OTA_RESTART_DELAY_MS));
+    journal_flush();
+    esp_restart();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Firmware update over the AP.
+//
+// POST /ota streams an app image (the build's .bin) into the OTA slot the
+// app isn't running from. The body is received into one of two buffers
+// while a writer task hashes the other and writes it to flash, so the
+// radio and the flash work at the same time instead of taking turns. The
+// image is only made bootable if all of it arrived, it authenticates and
+// the image's own checks pass; anything else leaves the running firmware
+// in charge. The pump is held stopped from the start of an update until it
+// fails or the device restarts.
+//
+// The AP is open, so a hash alone would let anyone on it flash anything.
+// Updates are off unless built with CONFIG_PLANTDOC_OTA, and then the
+// client must send the image's HMAC-SHA256 under the shared
+// CONFIG_PLANTDOC_OTA_KEY (tools/ota_upload.py). Signed apps
+// (CONFIG_SECURE_SIGNED_APPS_NO_SECURE_BOOT) add a check that doesn't rest
+// on a secret kept in the firmware.
+//
+// The new image boots on probation (CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE):
+// ota_boot_check() keeps it once boot went through, and a failed boot, or a
+// crash before that, goes back to the previous image.
+
+#define OTA_CHUNK           4096      // Per buffer: one flash sector
+#define OTA_MAC_LEN         32        // HMAC-SHA256
+#define OTA_KEY_MIN         16        // Shorter keys leave updates off
+#define OTA_KEY_MAX         64        // One SHA-256 block
+#define OTA_RESTART_DELAY_MS 500      // Lets the reply reach the client
+
+typedef struct {
+    uint32_t bytes;                   // Received and written
+    uint32_t total_us;
+    uint32_t recv_wait_us;            // Receiving held up by the flash
+    uint32_t flash_us;                // Writer busy hashing and writing
+} ota_stats_t;
+
+// Read up to len bytes of the image into buf. Returns the count, 0 if the
+// stream ended or negative on an error.
+typedef int (*ota_recv_fn)(void *ctx, uint8_t *buf, size_t len);
+
+// Updates are built in and have a usable key
+bool ota_enabled(void);
+
+// Receive a size byte image through recv and set it to boot next.
+// ESP_ERR_NOT_SUPPORTED with updates off, ESP_ERR_INVALID_SIZE if the
+// stream ended or broke early, ESP_ERR_INVALID_CRC if mac isn't the image's
+// HMAC-SHA256 under the key, ESP_ERR_INVALID_STATE with an update already
+// running, or the flash's error. stats may be NULL.
+esp_err_t ota_receive(ota_recv_fn recv, void *ctx, uint32_t size,
+                      const uint8_t mac[OTA_MAC_LEN], ota_stats_t *stats);
+
+// Call once boot is over: keeps an image on probation if healthy, else
+// rolls back to the previous one (reboots). No-op for a confirmed image.
+void ota_boot_check(bool healthy);
+
+// Commit the journal and restart into the new image
+void ota_restart(void);
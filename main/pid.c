@@ -0,0 +1,29 @@
+#include "pid.h"
+
+static int64_t clamp64(int64_t v, int64_t lo, int64_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void pid_reset(pid_ctrl_t *pid, int32_t meas, int32_t bias)
+{
+    pid->integ = clamp64((int64_t)bias << PID_Q,
+                         (int64_t)pid->out_min << PID_Q,
+                         (int64_t)pid->out_max << PID_Q);
+    pid->prev_meas = meas;
+}
+
+int32_t pid_update(pid_ctrl_t *pid, int32_t setpoint, int32_t meas)
+{
+    int32_t err = setpoint - meas;
+    int64_t lo = (int64_t)pid->out_min << PID_Q;
+    int64_t hi = (int64_t)pid->out_max << PID_Q;
+
+    pid->integ = clamp64(pid->integ + (int64_t)pid->ki * err, lo, hi);
+
+    int64_t out = (int64_t)pid->kp * err + pid->integ -
+                  (int64_t)pid->kd * (meas - pid->prev_meas);
+    pid->prev_meas = meas;
+
+    return (int32_t)(clamp64(out, lo, hi) >> PID_Q);
+}
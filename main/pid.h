@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed-point PID controller.
+//
+// Gains are Q16.16 and already include the loop period, so pid_update()
+// is integer-only: three multiplies, a shift and two clamps per call.
+// The derivative acts on the measurement (no kick on setpoint changes)
+// and the integrator is clamped to the output range (anti-windup).
+
+#define PID_Q           16
+#define PID_GAIN(x)     ((int32_t)((x) * (1 << PID_Q) + 0.5))
+
+typedef struct {
+    int32_t kp;                       // Q16.16
+    int32_t ki;                       // Q16.16, per update
+    int32_t kd;                       // Q16.16, per update
+    int32_t out_min;
+    int32_t out_max;
+    int64_t integ;                    // Integrator, Q16.16 output units
+    int32_t prev_meas;
+} pid_ctrl_t;
+
+// Reset state; the integrator starts at `bias` so the output doesn't jump
+void pid_reset(pid_ctrl_t *pid, int32_t meas, int32_t bias);
+
+// One controller step; returns the clamped output
+int32_t pid_update(pid_ctrl_t *pid, int32_t setpoint, int32_t meas);
@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "program.h"
+#include "pump_ctrl.h"
+#include "trace.h"
+
+static const char *TAG = "program";
+
+static program_t slots[PROGRAM_SLOTS];
+static esp_timer_handle_t seq_timer;
+static portMUX_TYPE seq_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Sequencer state, guarded by seq_lock
+static program_state_t state;
+static uint32_t run_token;            // pump_ctrl ownership token
+static uint32_t run_gen;              // Bumped by every program_run()
+static int64_t next_deadline_us;      // Absolute time the current step ends
+
+// Snapshot of the step to apply, taken under seq_lock
+typedef struct {
+    uint8_t slot;
+    uint8_t index;
+    uint8_t duty;
+    uint32_t token;
+    uint32_t gen;
+    int64_t deadline_us;
+} seq_step_t;
+
+// Load the current step and push the deadline out by its duration.
+// Deadlines are absolute, so callback latency never accumulates.
+static void seq_load_step_locked(seq_step_t *out)
+{
+    const program_step_t *step = &slots[state.slot].steps[state.step];
+
+    next_deadline_us += (int64_t)step->duration_ms * 1000;
+    out->slot = state.slot;
+    out->index = state.step;
+    out->duty = step->duty;
+    out->token = run_token;
+    out->gen = run_gen;
+    out->deadline_us = next_deadline_us;
+}
+
+static bool seq_current(uint32_t gen)
+{
+    portENTER_CRITICAL(&seq_lock);
+    bool current = state.running && run_gen == gen;
+    portEXIT_CRITICAL(&seq_lock);
+    return current;
+}
+
+// Apply a step and arm the timer for its end. esp_timer_stop() doesn't wait
+// for a callback already running, so one from the run before a
+// program_run() can get here with its old step: it is dropped, and if it
+// armed the timer first, the current run re-arms it with its own deadline.
+static void seq_fire(const seq_step_t *step)
+{
+    if (!seq_current(step->gen)) {
+        return;
+    }
+    pump_ctrl_post(step->duty, step->token);
+    trace_event(TRACE_PROGRAM_STEP, (step->slot << 8) | step->index, step->duty);
+
+    int64_t now = esp_timer_get_time();
+    uint64_t after = step->deadline_us > now ? step->deadline_us - now : 0;
+    esp_err_t err = esp_timer_start_once(seq_timer, after);
+    if (err == ESP_ERR_INVALID_STATE && seq_current(step->gen)) {
+        esp_timer_stop(seq_timer);
+        err = esp_timer_start_once(seq_timer, after);
+    }
+    if (err != ESP_OK && seq_current(step->gen)) {
+        ESP_LOGE(TAG, "Can't time step %d of slot %d: %s", step->index, step->slot,
+                 esp_err_to_name(err));
+    }
+}
+
+static void seq_timer_cb(void *arg)
+{
+    seq_step_t step;
+    bool done = false;
+
+    portENTER_CRITICAL(&seq_lock);
+    if (!state.running || !pump_ctrl_owns(run_token)) {
+        state.running = false;        // Stopped or overridden meanwhile
+        portEXIT_CRITICAL(&seq_lock);
+        return;
+    }
+    if (++state.step >= slots[state.slot].n_steps) {
+        state.step = 0;
+        if (++state.pass >= slots[state.slot].repeat) {
+            state.running = false;
+            done = true;
+        }
+    }
+    if (done) {
+        step.slot = state.slot;
+        step.token = run_token;
+    } else {
+        seq_load_step_locked(&step);
+    }
+    portEXIT_CRITICAL(&seq_lock);
+
+    if (done) {
+        pump_ctrl_post(0, step.token);
+        trace_event(TRACE_PROGRAM_DONE, step.slot, 0);
+    } else {
+        seq_fire(&step);
+    }
+}
+
+esp_err_t program_init(void)
+{
+    const esp_timer_create_args_t args = {
+        .callback = seq_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "program"
+    };
+    return esp_timer_create(&args, &seq_timer);
+}
+
+esp_err_t program_parse(const char *steps, int repeat, program_t *prog)
+{
+    const char *p = steps;
+
+    if (repeat < 1 || repeat > PROGRAM_MAX_REPEAT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(prog, 0, sizeof(*prog));
+    prog->repeat = repeat;
+
+    while (*p) {
+        char *end;
+        long duty = strtol(p, &end, 10);
+        if (end == p || *end != ':' || duty < 0 || duty > 255) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        p = end + 1;
+        long ms = strtol(p, &end, 10);
+        if (end == p || ms < 1 || ms > PROGRAM_MAX_STEP_MS) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (prog->n_steps >= PROGRAM_MAX_STEPS) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        prog->steps[prog->n_steps].duty = duty;
+        prog->steps[prog->n_steps].duration_ms = ms;
+        prog->n_steps++;
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return ESP_ERR_INVALID_ARG;
+        }
+        p = end;
+    }
+    return prog->n_steps ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t program_store(uint8_t slot, const program_t *prog)
+{
+    if (slot >= PROGRAM_SLOTS || prog->n_steps == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // A program stopped or overridden since its last step still has
+    // state.running set until its timer fires; that slot is free
+    portENTER_CRITICAL(&seq_lock);
+    bool busy = state.running && state.slot == slot && pump_ctrl_owns(run_token);
+    if (!busy) {
+        slots[slot] = *prog;
+    }
+    portEXIT_CRITICAL(&seq_lock);
+
+    return busy ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t program_run(uint8_t slot)
+{
+    if (slot >= PROGRAM_SLOTS || slots[slot].n_steps == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    seq_step_t step;
+
+    program_cancel();
+
+    portENTER_CRITICAL(&seq_lock);
+    state.running = true;
+    state.slot = slot;
+    state.step = 0;
+    state.pass = 0;
+    run_gen++;
+    run_token = pump_ctrl_acquire();
+    next_deadline_us = esp_timer_get_time();
+    seq_load_step_locked(&step);
+    portEXIT_CRITICAL(&seq_lock);
+
+    ESP_LOGI(TAG, "Running slot %d (%d steps x%d)", slot, slots[slot].n_steps, slots[slot].repeat);
+    seq_fire(&step);
+    return ESP_OK;
+}
+
+void program_cancel(void)
+{
+    portENTER_CRITICAL(&seq_lock);
+    bool was_running = state.running;
+    uint8_t slot = state.slot;
+    state.running = false;
+    portEXIT_CRITICAL(&seq_lock);
+
+    if (was_running) {
+        esp_timer_stop(seq_timer);
+        trace_event(TRACE_PROGRAM_CANCEL, slot, 0);
+    }
+}
+
+void program_get_state(program_state_t *out)
+{
+    portENTER_CRITICAL(&seq_lock);
+    *out = state;
+    out->running = state.running && pump_ctrl_owns(run_token);
+    portEXIT_CRITICAL(&seq_lock);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// On-device spray programs.
+//
+// A program is a list of (duty, duration_ms) steps run `repeat` times, then
+// the pump stops. Programs are validated into a fixed slot table and played
+// back by an esp_timer sequencer, so step timing does not depend on the
+// browser or Wi-Fi. Any manual speed change or stop cancels the program.
+
+#define PROGRAM_SLOTS           4
+#define PROGRAM_MAX_STEPS       16
+#define PROGRAM_MAX_STEP_MS     600000        // 10 minutes per step
+#define PROGRAM_MAX_REPEAT      255
+
+typedef struct {
+    uint8_t duty;
+    uint32_t duration_ms;
+} program_step_t;
+
+typedef struct {
+    uint8_t n_steps;
+    uint8_t repeat;
+    program_step_t steps[PROGRAM_MAX_STEPS];
+} program_t;
+
+typedef struct {
+    bool running;
+    uint8_t slot;
+    uint8_t step;
+    uint8_t pass;                     // Current repetition, 0-based
+} program_state_t;
+
+// Create the sequencer timer
+esp_err_t program_init(void);
+
+// Parse "128:500,0:250,..." into prog. ESP_ERR_INVALID_ARG on any bad step.
+esp_err_t program_parse(const char *steps, int repeat, program_t *prog);
+
+// Copy a validated program into a slot
+esp_err_t program_store(uint8_t slot, const program_t *prog);
+
+// Start the program stored in a slot, replacing any running one
+esp_err_t program_run(uint8_t slot);
+
+// Stop the sequencer. Does not touch the pump; callers stop it themselves.
+// Programs also end by themselves once pump_ctrl ownership is lost.
+void program_cancel(void);
+
+void program_get_state(program_state_t *out);
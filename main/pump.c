@@ -0,0 +1,647 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "pump.h"
+#include "hal.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "history.h"
+#include "journal.h"
+#include "metrics.h"
+#include "trace.h"
+#include "pwm_tables.h"               // Generated from pwm_profiles.csv
+
+static const char *TAG = "pump";
+
+// One entry per L9110; LEDC channel = table index. The rows past the first
+// are the four-nozzle rig, used when PUMP_NUM_CHANNELS is raised.
+static const pump_channel_cfg_t channels[PUMP_NUM_CHANNELS] = {
+    { .pin_ia = 25, .pin_ib = 26, .reverse = false, .min_duty = 0, .max_duty = 255 },
+#if PUMP_NUM_CHANNELS > 1
+    { .pin_ia = 27, .pin_ib = 14, .reverse = false, .min_duty = 0, .max_duty = 255 },
+#endif
+#if PUMP_NUM_CHANNELS > 2
+    { .pin_ia = 32, .pin_ib = 33, .reverse = false, .min_duty = 0, .max_duty = 255 },
+#endif
+#if PUMP_NUM_CHANNELS > 3
+    { .pin_ia = 18, .pin_ib = 19, .reverse = false, .min_duty = 0, .max_duty = 255 },
+#endif
+};
+
+_Static_assert(PUMP_NUM_CHANNELS >= 1 && PUMP_NUM_CHANNELS <= PUMP_MAX_CHANNELS,
+               "LEDC has 8 channels");
+
+#define PUMP_PWM_TIMER      0
+
+// LEDC channels of a pump: IA on 2 * ch, IB on 2 * ch + 1
+#define LEG_IA(ch)          (2 * (ch))
+#define LEG_IB(ch)          (2 * (ch) + 1)
+
+#define RAMP_MIN_SEG_MS     10        // Shorter fades aren't worth an interrupt each
+#define RAMP_GRACE_US       20000     // Fade end this overdue: carry on without it
+
+// A ramp in progress. Segment k of n ends at the shape's speed for k / n;
+// the duty between segment ends follows the profile's table only at those
+// points, the fade engine interpolating linearly in between.
+typedef struct {
+    uint8_t from, to;                 // Speeds at either end
+    uint8_t shape;                    // pump_ramp_t
+    uint8_t leg;                      // LEDC channel fading
+    uint8_t seg, n;                   // Segments started, in total
+    uint16_t seg_ms;
+    uint32_t target;                  // Duty the running fade ends at
+    int64_t due_us;                   // When its fade end is overdue
+} ramp_t;
+
+static const pwm_profile_t *profile = &pwm_profiles[0];
+static uint8_t profile_idx;
+static volatile uint8_t current_speed[PUMP_NUM_CHANNELS];
+static uint8_t command[PUMP_NUM_CHANNELS];            // Before compensation
+static const uint8_t *volatile comp_table[PUMP_NUM_CHANNELS];
+static volatile uint8_t comp_profile[PUMP_NUM_CHANNELS];
+static uint8_t direction[PUMP_NUM_CHANNELS];          // pump_dir_t
+static int64_t brake_until_us[PUMP_NUM_CHANNELS];     // 0 unless braking
+static uint8_t reversing;             // Braking for a direction change: speeds wait
+static ramp_t ramps[PUMP_NUM_CHANNELS];
+static uint8_t ramping;               // Channels with a ramp under way
+static bool fade_ok;                  // Fade engine installed
+static atomic_uint fade_done;         // LEDC channels whose fade ended, set by the ISR
+static TaskHandle_t event_task;       // Woken when a fade ends
+
+// Written by the HTTP task, read by the control task on the next stop
+static volatile uint8_t stop_mode = PUMP_STOP_BRAKE;
+static volatile uint16_t brake_ms = PUMP_BRAKE_MS_DEFAULT;
+static volatile uint8_t ramp_shape = PUMP_RAMP_OFF;
+static volatile uint16_t ramp_ms = PUMP_RAMP_MS_DEFAULT;
+
+// Accumulated time with any channel running, guarded by on_time_lock
+static portMUX_TYPE on_time_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t on_time_us;
+static int64_t on_since_us;           // 0 while all channels are stopped
+static uint8_t session_peak;          // Highest speed since on_since_us
+
+// Called after every speed change (control task only)
+static void update_on_time(void)
+{
+    uint8_t peak = 0;
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if (current_speed[ch] > peak) {
+            peak = current_speed[ch];
+        }
+    }
+    if (peak > session_peak) {
+        session_peak = peak;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t started = 0;
+    portENTER_CRITICAL(&on_time_lock);
+    if (peak && on_since_us == 0) {
+        on_since_us = now;
+    } else if (!peak && on_since_us != 0) {
+        on_time_us += now - on_since_us;
+        started = on_since_us;
+        on_since_us = 0;
+    }
+    portEXIT_CRITICAL(&on_time_lock);
+
+    // A spray session ends when the last channel stops
+    if (started) {
+        journal_log_session(started / 1000000, (now - started) / 1000, session_peak);
+        session_peak = 0;
+    }
+}
+
+static uint8_t apply_limits(const pump_channel_cfg_t *cfg, uint8_t speed)
+{
+    if (speed < cfg->min_duty) {
+        return 0;
+    }
+    return speed > cfg->max_duty ? cfg->max_duty : speed;
+}
+
+// Speed a channel runs at for its command: compensated if its table is
+// for the current profile, then limited
+static uint8_t channel_speed(uint8_t ch)
+{
+    const uint8_t *comp = comp_table[ch];
+    uint8_t speed = command[ch];
+
+    if (comp && comp_profile[ch] == profile_idx) {
+        speed = comp[speed];
+    }
+    return apply_limits(&channels[ch], speed);
+}
+
+// LEDC channel that drives a channel in its current direction. Backwards
+// wiring swaps which leg gives forward flow.
+static uint8_t drive_leg(uint8_t ch)
+{
+    return (direction[ch] == PUMP_REVERSE) != channels[ch].reverse ? LEG_IB(ch) : LEG_IA(ch);
+}
+
+// Stage both legs of a channel from its state: a braking channel gets both
+// legs fully on, a running one the speed's duty on the leg for its direction,
+// anything else coasts with both legs off
+static int stage_legs(uint8_t ch, uint8_t *legs, uint32_t *duty)
+{
+    uint32_t ia = 0, ib = 0;
+
+    if (brake_until_us[ch]) {
+        ia = ib = 1u << profile->bits;    // 100% in LEDC terms
+    } else if (current_speed[ch]) {
+        *(drive_leg(ch) == LEG_IB(ch) ? &ib : &ia) = profile->lut[current_speed[ch]];
+    }
+    legs[0] = LEG_IA(ch);
+    duty[0] = ia;
+    legs[1] = LEG_IB(ch);
+    duty[1] = ib;
+    return 2;
+}
+
+// Write the current state of every channel in mask to the hardware,
+// cutting short any ramp on them
+static void latch(uint8_t mask)
+{
+    uint8_t legs[2 * PUMP_NUM_CHANNELS];
+    uint32_t duty[2 * PUMP_NUM_CHANNELS];
+    int n = 0;
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if (mask & ramping & (1 << ch)) {
+            hal_pwm_fade_stop(ramps[ch].leg);
+            ramping &= ~(1 << ch);
+        }
+        if (mask & (1 << ch)) {
+            n += stage_legs(ch, legs + n, duty + n);
+        }
+    }
+    hal_pwm_set_duty_batch(legs, duty, n);
+}
+
+// Fade-end interrupt: note the channel and wake the control task
+static bool on_fade_end(uint8_t leg)
+{
+    BaseType_t woken = pdFALSE;
+
+    atomic_fetch_or_explicit(&fade_done, 1u << leg, memory_order_relaxed);
+    if (event_task) {
+        vTaskNotifyGiveFromISR(event_task, &woken);
+    }
+    return woken == pdTRUE;
+}
+
+// Lowest speed whose duty reaches duty; the table only ever rises
+static uint8_t duty_to_speed(uint32_t duty)
+{
+    int lo = 0, hi = 255;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (profile->lut[mid] < duty) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Speed at the end of segment k
+static uint8_t ramp_point(const ramp_t *r, int k)
+{
+    int n = r->n, span = r->to - r->from;
+
+    if (r->shape == PUMP_RAMP_SCURVE) {
+        return r->from + span * k * k * (3 * n - 2 * k) / (n * n * n);  // 3x^2 - 2x^3
+    }
+    return r->from + span * k / n;
+}
+
+// Start the fade to the end of the next segment that changes the duty,
+// folding in the time of any that don't. Past the last one the ramp is done.
+static void ramp_next(uint8_t ch, int64_t now)
+{
+    ramp_t *r = &ramps[ch];
+    uint32_t ms = 0;
+
+    while (r->seg < r->n) {
+        r->seg++;
+        ms += r->seg_ms;
+        uint32_t duty = profile->lut[ramp_point(r, r->seg)];
+        if (duty != r->target) {
+            r->target = duty;
+            r->due_us = now + ms * 1000LL + RAMP_GRACE_US;
+            hal_pwm_fade(r->leg, duty, ms);
+            return;
+        }
+    }
+    ramping &= ~(1 << ch);
+}
+
+// Ramp a channel to current_speed from wherever its duty is, stopping a
+// ramp already under way first. False if it has to jump instead: ramps off,
+// braking, or a step too small to split into fades.
+static bool ramp_begin(uint8_t ch)
+{
+    uint8_t leg = drive_leg(ch);
+    uint8_t shape = ramp_shape;
+
+    if (shape == PUMP_RAMP_OFF || !fade_ok || brake_until_us[ch] ||
+        ((ramping & (1 << ch)) && ramps[ch].leg != leg)) {
+        return false;
+    }
+    if (ramping & (1 << ch)) {
+        hal_pwm_fade_stop(leg);
+    }
+
+    // Ramps run on the driving leg; the other is already off, as nothing
+    // but a brake (which doesn't ramp) turns both on
+    uint32_t duty = hal_pwm_get_duty(leg);
+    uint8_t from = duty_to_speed(duty), to = current_speed[ch];
+    uint32_t ms = (uint32_t)ramp_ms * abs(to - from) / 255;
+    uint32_t n = ms / RAMP_MIN_SEG_MS;
+    if (n == 0) {
+        return false;                 // latch() clears a ramp stopped above
+    }
+    if (n > PUMP_RAMP_SEGMENTS) {
+        n = PUMP_RAMP_SEGMENTS;
+    }
+
+    ramps[ch] = (ramp_t){
+        .from = from, .to = to, .shape = shape, .leg = leg,
+        .n = n, .seg_ms = ms / n, .target = duty
+    };
+    ramping |= 1 << ch;
+    trace_event(TRACE_PUMP_RAMP, from << 8 | to, ch);
+    ramp_next(ch, esp_timer_get_time());
+    return true;
+}
+
+// Set one channel's speed (0-255)
+esp_err_t pump_set_channel(uint8_t ch, uint8_t speed)
+{
+    uint8_t speeds[PUMP_NUM_CHANNELS] = {0};
+
+    if (ch >= PUMP_NUM_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    speeds[ch] = speed;
+    pump_set_batch(1 << ch, speeds);
+    return ESP_OK;
+}
+
+// Set several channels together; both legs of every channel latch
+// back-to-back. With ramp set, channels that can ramp get there that way.
+static void set_batch(uint8_t mask, const uint8_t *speeds, bool ramp)
+{
+    uint8_t jump = 0;
+
+    mask &= (1 << PUMP_NUM_CHANNELS) - 1;
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if (mask & (1 << ch)) {
+            command[ch] = speeds[ch];
+            uint8_t speed = channel_speed(ch);
+            // Driving ends a brake, except the one before a direction change,
+            // which holds the speed until release. A zero leaves it be.
+            if (speed && !(reversing & (1 << ch))) {
+                brake_until_us[ch] = 0;
+            }
+            current_speed[ch] = speed;
+            if (!(ramp && ramp_begin(ch))) {
+                jump |= 1 << ch;
+            }
+        }
+    }
+    latch(jump);
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if (!(mask & (1 << ch))) {
+            continue;
+        }
+        uint8_t speed = current_speed[ch];
+        trace_event(TRACE_PUMP_SPEED, speed, ch);
+        metrics_inc(METRIC_DUTY_CHANGES);
+        history_append(HIST_DUTY + ch, speed);
+        if (speed) {
+            journal_set(JKEY_LAST_SPEED + ch, speed);
+        }
+    }
+    update_on_time();
+}
+
+void pump_set_batch(uint8_t mask, const uint8_t *speeds)
+{
+    set_batch(mask, speeds, true);
+}
+
+// Set pump speed (0-255) on channel 0
+void pump_set_speed(uint8_t speed)
+{
+    pump_set_channel(0, speed);
+}
+
+// Put every running channel in mask into brake for the configured time
+static void start_brake(uint8_t mask)
+{
+    uint16_t ms = brake_ms;
+    int64_t until = esp_timer_get_time() + ms * 1000LL;
+    uint8_t braked = 0;
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if ((mask & (1 << ch)) &&
+            (current_speed[ch] || brake_until_us[ch] || (ramping & (1 << ch)))) {
+            brake_until_us[ch] = until;
+            braked |= 1 << ch;
+        }
+    }
+    if (braked) {
+        trace_event(TRACE_PUMP_BRAKE, ms, braked);
+    }
+}
+
+// Stop all channels with the given mode
+void pump_stop_with(pump_stop_mode_t mode)
+{
+    static const uint8_t zero[PUMP_NUM_CHANNELS];
+    const uint8_t all = (1 << PUMP_NUM_CHANNELS) - 1;
+
+    if (mode == PUMP_STOP_BRAKE) {
+        start_brake(all);
+    } else {
+        for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+            brake_until_us[ch] = 0;
+        }
+        reversing = 0;
+    }
+    set_batch(all, zero, false);
+    trace_event(TRACE_PUMP_STOP, 0, 0);
+    metrics_inc(METRIC_PUMP_STOPS);
+}
+
+// Stop all channels with the configured stop mode
+void pump_stop(void)
+{
+    pump_stop_with(stop_mode);
+}
+
+esp_err_t pump_set_stop_mode(pump_stop_mode_t mode, uint16_t ms)
+{
+    if ((unsigned)mode > PUMP_STOP_COAST || ms > PUMP_BRAKE_MS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stop_mode = mode;
+    brake_ms = ms ? ms : PUMP_BRAKE_MS_DEFAULT;
+    journal_set(JKEY_STOP_MODE, mode);
+    journal_set(JKEY_BRAKE_MS, brake_ms);
+    return ESP_OK;
+}
+
+pump_stop_mode_t pump_get_stop_mode(uint16_t *ms)
+{
+    if (ms) {
+        *ms = brake_ms;
+    }
+    return stop_mode;
+}
+
+esp_err_t pump_set_ramp(pump_ramp_t shape, uint16_t ms)
+{
+    if ((unsigned)shape > PUMP_RAMP_SCURVE || ms > PUMP_RAMP_MS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ramp_shape = shape;
+    ramp_ms = ms ? ms : PUMP_RAMP_MS_DEFAULT;
+    journal_set(JKEY_RAMP_SHAPE, shape);
+    journal_set(JKEY_RAMP_MS, ramp_ms);
+    return ESP_OK;
+}
+
+pump_ramp_t pump_get_ramp(uint16_t *ms)
+{
+    if (ms) {
+        *ms = ramp_ms;
+    }
+    return ramp_shape;
+}
+
+void pump_set_event_task(TaskHandle_t task)
+{
+    event_task = task;
+}
+
+// Release brakes whose time is up, move ramps on whose fade ended, and
+// report when the next brake or overdue fade end is due
+int32_t pump_poll(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+    uint8_t released = 0, rise = 0;
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if (brake_until_us[ch] == 0) {
+            continue;
+        }
+        if (now >= brake_until_us[ch]) {
+            brake_until_us[ch] = 0;
+            released |= 1 << ch;
+            reversing &= ~(1 << ch);
+        } else if (brake_until_us[ch] < next) {
+            next = brake_until_us[ch];
+        }
+    }
+    if (released) {
+        // A speed held through a brake ramps up from standstill
+        for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+            if ((released & (1 << ch)) && current_speed[ch] && ramp_shape != PUMP_RAMP_OFF) {
+                uint8_t legs[2] = { LEG_IA(ch), LEG_IB(ch) };
+                uint32_t off[2] = { 0, 0 };
+
+                hal_pwm_set_duty_batch(legs, off, 2);
+                if (ramp_begin(ch)) {
+                    rise |= 1 << ch;
+                }
+            }
+        }
+        latch(released & ~rise);
+        trace_event(TRACE_PUMP_COAST, 0, released);
+    }
+
+    // A fade end only counts if the duty got there: one from a fade stopped
+    // for a retarget can land after the new fade started
+    unsigned done = atomic_exchange_explicit(&fade_done, 0, memory_order_relaxed);
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        ramp_t *r = &ramps[ch];
+
+        if (!(ramping & (1 << ch))) {
+            continue;
+        }
+        if (((done & (1u << r->leg)) && hal_pwm_get_duty(r->leg) == r->target) ||
+            now >= r->due_us) {
+            ramp_next(ch, now);
+        }
+        if ((ramping & (1 << ch)) && r->due_us < next) {
+            next = r->due_us;
+        }
+    }
+    return next == INT64_MAX ? -1 : (int32_t)((next - now + 999) / 1000);
+}
+
+// Change direction. A spinning motor is never driven straight the other way:
+// it brakes for the brake time whatever the stop mode, and a speed command
+// meanwhile takes effect on release, so the bridge never sees a plugging
+// current.
+esp_err_t pump_set_direction(uint8_t ch, pump_dir_t dir)
+{
+    if (ch >= PUMP_NUM_CHANNELS || (unsigned)dir > PUMP_REVERSE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (direction[ch] == dir) {
+        return ESP_OK;
+    }
+    if (current_speed[ch] || brake_until_us[ch] || (ramping & (1 << ch))) {
+        uint8_t zero[PUMP_NUM_CHANNELS] = {0};
+
+        start_brake(1 << ch);
+        reversing |= 1 << ch;
+        set_batch(1 << ch, zero, false);
+    }
+    direction[ch] = dir;
+    trace_event(TRACE_PUMP_DIRECTION, dir, ch);
+    return ESP_OK;
+}
+
+pump_dir_t pump_get_direction(uint8_t ch)
+{
+    return ch < PUMP_NUM_CHANNELS ? direction[ch] : PUMP_FORWARD;
+}
+
+bool pump_is_braking(uint8_t ch)
+{
+    return ch < PUMP_NUM_CHANNELS && brake_until_us[ch] != 0;
+}
+
+bool pump_is_ramping(uint8_t ch)
+{
+    return ch < PUMP_NUM_CHANNELS && (ramping & (1 << ch));
+}
+
+void pump_set_compensation(uint8_t ch, const uint8_t *table, uint8_t idx)
+{
+    if (ch < PUMP_NUM_CHANNELS) {
+        comp_table[ch] = NULL;
+        comp_profile[ch] = idx;
+        comp_table[ch] = table;
+    }
+}
+
+// Last speed applied to a channel
+uint8_t pump_get_channel(uint8_t ch)
+{
+    return ch < PUMP_NUM_CHANNELS ? current_speed[ch] : 0;
+}
+
+uint8_t pump_get_command(uint8_t ch)
+{
+    return ch < PUMP_NUM_CHANNELS ? command[ch] : 0;
+}
+
+// Total time any channel has been running
+uint64_t pump_get_on_time_us(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&on_time_lock);
+    uint64_t total = on_time_us + (on_since_us ? now - on_since_us : 0);
+    portEXIT_CRITICAL(&on_time_lock);
+    return total;
+}
+
+// Last speed applied to channel 0
+uint8_t pump_get_speed(void)
+{
+    return current_speed[0];
+}
+
+// Switch PWM frequency/resolution and re-apply the current speeds. The
+// pump neither stops nor starts here, so nothing is traced, journaled or
+// counted as a speed change.
+esp_err_t pump_set_profile(uint8_t idx)
+{
+    static const uint32_t zero[2 * PUMP_NUM_CHANNELS];
+    uint8_t legs[2 * PUMP_NUM_CHANNELS];
+
+    if (idx >= PWM_PROFILE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Old duties are meaningless at the new resolution; park every leg at 0
+    // meanwhile, cutting short any ramp
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if (ramping & (1 << ch)) {
+            hal_pwm_fade_stop(ramps[ch].leg);
+        }
+        legs[2 * ch] = LEG_IA(ch);
+        legs[2 * ch + 1] = LEG_IB(ch);
+    }
+    ramping = 0;
+    hal_pwm_set_duty_batch(legs, zero, 2 * PUMP_NUM_CHANNELS);
+    esp_err_t err = hal_pwm_timer_init(PUMP_PWM_TIMER, pwm_profiles[idx].freq_hz,
+                                       pwm_profiles[idx].bits);
+    if (err != ESP_OK) {
+        hal_pwm_timer_init(PUMP_PWM_TIMER, profile->freq_hz, profile->bits);
+    } else {
+        profile = &pwm_profiles[idx];
+        profile_idx = idx;
+        journal_set(JKEY_PWM_PROFILE, idx);
+    }
+
+    // Speeds again from the commands, as compensation may differ per
+    // profile; brakes stay on and are staged at the new full duty
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        current_speed[ch] = channel_speed(ch);
+    }
+    latch((1 << PUMP_NUM_CHANNELS) - 1);
+    update_on_time();                 // Only if compensation started or stopped a channel
+    return err;
+}
+
+uint8_t pump_get_profile(void)
+{
+    return profile_idx;
+}
+
+const pwm_profile_t *pump_profile_info(uint8_t idx)
+{
+    return idx < PWM_PROFILE_COUNT ? &pwm_profiles[idx] : NULL;
+}
+
+// Initialize PWM for motor control
+void pump_init(void)
+{
+    uint8_t legs = 0;
+
+    hal_pwm_timer_init(PUMP_PWM_TIMER, profile->freq_hz, profile->bits);
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        const pump_channel_cfg_t *cfg = &channels[ch];
+
+        // Both legs low: the motor coasts until the first command
+        hal_pwm_channel_init(LEG_IA(ch), PUMP_PWM_TIMER, cfg->pin_ia, false);
+        hal_pwm_channel_init(LEG_IB(ch), PUMP_PWM_TIMER, cfg->pin_ib, false);
+
+        legs |= 1 << LEG_IA(ch) | 1 << LEG_IB(ch);
+
+        ESP_LOGI(TAG, "Pump %d initialized on GPIO %d (IA) and GPIO %d (IB)",
+                 ch, cfg->pin_ia, cfg->pin_ib);
+    }
+
+    esp_err_t err = hal_pwm_fade_init(legs, on_fade_end);
+    fade_ok = err == ESP_OK;
+    if (!fade_ok) {
+        ESP_LOGW(TAG, "No LEDC fade engine (%s), speed changes won't ramp",
+                 esp_err_to_name(err));
+    }
+}
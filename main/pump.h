@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "pwm_profile.h"
+
+// Pump array: one L9110 per channel with both inputs on LEDC, so a channel
+// can drive either way, coast (IA = IB = low) or brake (IA = IB = high).
+//
+// Channels are described by the compile-time table in pump.c; each one
+// takes two LEDC channels (ESP32 has 8) on a shared PWM timer.
+
+#define PUMP_MAX_CHANNELS   4         // Two LEDC channels per L9110
+#ifndef PUMP_NUM_CHANNELS
+#define PUMP_NUM_CHANNELS   1         // Entries in the channel table (pump.c)
+#endif
+
+#define PUMP_BRAKE_MS_DEFAULT   200   // Brake time before a stop releases to coast
+#define PUMP_BRAKE_MS_MAX       2000
+
+#define PUMP_RAMP_MS_DEFAULT    500   // Full-scale (0 to 255) ramp time
+#define PUMP_RAMP_MS_MAX        5000
+#define PUMP_RAMP_SEGMENTS      8     // Hardware fades per ramp, at most
+
+typedef enum {
+    PUMP_FORWARD,
+    PUMP_REVERSE,                     // Backwards, e.g. to clear a nozzle
+} pump_dir_t;
+
+typedef enum {
+    PUMP_STOP_BRAKE,                  // Short the motor, then coast (default)
+    PUMP_STOP_COAST,                  // Let the motor spin down on its own
+} pump_stop_mode_t;
+
+typedef enum {
+    PUMP_RAMP_OFF,                    // Jump straight to the new speed (default)
+    PUMP_RAMP_LINEAR,                 // Constant rate
+    PUMP_RAMP_SCURVE,                 // Smoothstep: gentle at both ends
+} pump_ramp_t;
+
+typedef struct {
+    int pin_ia;                       // Forward leg
+    int pin_ib;                       // Reverse leg
+    bool reverse;                     // Motor wired backwards: legs swapped
+    uint8_t min_duty;                 // Requests below this stop the channel (dead zone)
+    uint8_t max_duty;                 // Requests above this are clamped
+} pump_channel_cfg_t;
+
+// Configure PWM and direction pins of every channel, all left stopped
+void pump_init(void);
+
+// Set one channel's speed (0-255)
+esp_err_t pump_set_channel(uint8_t ch, uint8_t speed);
+
+// Set every channel in mask to speeds[ch], latched back-to-back so the
+// channels change together
+void pump_set_batch(uint8_t mask, const uint8_t *speeds);
+
+// Set pump speed (0-255) on channel 0
+void pump_set_speed(uint8_t speed);
+
+// Stop all channels with the configured stop mode
+void pump_stop(void);
+
+// Stop all channels with the given mode. A brake lasts the configured brake
+// time; pump_poll() releases it.
+void pump_stop_with(pump_stop_mode_t mode);
+
+// Default stop mode and brake time (0 = PUMP_BRAKE_MS_DEFAULT), persisted
+esp_err_t pump_set_stop_mode(pump_stop_mode_t mode, uint16_t brake_ms);
+pump_stop_mode_t pump_get_stop_mode(uint16_t *brake_ms);
+
+// Speed change ramps and their full-scale time (0 = PUMP_RAMP_MS_DEFAULT),
+// persisted. A ramp runs on the LEDC fade engine as up to
+// PUMP_RAMP_SEGMENTS linear fades, a smaller step taking proportionally
+// less time. A new command mid-ramp ramps on from wherever the duty got to.
+// Stops, brakes, direction and profile changes never ramp.
+esp_err_t pump_set_ramp(pump_ramp_t shape, uint16_t ms);
+pump_ramp_t pump_get_ramp(uint16_t *ms);
+
+// Task to wake when a ramp segment's fade ends; it must then call pump_poll()
+void pump_set_event_task(TaskHandle_t task);
+
+// Release brakes that have run their time and start the next segment of
+// ramps whose fade ended. Returns ms until a brake is due or a fade end is
+// overdue, or -1 if nothing is pending. Control task only, like the setters.
+int32_t pump_poll(void);
+
+// Set a channel's direction. A running channel brakes for the brake time
+// first; speed commands meanwhile apply when the brake releases.
+esp_err_t pump_set_direction(uint8_t ch, pump_dir_t dir);
+pump_dir_t pump_get_direction(uint8_t ch);
+
+// True while a channel is braking
+bool pump_is_braking(uint8_t ch);
+
+// True while a channel is ramping towards its speed
+bool pump_is_ramping(uint8_t ch);
+
+// Per-unit compensation (calib.h): speed commands on a channel go through
+// table[speed] first while profile idx is active. NULL turns it off. The
+// table must stay valid while installed; takes effect from the next command.
+void pump_set_compensation(uint8_t ch, const uint8_t *table, uint8_t profile_idx);
+
+// Last speed applied to a channel, after compensation and limits (the
+// ramp target while ramping)
+uint8_t pump_get_channel(uint8_t ch);
+
+// Last speed commanded on a channel, before compensation
+uint8_t pump_get_command(uint8_t ch);
+
+// Last speed applied to channel 0
+uint8_t pump_get_speed(void);
+
+// Total time any channel has been running since boot
+uint64_t pump_get_on_time_us(void);
+
+// Switch the PWM frequency/resolution profile (pwm_profiles.csv) at runtime.
+// Speed commands stay 0-255 and go through the profile's linearization table.
+esp_err_t pump_set_profile(uint8_t idx);
+
+// Active profile index
+uint8_t pump_get_profile(void);
+
+// Profile description, NULL past the last one
+const pwm_profile_t *pump_profile_info(uint8_t idx);
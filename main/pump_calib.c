@@ -0,0 +1,242 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "flow_ctrl.h"
+#include "journal.h"
+#include "mem_budget.h"
+#include "pump_ctrl.h"
+#include "sensors.h"
+#include "trace.h"
+#include "pump_calib.h"
+
+static const char *TAG = "pump_calib";
+
+#define CALIB_TASK_STACK    3072
+#define CALIB_TASK_PRIO     2         // Background; pump_ctrl does the timing-critical part
+#define CALIB_SETTLE_MS     1000      // After each speed change, before measuring
+#define CALIB_REST_MS       1500      // Motor stopped before a from-rest probe
+#define CALIB_FLOW_SAMPLES  4         // Flow readings averaged per point...
+#define CALIB_FLOW_GAP_MS   500       // ...one per flow_ctrl averaging window
+#define CALIB_CURRENT_SAMPLES 8
+#define CALIB_CURRENT_GAP_MS 50
+
+static portMUX_TYPE calib_lock = portMUX_INITIALIZER_UNLOCKED;
+static pump_calib_status_t status;    // Guarded by calib_lock
+MEM_TASK(calib_task_mem, "pump_calib", CALIB_TASK_STACK);
+static calib_sweep_t sweep;           // Calibration task only
+static uint8_t tables[PUMP_NUM_CHANNELS][256];
+
+// Journal layout, three keys per channel:
+//   +0 knots 0-3, +1 knots 4-7, +2 knot 8 | stall << 8 | profile << 16 | 1 << 24
+static void journal_store(uint8_t ch, const calib_curve_t *c, uint8_t profile, bool valid)
+{
+    int32_t k[3] = {0};
+
+    if (valid) {
+        memcpy(&k[0], &c->knots[0], 4);
+        memcpy(&k[1], &c->knots[4], 4);
+        k[2] = c->knots[8] | c->stall << 8 | profile << 16 | 1 << 24;
+    }
+    for (int i = 0; i < 3; i++) {
+        journal_set(JKEY_CALIB + 3 * ch + i, k[i]);
+    }
+}
+
+static bool journal_load(uint8_t ch, calib_curve_t *c, uint8_t *profile)
+{
+    int32_t k[3];
+
+    for (int i = 0; i < 3; i++) {
+        k[i] = journal_get(JKEY_CALIB + 3 * ch + i);
+    }
+    if (!(k[2] >> 24 & 1)) {
+        return false;
+    }
+    memset(c, 0, sizeof(*c));
+    memcpy(&c->knots[0], &k[0], 4);
+    memcpy(&c->knots[4], &k[1], 4);
+    c->knots[8] = k[2] & 0xff;
+    c->stall = k[2] >> 8 & 0xff;
+    c->start = c->knots[0];
+    c->saturation = c->knots[8];
+    *profile = k[2] >> 16 & 0xff;
+    return true;
+}
+
+// Post a speed to one channel, waiting out a full ring
+static void post(uint8_t ch, uint8_t speed, uint32_t token)
+{
+    uint8_t speeds[PUMP_NUM_CHANNELS] = {0};
+
+    speeds[ch] = speed;
+    while (pump_ctrl_post_batch(1 << ch, speeds, token) == ESP_ERR_NO_MEM && pump_ctrl_owns(token)) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+static int32_t measure(calib_source_t source)
+{
+    int32_t sum = 0;
+
+    if (source == CALIB_SRC_FLOW) {
+        flow_ctrl_status_t fs;
+        for (int i = 0; i < CALIB_FLOW_SAMPLES; i++) {
+            vTaskDelay(pdMS_TO_TICKS(CALIB_FLOW_GAP_MS));
+            flow_ctrl_get_status(&fs);
+            sum += fs.flow_mlpm;
+        }
+        return sum / CALIB_FLOW_SAMPLES;
+    }
+
+    sensors_reading_t r;
+    for (int i = 0; i < CALIB_CURRENT_SAMPLES; i++) {
+        vTaskDelay(pdMS_TO_TICKS(CALIB_CURRENT_GAP_MS));
+        sensors_get(&r);
+        sum += r.current_ma;
+    }
+    return sum / CALIB_CURRENT_SAMPLES;
+}
+
+static void calib_task(void *arg)
+{
+    static const uint8_t zero[PUMP_NUM_CHANNELS];
+    uint8_t ch = status.ch;
+    uint8_t profile = pump_get_profile();
+    uint32_t token = pump_ctrl_acquire();
+    bool more = true;
+
+    // Raw speeds while measuring; other channels off so the sensor sees one pump
+    pump_set_compensation(ch, NULL, 0);
+    pump_ctrl_post_batch((1 << PUMP_NUM_CHANNELS) - 1, zero, token);
+    calib_begin(&sweep, status.source, pump_profile_info(profile));
+
+    while (more && pump_ctrl_owns(token)) {
+        if (sweep.from_rest) {
+            post(ch, 0, token);
+            vTaskDelay(pdMS_TO_TICKS(CALIB_REST_MS));
+        }
+        post(ch, sweep.speed, token);
+        vTaskDelay(pdMS_TO_TICKS(CALIB_SETTLE_MS));
+        int32_t value = measure(sweep.source);
+        if (!pump_ctrl_owns(token)) {
+            break;
+        }
+        more = calib_step(&sweep, value);
+
+        portENTER_CRITICAL(&calib_lock);
+        status.phase = sweep.phase;
+        status.speed = sweep.speed;
+        status.points++;
+        portEXIT_CRITICAL(&calib_lock);
+    }
+    if (pump_ctrl_owns(token)) {
+        post(ch, 0, token);
+    }
+
+    bool done = sweep.phase == CALIB_DONE;
+    if (done) {
+        calib_expand(&sweep.curve, tables[ch]);
+        journal_store(ch, &sweep.curve, profile, true);
+        trace_event(TRACE_CALIB_DONE, sweep.curve.saturation << 8 | sweep.curve.start, ch);
+        ESP_LOGI(TAG, "Pump %d: start %d, stall %d, saturation %d (%ld %s)", ch,
+                 sweep.curve.start, sweep.curve.stall, sweep.curve.saturation,
+                 (long)sweep.curve.full_output,
+                 sweep.source == CALIB_SRC_FLOW ? "mL/min" : "permille speed");
+    } else {
+        trace_event(TRACE_CALIB_FAIL, sweep.phase, ch);
+        ESP_LOGW(TAG, "Pump %d calibration stopped: %s", ch,
+                 sweep.error ? sweep.error : "cancelled");
+    }
+
+    portENTER_CRITICAL(&calib_lock);
+    if (done) {
+        status.valid[ch] = true;
+        status.profile[ch] = profile;
+        status.curve[ch] = sweep.curve;
+    }
+    status.error = done ? NULL : sweep.error ? sweep.error : "cancelled";
+    status.phase = sweep.phase;
+    status.running = false;
+    portEXIT_CRITICAL(&calib_lock);
+
+    // A failed run leaves the previous curve in place
+    if (status.valid[ch]) {
+        pump_set_compensation(ch, tables[ch], status.profile[ch]);
+    }
+    mem_task_end(&calib_task_mem);
+}
+
+esp_err_t pump_calib_init(void)
+{
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        if (journal_load(ch, &status.curve[ch], &status.profile[ch])) {
+            status.valid[ch] = true;
+            calib_expand(&status.curve[ch], tables[ch]);
+            pump_set_compensation(ch, tables[ch], status.profile[ch]);
+            ESP_LOGI(TAG, "Pump %d compensation: start %d, saturation %d (profile %d)", ch,
+                     status.curve[ch].start, status.curve[ch].saturation, status.profile[ch]);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t pump_calib_start(uint8_t ch)
+{
+    calib_source_t source;
+
+    if (ch >= PUMP_NUM_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if CONFIG_PLANTDOC_FLOW_SENSOR
+    source = CALIB_SRC_FLOW;
+#elif CONFIG_PLANTDOC_SENSORS
+    source = CALIB_SRC_CURRENT;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+
+    portENTER_CRITICAL(&calib_lock);
+    if (status.running) {
+        portEXIT_CRITICAL(&calib_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    status.running = true;
+    status.ch = ch;
+    status.source = source;
+    status.phase = CALIB_BASELINE;
+    status.speed = 0;
+    status.points = 0;
+    status.error = NULL;
+    portEXIT_CRITICAL(&calib_lock);
+
+    esp_err_t err = mem_task_start(&calib_task_mem, calib_task, NULL, CALIB_TASK_PRIO,
+                                   tskNO_AFFINITY, NULL);
+    if (err != ESP_OK) {
+        status.running = false;       // Or the last run hasn't quite ended yet
+    }
+    return err;
+}
+
+esp_err_t pump_calib_clear(uint8_t ch)
+{
+    if (ch >= PUMP_NUM_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (status.running && status.ch == ch) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pump_set_compensation(ch, NULL, 0);
+    portENTER_CRITICAL(&calib_lock);
+    status.valid[ch] = false;
+    portEXIT_CRITICAL(&calib_lock);
+    journal_store(ch, NULL, 0, false);
+    return ESP_OK;
+}
+
+void pump_calib_get_status(pump_calib_status_t *out)
+{
+    portENTER_CRITICAL(&calib_lock);
+    *out = status;
+    portEXIT_CRITICAL(&calib_lock);
+}
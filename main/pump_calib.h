@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "calib.h"
+#include "pump.h"
+
+// Per-unit pump calibration.
+//
+// Runs the calib.h sweep on one channel in its own task, driving the pump
+// through pump_ctrl like any automation (a manual command or stop cancels
+// it) and measuring flow (CONFIG_PLANTDOC_FLOW_SENSOR) or, failing that,
+// motor current (CONFIG_PLANTDOC_SENSORS). The resulting curve is journalled
+// and installed with pump_set_compensation(), so 0-255 commands map to
+// equal output steps from a reliable start. A curve belongs to the PWM
+// profile it was measured with and is ignored under any other.
+
+typedef struct {
+    bool running;
+    uint8_t ch;                       // Channel of the current or last run
+    calib_source_t source;
+    calib_phase_t phase;
+    uint8_t speed;                    // Point being measured
+    uint8_t points;                   // Points measured so far
+    const char *error;                // Last run failed or was cancelled
+    bool valid[PUMP_NUM_CHANNELS];
+    uint8_t profile[PUMP_NUM_CHANNELS];
+    calib_curve_t curve[PUMP_NUM_CHANNELS];
+} pump_calib_status_t;
+
+// Restore journalled curves and install them; call after pump_init
+esp_err_t pump_calib_init(void);
+
+// Start a sweep on a channel. ESP_ERR_INVALID_STATE while one is running,
+// ESP_ERR_NOT_SUPPORTED without a sensor to measure with.
+esp_err_t pump_calib_start(uint8_t ch);
+
+// Drop a channel's curve; commands go straight to the PWM profile again
+esp_err_t pump_calib_clear(uint8_t ch);
+
+void pump_calib_get_status(pump_calib_status_t *out);
@@ -0,0 +1,346 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "mem_budget.h"
+#include "metrics.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "state_events.h"
+
+static const char *TAG = "pump_ctrl";
+
+#define CTRL_TASK_STACK     3072
+#define CTRL_TASK_PRIO      (configMAX_PRIORITIES - 2)
+#define CTRL_RING_SIZE      16        // Power of two
+
+// Run on whichever core the Wi-Fi task is not pinned to
+#if CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_1
+#define CTRL_TASK_CORE      0
+#else
+#define CTRL_TASK_CORE      1
+#endif
+
+#define LAT_BUCKETS         24        // log2 buckets, bucket i covers [2^i, 2^(i+1)) us
+
+typedef struct {
+    atomic_uint seq;                  // Slot sequence (bounded MPMC ring, Vyukov)
+    uint32_t owner;                   // Owner token at post time
+    int64_t posted_us;
+    uint8_t mask;                     // Channels to update
+    uint8_t speeds[PUMP_NUM_CHANNELS];
+} ctrl_slot_t;
+
+static ctrl_slot_t ring[CTRL_RING_SIZE];
+static atomic_uint ring_head;         // Next slot to claim (producers)
+static unsigned ring_tail;            // Next slot to consume (control task only)
+
+static atomic_uint stop_epoch;        // Bumped by every stop request
+static atomic_uint owner;             // Bumped whenever control changes hands
+static atomic_uint manual_owner;      // Token held by manual commands, if they own the pump
+static atomic_int pending_profile = -1;
+static atomic_int stop_mode_req = -1; // pump_stop_mode_t, -1 for the configured one
+static atomic_uint pending_dir;       // Bit ch: request for ch, bit 8 + ch: reverse
+static atomic_llong stop_posted_us;
+static atomic_bool held;              // pump_ctrl_hold()
+static portMUX_TYPE manual_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t ctrl_task;
+MEM_TASK(ctrl_task_mem, "pump_ctrl", CTRL_TASK_STACK);
+
+static uint32_t lat_hist[LAT_BUCKETS];
+static uint32_t lat_max_us;
+static atomic_ullong lat_sum_us;      // 64 bits: not a single store on the device
+
+static void record_latency(int64_t posted_us)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - posted_us);
+    int bucket = us ? 31 - __builtin_clz(us) : 0;
+
+    if (bucket >= LAT_BUCKETS) {
+        bucket = LAT_BUCKETS - 1;
+    }
+    lat_hist[bucket]++;
+    atomic_fetch_add_explicit(&lat_sum_us, us, memory_order_relaxed);
+    if (us > lat_max_us) {
+        lat_max_us = us;
+    }
+}
+
+// Claim a slot and publish a speed command; safe from any number of tasks
+static bool ring_push(uint8_t mask, const uint8_t *speeds, uint32_t token)
+{
+    unsigned pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+
+    for (;;) {
+        ctrl_slot_t *slot = &ring[pos & (CTRL_RING_SIZE - 1)];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                slot->mask = mask;
+                memcpy(slot->speeds, speeds, sizeof(slot->speeds));
+                slot->owner = token;
+                slot->posted_us = esp_timer_get_time();
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;             // Full
+        } else {
+            pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        }
+    }
+}
+
+// Single consumer: pop the oldest published command, if any
+static bool ring_pop(ctrl_slot_t *out)
+{
+    ctrl_slot_t *slot = &ring[ring_tail & (CTRL_RING_SIZE - 1)];
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if ((int)(seq - (ring_tail + 1)) < 0) {
+        return false;                 // Empty
+    }
+    out->mask = slot->mask;
+    memcpy(out->speeds, slot->speeds, sizeof(out->speeds));
+    out->owner = slot->owner;
+    out->posted_us = slot->posted_us;
+    atomic_store_explicit(&slot->seq, ring_tail + CTRL_RING_SIZE, memory_order_release);
+    ring_tail++;
+    return true;
+}
+
+static void pump_ctrl_task(void *arg)
+{
+    uint32_t applied_epoch = atomic_load(&stop_epoch);
+    ctrl_slot_t cmd;
+
+    for (;;) {
+        // Sleep until a command arrives, a ramp's fade ends or the next brake
+        // is due for release
+        int32_t due_ms = pump_poll();
+        ulTaskNotifyTake(pdTRUE, due_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(due_ms) + 1);
+
+        for (;;) {
+            // A stop always goes first, whatever is queued behind it
+            uint32_t epoch = atomic_load_explicit(&stop_epoch, memory_order_acquire);
+            if (epoch != applied_epoch) {
+                int mode = atomic_load_explicit(&stop_mode_req, memory_order_relaxed);
+                if (mode < 0) {
+                    pump_stop();
+                } else {
+                    pump_stop_with(mode);
+                }
+                record_latency(atomic_load(&stop_posted_us));
+                applied_epoch = epoch;
+            }
+
+            unsigned dirs = atomic_exchange_explicit(&pending_dir, 0, memory_order_acq_rel);
+            for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+                if (dirs & (1u << ch)) {
+                    pump_set_direction(ch, (dirs >> (8 + ch)) & 1 ? PUMP_REVERSE : PUMP_FORWARD);
+                }
+            }
+
+            int prof = atomic_exchange_explicit(&pending_profile, -1, memory_order_acq_rel);
+            if (prof >= 0) {
+                pump_set_profile(prof);
+            }
+
+            if (!ring_pop(&cmd)) {
+                break;
+            }
+            if (cmd.owner != atomic_load_explicit(&owner, memory_order_acquire)) {
+                continue;             // Superseded by a stop or a newer owner
+            }
+            pump_set_batch(cmd.mask, cmd.speeds);
+            record_latency(cmd.posted_us);
+        }
+        state_events_notify();        // Coalesced there, so once per wake is plenty
+    }
+}
+
+esp_err_t pump_ctrl_start(void)
+{
+    for (unsigned i = 0; i < CTRL_RING_SIZE; i++) {
+        atomic_init(&ring[i].seq, i);
+    }
+
+    if (mem_task_start(&ctrl_task_mem, pump_ctrl_task, NULL, CTRL_TASK_PRIO, CTRL_TASK_CORE,
+                       &ctrl_task) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create control task");
+        return ESP_ERR_NO_MEM;
+    }
+    pump_set_event_task(ctrl_task);  // Ramp fade ends wake it
+    ESP_LOGI(TAG, "Control task running on core %d", CTRL_TASK_CORE);
+    return ESP_OK;
+}
+
+uint32_t pump_ctrl_acquire(void)
+{
+    return atomic_fetch_add_explicit(&owner, 1, memory_order_acq_rel) + 1;
+}
+
+bool pump_ctrl_owns(uint32_t token)
+{
+    return atomic_load_explicit(&owner, memory_order_acquire) == token;
+}
+
+esp_err_t pump_ctrl_post_batch(uint8_t mask, const uint8_t *speeds, uint32_t token)
+{
+    // Checked after the caller took its token, so a command racing a hold
+    // is either refused here or carries a token the hold's stop made stale
+    if (atomic_load(&held)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!ring_push(mask, speeds, token)) {
+        metrics_inc(METRIC_CTRL_RING_FULL);
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskNotifyGive(ctrl_task);
+    return ESP_OK;
+}
+
+esp_err_t pump_ctrl_post(uint8_t speed, uint32_t token)
+{
+    uint8_t speeds[PUMP_NUM_CHANNELS] = { speed };
+
+    return pump_ctrl_post_batch(1, speeds, token);
+}
+
+// Manual commands take over from any running program or control loop, but
+// share one token among themselves so they never cancel each other. The
+// takeover is serialised: two producers that both found the token stale
+// would otherwise each acquire, the second making the first one's command
+// stale before it's applied.
+static uint32_t manual_acquire(void)
+{
+    uint32_t token = atomic_load_explicit(&manual_owner, memory_order_acquire);
+
+    if (pump_ctrl_owns(token)) {
+        return token;
+    }
+    portENTER_CRITICAL(&manual_lock);
+    token = atomic_load_explicit(&manual_owner, memory_order_relaxed);
+    if (!pump_ctrl_owns(token)) {
+        token = pump_ctrl_acquire();
+        atomic_store_explicit(&manual_owner, token, memory_order_release);
+    }
+    portEXIT_CRITICAL(&manual_lock);
+    return token;
+}
+
+esp_err_t pump_ctrl_set_batch(uint8_t mask, const uint8_t *speeds)
+{
+    if (mask == 0 || mask >> PUMP_NUM_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return pump_ctrl_post_batch(mask, speeds, manual_acquire());
+}
+
+esp_err_t pump_ctrl_set_channel(uint8_t ch, uint8_t speed)
+{
+    uint8_t speeds[PUMP_NUM_CHANNELS] = {0};
+
+    if (ch >= PUMP_NUM_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    speeds[ch] = speed;
+    return pump_ctrl_post_batch(1 << ch, speeds, manual_acquire());
+}
+
+esp_err_t pump_ctrl_set_speed(uint8_t speed)
+{
+    return pump_ctrl_set_channel(0, speed);
+}
+
+static void post_stop(int mode)
+{
+    pump_ctrl_acquire();
+    atomic_store_explicit(&stop_mode_req, mode, memory_order_relaxed);
+    atomic_store_explicit(&stop_posted_us, esp_timer_get_time(), memory_order_relaxed);
+    atomic_fetch_add_explicit(&stop_epoch, 1, memory_order_release);
+    xTaskNotifyGive(ctrl_task);
+}
+
+void pump_ctrl_stop(void)
+{
+    post_stop(-1);
+}
+
+void pump_ctrl_stop_with(pump_stop_mode_t mode)
+{
+    post_stop(mode);
+}
+
+void pump_ctrl_hold(bool hold)
+{
+    atomic_store(&held, hold);
+    if (hold) {
+        post_stop(-1);
+    }
+}
+
+esp_err_t pump_ctrl_set_direction(uint8_t ch, pump_dir_t dir)
+{
+    unsigned old, req;
+
+    if (ch >= PUMP_NUM_CHANNELS || (unsigned)dir > PUMP_REVERSE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    manual_acquire();
+    old = atomic_load_explicit(&pending_dir, memory_order_relaxed);
+    do {
+        req = (old & ~(0x101u << ch)) | (1u << ch) | ((unsigned)dir << (8 + ch));
+    } while (!atomic_compare_exchange_weak_explicit(&pending_dir, &old, req,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+    xTaskNotifyGive(ctrl_task);
+    return ESP_OK;
+}
+
+esp_err_t pump_ctrl_set_profile(uint8_t idx)
+{
+    if (pump_profile_info(idx) == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    atomic_store_explicit(&pending_profile, idx, memory_order_release);
+    xTaskNotifyGive(ctrl_task);
+    return ESP_OK;
+}
+
+// Upper bound of the bucket holding the given rank
+static uint32_t hist_percentile(const uint32_t *hist, uint32_t count, uint32_t pct)
+{
+    uint32_t rank = ((uint64_t)count * pct + 99) / 100;  // count * 99 overflows 32 bits
+    uint32_t seen = 0;
+
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= rank) {
+            return (2u << i) - 1;
+        }
+    }
+    return UINT32_MAX;
+}
+
+void pump_ctrl_get_latency(pump_ctrl_latency_t *out)
+{
+    uint32_t hist[LAT_BUCKETS];
+
+    // Snapshot; the control task may be mid-update, which only skews one sample
+    memcpy(hist, lat_hist, sizeof(hist));
+    out->count = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        out->count += hist[i];
+    }
+    out->max_us = lat_max_us;
+    out->sum_us = atomic_load_explicit(&lat_sum_us, memory_order_relaxed);
+    out->p50_us = out->count ? hist_percentile(hist, out->count, 50) : 0;
+    out->p99_us = out->count ? hist_percentile(hist, out->count, 99) : 0;
+}
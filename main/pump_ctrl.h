@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pump.h"
+
+// Pump control task.
+//
+// Callers post commands instead of touching the pump directly, so a slow
+// HTTP client can never delay actuation. Commands travel through a lock-free
+// multi-producer ring; a stop bypasses the ring and discards every speed
+// change queued before it.
+
+// Create the control task (pinned to the core not running Wi-Fi)
+esp_err_t pump_ctrl_start(void);
+
+// Queue a speed change (0-255) for channel 0. ESP_ERR_NO_MEM if the ring is full.
+esp_err_t pump_ctrl_set_speed(uint8_t speed);
+
+// Queue a speed change for one channel of the pump array
+esp_err_t pump_ctrl_set_channel(uint8_t ch, uint8_t speed);
+
+// Queue one command updating every channel in mask to speeds[ch] together
+esp_err_t pump_ctrl_set_batch(uint8_t mask, const uint8_t *speeds);
+
+// Request a stop. Never fails and preempts pending speed changes.
+void pump_ctrl_stop(void);
+
+// Same, with an explicit stop mode instead of the configured one
+void pump_ctrl_stop_with(pump_stop_mode_t mode);
+
+// Change a channel's direction (pump_set_direction) as a manual command.
+// Applied before any speed command posted after it.
+esp_err_t pump_ctrl_set_direction(uint8_t ch, pump_dir_t dir);
+
+// Switch PWM profile (pump_set_profile) from the control task
+esp_err_t pump_ctrl_set_profile(uint8_t idx);
+
+// Hold the pump stopped, e.g. through a firmware update: stops it now and
+// refuses speed commands from anyone (ESP_ERR_INVALID_STATE) until released
+void pump_ctrl_hold(bool hold);
+
+// Ownership: automations (spray programs, the flow loop) call
+// pump_ctrl_acquire() once and post every command with the returned token.
+// Any later acquire, manual set_speed or stop takes ownership away; queued
+// commands carrying a stale token are dropped and the automation notices
+// via pump_ctrl_owns() and winds down on its own.
+uint32_t pump_ctrl_acquire(void);
+bool pump_ctrl_owns(uint32_t token);
+esp_err_t pump_ctrl_post(uint8_t speed, uint32_t token);      // Channel 0
+esp_err_t pump_ctrl_post_batch(uint8_t mask, const uint8_t *speeds, uint32_t token);
+
+// Command-to-duty-update latency percentiles in microseconds
+typedef struct {
+    uint32_t count;                   // Commands applied since boot
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint64_t sum_us;                  // Of every command's latency
+} pump_ctrl_latency_t;
+
+void pump_ctrl_get_latency(pump_ctrl_latency_t *out);
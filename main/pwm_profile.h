@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+// PWM frequency/resolution profile with its speed linearization table.
+// The profiles themselves are generated from pwm_profiles.csv at build time.
+typedef struct {
+    const char *name;
+    uint32_t freq_hz;
+    uint8_t bits;                     // Duty resolution
+    const uint16_t *lut;              // 256 entries: speed command -> duty
+} pwm_profile_t;
@@ -0,0 +1,35 @@
+#include "sensor_filter.h"
+
+void sensor_filter_init(sensor_filter_t *f, uint16_t factor, uint8_t shift)
+{
+    f->factor = factor ? factor : 1;
+    f->shift = shift;
+    f->primed = false;
+    f->n = 0;
+    f->acc = 0;
+    f->y = 0;
+}
+
+bool sensor_filter_push(sensor_filter_t *f, uint16_t raw)
+{
+    f->acc += raw;
+    if (++f->n < f->factor) {
+        return false;
+    }
+
+    int32_t x = (int32_t)((f->acc << SENSOR_FILTER_Q) / f->factor);
+    f->acc = 0;
+    f->n = 0;
+    if (!f->primed) {
+        f->y = x;
+        f->primed = true;
+    } else {
+        f->y += (x - f->y) >> f->shift;
+    }
+    return true;
+}
+
+uint16_t sensor_filter_value(const sensor_filter_t *f)
+{
+    return (uint16_t)((f->y + (1 << (SENSOR_FILTER_Q - 1))) >> SENSOR_FILTER_Q);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fixed-point decimating filter for raw ADC streams.
+//
+// Each stage first averages `factor` consecutive samples (boxcar
+// decimation, which also rejects PWM ripple when the samples fall on evenly
+// spread phases of the PWM period, see sensors.c), then smooths the block
+// means with a one-pole IIR:
+//   y += (x - y) >> shift
+// i.e. alpha = 2^-shift. State is Q8 so slow filters keep sub-LSB detail;
+// the hot path is one add and a compare per input sample.
+
+#define SENSOR_FILTER_Q 8
+
+typedef struct {
+    uint16_t factor;                  // Input samples per output, <= 4096 for 12-bit input
+    uint8_t shift;                    // IIR coefficient, 0 = no smoothing
+    bool primed;                      // First output seeds the IIR
+    uint16_t n;
+    uint32_t acc;
+    int32_t y;                        // Q8
+} sensor_filter_t;
+
+void sensor_filter_init(sensor_filter_t *f, uint16_t factor, uint8_t shift);
+
+// Add one sample; returns true when it completes a block and the output
+// (sensor_filter_value) has been updated
+bool sensor_filter_push(sensor_filter_t *f, uint16_t raw);
+
+// Current filtered value in input units, rounded
+uint16_t sensor_filter_value(const sensor_filter_t *f);
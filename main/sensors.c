@@ -0,0 +1,185 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "hal.h"
+#include "history.h"
+#include "mem_budget.h"
+#include "pump.h"
+#include "sensor_filter.h"
+#include "sensors.h"
+
+static const char *TAG = "sensors";
+
+#define SENSORS_RATE_HZ     20200     // Total ADC rate, 10.1 kHz per channel
+#define SENSORS_TASK_STACK  3072
+#define SENSORS_TASK_PRIO   (configMAX_PRIORITIES - 4)  // Below flow_ctrl
+#define SENSORS_BATCH       256       // Samples drained per read
+#define SENSORS_HISTORY_US  1000000   // Readings kept in history once a second
+
+// Motor current: 100 Hz out, light smoothing so a current step settles to
+// 90% in ~80 ms. The shunt sees the PWM chopping at 1-25 kHz, at or above
+// the per-channel rate, so each sample catches one point of the PWM period
+// and a block mean is only the average current if those points are spread
+// evenly over the period. At a round 10 kHz they aren't: 20 kHz puts every
+// sample on the same phase and 25 or 5 kHz on two, so the reading is
+// whatever the waveform is there, full scale or nothing. 10.1 kHz is
+// 101 x 100 Hz with 101 prime, so against any PWM frequency that is a
+// multiple of 100 Hz (and not of 10.1 kHz) the phase steps by k/101 per
+// sample and a block of 101 samples lands once on each of 101 evenly
+// spread phases: the mean to within 1 % of full scale. A clock slightly
+// off nominal only drifts those phases by a fraction of a step per block.
+// sensors_current_phases() checks a profile against this.
+#define CURRENT_DECIMATE    101
+#define CURRENT_IIR_SHIFT   2
+#define CURRENT_MIN_PHASES  50        // 2 % duty resolution
+// Soil moisture: 10 Hz out, tau ~3 s
+#define SOIL_DECIMATE       1010
+#define SOIL_IIR_SHIFT      5
+
+enum { CH_SOIL, CH_CURRENT, CH_COUNT };
+
+#ifndef CONFIG_PLANTDOC_SOIL_DRY_MV
+#define CONFIG_PLANTDOC_SOIL_DRY_MV     2600
+#define CONFIG_PLANTDOC_SOIL_WET_MV     1100
+#define CONFIG_PLANTDOC_CURRENT_SHUNT_MOHM 500
+#endif
+
+static TaskHandle_t sensors_task_handle;
+MEM_TASK(sensors_task_mem, "sensors", SENSORS_TASK_STACK);
+static sensor_filter_t filters[CH_COUNT];
+
+// Sequence lock: odd while the single writer is updating `published`
+static atomic_uint pub_seq;
+static sensors_reading_t published;
+
+static void IRAM_ATTR on_frame(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(sensors_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static uint16_t soil_permille(int mv)
+{
+    const int dry = CONFIG_PLANTDOC_SOIL_DRY_MV, wet = CONFIG_PLANTDOC_SOIL_WET_MV;
+    int p = (dry - mv) * 1000 / (dry - wet);    // Capacitive probes read lower when wet
+    return p < 0 ? 0 : (p > 1000 ? 1000 : p);
+}
+
+static void publish(const sensors_reading_t *r)
+{
+    unsigned seq = atomic_load_explicit(&pub_seq, memory_order_relaxed);
+
+    atomic_store_explicit(&pub_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    published = *r;
+    atomic_store_explicit(&pub_seq, seq + 2, memory_order_release);
+}
+
+void sensors_get(sensors_reading_t *out)
+{
+    unsigned s1, s2;
+
+    do {
+        s1 = atomic_load_explicit(&pub_seq, memory_order_acquire);
+        *out = published;
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&pub_seq, memory_order_relaxed);
+    } while (s1 != s2 || (s1 & 1));
+}
+
+static void sensors_task(void *arg)
+{
+    static hal_adc_sample_t batch[SENSORS_BATCH];
+    sensors_reading_t r = {0};
+    int64_t next_history_us = 0;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        bool updated = false;
+        int n;
+        while ((n = hal_adc_stream_read(batch, SENSORS_BATCH)) > 0) {
+            for (int i = 0; i < n; i++) {
+                updated |= sensor_filter_push(&filters[batch[i].index], batch[i].raw);
+            }
+            r.samples += n;
+        }
+        if (!updated) {
+            continue;
+        }
+
+        r.soil_mv = hal_adc_raw_to_mv(sensor_filter_value(&filters[CH_SOIL]));
+        r.soil_permille = soil_permille(r.soil_mv);
+        r.current_mv = hal_adc_raw_to_mv(sensor_filter_value(&filters[CH_CURRENT]));
+        r.current_ma = (uint32_t)r.current_mv * 1000 / CONFIG_PLANTDOC_CURRENT_SHUNT_MOHM;
+        r.overflows = hal_adc_stream_overflows();
+        r.time_us = esp_timer_get_time();
+        r.seq++;
+        publish(&r);
+
+        if (r.time_us >= next_history_us) {
+            next_history_us = r.time_us + SENSORS_HISTORY_US;
+            history_append(HIST_SOIL, r.soil_permille);
+            history_append(HIST_CURRENT, r.current_ma);
+        }
+    }
+}
+
+uint32_t sensors_current_phases(uint32_t pwm_hz)
+{
+    uint32_t fs = SENSORS_RATE_HZ / CH_COUNT, a = pwm_hz, b = fs;
+
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    uint32_t phases = fs / a;         // Period of the phase sequence
+    return phases >= CURRENT_MIN_PHASES && CURRENT_DECIMATE % phases == 0 ? phases : 0;
+}
+
+esp_err_t sensors_start(void)
+{
+#if CONFIG_PLANTDOC_SENSORS
+    static const int gpios[CH_COUNT] = {
+        [CH_SOIL]    = CONFIG_PLANTDOC_SOIL_GPIO,
+        [CH_CURRENT] = CONFIG_PLANTDOC_CURRENT_GPIO,
+    };
+
+    sensor_filter_init(&filters[CH_SOIL], SOIL_DECIMATE, SOIL_IIR_SHIFT);
+    sensor_filter_init(&filters[CH_CURRENT], CURRENT_DECIMATE, CURRENT_IIR_SHIFT);
+
+    esp_err_t err = mem_task_start(&sensors_task_mem, sensors_task, NULL, SENSORS_TASK_PRIO,
+                                   tskNO_AFFINITY, &sensors_task_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = hal_adc_stream_start(gpios, CH_COUNT, SENSORS_RATE_HZ, on_frame, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ADC stream start failed: %s", esp_err_to_name(err));
+        mem_task_end(&sensors_task_mem);
+        return err;
+    }
+    ESP_LOGI(TAG, "Soil on GPIO %d, motor current on GPIO %d, %d Hz",
+             CONFIG_PLANTDOC_SOIL_GPIO, CONFIG_PLANTDOC_CURRENT_GPIO, SENSORS_RATE_HZ);
+    const pwm_profile_t *prof;
+    for (uint8_t i = 0; (prof = pump_profile_info(i)) != NULL; i++) {
+        if (sensors_current_phases(prof->freq_hz) == 0) {
+            ESP_LOGW(TAG, "Profile %s (%lu Hz) aliases the motor current reading",
+                     prof->name, (unsigned long)prof->freq_hz);
+        }
+    }
+    return ESP_OK;
+#else
+    (void)sensors_task;
+    (void)sensors_task_mem;
+    (void)on_frame;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Soil moisture and motor current sensing (CONFIG_PLANTDOC_SENSORS).
+//
+// ADC1 samples both inputs continuously with DMA; a task woken per DMA
+// frame runs each channel through a sensor_filter_t and publishes the
+// latest readings with a sequence lock. Readers (HTTP, metrics, control
+// loops) never block the sampler and never see a torn reading.
+
+typedef struct {
+    uint32_t seq;                     // Publication count, 0 = no data yet
+    int64_t time_us;                  // When this reading was published
+    uint16_t soil_mv;
+    uint16_t soil_permille;           // 0 = dry calibration point, 1000 = wet
+    uint16_t current_mv;              // Across the motor shunt
+    uint16_t current_ma;
+    uint32_t samples;                 // Raw conversions processed since start
+    uint32_t overflows;               // DMA frames dropped by the driver
+} sensors_reading_t;
+
+// Start sampling. ESP_ERR_NOT_SUPPORTED without CONFIG_PLANTDOC_SENSORS.
+esp_err_t sensors_start(void);
+
+// Copy the latest published reading; lock-free, callable from any task
+void sensors_get(sensors_reading_t *out);
+
+// Evenly spread PWM phases one motor current block samples at pwm_hz, or 0
+// if that frequency would alias the reading (too few phases, or a block
+// that doesn't cover them all)
+uint32_t sensors_current_phases(uint32_t pwm_hz);
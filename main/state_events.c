@@ -0,0 +1,272 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "flow_ctrl.h"
+#include "mem_budget.h"
+#include "metrics.h"
+#include "program.h"
+#include "pump.h"
+#include "pump_calib.h"
+#include "state_events.h"
+
+static const char *TAG = "events";
+
+#define EVENTS_TASK_STACK   3072
+#define EVENTS_TASK_PRIO    3         // Below httpd (5): formatting a frame is never urgent
+#define EVENTS_INTERVAL_US  (CONFIG_PLANTDOC_SSE_INTERVAL_MS * 1000LL)
+#define EVENTS_POLL_MS      1000      // Also catch changes nobody notified about
+#define EVENTS_KEEPALIVE_US 15000000  // Comment line on an idle stream, so dead peers get noticed
+#define EVENTS_FRAME_MAX    256
+#define EVENTS_RETRY_MS     2000      // Client reconnect delay, sent with the first frame
+
+typedef enum {
+    MODE_IDLE,
+    MODE_MANUAL,
+    MODE_PROGRAM,
+    MODE_FLOW,
+    MODE_CALIBRATE,
+} events_mode_t;
+
+static const char *const mode_names[] = { "idle", "manual", "program", "flow", "calibrate" };
+
+// Everything a frame shows; compared bytewise, so always zeroed before filling
+typedef struct {
+    uint8_t mode;
+    uint8_t duty[PUMP_NUM_CHANNELS];
+    uint8_t dir[PUMP_NUM_CHANNELS];
+    program_state_t prog;             // All zero unless running
+    uint32_t flow_target;             // Zero unless the flow loop is active
+} events_state_t;
+
+typedef struct {
+    int fd;
+    bool used;
+    bool closing;                     // Close requested, session not freed yet
+} events_client_t;
+
+static httpd_handle_t server;
+static TaskHandle_t events_task_handle;
+MEM_TASK(events_task_mem, "events", EVENTS_TASK_STACK);
+static events_client_t clients[STATE_EVENTS_MAX_CLIENTS];  // httpd task only
+static atomic_int n_clients;
+static atomic_uint frame_id;
+
+// Frame being written out by broadcast_work; owned by the broadcaster task
+// while frame_busy is clear and by the httpd task while it is set
+static char frame[EVENTS_FRAME_MAX];
+static size_t frame_len;
+static atomic_bool frame_busy;
+
+// Broadcaster task only
+static events_state_t last_sent;
+static int64_t last_frame_us;
+
+static void snapshot(events_state_t *s)
+{
+    flow_ctrl_status_t fs;
+    pump_calib_status_t cs;
+    bool running = false;
+
+    memset(s, 0, sizeof(*s));
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        s->duty[ch] = pump_get_command(ch);
+        s->dir[ch] = pump_get_direction(ch);
+        running |= s->duty[ch] != 0;
+    }
+    program_get_state(&s->prog);
+    flow_ctrl_get_status(&fs);
+    pump_calib_get_status(&cs);
+
+    if (cs.running) {
+        s->mode = MODE_CALIBRATE;
+    } else if (s->prog.running) {
+        s->mode = MODE_PROGRAM;
+    } else if (fs.active) {
+        s->mode = MODE_FLOW;
+        s->flow_target = fs.target_mlpm;
+    } else {
+        s->mode = running ? MODE_MANUAL : MODE_IDLE;
+    }
+    if (!s->prog.running) {
+        memset(&s->prog, 0, sizeof(s->prog));
+    }
+}
+
+static size_t format_state(const events_state_t *s, char *buf, size_t size)
+{
+    int len = snprintf(buf, size, "event: state\nid: %u\ndata: {\"mode\":\"%s\",\"duty\":[",
+                       atomic_fetch_add_explicit(&frame_id, 1, memory_order_relaxed) + 1,
+                       mode_names[s->mode]);
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        len += snprintf(buf + len, size - len, "%s%u", ch ? "," : "", s->duty[ch]);
+    }
+    len += snprintf(buf + len, size - len, "],\"dir\":[");
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS; ch++) {
+        len += snprintf(buf + len, size - len, "%s%u", ch ? "," : "", s->dir[ch]);
+    }
+    if (s->prog.running) {
+        len += snprintf(buf + len, size - len,
+                        "],\"program\":{\"slot\":%u,\"step\":%u,\"pass\":%u},",
+                        s->prog.slot, s->prog.step, s->prog.pass);
+    } else {
+        len += snprintf(buf + len, size - len, "],\"program\":null,");
+    }
+    len += snprintf(buf + len, size - len, "\"flow_target\":%lu}\n\n",
+                    (unsigned long)s->flow_target);
+    return len < (int)size ? len : size - 1;
+}
+
+// Runs in the httpd task, so it can't race a session being closed and freed
+static void broadcast_work(void *arg)
+{
+    for (int i = 0; i < STATE_EVENTS_MAX_CLIENTS; i++) {
+        events_client_t *c = &clients[i];
+        if (!c->used || c->closing) {
+            continue;
+        }
+        // Never block the server on one slow peer; a partial frame would
+        // corrupt its stream, so it reconnects instead
+        int ret = httpd_socket_send(server, c->fd, frame, frame_len, MSG_DONTWAIT);
+        if (ret != (int)frame_len) {
+            c->closing = true;
+            httpd_sess_trigger_close(server, c->fd);
+            metrics_inc(METRIC_SSE_DROPS);
+        }
+    }
+    atomic_store_explicit(&frame_busy, false, memory_order_release);
+}
+
+// Session free callback: the client went away
+static void client_gone(void *ctx)
+{
+    events_client_t *c = ctx;
+
+    c->used = false;
+    c->closing = false;
+    atomic_fetch_sub_explicit(&n_clients, 1, memory_order_relaxed);
+}
+
+// One broadcaster pass; returns how long to sleep before the next
+static TickType_t events_poll(void)
+{
+    events_state_t now;
+    int64_t now_us = esp_timer_get_time();
+    int64_t due_us = last_frame_us + EVENTS_INTERVAL_US;
+
+    if (atomic_load_explicit(&n_clients, memory_order_relaxed) == 0) {
+        return portMAX_DELAY;
+    }
+    // Coalesce: whatever else changes before the interval is up rides along
+    if (now_us < due_us) {
+        return pdMS_TO_TICKS((due_us - now_us) / 1000) + 1;
+    }
+    // Previous frame still going out; try again next interval
+    if (atomic_load_explicit(&frame_busy, memory_order_acquire)) {
+        return pdMS_TO_TICKS(CONFIG_PLANTDOC_SSE_INTERVAL_MS);
+    }
+
+    snapshot(&now);
+    bool changed = memcmp(&now, &last_sent, sizeof(now)) != 0;
+    if (!changed && now_us - last_frame_us < EVENTS_KEEPALIVE_US) {
+        return pdMS_TO_TICKS(EVENTS_POLL_MS);
+    }
+
+    frame_len = changed ? format_state(&now, frame, sizeof(frame))
+                        : (size_t)snprintf(frame, sizeof(frame), ": keepalive\n\n");
+    atomic_store_explicit(&frame_busy, true, memory_order_relaxed);
+    if (httpd_queue_work(server, broadcast_work, NULL) != ESP_OK) {
+        atomic_store_explicit(&frame_busy, false, memory_order_relaxed);
+        return pdMS_TO_TICKS(CONFIG_PLANTDOC_SSE_INTERVAL_MS);
+    }
+    if (changed) {
+        last_sent = now;
+        metrics_inc(METRIC_SSE_FRAMES);
+    }
+    last_frame_us = now_us;
+    return pdMS_TO_TICKS(EVENTS_POLL_MS);
+}
+
+static void events_task(void *arg)
+{
+    TickType_t wait = portMAX_DELAY;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, wait);
+        wait = events_poll();
+    }
+}
+
+void state_events_notify(void)
+{
+    if (events_task_handle) {
+        xTaskNotifyGive(events_task_handle);
+    }
+}
+
+// HTTP GET handler for /events: answer with the stream headers and the
+// current state, then keep the socket as a subscriber. httpd goes on waiting
+// for a next request on it that never comes, so it stays open until the
+// client leaves.
+static esp_err_t events_get_handler(httpd_req_t *req)
+{
+    static char buf[EVENTS_FRAME_MAX + 160];
+    events_state_t now;
+    int slot = 0;
+
+    while (slot < STATE_EVENTS_MAX_CLIENTS && clients[slot].used) {
+        slot++;
+    }
+    if (slot == STATE_EVENTS_MAX_CLIENTS) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "Too many subscribers");
+    }
+
+    int len = snprintf(buf, sizeof(buf),
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Connection: keep-alive\r\n\r\n"
+                       "retry: %d\n\n", EVENTS_RETRY_MS);
+    snapshot(&now);
+    len += format_state(&now, buf + len, sizeof(buf) - len);
+    if (httpd_send(req, buf, len) != len) {
+        return ESP_FAIL;
+    }
+
+    clients[slot].fd = httpd_req_to_sockfd(req);
+    clients[slot].used = true;
+    clients[slot].closing = false;
+    req->sess_ctx = &clients[slot];
+    req->free_ctx = client_gone;
+    atomic_fetch_add_explicit(&n_clients, 1, memory_order_relaxed);
+    xTaskNotifyGive(events_task_handle);  // Leave the idle wait
+    return ESP_OK;
+}
+
+esp_err_t state_events_register(httpd_handle_t handle)
+{
+    server = handle;
+    if (events_task_handle == NULL &&
+        mem_task_start(&events_task_mem, events_task, NULL, EVENTS_TASK_PRIO, tskNO_AFFINITY,
+                       &events_task_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create broadcaster task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_uri_t events = {
+        .uri       = "/events",
+        .method    = HTTP_GET,
+        .handler   = events_get_handler,
+        .user_ctx  = NULL
+    };
+    esp_err_t err = httpd_register_uri_handler(server, &events);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /events: %s", esp_err_to_name(err));
+    }
+    return err;
+}
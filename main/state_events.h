@@ -0,0 +1,28 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+// Server-Sent Events stream of pump state at /events.
+//
+// Every open page subscribes with EventSource and gets the full state as
+// soon as it connects, then again whenever it changes:
+//
+//   event: state
+//   id: <n>
+//   data: {"mode":"program","duty":[128,0],"dir":[0,0],
+//          "program":{"slot":0,"step":2,"pass":0},"flow_target":0}
+//
+// mode is idle, manual, program, flow or calibrate; program is null unless
+// one is running. Changes are coalesced: the broadcaster sends at most one
+// frame per CONFIG_PLANTDOC_SSE_INTERVAL_MS, formatted once and written to
+// every subscriber from the httpd task, so a burst of updates costs one send
+// per client. A client whose socket can't take a whole frame is dropped;
+// EventSource reconnects and the connect event brings it up to date.
+
+#define STATE_EVENTS_MAX_CLIENTS    8
+
+// Start the broadcaster and register /events on a running server
+esp_err_t state_events_register(httpd_handle_t server);
+
+// Pump state may have changed; cheap and callable from any task
+void state_events_notify(void);
@@ -0,0 +1,75 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "trace.h"
+
+typedef struct {
+    atomic_uint head;                 // Next write index
+    trace_rec_t rec[TRACE_RING_SIZE];
+} trace_ring_t;
+
+static trace_ring_t rings[portNUM_PROCESSORS];
+
+void IRAM_ATTR trace_event(trace_event_id_t id, uint16_t arg0, uint32_t arg1)
+{
+    // The core only picks the ring; a task migrating mid-call still gets a
+    // unique slot from the atomic increment, it just contends a little.
+    trace_ring_t *ring = &rings[xPortGetCoreID()];
+    uint32_t idx = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    trace_rec_t *rec = &ring->rec[idx & (TRACE_RING_SIZE - 1)];
+    volatile uint32_t *seq = &rec->seq;
+
+    *seq = 0;
+    atomic_thread_fence(memory_order_release);
+    rec->ts_us = (uint32_t)esp_timer_get_time();
+    rec->id = id;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+    atomic_thread_fence(memory_order_release);
+    *seq = idx + 1;
+}
+
+size_t trace_dump(uint8_t *buf, size_t size)
+{
+    trace_dump_hdr_t hdr = {
+        .magic = TRACE_DUMP_MAGIC,
+        .rec_size = sizeof(trace_rec_t),
+        .count = 0,
+        .now_us = esp_timer_get_time()
+    };
+    size_t off = sizeof(hdr);
+
+    if (size < sizeof(hdr)) {
+        return 0;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        trace_ring_t *ring = &rings[core];
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        for (uint32_t i = first; i < head && off + sizeof(trace_rec_t) <= size; i++) {
+            const trace_rec_t *src = &ring->rec[i & (TRACE_RING_SIZE - 1)];
+            trace_rec_t rec;
+
+            // Skip slots being written or already overwritten by a newer lap
+            if (((volatile const trace_rec_t *)src)->seq != i + 1) {
+                continue;
+            }
+            atomic_thread_fence(memory_order_acquire);
+            memcpy(&rec, src, sizeof(rec));
+            atomic_thread_fence(memory_order_acquire);
+            if (((volatile const trace_rec_t *)src)->seq != i + 1) {
+                continue;
+            }
+            memcpy(buf + off, &rec, sizeof(rec));
+            off += sizeof(rec);
+            hdr.count++;
+        }
+    }
+
+    memcpy(buf, &hdr, sizeof(hdr));
+    return off;
+}
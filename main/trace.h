@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+// Binary deferred trace log.
+//
+// trace_event() stores a fixed 16-byte record (timestamp, event id, two
+// integer args) in a per-core lock-free ring and returns; nothing is
+// formatted or sent to the UART. The rings are dumped raw over HTTP and
+// turned back into text on the host by tools/trace_decode.py.
+
+#define TRACE_EVENT(name, fmt) TRACE_##name,
+typedef enum {
+#include "trace_events.h"
+    TRACE_EVENT_COUNT
+} trace_event_id_t;
+#undef TRACE_EVENT
+
+#define TRACE_RING_SIZE     128       // Records per core, power of two
+#define TRACE_DUMP_MAGIC    0x31435254u  // "TRC1"
+
+typedef struct {
+    uint32_t seq;                     // Per-core write index + 1, 0 while being written
+    uint32_t ts_us;                   // Low 32 bits of esp_timer_get_time()
+    uint16_t id;                      // trace_event_id_t
+    uint16_t arg0;
+    uint32_t arg1;
+} trace_rec_t;
+
+// Dump header, followed by `count` trace_rec_t records
+typedef struct {
+    uint32_t magic;                   // TRACE_DUMP_MAGIC
+    uint16_t rec_size;                // sizeof(trace_rec_t)
+    uint16_t count;
+    uint64_t now_us;                  // Full timestamp when the dump was taken
+} trace_dump_hdr_t;
+
+// Record an event; safe from any task or ISR, never blocks
+void trace_event(trace_event_id_t id, uint16_t arg0, uint32_t arg1);
+
+// Snapshot every valid record into buf (header first).
+// Returns the number of bytes written.
+size_t trace_dump(uint8_t *buf, size_t size);
+
+// Size of a full dump of all cores
+#define TRACE_DUMP_MAX_SIZE (sizeof(trace_dump_hdr_t) + \
+                             portNUM_PROCESSORS * TRACE_RING_SIZE * sizeof(trace_rec_t))
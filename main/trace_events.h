@@ -0,0 +1,32 @@
+// Trace event table: TRACE_EVENT(name, "format")
+//
+// The format is only used by tools/trace_decode.py, which parses this file;
+// the firmware just records the event id and two integer arguments.
+// {a0} is a 16-bit and {a1} a 32-bit argument (Python format syntax).
+// Append new events at the end so ids stay stable across builds.
+
+TRACE_EVENT(PUMP_SPEED,         "Pump {a1} speed set to: {a0} ({a0_pct}%)")
+TRACE_EVENT(PUMP_STOP,          "Pump stopped")
+TRACE_EVENT(HTTP_SPRAY,         "Spray started with PWM: {a0} (channel {a1})")
+TRACE_EVENT(HTTP_STOP,          "Stop requested")
+TRACE_EVENT(HTTP_SPRAY_BUSY,    "Spray rejected, control ring full (PWM: {a0})")
+TRACE_EVENT(WIFI_STA_CONNECT,   "Station connected - MAC: {mac}")
+TRACE_EVENT(WIFI_STA_DISCONNECT, "Station disconnected - MAC: {mac}")
+TRACE_EVENT(WS_SPEED,           "WebSocket speed: {a0}")
+TRACE_EVENT(WS_STOP,            "WebSocket stop")
+TRACE_EVENT(PROGRAM_STEP,       "Program slot {a0_hi} step {a0_lo}: duty {a1}")
+TRACE_EVENT(PROGRAM_DONE,       "Program slot {a0} finished")
+TRACE_EVENT(PROGRAM_CANCEL,     "Program slot {a0} cancelled")
+TRACE_EVENT(HTTP_SPRAY_FLOW,    "Spray started with flow target: {a1} mL/min")
+TRACE_EVENT(HTTP_SPRAY_BATCH,   "Batch spray on channel mask 0x{a0:02x}")
+TRACE_EVENT(CLASSIFY,           "Classified as class {a0} ({a1}% confidence)")
+TRACE_EVENT(PUMP_BRAKE,         "Pump braking for {a0} ms, channel mask 0x{a1:02x}")
+TRACE_EVENT(PUMP_COAST,         "Pump brake released, channel mask 0x{a1:02x}")
+TRACE_EVENT(PUMP_DIRECTION,     "Pump {a1} direction set to {a0} (1 = reverse)")
+TRACE_EVENT(CALIB_DONE,         "Pump {a1} calibrated: start {a0_lo}, saturation {a0_hi}")
+TRACE_EVENT(CALIB_FAIL,         "Pump {a1} calibration failed in phase {a0}")
+TRACE_EVENT(UDP_SPEED,          "UDP speed: {a0} (channel {a1})")
+TRACE_EVENT(UDP_STOP,           "UDP stop")
+TRACE_EVENT(PUMP_RAMP,          "Pump {a1} ramping to {a0_lo} from {a0_hi}")
+TRACE_EVENT(OTA_DONE,           "Firmware update received: {a1} bytes in {a0} s")
+TRACE_EVENT(OTA_FAIL,           "Firmware update failed: error 0x{a1:x}")
@@ -0,0 +1,172 @@
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "mem_budget.h"
+#include "metrics.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "trace.h"
+#include "ws_control.h"
+#include "udp_ctrl.h"
+
+static const char *TAG = "udp_ctrl";
+
+#define UDP_TASK_STACK      3072
+#define UDP_TASK_PRIO       (configMAX_PRIORITIES - 4)  // Just below flow_ctrl
+
+// Newest seq seen from one sender
+typedef struct {
+    uint32_t addr;
+    uint16_t port;
+    bool used;
+    uint32_t seq;
+    int64_t seen_us;
+} udp_peer_t;
+
+static int sock = -1;
+static udp_peer_t peers[UDP_CTRL_PEERS];  // UDP task only
+MEM_TASK(udp_task_mem, "udp_ctrl", UDP_TASK_STACK);
+
+static uint32_t frame_crc(const udp_ctrl_frame_t *f)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)f, offsetof(udp_ctrl_frame_t, crc));
+}
+
+// Check seq against the sender's last one and record it. A sender we have
+// no room for replaces the one heard from longest ago.
+static uint8_t check_order(const struct sockaddr_in *from, uint32_t seq)
+{
+    udp_peer_t *p = NULL, *oldest = &peers[0];
+
+    for (int i = 0; i < UDP_CTRL_PEERS; i++) {
+        if (peers[i].used && peers[i].addr == from->sin_addr.s_addr &&
+            peers[i].port == from->sin_port) {
+            p = &peers[i];
+            break;
+        }
+        if (!peers[i].used || (oldest->used && peers[i].seen_us < oldest->seen_us)) {
+            oldest = &peers[i];
+        }
+    }
+
+    if (p != NULL && seq != 0) {
+        int32_t diff = (int32_t)(seq - p->seq);  // Wraps like TCP sequence numbers
+        if (diff == 0) {
+            return UDP_STATUS_DUP;
+        }
+        if (diff < 0) {
+            return UDP_STATUS_STALE;
+        }
+    }
+    if (p == NULL) {
+        p = oldest;
+        p->addr = from->sin_addr.s_addr;
+        p->port = from->sin_port;
+        p->used = true;
+    }
+    p->seq = seq;
+    p->seen_us = esp_timer_get_time();
+    return UDP_STATUS_OK;
+}
+
+static uint8_t udp_apply(const udp_ctrl_frame_t *req)
+{
+    switch (req->op) {
+    case WS_OP_SPEED:
+        if (req->arg >= PUMP_NUM_CHANNELS) {
+            return UDP_STATUS_BAD;
+        }
+        if (pump_ctrl_set_channel(req->arg, req->duty) != ESP_OK) {
+            trace_event(TRACE_HTTP_SPRAY_BUSY, req->duty, 0);
+            return UDP_STATUS_BUSY;
+        }
+        trace_event(TRACE_UDP_SPEED, req->duty, req->arg);
+        return UDP_STATUS_OK;
+    case WS_OP_STOP:
+        pump_ctrl_stop();
+        trace_event(TRACE_UDP_STOP, 0, 0);
+        return UDP_STATUS_OK;
+    case WS_OP_QUERY:
+        return req->arg < PUMP_NUM_CHANNELS ? UDP_STATUS_OK : UDP_STATUS_BAD;
+    default:
+        return UDP_STATUS_BAD;
+    }
+}
+
+static void udp_task(void *arg)
+{
+    uint8_t buf[UDP_CTRL_FRAME_LEN + 1];  // One spare byte to spot oversized frames
+    udp_ctrl_frame_t req, ack;
+    struct sockaddr_in from;
+
+    for (;;) {
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            ESP_LOGW(TAG, "recvfrom failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        memcpy(&req, buf, sizeof(req));
+        if (len != UDP_CTRL_FRAME_LEN || req.magic != UDP_CTRL_MAGIC || req.crc != frame_crc(&req)) {
+            metrics_inc(METRIC_UDP_REJECTED);
+            continue;                 // Nothing in it can be trusted, not even seq
+        }
+
+        uint8_t status = check_order(&from, req.seq);
+        if (status == UDP_STATUS_OK) {
+            status = udp_apply(&req);
+            metrics_inc(METRIC_UDP_COMMANDS);
+        } else if (status == UDP_STATUS_STALE) {
+            metrics_inc(METRIC_UDP_REJECTED);
+        }
+
+        ack.magic = UDP_CTRL_MAGIC;
+        ack.op = req.op | 0x80;
+        ack.arg = status;
+        ack.duty = pump_get_command(req.arg < PUMP_NUM_CHANNELS ? req.arg : 0);
+        ack.seq = req.seq;
+        ack.crc = frame_crc(&ack);
+        sendto(sock, &ack, sizeof(ack), 0, (struct sockaddr *)&from, from_len);
+    }
+}
+
+esp_err_t udp_ctrl_start(void)
+{
+#if CONFIG_PLANTDOC_UDP_CONTROL
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_PLANTDOC_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "socket failed: errno %d", errno);
+        return ESP_FAIL;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(TAG, "bind to port %d failed: errno %d", CONFIG_PLANTDOC_UDP_PORT, errno);
+        close(sock);
+        sock = -1;
+        return ESP_FAIL;
+    }
+    if (mem_task_start(&udp_task_mem, udp_task, NULL, UDP_TASK_PRIO, tskNO_AFFINITY,
+                       NULL) != ESP_OK) {
+        close(sock);
+        sock = -1;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Listening on UDP port %d", CONFIG_PLANTDOC_UDP_PORT);
+    return ESP_OK;
+#else
+    (void)udp_task;
+    (void)udp_task_mem;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// UDP binary control (CONFIG_PLANTDOC_UDP_CONTROL), for automation scripts.
+//
+// One datagram per command, no connection, no parsing: each request and
+// ack is a fixed 12-byte little-endian frame on CONFIG_PLANTDOC_UDP_PORT
+//
+//   request: [magic][op][ch][duty][seq:u32][crc:u32]
+//   ack:     [magic][op | 0x80][status][duty][seq:u32][crc:u32]
+//
+// with ops as in ws_control.h ('S' set a channel's duty, 'X' stop, 'Q'
+// query) and crc the CRC-32 (zlib polynomial) of the first 8 bytes. The ack
+// echoes seq and carries the channel's commanded duty. Frames with a bad
+// size, magic or CRC are dropped without an ack. seq must increase per
+// sender (address and port): an older frame that arrives late is not
+// applied and acked UDP_STATUS_STALE, a repeat of the newest one is acked
+// UDP_STATUS_DUP without applying it again. seq 0 starts a new sequence.
+// tools/udp_ctrl.py is a client and benchmark.
+
+#define UDP_CTRL_MAGIC      0xD7
+#define UDP_CTRL_FRAME_LEN  12
+#define UDP_CTRL_PEERS      4         // Senders tracked for ordering (MAX_STA_CONN)
+
+#define UDP_STATUS_OK       0
+#define UDP_STATUS_BUSY     1         // Control ring full, retry
+#define UDP_STATUS_BAD      2         // Unknown op or channel
+#define UDP_STATUS_STALE    3         // Older than a frame already applied
+#define UDP_STATUS_DUP      4         // Newest frame again, already applied
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t op;
+    uint8_t arg;                      // Request: channel. Ack: status.
+    uint8_t duty;
+    uint32_t seq;
+    uint32_t crc;
+} udp_ctrl_frame_t;
+
+_Static_assert(sizeof(udp_ctrl_frame_t) == UDP_CTRL_FRAME_LEN, "fixed wire layout");
+
+// Open the socket and start the listener. ESP_ERR_NOT_SUPPORTED when
+// disabled in menuconfig.
+esp_err_t udp_ctrl_start(void);
@@ -0,0 +1,1137 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "assets.h"
+#include "boot.h"
+#include "classify.h"
+#include "flow_ctrl.h"
+#include "history.h"
+#include "img_decode.h"
+#include "journal.h"
+#include "mem_budget.h"
+#include "metrics.h"
+#include "ota.h"
+#include "program.h"
+#include "pump.h"
+#include "pump_calib.h"
+#include "pump_ctrl.h"
+#include "sensors.h"
+#include "state_events.h"
+#include "trace.h"
+#include "ws_control.h"
+#include "web_server.h"
+
+static const char *TAG = "web";
+
+#define UPLOAD_CHUNK    1024          // Upload receive piece
+#define HISTORY_POINTS  120           // Default buckets per series for /history
+#define METRICS_CHUNK   1024          // /metrics is sent in pieces of up to this
+#define RECV_TIMEOUTS   3             // Receive timeouts in a row before a body is dropped
+
+// Handlers keep buffers of any size in function statics rather than on the
+// httpd task's stack (CONFIG_PLANTDOC_HTTPD_STACK). httpd runs one handler
+// at a time, so no two requests ever share one; the same holds for the
+// handlers other modules register on the server (state_events.c).
+
+// HTTP GET handler for the web UI, any path no other handler claims: files
+// come from the assets partition (assets.h), "/" is /index.html. Sent
+// straight from the flash mapping; the ETag is the file's CRC.
+static esp_err_t asset_get_handler(httpd_req_t *req)
+{
+    char path[ASSETS_PATH_MAX];
+    char etag[12], inm[64];
+    asset_t a;
+
+    size_t len = strcspn(req->uri, "?");
+    if (len >= sizeof(path)) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
+    }
+    memcpy(path, req->uri, len);
+    path[len] = '\0';
+    if (strcmp(path, "/") == 0) {
+        strcpy(path, "/index.html");
+    }
+    if (!assets_find(path, &a)) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, strcmp(path, "/index.html") == 0 ?
+                                   "Web UI not flashed, run idf.py assets-flash" : NULL);
+    }
+
+    snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)a.crc);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");  // Always revalidate, 304 is cheap
+
+    // Client already has this build of the file
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) == ESP_OK &&
+        strstr(inm, etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, a.type);
+    if (a.gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    return httpd_resp_send(req, (const char *)a.data, a.len);
+}
+
+// Read a string query parameter from the request URL
+esp_err_t web_query_str(httpd_req_t *req, const char *key, char *out, size_t size)
+{
+    char buf[100];
+    size_t buf_len = httpd_req_get_url_query_len(req) + 1;
+
+    if (buf_len <= 1 || buf_len > sizeof(buf)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (httpd_req_get_url_query_str(req, buf, buf_len) != ESP_OK ||
+        httpd_query_key_value(buf, key, out, size) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+// A whole decimal int, nothing before or after it
+static esp_err_t parse_int(const char *s, int *out)
+{
+    char *end;
+    errno = 0;
+    long val = strtol(s, &end, 10);
+
+    if (end == s || *end != '\0' || errno == ERANGE || val < INT_MIN || val > INT_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = (int)val;
+    return ESP_OK;
+}
+
+// Read an integer query parameter from the request URL
+esp_err_t web_query_int(httpd_req_t *req, const char *key, int *out)
+{
+    char param[32];
+
+    if (web_query_str(req, key, param, sizeof(param)) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return parse_int(param, out);
+}
+
+// Optional integer parameter: absent leaves *out as it is, present it must
+// be a number in [min, max]
+static esp_err_t query_int_in(httpd_req_t *req, const char *key, int *out, int min, int max)
+{
+    int val;
+    esp_err_t err = web_query_int(req, key, &val);
+
+    if (err == ESP_ERR_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK || val < min || val > max) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = val;
+    return ESP_OK;
+}
+
+// Optional integer field of a form body, as query_int_in(): absent leaves
+// *out as it is, present it must be a number in [min, max]
+static esp_err_t form_int_in(const char *body, const char *key, int *out, int min, int max)
+{
+    char param[12];
+    int val;
+    esp_err_t err = httpd_query_key_value(body, key, param, sizeof(param));
+
+    if (err == ESP_ERR_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK || parse_int(param, &val) != ESP_OK || val < min || val > max) {
+        return ESP_ERR_INVALID_ARG;   // Too long to be one, too
+    }
+    *out = val;
+    return ESP_OK;
+}
+
+// Receive the next piece of a request body. A stalled client gets
+// RECV_TIMEOUTS socket timeouts in a row, then the body is dropped, so it
+// can't hold the (single) httpd task forever. Returns the bytes read, 0 if
+// the client closed, or -1.
+int web_recv(httpd_req_t *req, void *buf, size_t len)
+{
+    for (int tries = 0; tries < RECV_TIMEOUTS; tries++) {
+        int ret = httpd_req_recv(req, buf, len);
+        if (ret != HTTPD_SOCK_ERR_TIMEOUT) {
+            return ret < 0 ? -1 : ret;
+        }
+    }
+    ESP_LOGW(TAG, "%s: client stalled, dropping the body", req->uri);
+    return -1;
+}
+
+// Read the whole (small) request body into buf as a NUL-terminated string
+esp_err_t web_recv_body(httpd_req_t *req, char *buf, size_t size)
+{
+    size_t got = 0;
+
+    if (req->content_len >= size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (got < req->content_len) {
+        int ret = web_recv(req, buf + got, req->content_len - got);
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        got += ret;
+    }
+    buf[got] = '\0';
+    return ESP_OK;
+}
+
+// Parse "a,b,c" into per-channel speeds; returns the channel mask or 0
+static uint8_t parse_speed_list(const char *list, uint8_t *speeds)
+{
+    uint8_t mask = 0;
+    const char *p = list;
+
+    for (int ch = 0; ch < PUMP_NUM_CHANNELS && *p; ch++) {
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end == p || v < 0 || v > 255 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        speeds[ch] = v;
+        mask |= 1 << ch;
+        p = *end ? end + 1 : end;
+    }
+    return *p ? 0 : mask;             // More values than channels
+}
+
+// HTTP GET handler for spray endpoint:
+//   ?pwm=<0-255>[&ch=N]   one channel (default 0)
+//   ?pwm=<a>,<b>,...      channels 0, 1, ... updated together
+//   ?flow=<mL/min>        closed-loop flow target
+static esp_err_t spray_get_handler(httpd_req_t *req)
+{
+    int pwm, flow, ch = 0;
+    char list[4 * PUMP_MAX_CHANNELS + 1];
+    uint8_t speeds[PUMP_NUM_CHANNELS];
+
+    if (web_query_int(req, "flow", &flow) == ESP_OK && flow >= 0) {
+        if (flow == 0) {
+            pump_ctrl_stop();
+        } else if (flow_ctrl_set_target(flow) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No flow sensor");
+        }
+        trace_event(TRACE_HTTP_SPRAY_FLOW, 0, flow);
+    } else if (web_query_str(req, "pwm", list, sizeof(list)) == ESP_OK && strchr(list, ',')) {
+        uint8_t mask = parse_speed_list(list, speeds);
+        if (mask == 0) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad speed list");
+        }
+        if (pump_ctrl_set_batch(mask, speeds) != ESP_OK) {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            return httpd_resp_sendstr(req, "BUSY");
+        }
+        trace_event(TRACE_HTTP_SPRAY_BATCH, mask, 0);
+    } else if (web_query_int(req, "pwm", &pwm) == ESP_OK && pwm >= 0 && pwm <= 255) {
+        web_query_int(req, "ch", &ch);
+        if (ch < 0 || ch >= PUMP_NUM_CHANNELS) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No such channel");
+        }
+        if (pump_ctrl_set_channel(ch, (uint8_t)pwm) != ESP_OK) {
+            trace_event(TRACE_HTTP_SPRAY_BUSY, pwm, 0);
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            return httpd_resp_sendstr(req, "BUSY");
+        }
+        trace_event(TRACE_HTTP_SPRAY, pwm, ch);
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// Parse a stop mode name; -1 if unknown
+static int parse_stop_mode(const char *name)
+{
+    if (strcmp(name, "brake") == 0) {
+        return PUMP_STOP_BRAKE;
+    }
+    if (strcmp(name, "coast") == 0) {
+        return PUMP_STOP_COAST;
+    }
+    return -1;
+}
+
+// HTTP GET handler for stop endpoint: /stop[?mode=brake|coast], default
+// is the configured stop mode (brake unless changed through /drive)
+static esp_err_t stop_get_handler(httpd_req_t *req)
+{
+    char name[8];
+
+    if (web_query_str(req, "mode", name, sizeof(name)) == ESP_OK) {
+        int mode = parse_stop_mode(name);
+        if (mode < 0) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown stop mode");
+        }
+        pump_ctrl_stop_with(mode);
+    } else {
+        pump_ctrl_stop();
+    }
+    trace_event(TRACE_HTTP_STOP, 0, 0);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_send(req, "OK", 2);
+    return ESP_OK;
+}
+
+// HTTP POST handler storing (and by default running) a spray program.
+// Body: steps=<duty>:<ms>,<duty>:<ms>,...[&repeat=N][&slot=N][&run=0]
+static esp_err_t program_post_handler(httpd_req_t *req)
+{
+    char body[256];
+    char steps[200];
+    int repeat = 1, slot = 0, run = 1;
+    program_t prog;
+
+    esp_err_t err = web_recv_body(req, body, sizeof(body));
+    if (err == ESP_ERR_INVALID_SIZE) {
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        return httpd_resp_sendstr(req, "Program too long");
+    }
+    if (err != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    if (httpd_query_key_value(body, "steps", steps, sizeof(steps)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing steps");
+    }
+    if (form_int_in(body, "repeat", &repeat, 1, PROGRAM_MAX_REPEAT) != ESP_OK ||
+        form_int_in(body, "slot", &slot, 0, PROGRAM_SLOTS - 1) != ESP_OK ||
+        form_int_in(body, "run", &run, 0, 1) != ESP_OK ||
+        program_parse(steps, repeat, &prog) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid program");
+    }
+    if (program_store(slot, &prog) != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_sendstr(req, "Slot is running");
+    }
+    if (run) {
+        program_run(slot);
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_sendstr(req, "OK");
+}
+
+// HTTP GET handler running a stored program: /program/run?slot=N
+static esp_err_t program_run_get_handler(httpd_req_t *req)
+{
+    int slot = 0;
+
+    web_query_int(req, "slot", &slot);
+    if (slot < 0 || slot >= PROGRAM_SLOTS || program_run(slot) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No program in slot");
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_sendstr(req, "OK");
+}
+
+// Start the pump if asked to, then send a classification result as JSON.
+// img, when set, adds the decode statistics of an uploaded file. ?spray=1
+// is refused unless CONFIG_PLANTDOC_CLASSIFY_SPRAY is set.
+static esp_err_t classify_reply(httpd_req_t *req, const classify_result_t *res,
+                                uint8_t pwm, const img_result_t *img)
+{
+    char buf[448];
+    int spray = 0;
+
+    web_query_int(req, "spray", &spray);
+#if !CONFIG_PLANTDOC_CLASSIFY_SPRAY
+    if (spray) {
+        return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN,
+                                   "Spraying on a classification is disabled");
+    }
+#endif
+    bool sprayed = spray && pwm > 0 && pump_ctrl_set_speed(pwm) == ESP_OK;
+
+    int len = snprintf(buf, sizeof(buf),
+                       "{\"label\":\"%s\",\"plant\":\"%s\",\"disease\":\"%s\","
+                       "\"treatment\":\"%s\",\"confidence\":%.3f,\"pwm\":%d,"
+                       "\"sprayed\":%s,\"us\":%lu,\"arena_peak\":%u,",
+                       res->label->name, res->label->plant, res->label->disease,
+                       res->label->treatment, res->confidence, pwm,
+                       sprayed ? "true" : "false", (unsigned long)res->nn.total_us,
+                       (unsigned)classify_peak_bytes());
+    if (img) {
+        len += snprintf(buf + len, sizeof(buf) - len,
+                        "\"width\":%u,\"height\":%u,\"bytes\":%lu,\"lesion_permille\":%lu,",
+                        img->width, img->height, (unsigned long)img->bytes_in,
+                        (unsigned long)img_lesion_permille(img));
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, "\"layers_us\":[");
+    for (int i = 0; i < classify_layer_count() && len < (int)sizeof(buf) - 16; i++) {
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%lu", i ? "," : "",
+                        (unsigned long)res->nn.layer_us[i]);
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, "]}");
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, len);
+}
+
+// HTTP POST handler classifying one image: the body is raw RGB888 at the
+// model input size (32x32). ?spray=1 also starts the pump at the class's PWM
+// when the result is a confident disease, if classifier spraying is enabled.
+static esp_err_t classify_post_handler(httpd_req_t *req)
+{
+    static uint8_t rgb[IMG_OUT_SIZE * IMG_OUT_SIZE * 3];
+    size_t need = classify_input_size();
+    size_t got = 0;
+    classify_result_t res;
+
+    if (need == 0 || need > sizeof(rgb) || req->content_len != need) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body must be raw RGB at model size");
+    }
+    while (got < need) {
+        int ret = web_recv(req, rgb + got, need - got);
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        got += ret;
+    }
+
+    if (classify_rgb(rgb, &res) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Inference failed");
+    }
+    // No severity information in a raw frame: spray at the class PWM
+    return classify_reply(req, &res, classify_spray_pwm(&res, CLASSIFY_LESION_FULL_PERMILLE), NULL);
+}
+
+// HTTP POST handler for a PNG upload. The body is streamed through the
+// decoder in UPLOAD_CHUNK pieces, so file size is bounded only by the
+// decoder's dimension limits. The downscaled image is classified and the
+// lesion ratio scales the class PWM; ?spray=1 starts the pump.
+static esp_err_t upload_post_handler(httpd_req_t *req)
+{
+    static img_decoder_t dec;         // ~45 KiB
+    static uint8_t chunk[UPLOAD_CHUNK];
+    size_t left = req->content_len;
+    const img_result_t *img;
+    classify_result_t res;
+    esp_err_t err = ESP_OK;
+
+    if (classify_input_size() != sizeof(img->rgb)) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Model input size mismatch");
+    }
+
+    img_decode_begin(&dec);
+    while (left > 0) {
+        int ret = web_recv(req, chunk, left < sizeof(chunk) ? left : sizeof(chunk));
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        left -= ret;
+        // Keep draining the body after an error so the reply is readable
+        if (err == ESP_OK) {
+            err = img_decode_feed(&dec, chunk, ret);
+        }
+    }
+    if (err == ESP_OK) {
+        err = img_decode_end(&dec, &img);
+    }
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        httpd_resp_set_status(req, "415 Unsupported Media Type");
+        return httpd_resp_sendstr(req, "Need an 8-bit non-interlaced PNG, 32..2048 px wide");
+    }
+    if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid or truncated PNG");
+    }
+
+    if (classify_rgb(img->rgb, &res) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Inference failed");
+    }
+    return classify_reply(req, &res, classify_spray_pwm(&res, img_lesion_permille(img)), img);
+}
+
+// HTTP GET handler for PWM profiles: ?profile=N switches, always lists them
+static esp_err_t pwm_get_handler(httpd_req_t *req)
+{
+    const pwm_profile_t *prof;
+    char line[64];
+    int idx;
+
+    if (web_query_int(req, "profile", &idx) == ESP_OK) {
+        if (idx < 0 || pump_ctrl_set_profile(idx) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No such profile");
+        }
+    } else {
+        idx = pump_get_profile();
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    for (int i = 0; (prof = pump_profile_info(i)) != NULL; i++) {
+        snprintf(line, sizeof(line), "%c%d %s %lu Hz %d bit\n", i == idx ? '*' : ' ', i,
+                 prof->name, (unsigned long)prof->freq_hz, prof->bits);
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+// HTTP GET handler for drive modes:
+//   ?dir=forward|reverse[&ch=N]     direction (a running channel stops first)
+//   ?stop=brake|coast[&brake_ms=N]  default stop mode for /stop and the UI
+//   ?ramp=off|linear|scurve[&ramp_ms=N]  speed change ramps, N full scale
+static esp_err_t drive_get_handler(httpd_req_t *req)
+{
+    static const char *const dir_names[] = { "forward", "reverse" };
+    static const char *const stop_names[] = { "brake", "coast" };
+    static const char *const ramp_names[] = { "off", "linear", "scurve" };
+    char name[8], line[64];
+    int ch = 0, ms = 0;
+    int dir = -1;
+    uint16_t brake_ms, ramp_ms;
+
+    if (web_query_str(req, "dir", name, sizeof(name)) == ESP_OK) {
+        web_query_int(req, "ch", &ch);
+        dir = strcmp(name, "reverse") == 0 ? PUMP_REVERSE :
+              strcmp(name, "forward") == 0 ? PUMP_FORWARD : -1;
+        if (dir < 0 || ch < 0 || pump_ctrl_set_direction(ch, dir) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad direction or channel");
+        }
+    }
+    if (web_query_str(req, "stop", name, sizeof(name)) == ESP_OK) {
+        int mode = parse_stop_mode(name);
+        web_query_int(req, "brake_ms", &ms);
+        if (mode < 0 || ms < 0 || ms > PUMP_BRAKE_MS_MAX ||
+            pump_set_stop_mode(mode, ms) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad stop mode");
+        }
+    }
+    if (web_query_str(req, "ramp", name, sizeof(name)) == ESP_OK) {
+        int shape = -1;
+        ms = 0;
+        web_query_int(req, "ramp_ms", &ms);
+        for (int i = 0; i < 3; i++) {
+            if (strcmp(name, ramp_names[i]) == 0) {
+                shape = i;
+            }
+        }
+        if (shape < 0 || ms < 0 || ms > PUMP_RAMP_MS_MAX ||
+            pump_set_ramp(shape, ms) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad ramp");
+        }
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+    pump_stop_mode_t mode = pump_get_stop_mode(&brake_ms);
+    snprintf(line, sizeof(line), "stop %s %u ms\n", stop_names[mode], brake_ms);
+    httpd_resp_sendstr_chunk(req, line);
+    snprintf(line, sizeof(line), "ramp %s %u ms\n", ramp_names[pump_get_ramp(&ramp_ms)], ramp_ms);
+    httpd_resp_sendstr_chunk(req, line);
+    for (int i = 0; i < PUMP_NUM_CHANNELS; i++) {
+        // A direction just requested is reported as applied; the control task
+        // picks it up within microseconds
+        int d = (dir >= 0 && i == ch) ? dir : (int)pump_get_direction(i);
+        snprintf(line, sizeof(line), "ch%d %s speed %u%s\n", i, dir_names[d],
+                 pump_get_channel(i), pump_is_braking(i) ? " braking" :
+                 pump_is_ramping(i) ? " ramping" : "");
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+// HTTP GET handler for pump calibration:
+//   ?start=1[&ch=N]   sweep a channel (takes over the pump for a few minutes)
+//   ?clear=1[&ch=N]   drop a channel's compensation curve
+static esp_err_t calibrate_get_handler(httpd_req_t *req)
+{
+    static const char *const phases[] = { "baseline", "up", "refine", "down", "done", "failed" };
+    pump_calib_status_t st;
+    int ch = 0, flag = 0;
+    char line[96];
+
+    web_query_int(req, "ch", &ch);
+    if (ch < 0 || ch >= PUMP_NUM_CHANNELS) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No such channel");
+    }
+    if (web_query_int(req, "start", &flag) == ESP_OK && flag) {
+        esp_err_t err = pump_calib_start(ch);
+        if (err == ESP_ERR_NOT_SUPPORTED) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No flow or current sensor");
+        }
+        if (err != ESP_OK) {
+            httpd_resp_set_status(req, "409 Conflict");
+            return httpd_resp_sendstr(req, "Calibration already running");
+        }
+    } else if (web_query_int(req, "clear", &flag) == ESP_OK && flag) {
+        if (pump_calib_clear(ch) != ESP_OK) {
+            httpd_resp_set_status(req, "409 Conflict");
+            return httpd_resp_sendstr(req, "Channel is being calibrated");
+        }
+    }
+
+    pump_calib_get_status(&st);
+    httpd_resp_set_type(req, "text/plain");
+    snprintf(line, sizeof(line), "%s ch%d %s phase %s speed %u points %u%s%s\n",
+             st.running ? "running" : "idle", st.ch,
+             st.source == CALIB_SRC_FLOW ? "flow" : "current", phases[st.phase],
+             st.speed, st.points, st.error ? " error: " : "", st.error ? st.error : "");
+    httpd_resp_sendstr_chunk(req, line);
+    for (int i = 0; i < PUMP_NUM_CHANNELS; i++) {
+        const calib_curve_t *c = &st.curve[i];
+        if (!st.valid[i]) {
+            snprintf(line, sizeof(line), "ch%d uncalibrated\n", i);
+        } else {
+            int n = snprintf(line, sizeof(line), "ch%d profile %u start %u stall %u saturation %u knots",
+                             i, st.profile[i], c->start, c->stall, c->saturation);
+            for (int k = 0; k < CALIB_KNOTS; k++) {
+                n += snprintf(line + n, sizeof(line) - n, "%c%u", k ? ',' : ' ', c->knots[k]);
+            }
+            snprintf(line + n, sizeof(line) - n, "\n");
+        }
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+// HTTP GET handler for control latency statistics
+static esp_err_t latency_get_handler(httpd_req_t *req)
+{
+    pump_ctrl_latency_t lat;
+    char buf[96];
+
+    pump_ctrl_get_latency(&lat);
+    snprintf(buf, sizeof(buf), "count=%lu p50_us=%lu p99_us=%lu max_us=%lu\n",
+             (unsigned long)lat.count, (unsigned long)lat.p50_us,
+             (unsigned long)lat.p99_us, (unsigned long)lat.max_us);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_sendstr(req, buf);
+}
+
+// HTTP GET handler for the latest sensor readings
+static esp_err_t sensors_get_handler(httpd_req_t *req)
+{
+    sensors_reading_t r;
+    char buf[192];
+
+    sensors_get(&r);
+    if (r.seq == 0) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No sensor data");
+    }
+    snprintf(buf, sizeof(buf),
+             "{\"soil_mv\":%u,\"soil_permille\":%u,\"current_mv\":%u,\"current_ma\":%u,"
+             "\"age_ms\":%lu,\"samples\":%lu,\"overflows\":%lu}",
+             r.soil_mv, r.soil_permille, r.current_mv, r.current_ma,
+             (unsigned long)((esp_timer_get_time() - r.time_us) / 1000),
+             (unsigned long)r.samples, (unsigned long)r.overflows);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, buf);
+}
+
+// Streams history buckets as CSV, flushing one HTTP chunk at a time
+typedef struct {
+    httpd_req_t *req;
+    size_t len;
+    bool failed;
+    char buf[1024];
+} history_out_t;
+
+static bool history_emit(const history_bucket_t *b, void *ctx)
+{
+    history_out_t *o = ctx;
+
+    if (o->len > sizeof(o->buf) - 64) {
+        o->failed = httpd_resp_send_chunk(o->req, o->buf, o->len) != ESP_OK;
+        o->len = 0;
+    }
+    o->len += snprintf(o->buf + o->len, sizeof(o->buf) - o->len, "%lu,%u,%u,%ld,%ld,%ld\n",
+                       (unsigned long)b->t_ms, b->series, b->count,
+                       (long)b->min, (long)b->max, (long)b->mean);
+    return !o->failed;
+}
+
+// HTTP GET handler for recorded history:
+//   /history?from=<ms>&to=<ms>&step=<ms>&series=<mask>
+// Times are ms since boot; negative values are relative to now. Defaults
+// are the last 10 minutes, all series, HISTORY_POINTS buckets per series.
+// Series ids (history.h): pump duty of channel c is HIST_DUTY + c (0-3),
+// then HIST_SOIL permille (4), HIST_CURRENT mA (5), HIST_FLOW mL/min (6).
+static esp_err_t history_get_handler(httpd_req_t *req)
+{
+    static history_out_t out;
+    const int64_t now = history_now_ms();
+    int from = -600000, to = 0, step = -1, mask = 0xffff;
+
+    if (query_int_in(req, "from", &from, INT_MIN, INT_MAX) != ESP_OK ||
+        query_int_in(req, "to", &to, INT_MIN, INT_MAX) != ESP_OK ||
+        query_int_in(req, "step", &step, 0, INT_MAX) != ESP_OK ||
+        query_int_in(req, "series", &mask, 0, 0xffff) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad parameter");
+    }
+
+    // In 64 bits: now + INT_MIN and the like can't wrap. A start before
+    // boot is boot; an end before boot leaves nothing.
+    int64_t from_ms = from < 0 ? now + from : from;
+    int64_t to_ms = to <= 0 ? now + to : to;
+    from_ms = from_ms < 0 ? 0 : from_ms;
+    if (to_ms < from_ms) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty range");
+    }
+    uint32_t step_ms = step >= 0 ? (uint32_t)step : (uint32_t)((to_ms - from_ms) / HISTORY_POINTS + 1);
+
+    out.req = req;
+    out.failed = false;
+    out.len = snprintf(out.buf, sizeof(out.buf), "t_ms,series,count,min,max,mean\n");
+    httpd_resp_set_type(req, "text/csv");
+    history_query((uint32_t)from_ms, (uint32_t)to_ms, step_ms, (uint16_t)mask, history_emit, &out);
+    if (out.failed) {
+        return ESP_FAIL;
+    }
+    if (out.len) {
+        httpd_resp_send_chunk(req, out.buf, out.len);
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Keeps the newest JOURNAL_RECENT sessions seen while walking the journal
+#define JOURNAL_RECENT  8
+
+typedef struct {
+    journal_session_t s[JOURNAL_RECENT];
+    uint32_t n;
+} recent_sessions_t;
+
+static bool collect_session(const journal_session_t *s, void *ctx)
+{
+    recent_sessions_t *r = ctx;
+
+    r->s[r->n++ % JOURNAL_RECENT] = *s;
+    return true;
+}
+
+// HTTP GET handler for persisted state: totals, journal wear statistics and
+// the most recent spray sessions. ?flush=1 commits pending changes first.
+static esp_err_t journal_get_handler(httpd_req_t *req)
+{
+    static recent_sessions_t recent;
+    journal_state_t st;
+    journal_stats_t js;
+    char buf[256];
+    int flush = 0;
+
+    web_query_int(req, "flush", &flush);
+    if (flush) {
+        journal_flush();
+    }
+    journal_get_state(&st);
+    journal_get_stats(&js);
+    recent.n = 0;
+    journal_for_each_session(collect_session, &recent);
+
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf),
+             "{\"boot\":%ld,\"profile\":%ld,\"sessions\":%lu,\"spray_s\":%llu,"
+             "\"flushes\":%lu,\"bytes_written\":%lu,\"erases\":%lu,\"replay_us\":%lu,"
+             "\"sector\":%u,\"sectors\":%u,\"recent\":[",
+             (long)st.keys[JKEY_BOOT_COUNT], (long)st.keys[JKEY_PWM_PROFILE],
+             (unsigned long)st.sessions, (unsigned long long)(st.spray_ms / 1000),
+             (unsigned long)js.flushes, (unsigned long)js.bytes_written,
+             (unsigned long)js.erases, (unsigned long)js.replay_us, js.sector, js.sectors);
+    httpd_resp_sendstr_chunk(req, buf);
+
+    uint32_t first = recent.n > JOURNAL_RECENT ? recent.n - JOURNAL_RECENT : 0;
+    for (uint32_t i = first; i < recent.n; i++) {
+        const journal_session_t *s = &recent.s[i % JOURNAL_RECENT];
+        snprintf(buf, sizeof(buf),
+                 "%s{\"boot\":%u,\"start_s\":%lu,\"duration_ms\":%lu,\"peak\":%u}",
+                 i > first ? "," : "", s->boot, (unsigned long)s->start_s,
+                 (unsigned long)s->duration_ms, s->peak_duty);
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+// HTTP GET handler for boot stage timing: when each stage ran and on which
+// core, in esp_timer microseconds since the app started
+static esp_err_t boot_get_handler(httpd_req_t *req)
+{
+    const boot_record_t *rec;
+    uint32_t total_us;
+    bool done;
+    char buf[160];
+    int n = boot_get_records(&rec, &done, &total_us);
+
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf), "{\"done\":%s,\"total_us\":%lu,\"stages\":[",
+             done ? "true" : "false", (unsigned long)total_us);
+    httpd_resp_sendstr_chunk(req, buf);
+    for (int i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf),
+                 "%s{\"name\":\"%s\",\"core\":%u,\"start_us\":%lu,\"end_us\":%lu,"
+                 "\"err\":\"%s\"}", i ? "," : "", rec[i].name, rec[i].core,
+                 (unsigned long)rec[i].start_us, (unsigned long)rec[i].end_us,
+                 esp_err_to_name(rec[i].err));
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+// Body reader for ota_receive()
+static int ota_recv(void *ctx, uint8_t *buf, size_t len)
+{
+    return web_recv(ctx, buf, len);
+}
+
+static bool parse_mac(const char *hex, uint8_t out[OTA_MAC_LEN])
+{
+    if (strlen(hex) != OTA_MAC_LEN * 2) {
+        return false;
+    }
+    for (int i = 0; i < OTA_MAC_LEN; i++) {
+        char byte[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+        char *end;
+        out[i] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// HTTP POST handler for firmware updates: the body is the app image, with
+// its HMAC-SHA256 under the OTA key in an X-Image-HMAC hex header
+// (tools/ota_upload.py). On success the device restarts into it after
+// replying. Refused outright unless updates are enabled (ota.h).
+static esp_err_t ota_post_handler(httpd_req_t *req)
+{
+    char hex[OTA_MAC_LEN * 2 + 1];
+    uint8_t mac[OTA_MAC_LEN];
+    ota_stats_t st;
+    char buf[160];
+
+    if (!ota_enabled()) {
+        return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN,
+                                   "Firmware updates over the AP are disabled");
+    }
+    if (httpd_req_get_hdr_value_str(req, "X-Image-HMAC", hex, sizeof(hex)) != ESP_OK ||
+        !parse_mac(hex, mac)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Need an X-Image-HMAC header");
+    }
+    if (req->content_len == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty image");
+    }
+
+    esp_err_t err = ota_receive(ota_recv, req, req->content_len, mac, &st);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_sendstr(req, "Update already in progress");
+    }
+    if (err == ESP_ERR_INVALID_SIZE) {
+        return ESP_FAIL;                  // Connection broke; nobody to reply to
+    }
+    if (err == ESP_ERR_INVALID_CRC) {
+        return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Image doesn't authenticate");
+    }
+    if (err != ESP_OK) {
+        snprintf(buf, sizeof(buf), "Update rejected: %s", esp_err_to_name(err));
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, buf);
+    }
+
+    snprintf(buf, sizeof(buf), "ok %lu bytes in %lu ms, flash %lu ms, receive waited %lu ms\n",
+             (unsigned long)st.bytes, (unsigned long)(st.total_us / 1000),
+             (unsigned long)(st.flash_us / 1000), (unsigned long)(st.recv_wait_us / 1000));
+    httpd_resp_sendstr(req, buf);
+    ota_restart();
+    return ESP_OK;
+}
+
+// HTTP GET handler for the stack budget: each task's stack size against its
+// high-water mark so far, with a suggested size (see mem_budget.h)
+static esp_err_t budget_get_handler(httpd_req_t *req)
+{
+    static mem_task_t tasks[MEM_MAX_TASKS];
+    static mem_stack_t per[MEM_MAX_TASKS];
+    mem_totals_t tot;
+    char buf[192];
+    int n = mem_budget_snapshot(tasks, MEM_MAX_TASKS);
+
+    mem_budget_aggregate(tasks, n, per, &tot);
+    httpd_resp_set_type(req, "application/json");
+    snprintf(buf, sizeof(buf),
+             "{\"static_alloc\":%s,\"heap_free\":%lu,\"heap_min_free\":%lu,"
+             "\"stack_static\":%lu,\"stack_heap\":%lu,\"stack_used\":%lu,"
+             "\"stack_suggested\":%lu,\"tasks\":[",
+             MEM_STATIC ? "true" : "false",
+             (unsigned long)esp_get_free_heap_size(), (unsigned long)esp_get_minimum_free_heap_size(),
+             (unsigned long)tot.stack_static, (unsigned long)tot.stack_heap,
+             (unsigned long)tot.stack_used, (unsigned long)tot.stack_suggested);
+    httpd_resp_sendstr_chunk(req, buf);
+    for (int i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf),
+                 "%s{\"name\":\"%s\",\"stack\":%lu,\"static\":%s,\"running\":%s,"
+                 "\"used\":%lu,\"suggested\":%lu,\"verdict\":\"%s\"}", i ? "," : "",
+                 tasks[i].name, (unsigned long)tasks[i].stack_bytes,
+                 tasks[i].stack ? "true" : "false", tasks[i].handle ? "true" : "false",
+                 (unsigned long)per[i].used, (unsigned long)per[i].suggested,
+                 mem_verdict_name(per[i].verdict));
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+// HTTP GET handler for the binary trace dump (decode with tools/trace_decode.py)
+static esp_err_t trace_get_handler(httpd_req_t *req)
+{
+    static uint8_t buf[TRACE_DUMP_MAX_SIZE];
+    size_t len = trace_dump(buf, sizeof(buf));
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    return httpd_resp_send(req, (const char *)buf, len);
+}
+
+// HTTP GET handler for Prometheus metrics
+static esp_err_t metrics_emit(void *ctx, const char *buf, size_t len)
+{
+    return httpd_resp_send_chunk(ctx, buf, len);
+}
+
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    static char buf[METRICS_CHUNK];
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t err = metrics_write(buf, sizeof(buf), metrics_emit, req);
+    if (err != ESP_OK) {
+        // Failing closes the socket mid-chunk: the scraper sees a broken
+        // response, never a short one it would take as complete
+        ESP_LOGE(TAG, "/metrics: %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Handlers whose latency goes into a metrics histogram
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    metric_hist_t hist;
+} timed_handler_t;
+
+static const timed_handler_t timed_assets = { asset_get_handler, METRIC_HIST_HTTP_ROOT };
+static const timed_handler_t timed_spray = { spray_get_handler, METRIC_HIST_HTTP_SPRAY };
+static const timed_handler_t timed_stop = { stop_get_handler, METRIC_HIST_HTTP_STOP };
+static const timed_handler_t timed_classify = { classify_post_handler, METRIC_HIST_HTTP_CLASSIFY };
+static const timed_handler_t timed_upload = { upload_post_handler, METRIC_HIST_HTTP_UPLOAD };
+
+static esp_err_t timed_handler(httpd_req_t *req)
+{
+    const timed_handler_t *t = req->user_ctx;
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = t->handler(req);
+
+    metrics_observe_us(t->hist, (uint32_t)(esp_timer_get_time() - start));
+    metrics_inc(METRIC_HTTP_REQUESTS);
+    return ret;
+}
+
+// Start HTTP server
+httpd_handle_t start_webserver(void)
+{
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.stack_size = CONFIG_PLANTDOC_HTTPD_STACK;
+    config.max_uri_handlers = 24;
+    // Each page holds a /ws and an /events socket open: room for every
+    // station (MAX_STA_CONN) plus ordinary requests. Needs
+    // CONFIG_LWIP_MAX_SOCKETS >= max_open_sockets + 3.
+    config.max_open_sockets = 13;
+    config.uri_match_fn = httpd_uri_match_wildcard;  // For the "/*" asset fallback
+    httpd_handle_t server = NULL;
+
+    if (httpd_start(&server, &config) == ESP_OK) {
+        // Spray endpoint
+        httpd_uri_t spray = {
+            .uri       = "/spray",
+            .method    = HTTP_GET,
+            .handler   = timed_handler,
+            .user_ctx  = (void *)&timed_spray
+        };
+        httpd_register_uri_handler(server, &spray);
+
+        // Stop endpoint
+        httpd_uri_t stop = {
+            .uri       = "/stop",
+            .method    = HTTP_GET,
+            .handler   = timed_handler,
+            .user_ctx  = (void *)&timed_stop
+        };
+        httpd_register_uri_handler(server, &stop);
+
+        // Spray program endpoints
+        httpd_uri_t program = {
+            .uri       = "/program",
+            .method    = HTTP_POST,
+            .handler   = program_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &program);
+
+        httpd_uri_t program_run = {
+            .uri       = "/program/run",
+            .method    = HTTP_GET,
+            .handler   = program_run_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &program_run);
+
+        // On-device classification endpoint
+        httpd_uri_t classify = {
+            .uri       = "/classify",
+            .method    = HTTP_POST,
+            .handler   = timed_handler,
+            .user_ctx  = (void *)&timed_classify
+        };
+        httpd_register_uri_handler(server, &classify);
+
+        httpd_uri_t upload = {
+            .uri       = "/upload",
+            .method    = HTTP_POST,
+            .handler   = timed_handler,
+            .user_ctx  = (void *)&timed_upload
+        };
+        httpd_register_uri_handler(server, &upload);
+
+        // PWM profile endpoint
+        httpd_uri_t pwm = {
+            .uri       = "/pwm",
+            .method    = HTTP_GET,
+            .handler   = pwm_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &pwm);
+
+        // Drive mode endpoint (direction, stop mode)
+        httpd_uri_t drive = {
+            .uri       = "/drive",
+            .method    = HTTP_GET,
+            .handler   = drive_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &drive);
+
+        // Pump calibration endpoint
+        httpd_uri_t calibrate = {
+            .uri       = "/calibrate",
+            .method    = HTTP_GET,
+            .handler   = calibrate_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &calibrate);
+
+        // Prometheus metrics endpoint
+        httpd_uri_t metrics = {
+            .uri       = "/metrics",
+            .method    = HTTP_GET,
+            .handler   = metrics_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &metrics);
+
+        // Control latency endpoint
+        httpd_uri_t latency = {
+            .uri       = "/latency",
+            .method    = HTTP_GET,
+            .handler   = latency_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &latency);
+
+        // Sensor readings endpoint
+        httpd_uri_t sensors = {
+            .uri       = "/sensors",
+            .method    = HTTP_GET,
+            .handler   = sensors_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &sensors);
+
+        // Recorded history endpoint
+        httpd_uri_t history = {
+            .uri       = "/history",
+            .method    = HTTP_GET,
+            .handler   = history_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &history);
+
+        // Persisted state endpoint
+        httpd_uri_t journal = {
+            .uri       = "/journal",
+            .method    = HTTP_GET,
+            .handler   = journal_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &journal);
+
+        // Boot timing endpoint
+        httpd_uri_t boot = {
+            .uri       = "/boot",
+            .method    = HTTP_GET,
+            .handler   = boot_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &boot);
+
+        // Stack budget endpoint
+        httpd_uri_t budget = {
+            .uri       = "/budget",
+            .method    = HTTP_GET,
+            .handler   = budget_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &budget);
+
+        // Firmware update endpoint
+        httpd_uri_t ota = {
+            .uri       = "/ota",
+            .method    = HTTP_POST,
+            .handler   = ota_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &ota);
+
+        // Binary trace dump endpoint
+        httpd_uri_t trace = {
+            .uri       = "/trace",
+            .method    = HTTP_GET,
+            .handler   = trace_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &trace);
+
+        // Persistent WebSocket control channel
+        ws_control_register(server);
+
+        // Pump state push to every open page
+        state_events_register(server);
+
+        // Web UI files; matches every path, so it must come last
+        httpd_uri_t assets = {
+            .uri       = "/*",
+            .method    = HTTP_GET,
+            .handler   = timed_handler,
+            .user_ctx  = (void *)&timed_assets
+        };
+        httpd_register_uri_handler(server, &assets);
+
+        mem_task_adopt("httpd", config.stack_size);
+        ESP_LOGI(TAG, "HTTP server started");
+    }
+
+    return server;
+}
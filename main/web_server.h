@@ -0,0 +1,23 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+// Start the HTTP server and register the UI and pump endpoints
+httpd_handle_t start_webserver(void);
+
+// Read a string query parameter from the request URL
+esp_err_t web_query_str(httpd_req_t *req, const char *key, char *out, size_t size);
+
+// Read an integer query parameter from the request URL.
+// Returns ESP_ERR_NOT_FOUND if absent, ESP_ERR_INVALID_ARG if not a number
+// or out of int range.
+esp_err_t web_query_int(httpd_req_t *req, const char *key, int *out);
+
+// Receive the next piece of the request body, retrying a few socket
+// timeouts. Returns the bytes read, 0 if the client closed, or -1 if it
+// failed or stalled.
+int web_recv(httpd_req_t *req, void *buf, size_t len);
+
+// Read the whole request body into buf as a NUL-terminated string.
+// Returns ESP_ERR_INVALID_SIZE if it doesn't fit.
+esp_err_t web_recv_body(httpd_req_t *req, char *buf, size_t size);
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "esp_log.h"
+#include "pump.h"
+#include "pump_ctrl.h"
+#include "trace.h"
+#include "ws_control.h"
+
+static const char *TAG = "ws_control";
+
+#define WS_REQ_LEN      3
+#define WS_RESP_LEN     4
+
+static uint8_t ws_apply(uint8_t op, uint8_t value)
+{
+    switch (op) {
+    case WS_OP_SPEED:
+        if (pump_ctrl_set_speed(value) != ESP_OK) {
+            trace_event(TRACE_HTTP_SPRAY_BUSY, value, 0);
+            return WS_STATUS_BUSY;
+        }
+        trace_event(TRACE_WS_SPEED, value, 0);
+        return WS_STATUS_OK;
+    case WS_OP_STOP:
+        pump_ctrl_stop();
+        trace_event(TRACE_WS_STOP, 0, 0);
+        return WS_STATUS_OK;
+    case WS_OP_QUERY:
+        return WS_STATUS_OK;
+    default:
+        return WS_STATUS_BAD;
+    }
+}
+
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET) {
+        return ESP_OK;                // Handshake done by httpd
+    }
+
+    uint8_t buf[WS_REQ_LEN];
+    httpd_ws_frame_t frame = {
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = NULL
+    };
+
+    // Peek the length first so an oversized frame can't overrun buf
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (frame.len != WS_REQ_LEN || frame.type != HTTPD_WS_TYPE_BINARY) {
+        return ESP_ERR_INVALID_SIZE;  // Drops the connection
+    }
+    frame.payload = buf;
+    err = httpd_ws_recv_frame(req, &frame, sizeof(buf));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // The commanded speed, as the UDP ack has it, not the duty applied so
+    // far. A command accepted here is only queued to the control task,
+    // which is what sets pump_get_command(), so it answers for itself.
+    uint8_t status = ws_apply(buf[0], buf[2]);
+    uint8_t speed = pump_get_command(0);
+    if (status == WS_STATUS_OK && buf[0] == WS_OP_SPEED) {
+        speed = buf[2];
+    } else if (status == WS_STATUS_OK && buf[0] == WS_OP_STOP) {
+        speed = 0;
+    }
+    uint8_t resp[WS_RESP_LEN] = { buf[0] | 0x80, buf[1], status, speed };
+    httpd_ws_frame_t out = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = resp,
+        .len = sizeof(resp)
+    };
+    return httpd_ws_send_frame(req, &out);
+}
+
+esp_err_t ws_control_register(httpd_handle_t server)
+{
+    httpd_uri_t ws = {
+        .uri          = "/ws",
+        .method       = HTTP_GET,
+        .handler      = ws_handler,
+        .user_ctx     = NULL,
+        .is_websocket = true
+    };
+    esp_err_t err = httpd_register_uri_handler(server, &ws);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /ws: %s", esp_err_to_name(err));
+    }
+    return err;
+}
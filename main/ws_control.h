@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+// WebSocket control channel at /ws.
+//
+// Clients keep one connection open and send 3-byte binary frames instead of
+// an HTTP request per command:
+//
+//   request:  [op][seq][value]        op 'S' = set speed (value 0-255)
+//                                     op 'X' = stop      (value ignored)
+//                                     op 'Q' = query state only
+//   response: [op | 0x80][seq][status][speed]
+//
+// status is WS_STATUS_*; speed is the speed last commanded on channel 0,
+// including this request's (pump_get_command(), before compensation), not
+// the duty the pump has reached.
+// The plain /spray and /stop GET endpoints remain for older clients.
+
+#define WS_OP_SPEED     'S'
+#define WS_OP_STOP      'X'
+#define WS_OP_QUERY     'Q'
+
+#define WS_STATUS_OK    0
+#define WS_STATUS_BUSY  1             // Control ring full, retry
+#define WS_STATUS_BAD   2             // Unknown op or malformed frame
+
+// Register the /ws handler on a running server
+esp_err_t ws_control_register(httpd_handle_t server);
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# Pack the web UI directory into an image for the "assets" partition.
+#
+# Layout (main/assets.h): a 16-byte header, an 80-byte table of contents
+# entry per file sorted by path, then the file data, each file 4-byte
+# aligned. Files are gzipped unless that doesn't make them smaller; the
+# gzip timestamp is zeroed so identical input always produces an identical
+# image (and therefore identical ETags on the device).
+#
+# Usage: asset_pack.py <dir> <assets.bin> [partition size]
+#        asset_pack.py --list <assets.bin>
+
+import gzip
+import mimetypes
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = 0x31414450                    # "PDA1"
+VERSION = 1
+HDR = struct.Struct('<IHHII')         # assets_hdr_t
+ENTRY = struct.Struct('<40s24sIIII')  # assets_entry_t
+PATH_MAX = 40
+TYPE_MAX = 24
+FLAG_GZIP = 0x1
+
+TYPES = {
+    '.html': 'text/html',
+    '.js': 'application/javascript',
+    '.css': 'text/css',
+    '.json': 'application/json',
+    '.svg': 'image/svg+xml',
+    '.png': 'image/png',
+    '.ico': 'image/x-icon',
+}
+
+
+def collect(root):
+    files = []
+    for dirpath, _, names in os.walk(root):
+        for name in names:
+            full = os.path.join(dirpath, name)
+            path = '/' + os.path.relpath(full, root).replace(os.sep, '/')
+            if len(path) >= PATH_MAX:
+                sys.exit('%s: path longer than %d bytes' % (path, PATH_MAX - 1))
+            ext = os.path.splitext(name)[1].lower()
+            ctype = TYPES.get(ext) or mimetypes.guess_type(name)[0] or 'application/octet-stream'
+            if len(ctype) >= TYPE_MAX:
+                sys.exit('%s: content type %s too long' % (path, ctype))
+            with open(full, 'rb') as f:
+                files.append((path, ctype, f.read()))
+    # Sorted by the bytes the device compares with strcmp
+    return sorted(files, key=lambda f: f[0].encode())
+
+
+def pack(files):
+    data_start = HDR.size + ENTRY.size * len(files)
+    toc, blobs = [], []
+    offset = data_start
+
+    for path, ctype, raw in files:
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        flags = FLAG_GZIP
+        if len(packed) >= len(raw):
+            packed, flags = raw, 0
+        toc.append(ENTRY.pack(path.encode(), ctype.encode(), offset, len(packed),
+                              zlib.crc32(packed), flags))
+        pad = -len(packed) % 4
+        blobs.append(packed + b'\0' * pad)
+        offset += len(packed) + pad
+
+    body = b''.join(toc) + b''.join(blobs)
+    return HDR.pack(MAGIC, VERSION, len(files), HDR.size + len(body), zlib.crc32(body)) + body
+
+
+def list_image(image):
+    magic, version, count, size, crc = HDR.unpack_from(image, 0)
+    if magic != MAGIC or version != VERSION:
+        sys.exit('not an asset image (magic %08x, version %d)' % (magic, version))
+    ok = size <= len(image) and zlib.crc32(image[HDR.size:size]) == crc
+    print('%d files, %d bytes, crc %s' % (count, size, 'ok' if ok else 'BAD'))
+    for i in range(count):
+        path, ctype, offset, length, fcrc, flags = ENTRY.unpack_from(image, HDR.size + i * ENTRY.size)
+        print('  %-30s %-24s %7d bytes at %6d %08x%s' %
+              (path.rstrip(b'\0').decode(), ctype.rstrip(b'\0').decode(), length, offset, fcrc,
+               ' gzip' if flags & FLAG_GZIP else ''))
+
+
+def main():
+    if len(sys.argv) == 3 and sys.argv[1] == '--list':
+        with open(sys.argv[2], 'rb') as f:
+            list_image(f.read())
+        return
+    if len(sys.argv) not in (3, 4):
+        sys.exit('usage: asset_pack.py <dir> <assets.bin> [partition size] | --list <assets.bin>')
+
+    files = collect(sys.argv[1])
+    image = pack(files)
+    if len(sys.argv) == 4 and len(image) > int(sys.argv[3], 0):
+        sys.exit('assets: %d bytes do not fit the %s byte partition' % (len(image), sys.argv[3]))
+
+    with open(sys.argv[2], 'wb') as f:
+        f.write(image)
+
+    raw = sum(len(f[2]) for f in files)
+    print('assets: %d files, %d -> %d bytes' % (len(files), raw, len(image)))
+
+
+if __name__ == '__main__':
+    main()
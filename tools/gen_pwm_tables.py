@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+# Generate the PWM linearization tables from main/pwm_profiles.csv.
+#
+# Each profile gets a 256-entry table mapping the 8-bit speed command to a
+# duty in the profile's resolution, so the pump hot path is one table load.
+# Tables are checked for monotonicity here, at build time.
+#
+# Usage: gen_pwm_tables.py <pwm_profiles.csv> <pwm_tables.h>
+
+import csv
+import sys
+
+LEDC_SRC_CLK_HZ = 80000000            # APB clock
+
+
+def load_profiles(path):
+    profiles = []
+    with open(path) as f:
+        rows = (line for line in f if line.strip() and not line.lstrip().startswith('#'))
+        for row in csv.reader(rows, skipinitialspace=True):
+            name, freq, bits, dead, gamma = row
+            profiles.append((name, int(freq), int(bits), float(dead), float(gamma)))
+    return profiles
+
+
+def build_table(bits, dead_zone, gamma):
+    top = (1 << bits) - 1
+    dead = dead_zone * top
+    table = [0]
+    for speed in range(1, 256):
+        table.append(int(round(dead + (top - dead) * (speed / 255.0) ** gamma)))
+    return table
+
+
+def check(name, freq, bits, table):
+    if not 1 <= bits <= 20:
+        sys.exit('%s: unsupported resolution %d bits' % (name, bits))
+    if (LEDC_SRC_CLK_HZ // freq) < (1 << bits):
+        sys.exit('%s: %d Hz is too fast for %d bits' % (name, freq, bits))
+    for i in range(1, len(table)):
+        if table[i] < table[i - 1]:
+            sys.exit('%s: table not monotonic at speed %d' % (name, i))
+    if table[0] != 0 or table[-1] != (1 << bits) - 1:
+        sys.exit('%s: table must span 0..full duty' % name)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: gen_pwm_tables.py <pwm_profiles.csv> <pwm_tables.h>')
+
+    profiles = load_profiles(sys.argv[1])
+    if not profiles:
+        sys.exit('no PWM profiles defined')
+
+    out = ['// Generated by tools/gen_pwm_tables.py from main/pwm_profiles.csv, do not edit',
+           '#pragma once',
+           '',
+           '#include "pwm_profile.h"',
+           '']
+    for name, freq, bits, dead, gamma in profiles:
+        table = build_table(bits, dead, gamma)
+        check(name, freq, bits, table)
+        out.append('static const uint16_t pwm_lut_%s[256] = {' % name)
+        for i in range(0, 256, 12):
+            out.append('    ' + ', '.join('%d' % v for v in table[i:i + 12]) + ',')
+        out.append('};')
+        out.append('')
+
+    out.append('#define PWM_PROFILE_COUNT %d' % len(profiles))
+    out.append('')
+    out.append('static const pwm_profile_t pwm_profiles[PWM_PROFILE_COUNT] = {')
+    for name, freq, bits, _, _ in profiles:
+        out.append('    { "%s", %d, %d, pwm_lut_%s },' % (name, freq, bits, name))
+    out.append('};')
+    out.append('')
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+# Memory budget report: every static RAM region the app owns and every task
+# stack, from the linker map, the sources and sdkconfig.
+#
+# Static regions are the app's (libmain.a) .bss/.data/.dram input sections in
+# the map, by source file, largest first. Task stacks are the MEM_TASK()
+# declarations in main/*.c (main/mem_budget.h), sized through the file's
+# #defines, plus the framework tasks whose stacks sdkconfig sets. A task
+# whose mem_task_t the linker dropped isn't built (its feature is off).
+# With CONFIG_PLANTDOC_STATIC_ALLOC the app's stacks are static regions
+# themselves; they are marked as such and counted once. Wi-Fi buffers are
+# estimated from their sdkconfig counts.
+#
+# The running device reports the other half, each stack's high-water mark,
+# at /budget.
+#
+# Usage: mem_budget.py <app.map> <main dir> <sdkconfig> [report.txt]
+
+import glob
+import os
+import re
+import sys
+
+RAM_SECTIONS = ('.bss', '.sbss', '.data', '.sdata', '.dram1', '.noinit', 'COMMON')
+APP_LIB = 'libmain.a('
+WIFI_BUF = 1600                       # Bytes per Wi-Fi RX/TX buffer, as the IDF docs size them
+
+# (task, sdkconfig key, instances)
+FRAMEWORK_TASKS = [
+    ('main', 'CONFIG_ESP_MAIN_TASK_STACK_SIZE', 1),
+    ('httpd', 'CONFIG_PLANTDOC_HTTPD_STACK', 1),
+    ('tiT', 'CONFIG_LWIP_TCPIP_TASK_STACK_SIZE', 1),
+    ('sys_evt', 'CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE', 1),
+    ('esp_timer', 'CONFIG_ESP_TIMER_TASK_STACK_SIZE', 1),
+    ('ipc', 'CONFIG_ESP_IPC_TASK_STACK_SIZE', 2),
+    ('IDLE', 'CONFIG_FREERTOS_IDLE_TASK_STACKSIZE', 2),
+    ('Tmr Svc', 'CONFIG_FREERTOS_TIMER_TASK_STACK_DEPTH', 1),
+]
+
+MEM_TASK_RE = re.compile(r'^MEM_TASK\((\w+),\s*"([^"]+)",\s*([^;]+)\);', re.M)
+DEFINE_RE = re.compile(r'^#define\s+(\w+)\s+([^/\n]+)', re.M)
+
+
+def read_sdkconfig(text):
+    config = {}
+    for line in text.splitlines():
+        key, sep, value = line.partition('=')
+        if sep and key.startswith('CONFIG_'):
+            value = value.strip().strip('"')
+            config[key] = int(value, 0) if re.fullmatch(r'-?(0x[0-9a-fA-F]+|\d+)', value) else value
+    return config
+
+
+def parse_map(text):
+    """The app's RAM input sections: [(module, name, size)]"""
+    regions = []
+    start = text.find('Linker script and memory map')
+    lines = text[start:].splitlines() if start >= 0 else []
+    pending = None                    # Section name waiting for its address line
+
+    for i, line in enumerate(lines):
+        fields = line.split()
+        if line.startswith(' ') and not line.startswith('  ') and fields:
+            # " .bss.ring  0x3ffb1234  0x400 libmain.a(pump_ctrl.c.obj)", or the
+            # name alone when it's too long and the rest on the next line
+            pending = fields[0]
+            fields = fields[1:]
+            if not fields:
+                continue
+        elif pending is None or len(fields) < 3:
+            continue
+
+        name, pending = pending, None
+        if len(fields) < 3 or not fields[0].startswith('0x') or APP_LIB not in fields[2]:
+            continue
+        if not name.startswith(RAM_SECTIONS):
+            continue
+        size = int(fields[1], 16)
+        if size == 0:
+            continue
+        module = fields[2][fields[2].index(APP_LIB) + len(APP_LIB):].rstrip(')')
+        module = module.replace('.c.obj', '.c').replace('.obj', '')
+        symbol = name.split('.', 2)[2] if name.count('.') >= 2 else name
+        # Sections like .dram1.3 say nothing; the symbol line after them does
+        if symbol.isdigit() and i + 1 < len(lines):
+            after = lines[i + 1].split()
+            if len(after) == 2 and after[0].startswith('0x'):
+                symbol = after[1]
+        regions.append((module, symbol, size))
+    return regions
+
+
+def eval_size(expr, defines, config):
+    """Evaluate a stack size expression through #defines and sdkconfig"""
+    for _ in range(8):
+        names = re.findall(r'[A-Za-z_]\w*', expr)
+        if not names:
+            break
+        for n in names:
+            if n in defines:
+                expr = re.sub(r'\b%s\b' % n, '(%s)' % defines[n], expr)
+            elif n in config:
+                expr = re.sub(r'\b%s\b' % n, str(config[n]), expr)
+            else:
+                raise ValueError('unknown name %s in %s' % (n, expr))
+    return int(eval(expr, {'__builtins__': {}}))
+
+
+def parse_tasks(sources, config):
+    """MEM_TASK() declarations: [(module, var, task name, stack bytes)]"""
+    tasks = []
+    for module, text in sources:
+        defines = {m.group(1): m.group(2).strip() for m in DEFINE_RE.finditer(text)}
+        for m in MEM_TASK_RE.finditer(text):
+            tasks.append((module, m.group(1), m.group(2), eval_size(m.group(3), defines, config)))
+    return tasks
+
+
+def aggregate(regions, tasks, config):
+    """Sort everything into the report's sections and total it up"""
+    static_alloc = config.get('CONFIG_PLANTDOC_STATIC_ALLOC') == 'y'
+    by_name = {(m, s): size for m, s, size in regions}
+    stack_regions = {}                # (module, symbol): note
+    app_tasks = []
+
+    for module, var, name, size in tasks:
+        built = (module, var) in by_name
+        placed = static_alloc and (module, var + '_stack') in by_name
+        if placed:
+            stack_regions[(module, var + '_stack')] = 'stack of ' + name
+            stack_regions[(module, var + '_tcb')] = 'TCB of ' + name
+        app_tasks.append({'name': name, 'module': module, 'stack': size, 'built': built,
+                          'static': placed})
+
+    modules = {}
+    for module, symbol, size in regions:
+        entry = modules.setdefault(module, {'total': 0, 'regions': []})
+        entry['total'] += size
+        entry['regions'].append((symbol, size, stack_regions.get((module, symbol), '')))
+    for entry in modules.values():
+        entry['regions'].sort(key=lambda r: -r[1])
+
+    framework = []
+    for name, key, count in FRAMEWORK_TASKS:
+        if isinstance(config.get(key), int):
+            framework.append({'name': name, 'stack': config[key], 'count': count})
+
+    wifi = {
+        'rx_static': config.get('CONFIG_ESP_WIFI_STATIC_RX_BUFFER_NUM', 0) * WIFI_BUF,
+        'rx_dynamic_max': config.get('CONFIG_ESP_WIFI_DYNAMIC_RX_BUFFER_NUM', 0) * WIFI_BUF,
+        'tx_static': 0,
+        'tx_dynamic_max': 0,
+    }
+    if config.get('CONFIG_ESP_WIFI_STATIC_TX_BUFFER') == 'y':
+        wifi['tx_static'] = config.get('CONFIG_ESP_WIFI_STATIC_TX_BUFFER_NUM', 0) * WIFI_BUF
+    else:
+        wifi['tx_dynamic_max'] = config.get('CONFIG_ESP_WIFI_DYNAMIC_TX_BUFFER_NUM', 0) * WIFI_BUF
+
+    built = [t for t in app_tasks if t['built']]
+    totals = {
+        'static': sum(m['total'] for m in modules.values()),
+        'app_stacks_static': sum(t['stack'] for t in built if t['static']),
+        'app_stacks_heap': sum(t['stack'] for t in built if not t['static']),
+        'framework_stacks': sum(t['stack'] * t['count'] for t in framework),
+        'wifi_init': wifi['rx_static'] + wifi['tx_static'],
+        'wifi_dynamic_max': wifi['rx_dynamic_max'] + wifi['tx_dynamic_max'],
+    }
+    # Static stacks are already part of the static regions
+    totals['committed'] = (totals['static'] + totals['app_stacks_heap'] +
+                           totals['framework_stacks'] + totals['wifi_init'])
+    return {'static_alloc': static_alloc, 'modules': modules, 'tasks': app_tasks,
+            'framework': framework, 'wifi': wifi, 'totals': totals}
+
+
+def format_report(r):
+    out = []
+    t = r['totals']
+    out.append('Memory budget (%s task stacks)' % ('static' if r['static_alloc'] else 'heap'))
+    out.append('')
+    out.append('Static regions, app: %d bytes' % t['static'])
+    for module, entry in sorted(r['modules'].items(), key=lambda m: -m[1]['total']):
+        out.append('  %-20s %8d' % (module, entry['total']))
+        for symbol, size, note in entry['regions']:
+            out.append(('    %-30s %8d  %s' % (symbol, size, note)).rstrip())
+    out.append('')
+    out.append('Task stacks, app')
+    for task in r['tasks']:
+        where = 'static' if task['static'] else 'heap' if task['built'] else 'not built'
+        out.append('  %-12s %-18s %6d  %s' % (task['name'], task['module'], task['stack'], where))
+    out.append('Task stacks, framework')
+    for task in r['framework']:
+        out.append('  %-12s %-18s %6d%s' % (task['name'], 'sdkconfig', task['stack'],
+                                            ' x%d' % task['count'] if task['count'] > 1 else ''))
+    out.append('')
+    w = r['wifi']
+    out.append('Wi-Fi buffers (estimate): %d at init (RX %d, TX %d), up to %d more on demand' %
+               (t['wifi_init'], w['rx_static'], w['tx_static'], t['wifi_dynamic_max']))
+    out.append('')
+    out.append('Static regions          %8d' % t['static'])
+    out.append('  of which task stacks  %8d' % t['app_stacks_static'])
+    out.append('App stacks from heap    %8d' % t['app_stacks_heap'])
+    out.append('Framework stacks        %8d' % t['framework_stacks'])
+    out.append('Wi-Fi buffers at init   %8d' % t['wifi_init'])
+    out.append('Committed               %8d' % t['committed'])
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    if len(sys.argv) not in (4, 5):
+        sys.exit('usage: mem_budget.py <app.map> <main dir> <sdkconfig> [report.txt]')
+
+    with open(sys.argv[3]) as f:
+        config = read_sdkconfig(f.read())
+    with open(sys.argv[1]) as f:
+        regions = parse_map(f.read())
+    sources = []
+    for path in sorted(glob.glob(os.path.join(sys.argv[2], '*.c'))):
+        with open(path) as f:
+            sources.append((os.path.basename(path), f.read()))
+
+    report = format_report(aggregate(regions, parse_tasks(sources, config), config))
+    sys.stdout.write(report)
+    if len(sys.argv) == 5:
+        with open(sys.argv[4], 'w') as f:
+            f.write(report)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+# Quantize a float model description (main/model/*.json) into the int8 blob
+# read by main/nn.c.
+#
+# Activations are per-tensor: ReLU outputs use [0, out_max] over the full
+# int8 range (zero point -128), the logits layer is symmetric. Weights are
+# symmetric per output channel. The input zero point is folded into each
+# bias, and every layer's scale ratio becomes a Q31 multiplier + shift.
+#
+# Usage: nn_pack.py <model.json> <model.bin>
+
+import json
+import math
+import struct
+import sys
+
+MAGIC = 0x31304e4e
+OPS = {'conv': 0, 'dwconv': 1, 'gap': 2, 'fc': 3}
+HEADER = struct.Struct('<IHHHHHbBfb3xII')
+LAYER = struct.Struct('<BBBBHHHHHHbb2xIIII')
+LABEL_LEN = 32
+LABEL = struct.Struct('<%ds%ds%ds%dsB3x' % ((LABEL_LEN,) * 4))
+
+
+def quant_multiplier(m):
+    mant, exp = math.frexp(m)
+    q = int(round(mant * (1 << 31)))
+    if q == 1 << 31:
+        q //= 2
+        exp += 1
+    shift = -exp
+    if not -30 <= shift <= 127:
+        sys.exit('requant scale %g out of range' % m)
+    return q, shift
+
+
+def same_out(n, s):
+    return (n + s - 1) // s
+
+
+def label_str(s):
+    b = s.encode()
+    if len(b) >= LABEL_LEN:
+        sys.exit('label "%s" too long' % s)
+    return b
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: nn_pack.py <model.json> <model.bin>')
+    model = json.load(open(sys.argv[1]))
+    h, w, c = model['input']
+    labels, layers = model['labels'], model['layers']
+
+    layers_off = HEADER.size
+    labels_off = layers_off + LAYER.size * len(layers)
+    data = bytearray()
+    data_base = labels_off + LABEL.size * len(labels)
+
+    def put(raw):
+        while (data_base + len(data)) % 4:
+            data.append(0)
+        off = data_base + len(data)
+        data.extend(raw)
+        return off
+
+    in_scale, in_zp = 1.0 / 255.0, -128
+    records = []
+    for i, l in enumerate(layers):
+        op = l['op']
+        k = l.get('kernel', 1)
+        s = l.get('stride', 1)
+        relu = bool(l.get('relu', False))
+        if op == 'gap':
+            oh, ow, oc = 1, 1, c
+            out_scale, out_zp = in_scale, in_zp
+            records.append(LAYER.pack(OPS[op], 1, 1, 0, h, w, c, oh, ow, oc,
+                                      in_zp, out_zp, 0, 0, 0, 0))
+            h, w, c = oh, ow, oc
+            continue
+
+        if op == 'fc':
+            if h * w != 1:
+                sys.exit('layer %d: fc needs a 1x1 input' % i)
+            oh, ow, oc = 1, 1, l['out_c']
+        else:
+            oh, ow = same_out(h, s), same_out(w, s)
+            oc = c if op == 'dwconv' else l['out_c']
+        if relu:
+            out_scale, out_zp = l['out_max'] / 255.0, -128
+        else:
+            out_scale, out_zp = l['out_max'] / 127.0, 0
+
+        wt, bias = l['weights'], l['bias']
+        per_oc = len(wt) // oc
+        if op == 'dwconv':
+            # Stored [k][k][c]: channel ch is every c-th weight
+            chan = [[wt[t * c + ch] for t in range(9)] for ch in range(c)]
+        else:
+            chan = [wt[o * per_oc:(o + 1) * per_oc] for o in range(oc)]
+
+        wq_chan, b_q, mults, shifts = [], [], [], []
+        for o in range(oc):
+            top = max(abs(v) for v in chan[o]) or 1.0
+            w_scale = top / 127.0
+            q = [max(-127, min(127, int(round(v / w_scale)))) for v in chan[o]]
+            wq_chan.append(q)
+            b = int(round(bias[o] / (in_scale * w_scale))) - in_zp * sum(q)
+            b_q.append(b)
+            m, sh = quant_multiplier(in_scale * w_scale / out_scale)
+            mults.append(m)
+            shifts.append(sh)
+
+        if op == 'dwconv':
+            wq = [wq_chan[ch][t] for t in range(9) for ch in range(c)]
+        else:
+            wq = [v for q in wq_chan for v in q]
+
+        w_off = put(struct.pack('<%db' % len(wq), *wq))
+        b_off = put(struct.pack('<%di' % oc, *b_q))
+        m_off = put(struct.pack('<%di' % oc, *mults))
+        s_off = put(struct.pack('<%db' % oc, *shifts))
+        records.append(LAYER.pack(OPS[op], k, s, int(relu), h, w, c, oh, ow, oc,
+                                  in_zp, out_zp, w_off, b_off, m_off, s_off))
+        h, w, c = oh, ow, oc
+        in_scale, in_zp = out_scale, out_zp
+
+    if c != len(labels):
+        sys.exit('model has %d outputs but %d labels' % (c, len(labels)))
+
+    blob = bytearray(HEADER.pack(MAGIC, len(layers), len(labels), *model['input'],
+                                 -128, 0, in_scale, in_zp, layers_off, labels_off))
+    for r in records:
+        blob += r
+    for lab in labels:
+        blob += LABEL.pack(label_str(lab['name']), label_str(lab['plant']),
+                           label_str(lab['disease']), label_str(lab['treatment']),
+                           lab['pwm'])
+    blob += data
+    with open(sys.argv[2], 'wb') as f:
+        f.write(blob)
+
+
+if __name__ == '__main__':
+    main()
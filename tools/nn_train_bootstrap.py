@@ -0,0 +1,362 @@
+#!/usr/bin/env python3
+# Fit the bootstrap leaf classifier shipped in main/model/plant_cnn.json.
+#
+# There is no labelled dataset in the tree, only one photo per class
+# (main/www/tom.png and sugarcane.png, the UI's samples). The feature
+# layers are therefore fixed by hand: colour-opponent and edge filters,
+# blurs and seeded random 1x1 mixes. Only the final fully connected layer
+# is fitted, by logistic regression on augmented crops of the two photos.
+# The result is a placeholder that exercises the int8 engine end to end; a
+# properly trained model with the same layer types drops in through the
+# same JSON format.
+#
+# The last class, no_match, has PWM 0 and never sprays. It is fitted on
+# images that are neither photo: flat colours, gradients, noise, and the
+# photos with their colours swapped or drained. Without it a two-class
+# model calls anything at all one of the two diseases.
+#
+# Pure Python, no numpy. Usage: nn_train_bootstrap.py <repo_root> <out.json>
+
+import json
+import math
+import os
+import random
+import struct
+import sys
+import zlib
+
+SIZE = 32
+MIN_CONFIDENCE = 0.6                  # CLASSIFY_MIN_CONFIDENCE in main/classify.h
+
+LABELS = [
+    {'name': 'sugarcane_red_rot', 'image': 'main/www/sugarcane.png', 'plant': 'Sugarcane Leaf',
+     'disease': 'Red Rot', 'treatment': 'Chlorantraniliprole', 'pwm': 128},
+    {'name': 'tomato_early_blight', 'image': 'main/www/tom.png', 'plant': 'Tomato Leaf',
+     'disease': 'Early Blight', 'treatment': 'Mancozeb / Chlorothalonil', 'pwm': 179},
+    {'name': 'no_match', 'image': None, 'plant': 'Unknown', 'disease': 'None recognised',
+     'treatment': 'None', 'pwm': 0},
+]
+
+
+def decode_png(path):
+    data = open(path, 'rb').read()
+    pos, idat = 8, b''
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + length]
+        if kind == b'IHDR':
+            w, h, depth, ctype, _, _, interlace = struct.unpack('>IIBBBBB', body)
+            if depth != 8 or interlace or ctype not in (2, 6):
+                sys.exit('%s: only 8-bit non-interlaced RGB/RGBA' % path)
+        elif kind == b'IDAT':
+            idat += body
+        pos += 12 + length
+    raw = zlib.decompress(idat)
+    bpp = 4 if ctype == 6 else 3
+    stride = w * bpp
+    rows, prev, i = [], bytearray(stride), 0
+    for _ in range(h):
+        ftype, line = raw[i], bytearray(raw[i + 1:i + 1 + stride])
+        i += 1 + stride
+        for x in range(stride):
+            a = line[x - bpp] if x >= bpp else 0
+            b = prev[x]
+            c = prev[x - bpp] if x >= bpp else 0
+            if ftype == 1:
+                line[x] = (line[x] + a) & 255
+            elif ftype == 2:
+                line[x] = (line[x] + b) & 255
+            elif ftype == 3:
+                line[x] = (line[x] + (a + b) // 2) & 255
+            elif ftype == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                line[x] = (line[x] + (a if pa <= pb and pa <= pc else b if pb <= pc else c)) & 255
+        rows.append(bytes(line))
+        prev = line
+    return w, h, bpp, rows
+
+
+def crop(img, x0, y0, cw, ch, flip):
+    # Box-filter a crop down to SIZE x SIZE using a 4x4 sample grid per pixel
+    w, h, bpp, rows = img
+    out = []
+    for oy in range(SIZE):
+        for ox in range(SIZE):
+            acc = [0, 0, 0]
+            for sy in range(4):
+                y = y0 + ((oy * 4 + sy) * ch) // (SIZE * 4)
+                for sx in range(4):
+                    x = x0 + ((ox * 4 + sx) * cw) // (SIZE * 4)
+                    if flip:
+                        x = x0 + cw - 1 - (x - x0)
+                    p = rows[y][x * bpp:x * bpp + 3]
+                    acc[0] += p[0]
+                    acc[1] += p[1]
+                    acc[2] += p[2]
+            out.append(tuple(v / 16.0 / 255.0 for v in acc))
+    return out
+
+
+def samples(img, n, rng):
+    w, h = img[0], img[1]
+    out = [crop(img, 0, 0, w, h, False)]
+    while len(out) < n:
+        s = rng.uniform(0.5, 1.0)
+        cw, ch = int(w * s), int(h * s)
+        out.append(crop(img, rng.randrange(w - cw + 1), rng.randrange(h - ch + 1),
+                        cw, ch, rng.random() < 0.5))
+    return out
+
+
+def synthetic(photos, n, rng):
+    # Inputs the model must not take for either disease
+    def px(r, g, b):
+        return tuple(min(max(v, 0.0), 1.0) for v in (r, g, b))
+
+    def flat():
+        c = [rng.random() for _ in range(3)]
+        return [px(*(v + rng.gauss(0, 0.02) for v in c)) for _ in range(SIZE * SIZE)]
+
+    def gradient():
+        a, b = [rng.random() for _ in range(3)], [rng.random() for _ in range(3)]
+        vertical = rng.random() < 0.5
+        out = []
+        for y in range(SIZE):
+            for x in range(SIZE):
+                t = (y if vertical else x) / (SIZE - 1.0)
+                out.append(px(*(a[i] + (b[i] - a[i]) * t for i in range(3))))
+        return out
+
+    def noise():
+        c, amp = [rng.random() for _ in range(3)], rng.uniform(0.1, 1.0)
+        return [px(*(v + amp * (rng.random() - 0.5) for v in c)) for _ in range(SIZE * SIZE)]
+
+    def tiles():
+        t = rng.choice((4, 8))
+        cols = {}
+        out = []
+        for y in range(SIZE):
+            for x in range(SIZE):
+                key = (y // t, x // t)
+                if key not in cols:
+                    cols[key] = px(rng.random(), rng.random(), rng.random())
+                out.append(cols[key])
+        return out
+
+    def recoloured():
+        img = rng.choice(samples(rng.choice(photos), 2, rng))  # Whole or a random crop
+        order = rng.choice(((2, 1, 0), (1, 2, 0), (2, 0, 1), (1, 0, 2)))
+        return [px(*(p[i] for i in order)) for p in img]
+
+    def drained():
+        img = rng.choice(samples(rng.choice(photos), 2, rng))
+        return [px(*((0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2]),) * 3) for p in img]
+
+    kinds = (flat, gradient, noise, tiles, recoloured, drained)
+    return [kinds[i % len(kinds)]() for i in range(n)]
+
+
+# Float reference of the engine ops, tensors are flat HWC lists
+
+def same_pad(n, k, s):
+    out = (n + s - 1) // s
+    return out, max((out - 1) * s + k - n, 0) // 2
+
+
+def conv(x, h, w, c, layer):
+    k, s, oc_n = layer['kernel'], layer['stride'], layer['out_c']
+    oh, pt = same_pad(h, k, s)
+    ow, pl = same_pad(w, k, s)
+    wt, b = layer['weights'], layer['bias']
+    out = []
+    for oy in range(oh):
+        for ox in range(ow):
+            for oc in range(oc_n):
+                acc = b[oc]
+                for ky in range(k):
+                    iy = oy * s - pt + ky
+                    if not 0 <= iy < h:
+                        continue
+                    for kx in range(k):
+                        ix = ox * s - pl + kx
+                        if not 0 <= ix < w:
+                            continue
+                        base = (iy * w + ix) * c
+                        wb = ((oc * k + ky) * k + kx) * c
+                        for ic in range(c):
+                            acc += x[base + ic] * wt[wb + ic]
+                out.append(max(acc, 0.0) if layer['relu'] else acc)
+    return out, oh, ow, oc_n
+
+
+def dwconv(x, h, w, c, layer):
+    s = layer['stride']
+    oh, pt = same_pad(h, 3, s)
+    ow, pl = same_pad(w, 3, s)
+    wt, b = layer['weights'], layer['bias']
+    out = []
+    for oy in range(oh):
+        for ox in range(ow):
+            for ch in range(c):
+                acc = b[ch]
+                for ky in range(3):
+                    iy = oy * s - pt + ky
+                    for kx in range(3):
+                        ix = ox * s - pl + kx
+                        if 0 <= iy < h and 0 <= ix < w:
+                            acc += x[(iy * w + ix) * c + ch] * wt[(ky * 3 + kx) * c + ch]
+                out.append(max(acc, 0.0) if layer['relu'] else acc)
+    return out, oh, ow, c
+
+
+def gap(x, h, w, c):
+    return [sum(x[p * c + ch] for p in range(h * w)) / (h * w) for ch in range(c)], 1, 1, c
+
+
+def forward(layers, img, ranges=None):
+    x, h, w, c = [v for p in img for v in p], SIZE, SIZE, 3
+    for i, layer in enumerate(layers):
+        if layer['op'] == 'conv':
+            x, h, w, c = conv(x, h, w, c, layer)
+        elif layer['op'] == 'dwconv':
+            x, h, w, c = dwconv(x, h, w, c, layer)
+        elif layer['op'] == 'gap':
+            x, h, w, c = gap(x, h, w, c)
+        elif layer['op'] == 'fc':
+            x = [layer['bias'][o] + sum(x[i2] * layer['weights'][o * c + i2] for i2 in range(c))
+                 for o in range(layer['out_c'])]
+            h, w, c = 1, 1, layer['out_c']
+        if ranges is not None:
+            ranges[i] = max(ranges[i], max(abs(v) for v in x))
+    return x
+
+
+def feature_layers(rng):
+    # conv 3x3/2: colour channels, colour opponents and luminance edges
+    sobel_x = [-1, 0, 1, -2, 0, 2, -1, 0, 1]
+    sobel_y = [-1, -2, -1, 0, 0, 0, 1, 2, 1]
+    lum = (0.299, 0.587, 0.114)
+    centre = [(1.0, 0, 0), (0, 1.0, 0), (0, 0, 1.0),
+              (1.0, -1.0, 0), (-1.0, 1.0, 0), (0.5, 0.5, -1.0)]
+    w1 = []
+    for rgb in centre:
+        for t in range(9):
+            w1 += list(rgb) if t == 4 else [0.0, 0.0, 0.0]
+    for kern in (sobel_x, sobel_y):
+        for t in range(9):
+            w1 += [kern[t] * 0.25 * l for l in lum]
+    conv1 = {'op': 'conv', 'kernel': 3, 'stride': 2, 'relu': True, 'out_c': 8,
+             'weights': w1, 'bias': [0.0, 0.0, 0.0, 0.1, 0.1, 0.1, 0.0, 0.0]}
+
+    blur = [1, 2, 1, 2, 4, 2, 1, 2, 1]
+
+    def dw(c, stride):
+        return {'op': 'dwconv', 'kernel': 3, 'stride': stride, 'relu': True, 'out_c': c,
+                'weights': [blur[t] / 16.0 for t in range(9) for _ in range(c)],
+                'bias': [0.0] * c}
+
+    def mix(ic, oc):
+        wt = []
+        for o in range(oc):
+            for i in range(ic):
+                wt.append((1.0 if o == i else 0.0) + rng.gauss(0, 0.5 / math.sqrt(ic)))
+        return {'op': 'conv', 'kernel': 1, 'stride': 1, 'relu': True, 'out_c': oc,
+                'weights': wt, 'bias': [0.0] * oc}
+
+    return [conv1, dw(8, 1), mix(8, 16), dw(16, 2), mix(16, 16), {'op': 'gap'}]
+
+
+def fit_head(feats, labels, n_classes, epochs=1500, lr=0.5, l2=1e-3):
+    # Softmax regression on standardized features, folded back afterwards
+    n = len(feats[0])
+    mean = [sum(f[i] for f in feats) / len(feats) for i in range(n)]
+    std = [math.sqrt(sum((f[i] - mean[i]) ** 2 for f in feats) / len(feats)) or 1.0
+           for i in range(n)]
+    z = [[(f[i] - mean[i]) / std[i] for i in range(n)] for f in feats]
+    w = [[0.0] * n for _ in range(n_classes)]
+    b = [0.0] * n_classes
+    for _ in range(epochs):
+        gw = [[0.0] * n for _ in range(n_classes)]
+        gb = [0.0] * n_classes
+        for x, y in zip(z, labels):
+            logits = [b[k] + sum(w[k][i] * x[i] for i in range(n)) for k in range(n_classes)]
+            top = max(logits)
+            e = [math.exp(v - top) for v in logits]
+            tot = sum(e)
+            for k in range(n_classes):
+                g = e[k] / tot - (1.0 if k == y else 0.0)
+                gb[k] += g
+                for i in range(n):
+                    gw[k][i] += g * x[i]
+        for k in range(n_classes):
+            b[k] -= lr * gb[k] / len(z)
+            for i in range(n):
+                w[k][i] -= lr * (gw[k][i] / len(z) + l2 * w[k][i])
+    weights, bias = [], []
+    for k in range(n_classes):
+        weights += [w[k][i] / std[i] for i in range(n)]
+        bias.append(b[k] - sum(w[k][i] * mean[i] / std[i] for i in range(n)))
+    return {'op': 'fc', 'relu': False, 'out_c': n_classes, 'weights': weights, 'bias': bias}
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: nn_train_bootstrap.py <repo_root> <out.json>')
+    root, out_path = sys.argv[1], sys.argv[2]
+    rng = random.Random(1)
+    layers = feature_layers(rng)
+
+    train, test, photos = [], [], []
+    for cls, label in enumerate(LABELS):
+        if label['image'] is None:
+            crops = synthetic(photos, 120, rng)
+            train += [(c, cls) for c in crops[:96]]
+            test += [(c, cls) for c in crops[96:]]
+            continue
+        img = decode_png(os.path.join(root, label['image']))
+        photos.append(img)
+        crops = samples(img, 48, rng)
+        train += [(c, cls) for c in crops[:40]]
+        test += [(c, cls) for c in crops[40:]]
+
+    feats = [forward(layers, c) for c, _ in train]
+    layers.append(fit_head(feats, [y for _, y in train], len(LABELS)))
+
+    ranges = [0.0] * len(layers)
+    for name, subset in (('train', train), ('held-out', test)):
+        correct = [0] * len(LABELS)
+        total = [0] * len(LABELS)
+        sprays = 0                    # Not a photo, yet a confident disease
+        for c, y in subset:
+            logits = forward(layers, c, ranges)
+            top = max(logits)
+            best = logits.index(top)
+            conf = 1.0 / sum(math.exp(v - top) for v in logits)
+            correct[y] += best == y
+            total[y] += 1
+            sprays += LABELS[y]['pwm'] == 0 and LABELS[best]['pwm'] > 0 and conf >= MIN_CONFIDENCE
+        print('%-8s accuracy %d/%d (%s), false sprays %d' %
+              (name, sum(correct), len(subset),
+               ', '.join('%s %d/%d' % (l['name'], c, t) for l, c, t in zip(LABELS, correct, total)),
+               sprays))
+
+    for layer, r in zip(layers, ranges):
+        layer['out_max'] = round(r * 1.05, 6)   # Headroom over the calibration set
+    for layer in layers:
+        for key in ('weights', 'bias'):
+            if key in layer:
+                layer[key] = [round(v, 6) for v in layer[key]]
+
+    model = {
+        'input': [SIZE, SIZE, 3],
+        'labels': [{k: v for k, v in l.items() if k != 'image'} for l in LABELS],
+        'layers': layers,
+    }
+    with open(out_path, 'w') as f:
+        json.dump(model, f, indent=1)
+        f.write('\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# Update the firmware over the AP: POST the app image to /ota (main/ota.h).
+#
+# The image goes up with its HMAC-SHA256 under the key the firmware was
+# built with (CONFIG_PLANTDOC_OTA_KEY) in the X-Image-HMAC header; the
+# device only boots it if everything arrived and authenticates, then
+# restarts into it. The key comes from the environment, not the command
+# line, where other users could see it. Prints the device's timing: how
+# long the flash was busy and how long receiving waited for it.
+#
+# Usage: PLANTDOC_OTA_KEY=<key> ota_upload.py <host> <app.bin>
+#        (build/water_pump.bin after idf.py build)
+
+import hashlib
+import hmac
+import http.client
+import os
+import sys
+import time
+
+TIMEOUT_S = 60
+KEY_MIN, KEY_MAX = 16, 64             # main/ota.h
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: ota_upload.py <host> <app.bin>')
+
+    key = os.environ.get('PLANTDOC_OTA_KEY', '').encode()
+    if not KEY_MIN <= len(key) <= KEY_MAX:
+        sys.exit('set PLANTDOC_OTA_KEY to the firmware\'s CONFIG_PLANTDOC_OTA_KEY (%d to %d '
+                 'characters)' % (KEY_MIN, KEY_MAX))
+    host, path = sys.argv[1], sys.argv[2]
+    with open(path, 'rb') as f:
+        image = f.read()
+    if not image or image[0] != 0xE9:
+        sys.exit('%s: not an ESP app image' % path)
+
+    conn = http.client.HTTPConnection(host, 80, timeout=TIMEOUT_S)
+    start = time.perf_counter()
+    conn.request('POST', '/ota', body=image, headers={
+        'Content-Type': 'application/octet-stream',
+        'X-Image-HMAC': hmac.new(key, image, hashlib.sha256).hexdigest(),
+    })
+    resp = conn.getresponse()
+    body = resp.read().decode(errors='replace').strip()
+    elapsed = time.perf_counter() - start
+    conn.close()
+
+    if resp.status == 403:
+        sys.exit('refused: %s (is the firmware built with CONFIG_PLANTDOC_OTA and this key?)'
+                 % body)
+    if resp.status != 200:
+        sys.exit('update failed: %d %s' % (resp.status, body))
+    print('%d bytes in %.1f s (%.0f KB/s); device: %s' %
+          (len(image), elapsed, len(image) / elapsed / 1000, body))
+    print('restarting into the new firmware')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# Decode a binary trace dump from the device into readable log lines.
+#
+# Event names and formats come from main/trace_events.h, so the decoder
+# always matches the firmware it was checked out with.
+#
+# Usage: trace_decode.py <dump.bin | http://192.168.4.1/trace>
+
+import os
+import re
+import struct
+import sys
+import urllib.request
+
+EVENTS_H = os.path.join(os.path.dirname(__file__), '..', 'main', 'trace_events.h')
+
+HDR = struct.Struct('<IHHQ')          # trace_dump_hdr_t
+REC = struct.Struct('<IIHHI')         # trace_rec_t
+MAGIC = 0x31435254
+
+
+def load_events(path):
+    events = []
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'\s*TRACE_EVENT\(\s*(\w+)\s*,\s*"(.*)"\s*\)', line)
+            if m:
+                events.append((m.group(1), m.group(2)))
+    return events
+
+
+def fields(a0, a1):
+    mac = [a0 >> 8, a0 & 0xff, a1 >> 24, (a1 >> 16) & 0xff, (a1 >> 8) & 0xff, a1 & 0xff]
+    return {
+        'a0': a0,
+        'a1': a1,
+        'a0_pct': round(a0 * 100 / 255),
+        'a0_hi': a0 >> 8,
+        'a0_lo': a0 & 0xff,
+        'mac': ':'.join('%02x' % b for b in mac),
+    }
+
+
+def decode(data, events):
+    magic, rec_size, count, now_us = HDR.unpack_from(data, 0)
+    if magic != MAGIC or rec_size != REC.size:
+        sys.exit('not a trace dump (magic %08x, record size %d)' % (magic, rec_size))
+
+    recs = []
+    for i in range(count):
+        _, ts, ev, a0, a1 = REC.unpack_from(data, HDR.size + i * REC.size)
+        # Widen the 32-bit timestamp using the full dump time as reference
+        full_ts = now_us - ((now_us - ts) & 0xffffffff)
+        recs.append((full_ts, ev, a0, a1))
+
+    for ts, ev, a0, a1 in sorted(recs):
+        if ev < len(events):
+            name, fmt = events[ev]
+            text = fmt.format(**fields(a0, a1))
+        else:
+            name, text = 'EVENT_%d' % ev, 'a0=%d a1=%d' % (a0, a1)
+        print('%12.6f %-20s %s' % (ts / 1e6, name, text))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('usage: trace_decode.py <dump.bin | url>')
+
+    src = sys.argv[1]
+    if src.startswith('http://'):
+        data = urllib.request.urlopen(src).read()
+    else:
+        with open(src, 'rb') as f:
+            data = f.read()
+
+    decode(data, load_events(EVENTS_H))
+
+
+if __name__ == '__main__':
+    main()
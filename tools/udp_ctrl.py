@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+# Client and benchmark for the UDP control protocol (main/udp_ctrl.h).
+#
+# "bench" sends the same duty changes over UDP and over the HTTP /spray
+# endpoint, one at a time and waiting for each reply, and reports round
+# trip latency and commands per second for each. HTTP is measured both with
+# a new connection per command, as a shell script calling curl does, and
+# with one kept-alive connection.
+#
+# Usage: udp_ctrl.py <host[:port]> set <ch> <duty>
+#        udp_ctrl.py <host[:port]> stop
+#        udp_ctrl.py <host[:port]> bench [count]
+
+import http.client
+import itertools
+import socket
+import struct
+import sys
+import time
+import zlib
+
+DEFAULT_PORT = 3333                   # CONFIG_PLANTDOC_UDP_PORT
+MAGIC = 0xD7
+FRAME = struct.Struct('<BBBBII')      # udp_ctrl_frame_t
+STATUS = ['ok', 'busy', 'bad', 'stale', 'dup']
+TIMEOUT_S = 0.5
+RETRIES = 3
+
+
+def pack(op, arg, duty, seq):
+    head = struct.pack('<BBBBI', MAGIC, ord(op), arg, duty, seq)
+    return head + struct.pack('<I', zlib.crc32(head))
+
+
+def unpack(data):
+    if len(data) != FRAME.size:
+        return None
+    magic, op, status, duty, seq, crc = FRAME.unpack(data)
+    if magic != MAGIC or crc != zlib.crc32(data[:8]):
+        return None
+    return op, status, duty, seq
+
+
+class UdpClient:
+    def __init__(self, host, port):
+        self.addr = (host, port)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(TIMEOUT_S)
+        self.seq = itertools.count(0)       # seq 0 starts a new sequence
+        self.lost = 0
+
+    def command(self, op, arg=0, duty=0):
+        """Send one frame, resending the same seq until acked; returns (status, duty)"""
+        seq = next(self.seq)
+        frame = pack(op, arg, duty, seq)
+        for _ in range(RETRIES):
+            self.sock.sendto(frame, self.addr)
+            try:
+                while True:
+                    ack = unpack(self.sock.recv(64))
+                    if ack and ack[3] == seq:       # Skip late acks of earlier frames
+                        return ack[1], ack[2]
+            except socket.timeout:
+                self.lost += 1
+        raise TimeoutError('no ack for seq %d' % seq)
+
+
+def stats(name, times, total_s):
+    times = sorted(times)
+    pct = lambda p: times[min(len(times) - 1, int(len(times) * p / 100))] * 1e3
+    print('%-22s p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms  %7.0f cmd/s' %
+          (name, pct(50), pct(99), times[-1] * 1e3, len(times) / total_s))
+
+
+def timed(fn, count):
+    times = []
+    start = time.perf_counter()
+    for i in range(count):
+        t = time.perf_counter()
+        fn(i)
+        times.append(time.perf_counter() - t)
+    return times, time.perf_counter() - start
+
+
+def bench(host, port, count):
+    duty = lambda i: 64 + i % 128
+
+    udp = UdpClient(host, port)
+    times, total = timed(lambda i: udp.command('S', 0, duty(i)), count)
+    stats('udp', times, total)
+    if udp.lost:
+        print('%22s %d frames resent' % ('', udp.lost))
+
+    def http_new(i):
+        conn = http.client.HTTPConnection(host, 80, timeout=5)
+        conn.request('GET', '/spray?pwm=%d' % duty(i))
+        conn.getresponse().read()
+        conn.close()
+
+    times, total = timed(http_new, count)
+    stats('http, new connection', times, total)
+
+    conn = http.client.HTTPConnection(host, 80, timeout=5)
+
+    def http_keepalive(i):
+        conn.request('GET', '/spray?pwm=%d' % duty(i))
+        conn.getresponse().read()
+
+    times, total = timed(http_keepalive, count)
+    stats('http, keep-alive', times, total)
+    conn.close()
+
+    udp.command('X')
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit('usage: udp_ctrl.py <host[:port]> set <ch> <duty> | stop | bench [count]')
+
+    host, _, port = sys.argv[1].partition(':')
+    port = int(port) if port else DEFAULT_PORT
+    cmd = sys.argv[2]
+
+    if cmd == 'bench':
+        bench(host, port, int(sys.argv[3]) if len(sys.argv) > 3 else 500)
+        return
+
+    udp = UdpClient(host, port)
+    if cmd == 'set' and len(sys.argv) == 5:
+        status, duty = udp.command('S', int(sys.argv[3]), int(sys.argv[4]))
+    elif cmd == 'stop':
+        status, duty = udp.command('X')
+    else:
+        sys.exit('unknown command: %s' % ' '.join(sys.argv[2:]))
+    print('%s, duty %d' % (STATUS[status] if status < len(STATUS) else status, duty))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+# Load test for the WebSocket control channel (main/ws_control.h) against
+# the HTTP /spray endpoint, on a real device.
+#
+# Sends the same speed changes over one WebSocket and over HTTP (a new
+# connection per command, and one kept-alive connection), waiting for each
+# reply, and reports round trip latency and commands per second. A last
+# run keeps up to <window> WebSocket frames in flight to find the
+# channel's throughput rather than its latency.
+#
+# Usage: ws_load.py <host> [count] [window]
+
+import base64
+import http.client
+import os
+import socket
+import struct
+import sys
+import time
+
+TIMEOUT_S = 5
+OP_SPEED, OP_STOP = ord('S'), ord('X')
+STATUS = ['ok', 'busy', 'bad']
+
+
+class WsClient:
+    def __init__(self, host):
+        self.sock = socket.create_connection((host, 80), timeout=TIMEOUT_S)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall(('GET /ws HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n'
+                           'Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n'
+                           'Sec-WebSocket-Version: 13\r\n\r\n' % (host, key)).encode())
+        head = b''
+        while b'\r\n\r\n' not in head:
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise ConnectionError('closed during handshake')
+            head += chunk
+        if not head.startswith(b'HTTP/1.1 101'):
+            raise ConnectionError(head.split(b'\r\n')[0].decode())
+        self.buf = head.split(b'\r\n\r\n', 1)[1]
+        self.seq = 0
+
+    def send(self, op, value=0):
+        """Send one masked 3-byte frame; returns its seq"""
+        self.seq = (self.seq + 1) & 0xff
+        mask = os.urandom(4)
+        payload = bytes([op, self.seq, value])
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(bytes([0x82, 0x80 | len(payload)]) + mask + masked)
+        return self.seq
+
+    def recv(self):
+        """Next response: (op, seq, status, speed)"""
+        while len(self.buf) < 2 or len(self.buf) < 2 + (self.buf[1] & 0x7f):
+            chunk = self.sock.recv(1024)
+            if not chunk:
+                raise ConnectionError('closed')
+            self.buf += chunk
+        n = self.buf[1] & 0x7f
+        payload, self.buf = self.buf[2:2 + n], self.buf[2 + n:]
+        return struct.unpack('<BBBB', payload)
+
+    def command(self, op, value=0):
+        seq = self.send(op, value)
+        while True:
+            op_ack, seq_ack, status, speed = self.recv()
+            if seq_ack == seq:
+                return status, speed
+
+    def close(self):
+        self.sock.close()
+
+
+def stats(name, times, total_s):
+    times = sorted(times)
+    pct = lambda p: times[min(len(times) - 1, int(len(times) * p / 100))] * 1e3
+    print('%-22s p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms  %7.0f cmd/s' %
+          (name, pct(50), pct(99), times[-1] * 1e3, len(times) / total_s))
+
+
+def timed(fn, count):
+    times = []
+    start = time.perf_counter()
+    for i in range(count):
+        t = time.perf_counter()
+        fn(i)
+        times.append(time.perf_counter() - t)
+    return times, time.perf_counter() - start
+
+
+def pipelined(ws, count, window, speed):
+    """Keep up to window frames unanswered; returns (cmd/s, busy replies)"""
+    start = time.perf_counter()
+    sent = received = busy = 0
+    while received < count:
+        while sent < count and sent - received < window:
+            ws.send(OP_SPEED, speed(sent))
+            sent += 1
+        if ws.recv()[2] == 1:
+            busy += 1
+        received += 1
+    return count / (time.perf_counter() - start), busy
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit('usage: ws_load.py <host> [count] [window]')
+    host = sys.argv[1]
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 500
+    window = int(sys.argv[3]) if len(sys.argv) > 3 else 8
+    speed = lambda i: 64 + i % 128
+
+    ws = WsClient(host)
+    times, total = timed(lambda i: ws.command(OP_SPEED, speed(i)), count)
+    stats('websocket', times, total)
+
+    def http_new(i):
+        conn = http.client.HTTPConnection(host, 80, timeout=TIMEOUT_S)
+        conn.request('GET', '/spray?pwm=%d' % speed(i))
+        conn.getresponse().read()
+        conn.close()
+
+    times, total = timed(http_new, count)
+    stats('http, new connection', times, total)
+
+    conn = http.client.HTTPConnection(host, 80, timeout=TIMEOUT_S)
+
+    def http_keepalive(i):
+        conn.request('GET', '/spray?pwm=%d' % speed(i))
+        conn.getresponse().read()
+
+    times, total = timed(http_keepalive, count)
+    stats('http, keep-alive', times, total)
+    conn.close()
+
+    rate, busy = pipelined(ws, count, window, speed)
+    print('%-22s %7.0f cmd/s, %d busy replies' % ('websocket, %d in flight' % window, rate, busy))
+
+    status, speed_now = ws.command(OP_STOP)
+    print('stop: %s, speed %d' % (STATUS[status] if status < len(STATUS) else status, speed_now))
+    ws.close()
+
+
+if __name__ == '__main__':
+    main()